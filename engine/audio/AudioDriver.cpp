@@ -0,0 +1,53 @@
+#include "AudioDriver.h"
+#include "DeviceAudioDriver.h"
+#include "FileAudioDriver.h"
+#include "NullAudioDriver.h"
+
+namespace audio {
+
+DriverSettings DriverSettings::fromArguments(const juce::ArgumentList& args) {
+    DriverSettings settings;
+
+    if (args.containsOption("--driver")) {
+        settings.type = args.getValueForOption("--driver").toLowerCase().toStdString();
+    }
+    if (args.containsOption("--device")) {
+        settings.deviceName = args.getValueForOption("--device").toStdString();
+    }
+    if (args.containsOption("--rate")) {
+        settings.sampleRate = args.getValueForOption("--rate").getDoubleValue();
+    }
+    if (args.containsOption("--block")) {
+        settings.blockSize = args.getValueForOption("--block").getIntValue();
+    }
+    if (args.containsOption("--inputs")) {
+        settings.numInputChannels = args.getValueForOption("--inputs").getIntValue();
+    }
+    if (args.containsOption("--outputs")) {
+        settings.numOutputChannels = args.getValueForOption("--outputs").getIntValue();
+    }
+    if (args.containsOption("--output")) {
+        settings.outputFile = juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--output"));
+    }
+
+    return settings;
+}
+
+std::unique_ptr<AudioDriver> AudioDriver::create(const DriverSettings& settings) {
+    if (settings.type == "null") {
+        return std::make_unique<NullAudioDriver>(settings);
+    }
+    if (settings.type == "file") {
+        return std::make_unique<FileAudioDriver>(settings);
+    }
+    if (settings.type == "alsa") {
+        return std::make_unique<DeviceAudioDriver>(settings, "ALSA");
+    }
+    if (settings.type == "jack") {
+        return std::make_unique<DeviceAudioDriver>(settings, "JACK");
+    }
+
+    return nullptr;
+}
+
+} // namespace audio
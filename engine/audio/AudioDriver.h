@@ -0,0 +1,65 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <memory>
+#include <string>
+
+namespace audio {
+
+//==============================================================================
+// Driver Settings - which output the headless engine renders to
+//==============================================================================
+struct DriverSettings {
+    std::string type = "null";      // "alsa", "jack", "null" or "file"
+    std::string deviceName;         // alsa/jack: device to open, empty for the default
+    double sampleRate = 48000.0;
+    int blockSize = 256;
+    int numInputChannels = 0;       // alsa/jack only
+    int numOutputChannels = 2;
+    juce::File outputFile;          // file: where the output is recorded
+
+    static DriverSettings fromArguments(const juce::ArgumentList& args);
+};
+
+//==============================================================================
+// Audio Driver - clocks the engine and takes its output
+//
+// Real devices (ALSA, JACK) are clocked by the sound card. The null driver is
+// clocked by a high resolution timer so servers without a sound card still get
+// sample-accurate transport timing; the file driver does the same and records
+// everything it renders.
+//==============================================================================
+class AudioDriver {
+public:
+    class Callback {
+    public:
+        virtual ~Callback() = default;
+
+        // Before the first block and whenever the rate or block size changes
+        virtual void prepare(double sampleRate, int blockSize) = 0;
+
+        // Realtime thread. Inputs may be empty; outputs must be filled completely.
+        virtual void render(const float* const* inputs, int numInputs,
+                            float* const* outputs, int numOutputs, int numSamples) = 0;
+
+        virtual void stopped() {}
+    };
+
+    virtual ~AudioDriver() = default;
+
+    // Starts calling 'callback' until stop(). Returns an error message, or an empty string.
+    virtual std::string start(Callback& callback) = 0;
+    virtual void stop() = 0;
+
+    virtual std::string getDescription() const = 0;
+    virtual double getSampleRate() const = 0;
+    virtual int getBlockSize() const = 0;
+
+    // Blocks the driver had to skip or couldn't deliver in time
+    virtual int getNumXruns() const { return 0; }
+
+    // Returns nullptr for unknown driver types
+    static std::unique_ptr<AudioDriver> create(const DriverSettings& settings);
+};
+
+} // namespace audio
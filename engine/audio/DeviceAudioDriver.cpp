@@ -0,0 +1,109 @@
+#include "DeviceAudioDriver.h"
+
+namespace audio {
+
+DeviceAudioDriver::DeviceAudioDriver(const DriverSettings& settings, const juce::String& typeName)
+    : settings_(settings),
+      typeName_(typeName)
+{
+}
+
+DeviceAudioDriver::~DeviceAudioDriver() {
+    stop();
+}
+
+std::string DeviceAudioDriver::start(Callback& callback) {
+    stop();
+
+    // Creates the device types available on this platform (without opening anything yet)
+    auto error = deviceManager_.initialise(0, 0, nullptr, false);
+    if (error.isNotEmpty()) {
+        return error.toStdString();
+    }
+
+    deviceManager_.setCurrentAudioDeviceType(typeName_, true);
+    auto* type = deviceManager_.getCurrentDeviceTypeObject();
+    if (type == nullptr || type->getTypeName() != typeName_) {
+        return typeName_.toStdString() + " is not available in this build or on this system";
+    }
+
+    type->scanForDevices();
+
+    auto setup = deviceManager_.getAudioDeviceSetup();
+    setup.outputDeviceName = settings_.deviceName.empty()
+        ? type->getDeviceNames(false)[type->getDefaultDeviceIndex(false)]
+        : juce::String(settings_.deviceName);
+    setup.inputDeviceName = settings_.numInputChannels > 0 ? setup.outputDeviceName : juce::String();
+    setup.sampleRate = settings_.sampleRate;
+    setup.bufferSize = settings_.blockSize;
+    setup.useDefaultInputChannels = false;
+    setup.useDefaultOutputChannels = false;
+    setup.inputChannels.clear();
+    setup.inputChannels.setRange(0, settings_.numInputChannels, true);
+    setup.outputChannels.clear();
+    setup.outputChannels.setRange(0, settings_.numOutputChannels, true);
+
+    error = deviceManager_.setAudioDeviceSetup(setup, true);
+    if (error.isNotEmpty()) {
+        return error.toStdString();
+    }
+
+    if (deviceManager_.getCurrentAudioDevice() == nullptr) {
+        return "Can't open " + typeName_.toStdString() + " device '" + setup.outputDeviceName.toStdString() + "'";
+    }
+
+    callback_ = &callback;
+    deviceManager_.addAudioCallback(this); // Calls audioDeviceAboutToStart
+    return {};
+}
+
+void DeviceAudioDriver::stop() {
+    if (callback_ != nullptr) {
+        deviceManager_.removeAudioCallback(this); // Calls audioDeviceStopped
+        callback_ = nullptr;
+    }
+
+    deviceManager_.closeAudioDevice();
+}
+
+std::string DeviceAudioDriver::getDescription() const {
+    if (auto* device = deviceManager_.getCurrentAudioDevice()) {
+        return typeName_.toStdString() + " '" + device->getName().toStdString() + "' ("
+             + std::to_string((int)device->getCurrentSampleRate()) + " Hz, "
+             + std::to_string(device->getCurrentBufferSizeSamples()) + " samples)";
+    }
+    return typeName_.toStdString() + " (closed)";
+}
+
+double DeviceAudioDriver::getSampleRate() const {
+    auto* device = deviceManager_.getCurrentAudioDevice();
+    return device != nullptr ? device->getCurrentSampleRate() : 0.0;
+}
+
+int DeviceAudioDriver::getBlockSize() const {
+    auto* device = deviceManager_.getCurrentAudioDevice();
+    return device != nullptr ? device->getCurrentBufferSizeSamples() : 0;
+}
+
+int DeviceAudioDriver::getNumXruns() const {
+    auto* device = deviceManager_.getCurrentAudioDevice();
+    return device != nullptr ? juce::jmax(0, device->getXRunCount()) : 0;
+}
+
+void DeviceAudioDriver::audioDeviceIOCallbackWithContext(const float* const* inputChannelData, int numInputChannels,
+                                                         float* const* outputChannelData, int numOutputChannels,
+                                                         int numSamples, const juce::AudioIODeviceCallbackContext&) {
+    callback_->render(inputChannelData, numInputChannels, outputChannelData, numOutputChannels, numSamples);
+}
+
+void DeviceAudioDriver::audioDeviceAboutToStart(juce::AudioIODevice* device) {
+    callback_->prepare(device->getCurrentSampleRate(), device->getCurrentBufferSizeSamples());
+}
+
+void DeviceAudioDriver::audioDeviceStopped() {
+    if (callback_ != nullptr) {
+        callback_->stopped();
+    }
+}
+
+} // namespace audio
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "AudioDriver.h"
+#include <juce_audio_devices/juce_audio_devices.h>
+#include <atomic>
+
+namespace audio {
+
+//==============================================================================
+// Device Driver - a sound card through one of JUCE's device types
+// (ALSA or JACK on Linux), clocked by the hardware
+//==============================================================================
+class DeviceAudioDriver : public AudioDriver, private juce::AudioIODeviceCallback {
+public:
+    // typeName is a JUCE device type name, e.g. "ALSA" or "JACK"
+    DeviceAudioDriver(const DriverSettings& settings, const juce::String& typeName);
+    ~DeviceAudioDriver() override;
+
+    std::string start(Callback& callback) override;
+    void stop() override;
+
+    std::string getDescription() const override;
+    double getSampleRate() const override;
+    int getBlockSize() const override;
+    int getNumXruns() const override;
+
+private:
+    void audioDeviceIOCallbackWithContext(const float* const* inputChannelData, int numInputChannels,
+                                          float* const* outputChannelData, int numOutputChannels,
+                                          int numSamples, const juce::AudioIODeviceCallbackContext& context) override;
+    void audioDeviceAboutToStart(juce::AudioIODevice* device) override;
+    void audioDeviceStopped() override;
+
+    const DriverSettings settings_;
+    const juce::String typeName_;
+    juce::AudioDeviceManager deviceManager_;
+    Callback* callback_ = nullptr;
+};
+
+} // namespace audio
@@ -0,0 +1,64 @@
+#include "FileAudioDriver.h"
+
+namespace audio {
+
+FileAudioDriver::FileAudioDriver(const DriverSettings& settings)
+    : NullAudioDriver(settings)
+{
+}
+
+FileAudioDriver::~FileAudioDriver() {
+    // The render thread calls back into us, stop it while we still exist
+    stop();
+}
+
+std::string FileAudioDriver::start(Callback& callback) {
+    stop();
+
+    const auto& file = settings_.outputFile;
+    if (file == juce::File()) {
+        return "No output file (use --output)";
+    }
+
+    file.getParentDirectory().createDirectory();
+    file.deleteFile();
+
+    std::unique_ptr<juce::FileOutputStream> stream(file.createOutputStream());
+    if (stream == nullptr) {
+        return "Can't write to " + file.getFullPathName().toStdString();
+    }
+
+    juce::WavAudioFormat wav;
+    auto* writer = wav.createWriterFor(stream.get(), settings_.sampleRate,
+                                       (unsigned int)settings_.numOutputChannels, 32, {}, 0);
+    if (writer == nullptr) {
+        return "Can't create a WAV writer";
+    }
+    stream.release(); // Writer owns it now
+
+    // A few seconds of slack between the render thread and the disk
+    writerThread_.startThread();
+    writer_ = std::make_unique<juce::AudioFormatWriter::ThreadedWriter>(writer, writerThread_, (int)settings_.sampleRate * 4);
+
+    return NullAudioDriver::start(callback);
+}
+
+void FileAudioDriver::stop() {
+    NullAudioDriver::stop();
+
+    writer_.reset(); // Flushes what's left
+    writerThread_.stopThread(2000);
+}
+
+std::string FileAudioDriver::getDescription() const {
+    return "file " + settings_.outputFile.getFullPathName().toStdString() + " (" + std::to_string((int)settings_.sampleRate)
+         + " Hz, " + std::to_string(settings_.blockSize) + " samples)";
+}
+
+void FileAudioDriver::blockRendered(const float* const* outputs, int numOutputs, int numSamples) {
+    if (writer_ != nullptr && !writer_->write(outputs, numSamples)) {
+        droppedBlocks_++;
+    }
+}
+
+} // namespace audio
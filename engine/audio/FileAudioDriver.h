@@ -0,0 +1,31 @@
+#pragma once
+
+#include "NullAudioDriver.h"
+#include <juce_audio_formats/juce_audio_formats.h>
+
+namespace audio {
+
+//==============================================================================
+// File Driver - clocked like the null driver, and records everything the
+// engine outputs to a WAV file (written on a background thread)
+//==============================================================================
+class FileAudioDriver : public NullAudioDriver {
+public:
+    explicit FileAudioDriver(const DriverSettings& settings);
+    ~FileAudioDriver() override;
+
+    std::string start(Callback& callback) override;
+    void stop() override;
+
+    std::string getDescription() const override;
+    int getNumXruns() const override { return NullAudioDriver::getNumXruns() + droppedBlocks_.load(); }
+
+private:
+    void blockRendered(const float* const* outputs, int numOutputs, int numSamples) override;
+
+    juce::TimeSliceThread writerThread_{"File Audio Driver Writer"};
+    std::unique_ptr<juce::AudioFormatWriter::ThreadedWriter> writer_;
+    std::atomic<int> droppedBlocks_{0};
+};
+
+} // namespace audio
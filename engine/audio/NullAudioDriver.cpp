@@ -0,0 +1,95 @@
+#include "NullAudioDriver.h"
+#include <iostream>
+
+namespace audio {
+
+NullAudioDriver::NullAudioDriver(const DriverSettings& settings)
+    : juce::Thread("Null Audio Driver"),
+      settings_(settings)
+{
+}
+
+NullAudioDriver::~NullAudioDriver() {
+    stop();
+}
+
+std::string NullAudioDriver::start(Callback& callback) {
+    if (settings_.sampleRate <= 0.0 || settings_.blockSize <= 0) {
+        return "Invalid sample rate or block size";
+    }
+
+    NullAudioDriver::stop(); // Not a subclass's stop(): it may have just set itself up
+
+    callback_ = &callback;
+    outputs_.setSize(settings_.numOutputChannels, settings_.blockSize);
+    callback_->prepare(settings_.sampleRate, settings_.blockSize);
+
+    if (!startRealtimeThread(juce::Thread::RealtimeOptions{}.withPriority(10))) {
+        startThread(juce::Thread::Priority::highest);
+    }
+
+    return {};
+}
+
+void NullAudioDriver::stop() {
+    if (isThreadRunning()) {
+        stopThread(2000);
+        callback_->stopped();
+    }
+}
+
+std::string NullAudioDriver::getDescription() const {
+    return "null (" + std::to_string((int)settings_.sampleRate) + " Hz, "
+         + std::to_string(settings_.blockSize) + " samples)";
+}
+
+void NullAudioDriver::run() {
+    const double ticksPerSecond = (double)juce::Time::getHighResolutionTicksPerSecond();
+    const double ticksPerBlock = ticksPerSecond * settings_.blockSize / settings_.sampleRate;
+
+    // Deadlines are counted from the start, so rounding never accumulates
+    const juce::int64 startTicks = juce::Time::getHighResolutionTicks();
+    juce::int64 blockIndex = 0;
+
+    while (!threadShouldExit()) {
+        outputs_.clear();
+        callback_->render(nullptr, 0, outputs_.getArrayOfWritePointers(), outputs_.getNumChannels(), settings_.blockSize);
+        blockRendered(outputs_.getArrayOfReadPointers(), outputs_.getNumChannels(), settings_.blockSize);
+
+        ++blockIndex;
+        auto deadline = startTicks + (juce::int64)(blockIndex * ticksPerBlock);
+        auto now = juce::Time::getHighResolutionTicks();
+
+        // More than a few blocks late (debugger, suspended VM): skip ahead rather than
+        // rendering a burst to catch up, like a sound card would
+        if (now - deadline > (juce::int64)(4 * ticksPerBlock)) {
+            auto missed = (juce::int64)((now - deadline) / ticksPerBlock);
+            blockIndex += missed;
+            xruns_ += (int)missed;
+            continue;
+        }
+
+        waitUntil(deadline);
+    }
+}
+
+void NullAudioDriver::waitUntil(juce::int64 deadlineTicks) {
+    const auto ticksPerMs = juce::Time::getHighResolutionTicksPerSecond() / 1000;
+
+    // Sleep while the deadline is comfortably far away, then spin the last stretch:
+    // sleep() alone may overshoot by a millisecond or more
+    for (;;) {
+        auto remaining = deadlineTicks - juce::Time::getHighResolutionTicks();
+        if (remaining <= 0 || threadShouldExit()) {
+            return;
+        }
+
+        if (remaining > 2 * ticksPerMs) {
+            juce::Thread::sleep((int)(remaining / ticksPerMs) - 1);
+        } else {
+            juce::Thread::yield();
+        }
+    }
+}
+
+} // namespace audio
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "AudioDriver.h"
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <atomic>
+#include <vector>
+
+namespace audio {
+
+//==============================================================================
+// Null Driver - renders blocks on a realtime thread at the pace a sound card
+// would, against absolute deadlines from the high resolution clock (so timing
+// doesn't drift with block sizes that aren't a whole number of milliseconds)
+//==============================================================================
+class NullAudioDriver : public AudioDriver, private juce::Thread {
+public:
+    explicit NullAudioDriver(const DriverSettings& settings);
+    ~NullAudioDriver() override;
+
+    std::string start(Callback& callback) override;
+    void stop() override;
+
+    std::string getDescription() const override;
+    double getSampleRate() const override { return settings_.sampleRate; }
+    int getBlockSize() const override { return settings_.blockSize; }
+    int getNumXruns() const override { return xruns_.load(); }
+
+protected:
+    // Render thread, after every block. The file driver records it here.
+    virtual void blockRendered(const float* const* outputs, int numOutputs, int numSamples) {}
+
+    const DriverSettings settings_;
+
+private:
+    void run() override;
+    void waitUntil(juce::int64 deadlineTicks);
+
+    Callback* callback_ = nullptr;
+    juce::AudioBuffer<float> outputs_;
+    std::atomic<int> xruns_{0};
+};
+
+} // namespace audio
@@ -16,6 +16,7 @@ namespace CommandType {
     constexpr const char* TRANSPORT_PLAY = "transport.play";
     constexpr const char* TRANSPORT_STOP = "transport.stop";
     constexpr const char* TRANSPORT_SET_TEMPO = "transport.setTempo";
+    constexpr const char* TRANSPORT_SET_TEMPO_MAP = "transport.setTempoMap";
     constexpr const char* TRANSPORT_SET_LOOP = "transport.setLoop";
     constexpr const char* TRANSPORT_SET_PLAYHEAD = "transport.setPlayhead";
     constexpr const char* TRANSPORT_TOGGLE_METRONOME = "transport.toggleMetronome";
@@ -24,6 +25,8 @@ namespace CommandType {
     constexpr const char* PROJECT_NEW = "project.new";
     constexpr const char* PROJECT_SAVE = "project.save";
     constexpr const char* PROJECT_OPEN = "project.open";
+    constexpr const char* PROJECT_RENDER = "project.render";
+    constexpr const char* PROJECT_CANCEL_RENDER = "project.cancelRender";
     
     // Track
     constexpr const char* TRACK_CREATE = "track.create";
@@ -35,14 +38,22 @@ namespace CommandType {
     constexpr const char* CLIP_CREATE_MIDI = "clip.createMidi";
     constexpr const char* CLIP_MOVE = "clip.move";
     constexpr const char* CLIP_RESIZE = "clip.resize";
+    constexpr const char* CLIP_TRIM_START = "clip.trimStart";
     constexpr const char* CLIP_DUPLICATE = "clip.duplicate";
     constexpr const char* CLIP_DELETE = "clip.delete";
+    constexpr const char* CLIP_GET_PEAKS = "clip.getPeaks";
     
     // Mixer
     constexpr const char* MIXER_SET_VOLUME = "mixer.setVolume";
     constexpr const char* MIXER_SET_PAN = "mixer.setPan";
     constexpr const char* MIXER_TOGGLE_MUTE = "mixer.toggleMute";
     constexpr const char* MIXER_TOGGLE_SOLO = "mixer.toggleSolo";
+    
+    // Recording
+    constexpr const char* RECORDING_SET_PRE_ROLL = "recording.setPreRoll";
+    
+    // Playback
+    constexpr const char* AUDIO_CACHE_SET_BUDGET = "audioCache.setBudget";
 }
 
 //==============================================================================
@@ -63,6 +74,8 @@ namespace EventType {
     constexpr const char* FILE_IMPORTED = "fileImported";
     constexpr const char* RENDER_PROGRESS = "renderProgress";
     constexpr const char* PLUGIN_SCAN_PROGRESS = "pluginScanProgress";
+    constexpr const char* PLUGIN_RESTORE_PROGRESS = "pluginRestoreProgress";
+    constexpr const char* PEAKS_UPDATED = "peaksUpdated";
 }
 
 //==============================================================================
@@ -120,7 +133,9 @@ struct Event {
 struct TransportState {
     bool isPlaying = false;
     double playheadBeat = 0.0;
-    double tempo = 120.0;
+    double playheadSeconds = 0.0;   // Through the tempo map
+    double playheadBar = 0.0;       // Fractional, counted from 0
+    double tempo = 120.0;           // Tempo and meter at the playhead
     bool isLooping = false;
     double loopStart = 0.0;
     double loopEnd = 16.0;
@@ -132,6 +147,8 @@ struct TransportState {
         return {
             {"isPlaying", isPlaying},
             {"playheadBeat", playheadBeat},
+            {"playheadSeconds", playheadSeconds},
+            {"playheadBar", playheadBar},
             {"tempo", tempo},
             {"isLooping", isLooping},
             {"loopStart", loopStart},
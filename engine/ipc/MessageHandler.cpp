@@ -15,6 +15,7 @@ void MessageHandler::registerBuiltinHandlers() {
     handlers_[CommandType::TRANSPORT_PLAY] = [this](const Command& cmd) { return handleTransportPlay(cmd); };
     handlers_[CommandType::TRANSPORT_STOP] = [this](const Command& cmd) { return handleTransportStop(cmd); };
     handlers_[CommandType::TRANSPORT_SET_TEMPO] = [this](const Command& cmd) { return handleTransportSetTempo(cmd); };
+    handlers_[CommandType::TRANSPORT_SET_TEMPO_MAP] = [this](const Command& cmd) { return handleTransportSetTempoMap(cmd); };
     handlers_[CommandType::TRANSPORT_SET_LOOP] = [this](const Command& cmd) { return handleTransportSetLoop(cmd); };
     handlers_[CommandType::TRANSPORT_SET_PLAYHEAD] = [this](const Command& cmd) { return handleTransportSetPlayhead(cmd); };
     handlers_[CommandType::TRANSPORT_TOGGLE_METRONOME] = [this](const Command& cmd) { return handleTransportToggleMetronome(cmd); };
@@ -29,6 +30,9 @@ void MessageHandler::registerBuiltinHandlers() {
     handlers_[CommandType::TRACK_DELETE] = [this](const Command& cmd) { return handleTrackDelete(cmd); };
     handlers_[CommandType::TRACK_RENAME] = [this](const Command& cmd) { return handleTrackRename(cmd); };
     
+    // Clip handlers
+    handlers_[CommandType::CLIP_TRIM_START] = [this](const Command& cmd) { return handleClipTrimStart(cmd); };
+    
     // Mixer handlers
     handlers_[CommandType::MIXER_SET_VOLUME] = [this](const Command& cmd) { return handleMixerSetVolume(cmd); };
     handlers_[CommandType::MIXER_SET_PAN] = [this](const Command& cmd) { return handleMixerSetPan(cmd); };
@@ -86,16 +90,21 @@ std::string MessageHandler::processMessage(const std::string& jsonMessage) {
 }
 
 TransportState MessageHandler::getTransportState() const {
+    const auto tempoMap = projectState_.createTempoMap();
+    const auto& meter = tempoMap.getMeterAt(projectState_.playheadBeat);
+    
     TransportState state;
     state.isPlaying = projectState_.isPlaying;
     state.playheadBeat = projectState_.playheadBeat;
-    state.tempo = projectState_.tempo;
+    state.playheadSeconds = tempoMap.beatToSeconds(state.playheadBeat);
+    state.playheadBar = tempoMap.beatToBar(state.playheadBeat);
+    state.tempo = tempoMap.getTempoAt(state.playheadBeat);
     state.isLooping = projectState_.isLooping;
     state.loopStart = projectState_.loopStart;
     state.loopEnd = projectState_.loopEnd;
     state.metronomeEnabled = projectState_.metronomeEnabled;
-    state.timeSignatureNumerator = projectState_.timeSignatureNumerator;
-    state.timeSignatureDenominator = projectState_.timeSignatureDenominator;
+    state.timeSignatureNumerator = meter.numerator;
+    state.timeSignatureDenominator = meter.denominator;
     return state;
 }
 
@@ -104,23 +113,28 @@ json MessageHandler::getProjectState() const {
     for (const auto& track : projectState_.tracks) {
         json clips = json::array();
         for (const auto& clip : track->clips) {
-            clips.push_back({
+            json clipJson = {
                 {"startBeat", clip.startBeat},
                 {"lengthBeats", clip.lengthBeats},
                 {"name", clip.name.toStdString()},
                 {"isMidi", clip.isMidi},
                 {"color", clip.clipColor.toString().toStdString()}
-            });
+            };
+            if (!clip.isMidi) {
+                clipJson["audioFile"] = clip.audioFile.getFullPathName().toStdString();
+            }
+            clips.push_back(clipJson);
         }
         
         tracks.push_back({
             {"id", track->id.toString().toStdString()},
             {"type", static_cast<int>(track->type)},
             {"name", track->name.toStdString()},
-            {"volume", track->volume},
-            {"pan", track->pan},
-            {"mute", track->mute},
-            {"solo", track->solo},
+            {"volume", track->mixer->volume.load()},
+            {"pan", track->mixer->pan.load()},
+            {"mute", track->mixer->mute.load()},
+            {"solo", track->mixer->solo.load()},
+            {"soloSafe", track->mixer->soloSafe.load()},
             {"arm", track->arm},
             {"color", track->trackColor.toString().toStdString()},
             {"clips", clips}
@@ -152,14 +166,38 @@ json MessageHandler::handleTransportStop(const Command& cmd) {
 json MessageHandler::handleTransportSetTempo(const Command& cmd) {
     double tempo = cmd.payload.value("tempo", 120.0);
     projectState_.tempo = std::clamp(tempo, 20.0, 999.0);
+    projectState_.markDirty();
     std::cout << "[Transport] Set tempo: " << projectState_.tempo << std::endl;
     return getTransportState().toJson();
 }
 
+// Changes after beat 0 ('tempo' and the time signature stay the start of the map)
+json MessageHandler::handleTransportSetTempoMap(const Command& cmd) {
+    projectState_.tempoChanges.clear();
+    for (const auto& change : cmd.payload.value("tempoChanges", json::array())) {
+        projectState_.tempoChanges.push_back({ change.value("beat", 0.0),
+                                               std::clamp(change.value("bpm", 120.0), 20.0, 999.0),
+                                               change.value("ramp", false) });
+    }
+    
+    projectState_.meterChanges.clear();
+    for (const auto& change : cmd.payload.value("meterChanges", json::array())) {
+        projectState_.meterChanges.push_back({ change.value("beat", 0.0),
+                                               change.value("numerator", 4),
+                                               change.value("denominator", 4) });
+    }
+    
+    projectState_.markDirty();
+    std::cout << "[Transport] Set tempo map: " << projectState_.tempoChanges.size() << " tempo, "
+              << projectState_.meterChanges.size() << " meter changes" << std::endl;
+    return getTransportState().toJson();
+}
+
 json MessageHandler::handleTransportSetLoop(const Command& cmd) {
     projectState_.isLooping = cmd.payload.value("enabled", false);
     projectState_.loopStart = cmd.payload.value("start", 0.0);
     projectState_.loopEnd = cmd.payload.value("end", 16.0);
+    projectState_.markDirty();
     std::cout << "[Transport] Set loop: " << projectState_.isLooping 
               << " [" << projectState_.loopStart << " - " << projectState_.loopEnd << "]" << std::endl;
     return getTransportState().toJson();
@@ -167,12 +205,13 @@ json MessageHandler::handleTransportSetLoop(const Command& cmd) {
 
 json MessageHandler::handleTransportSetPlayhead(const Command& cmd) {
     projectState_.playheadBeat = cmd.payload.value("beat", 0.0);
-    std::cout << "[Transport] Set playhead: " << projectState_.playheadBeat << std::endl;
+    std::cout << "[Transport] Set playhead: " << projectState_.playheadBeat.load() << std::endl;
     return getTransportState().toJson();
 }
 
 json MessageHandler::handleTransportToggleMetronome(const Command& cmd) {
     projectState_.metronomeEnabled = !projectState_.metronomeEnabled;
+    projectState_.markDirty();
     std::cout << "[Transport] Metronome: " << (projectState_.metronomeEnabled ? "ON" : "OFF") << std::endl;
     return getTransportState().toJson();
 }
@@ -187,6 +226,7 @@ json MessageHandler::handleProjectNew(const Command& cmd) {
     projectState_.selectedTrackIndex = -1;
     projectState_.playheadBeat = 0.0;
     projectState_.isPlaying = false;
+    projectState_.markDirty();
     
     std::cout << "[Project] New project created" << std::endl;
     return getProjectState();
@@ -240,6 +280,7 @@ json MessageHandler::handleTrackRename(const Command& cmd) {
     
     if (auto* track = projectState_.getTrack(index)) {
         track->name = juce::String(name);
+        projectState_.markDirty();
         std::cout << "[Track] Renamed to: " << name << std::endl;
     }
     return getProjectState();
@@ -249,13 +290,33 @@ json MessageHandler::handleTrackRename(const Command& cmd) {
 // Mixer Handlers
 //==============================================================================
 
+// Payload: trackIndex, clipIndex, startBeat. Moves an audio clip's start and keeps its end;
+// an earlier start reaches back into the file (e.g. a take's pre-roll).
+json MessageHandler::handleClipTrimStart(const Command& cmd) {
+    int index = cmd.payload.value("trackIndex", -1);
+    int clipIndex = cmd.payload.value("clipIndex", -1);
+    
+    auto* track = projectState_.getTrack(index);
+    if (track == nullptr || clipIndex < 0 || clipIndex >= (int)track->clips.size()) {
+        return {{"error", "No such clip"}};
+    }
+    
+    auto& clip = track->clips[(size_t)clipIndex];
+    ProjectState::trimClipStart(clip, cmd.payload.value("startBeat", clip.startBeat), projectState_.createTempoMap());
+    projectState_.markDirty();
+    std::cout << "[Clip] Track " << index << " clip " << clipIndex << " starts at beat " << clip.startBeat
+              << " (" << clip.sourceOffset << "s into the file)" << std::endl;
+    return {{"startBeat", clip.startBeat}, {"lengthBeats", clip.lengthBeats}, {"sourceOffset", clip.sourceOffset}};
+}
+
 json MessageHandler::handleMixerSetVolume(const Command& cmd) {
     int index = cmd.payload.value("trackIndex", -1);
     float volume = cmd.payload.value("volume", 1.0f);
     
     if (auto* track = projectState_.getTrack(index)) {
-        track->volume = std::clamp(volume, 0.0f, 2.0f);
-        std::cout << "[Mixer] Track " << index << " volume: " << track->volume << std::endl;
+        // Read by the audio thread directly, no snapshot rebuild
+        track->mixer->volume = std::clamp(volume, 0.0f, 2.0f);
+        std::cout << "[Mixer] Track " << index << " volume: " << track->mixer->volume << std::endl;
     }
     return json::object();
 }
@@ -265,8 +326,8 @@ json MessageHandler::handleMixerSetPan(const Command& cmd) {
     float pan = cmd.payload.value("pan", 0.0f);
     
     if (auto* track = projectState_.getTrack(index)) {
-        track->pan = std::clamp(pan, -1.0f, 1.0f);
-        std::cout << "[Mixer] Track " << index << " pan: " << track->pan << std::endl;
+        track->mixer->pan = std::clamp(pan, -1.0f, 1.0f);
+        std::cout << "[Mixer] Track " << index << " pan: " << track->mixer->pan << std::endl;
     }
     return json::object();
 }
@@ -275,8 +336,8 @@ json MessageHandler::handleMixerToggleMute(const Command& cmd) {
     int index = cmd.payload.value("trackIndex", -1);
     
     if (auto* track = projectState_.getTrack(index)) {
-        track->mute = !track->mute;
-        std::cout << "[Mixer] Track " << index << " mute: " << track->mute << std::endl;
+        track->mixer->mute = !track->mixer->mute;
+        std::cout << "[Mixer] Track " << index << " mute: " << track->mixer->mute << std::endl;
     }
     return json::object();
 }
@@ -285,8 +346,9 @@ json MessageHandler::handleMixerToggleSolo(const Command& cmd) {
     int index = cmd.payload.value("trackIndex", -1);
     
     if (auto* track = projectState_.getTrack(index)) {
-        track->solo = !track->solo;
-        std::cout << "[Mixer] Track " << index << " solo: " << track->solo << std::endl;
+        track->mixer->solo = !track->mixer->solo;
+        projectState_.markDirty(); // Solo changes which tracks are audible, worked out per snapshot
+        std::cout << "[Mixer] Track " << index << " solo: " << track->mixer->solo << std::endl;
     }
     return json::object();
 }
@@ -39,6 +39,7 @@ private:
     json handleTransportPlay(const Command& cmd);
     json handleTransportStop(const Command& cmd);
     json handleTransportSetTempo(const Command& cmd);
+    json handleTransportSetTempoMap(const Command& cmd);
     json handleTransportSetLoop(const Command& cmd);
     json handleTransportSetPlayhead(const Command& cmd);
     json handleTransportToggleMetronome(const Command& cmd);
@@ -51,6 +52,8 @@ private:
     json handleTrackDelete(const Command& cmd);
     json handleTrackRename(const Command& cmd);
     
+    json handleClipTrimStart(const Command& cmd);
+    
     json handleMixerSetVolume(const Command& cmd);
     json handleMixerSetPan(const Command& cmd);
     json handleMixerToggleMute(const Command& cmd);
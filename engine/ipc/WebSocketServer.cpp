@@ -90,10 +90,9 @@ void WebSocketServer::stop() {
 
 void WebSocketServer::broadcast(const std::string& message) {
     if (server_) {
-        // ix::WebSocketServer doesn't have direct broadcast, 
-        // but we can iterate through connections
-        // For now, this is handled via the server's internal mechanism
-        // Each client connection can be accessed through setOnClientMessageCallback
+        for (const auto& client : server_->getClients()) {
+            client->send(message);
+        }
     }
 }
 
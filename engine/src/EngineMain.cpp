@@ -3,6 +3,12 @@
  * 
  * This is the main entry point for the standalone engine process.
  * It initializes the audio system and WebSocket server for UI communication.
+ * 
+ * Usage: AiceCube_Engine [--driver null|file|alsa|jack] [--device <name>]
+ *                        [--rate <Hz>] [--block <samples>] [--inputs <n>] [--outputs <n>]
+ *                        [--output <file.wav>] [--port <port>]
+ *        AiceCube_Engine --scan-plugins=<job file>   (plugin scan worker, started by the engine itself)
+ *        AiceCube_Engine --aicecube-plugin-host:<pipe> (sandboxed plugin host, likewise)
  */
 
 #include <iostream>
@@ -12,11 +18,17 @@
 #include <csignal>
 
 #include <juce_core/juce_core.h>
+#include <juce_events/juce_events.h>
 
+#include "audio/AudioDriver.h"
 #include "ipc/WebSocketServer.h"
 #include "ipc/MessageHandler.h"
 #include "ipc/IpcMessages.h"
 #include "model/ProjectState.h"
+#include "model/ProjectSerializer.h"
+#include "engine/AudioEngine.h"
+#include "engine/PluginSandbox.h"
+#include "engine/PluginScanner.h"
 
 // Global flag for graceful shutdown
 std::atomic<bool> g_running{true};
@@ -29,11 +41,14 @@ void signalHandler(int signal) {
 //==============================================================================
 // Engine Application
 //==============================================================================
-class EngineApplication {
+class EngineApplication : private audio::AudioDriver::Callback,
+                          private juce::ChangeListener {
 public:
-    EngineApplication() 
+    EngineApplication(const audio::DriverSettings& driverSettings, int port)
         : messageHandler_(projectState_),
-          wsServer_(9001)  // Default WebSocket port
+          wsServer_(port),
+          driverSettings_(driverSettings),
+          port_(port)
     {
     }
     
@@ -45,18 +60,57 @@ public:
         // Initialize JUCE
         juce::initialiseJuce_GUI();
         
+        audioEngine_ = std::make_unique<AudioEngine>(projectState_);
+        audioEngine_->onError = [this](const juce::String& message) {
+            std::cerr << "[Engine] " << message << std::endl;
+            wsServer_.broadcast(ipc::Event{ipc::EventType::ERROR, message.toStdString(), ipc::json::object()}.toJson().dump());
+        };
+        registerProjectHandlers();
+        registerRenderHandlers();
+        registerPeakHandlers();
+        registerRecordingHandlers();
+        registerPlaybackHandlers();
+        
+        // Start audio
+        driver_ = audio::AudioDriver::create(driverSettings_);
+        if (!driver_) {
+            std::cerr << "[Engine] Unknown audio driver: " << driverSettings_.type << std::endl;
+            return false;
+        }
+        
+        auto driverError = driver_->start(*this);
+        if (!driverError.empty()) {
+            std::cerr << "[Engine] Failed to start audio driver: " << driverError << std::endl;
+            return false;
+        }
+        std::cout << "[Engine] Audio: " << driver_->getDescription() << std::endl;
+        
         // Setup WebSocket message handling
         wsServer_.setMessageCallback(
             [this](const std::string& message, std::function<void(const std::string&)> sendResponse) {
-                std::string response = messageHandler_.processMessage(message);
-                sendResponse(response);
+                // Commands edit ProjectState, which belongs to the message thread (as in the app):
+                // run them there and wait for the result on this connection's thread
+                auto responses = std::make_shared<std::vector<std::string>>();
+                auto done = std::make_shared<juce::WaitableEvent>();
+                
+                juce::MessageManager::callAsync([this, message, responses, done] {
+                    responses->push_back(messageHandler_.processMessage(message));
+                    
+                    // After processing command, also send updated transport state
+                    ipc::StateUpdate stateUpdate;
+                    stateUpdate.scope = ipc::StateType::TRANSPORT;
+                    stateUpdate.data = messageHandler_.getTransportState().toJson();
+                    responses->push_back(stateUpdate.toJson().dump());
+                    done->signal();
+                });
                 
-                // After processing command, also send updated transport state
-                auto transportState = messageHandler_.getTransportState();
-                ipc::StateUpdate stateUpdate;
-                stateUpdate.scope = ipc::StateType::TRANSPORT;
-                stateUpdate.data = transportState.toJson();
-                sendResponse(stateUpdate.toJson().dump());
+                while (!done->wait(100)) {
+                    if (!g_running) return;
+                }
+                
+                for (const auto& response : *responses) {
+                    sendResponse(response);
+                }
             }
         );
         
@@ -74,7 +128,7 @@ public:
             return false;
         }
         
-        std::cout << "[Engine] Ready. Waiting for UI connection on ws://localhost:9001" << std::endl;
+        std::cout << "[Engine] Ready. Waiting for UI connection on ws://localhost:" << port_ << std::endl;
         std::cout << "[Engine] Press Ctrl+C to stop." << std::endl;
         std::cout << std::endl;
         
@@ -82,29 +136,15 @@ public:
     }
     
     void run() {
-        // Main loop - process transport and broadcast state
+        // Main loop - this is the message thread: it runs IPC commands and the engine's
+        // snapshot timer, and broadcasts the transport. The audio driver advances the playhead.
         const auto transportBroadcastInterval = std::chrono::milliseconds(50);  // 20 fps
         auto lastBroadcast = std::chrono::steady_clock::now();
         
         while (g_running) {
-            auto now = std::chrono::steady_clock::now();
+            juce::MessageManager::getInstance()->runDispatchLoopUntil(10);
             
-            // Update playhead if playing
-            if (projectState_.isPlaying) {
-                // Calculate elapsed time and advance playhead
-                auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
-                    now - lastBroadcast
-                ).count();
-                
-                double beatsPerSecond = projectState_.tempo / 60.0;
-                double beatsElapsed = (elapsed / 1000000.0) * beatsPerSecond;
-                projectState_.playheadBeat += beatsElapsed;
-                
-                // Handle looping
-                if (projectState_.isLooping && projectState_.playheadBeat >= projectState_.loopEnd) {
-                    projectState_.playheadBeat = projectState_.loopStart;
-                }
-            }
+            auto now = std::chrono::steady_clock::now();
             
             // Broadcast transport state periodically
             if (now - lastBroadcast >= transportBroadcastInterval) {
@@ -113,21 +153,24 @@ public:
                     ipc::StateUpdate stateUpdate;
                     stateUpdate.scope = ipc::StateType::TRANSPORT;
                     stateUpdate.data = transportState.toJson();
-                    
-                    // Note: broadcast needs to be implemented properly
-                    // For now, state is sent as response to commands
+                    wsServer_.broadcast(stateUpdate.toJson().dump());
                 }
                 lastBroadcast = now;
             }
-            
-            // Sleep to prevent busy-waiting
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
         }
     }
     
     void shutdown() {
         std::cout << "[Engine] Shutting down..." << std::endl;
         wsServer_.stop();
+        
+        if (driver_) {
+            driver_->stop();
+            std::cout << "[Engine] Audio xruns: " << driver_->getNumXruns() << std::endl;
+            driver_.reset();
+        }
+        audioEngine_->getPeakCache().removeChangeListener(this);
+        audioEngine_.reset();
         juce::shutdownJuce_GUI();
         std::cout << "[Engine] Goodbye!" << std::endl;
     }
@@ -136,6 +179,244 @@ private:
     ProjectState projectState_;
     ipc::MessageHandler messageHandler_;
     ipc::WebSocketServer wsServer_;
+    std::unique_ptr<AudioEngine> audioEngine_;
+    
+    //==========================================================================
+    // Audio
+    //==========================================================================
+    audio::DriverSettings driverSettings_;
+    int port_;
+    std::unique_ptr<audio::AudioDriver> driver_;
+    juce::MidiBuffer midiBuffer_;
+    
+    void prepare(double sampleRate, int blockSize) override {
+        midiBuffer_.ensureSize(4096);
+        audioEngine_->prepareToPlay(sampleRate, blockSize);
+    }
+    
+    void render(const float* const* inputs, int numInputs, float* const* outputs, int numOutputs, int numSamples) override {
+        // The engine reads recording input from the buffer it renders into (like AudioSourcePlayer)
+        juce::AudioBuffer<float> buffer(outputs, numOutputs, numSamples);
+        for (int ch = 0; ch < numOutputs; ++ch) {
+            if (ch < numInputs && inputs[ch] != nullptr) {
+                buffer.copyFrom(ch, 0, inputs[ch], numSamples);
+            } else {
+                buffer.clear(ch, 0, numSamples);
+            }
+        }
+        
+        midiBuffer_.clear();
+        audioEngine_->processAudio(juce::AudioSourceChannelInfo(&buffer, 0, numSamples), midiBuffer_);
+    }
+    
+    void stopped() override {
+        audioEngine_->releaseResources();
+    }
+    
+    //==========================================================================
+    // Project Files
+    //==========================================================================
+    void registerProjectHandlers() {
+        messageHandler_.registerHandler(ipc::CommandType::PROJECT_OPEN, [this](const ipc::Command& cmd) {
+            return handleProjectOpen(cmd);
+        });
+    }
+    
+    // Payload: path, deferInactive (default true: plugins on muted, frozen and empty
+    // tracks load when they are first needed). Replies with the project right away;
+    // pluginRestoreProgress events follow while its plugins load.
+    ipc::json handleProjectOpen(const ipc::Command& cmd) {
+        juce::File file(juce::String(cmd.payload.value("path", "")));
+        if (!file.existsAsFile()) {
+            std::cerr << "[Project] Can't open: " << file.getFullPathName() << std::endl;
+            return {{"opened", false}, {"error", "File not found"}};
+        }
+        
+        ProjectSerializer::fromJSON(projectState_, file.loadFileAsString());
+        std::cout << "[Project] Opened: " << file.getFullPathName() << std::endl;
+        
+        audioEngine_->restorePlugins(cmd.payload.value("deferInactive", true),
+            [this](const AudioEngine::PluginRestoreProgress& progress) {
+                ipc::json problems = ipc::json::array();
+                for (const auto& problem : progress.problems)
+                    problems.push_back(problem.toStdString());
+                
+                ipc::json data = {
+                    {"total", progress.total},
+                    {"loaded", progress.loaded},
+                    {"failed", progress.failed},
+                    {"deferred", progress.deferred},
+                    {"finished", progress.isFinished()},
+                    {"problems", problems}
+                };
+                wsServer_.broadcast(ipc::Event{ipc::EventType::PLUGIN_RESTORE_PROGRESS, "", data}.toJson().dump());
+                
+                if (progress.isFinished()) {
+                    std::cout << "[Project] Plugins restored: " << progress.loaded << " loaded, "
+                              << progress.failed << " failed, " << progress.deferred << " deferred" << std::endl;
+                    for (const auto& problem : progress.problems)
+                        std::cerr << "[Project] " << problem << std::endl;
+                }
+            });
+        
+        return messageHandler_.getProjectState();
+    }
+    
+    //==========================================================================
+    // Offline Render
+    //==========================================================================
+    void registerRenderHandlers() {
+        messageHandler_.registerHandler(ipc::CommandType::PROJECT_RENDER, [this](const ipc::Command& cmd) {
+            return handleProjectRender(cmd);
+        });
+        messageHandler_.registerHandler(ipc::CommandType::PROJECT_CANCEL_RENDER, [this](const ipc::Command&) {
+            audioEngine_->cancelRender();
+            std::cout << "[Render] Cancel requested" << std::endl;
+            return ipc::json{{"cancelling", audioEngine_->isRendering()}};
+        });
+    }
+    
+    ipc::json handleProjectRender(const ipc::Command& cmd) {
+        OfflineRenderSettings settings;
+        settings.file = juce::File(juce::String(cmd.payload.value("path", "")));
+        settings.format = cmd.payload.value("format", "wav") == "flac" ? OfflineRenderSettings::Format::Flac
+                                                                       : OfflineRenderSettings::Format::Wav;
+        settings.bitDepth = cmd.payload.value("bitDepth", 24);
+        settings.dither = cmd.payload.value("dither", true);
+        settings.tailSeconds = cmd.payload.value("tailSeconds", 0.0);
+        
+        std::string range = cmd.payload.value("range", "song");
+        if (range == "loop") {
+            settings.range = OfflineRenderSettings::Range::Loop;
+        } else if (range == "custom") {
+            settings.range = OfflineRenderSettings::Range::Custom;
+            settings.startBeat = cmd.payload.value("startBeat", 0.0);
+            settings.endBeat = cmd.payload.value("endBeat", 0.0);
+        }
+        
+        auto sendProgress = [this](const std::string& state, double progress, ipc::json extra) {
+            extra["state"] = state;
+            extra["progress"] = progress;
+            wsServer_.broadcast(ipc::Event{ipc::EventType::RENDER_PROGRESS, state, extra}.toJson().dump());
+        };
+        
+        juce::String error;
+        bool started = audioEngine_->startRender(settings,
+            [sendProgress](double progress) {
+                sendProgress("rendering", progress, ipc::json::object());
+            },
+            [sendProgress](const OfflineRenderResult& result) {
+                ipc::json data = {
+                    {"path", result.file.getFullPathName().toStdString()},
+                    {"audioSeconds", result.audioSeconds},
+                    {"renderSeconds", result.renderSeconds}
+                };
+                
+                if (result.completed) {
+                    std::cout << "[Render] Finished in " << result.renderSeconds << "s" << std::endl;
+                    sendProgress("finished", 1.0, data);
+                } else if (result.cancelled) {
+                    sendProgress("cancelled", 0.0, data);
+                } else {
+                    data["error"] = result.error.toStdString();
+                    sendProgress("failed", 0.0, data);
+                }
+            },
+            error);
+        
+        std::cout << "[Render] " << (started ? "Started: " + settings.file.getFullPathName().toStdString()
+                                             : "Failed: " + error.toStdString()) << std::endl;
+        return {{"started", started}, {"error", error.toStdString()}};
+    }
+    
+    //==========================================================================
+    // Recording
+    //==========================================================================
+    // Payload: seconds. How far back takes reach before the record point (30 by default,
+    // 0 stops capturing armed inputs while not recording).
+    void registerRecordingHandlers() {
+        messageHandler_.registerHandler(ipc::CommandType::RECORDING_SET_PRE_ROLL, [this](const ipc::Command& cmd) {
+            audioEngine_->setRecordingPreRoll(juce::jlimit(0.0, 300.0, cmd.payload.value("seconds", 30.0)));
+            std::cout << "[Recording] Pre-roll: " << audioEngine_->getRecordingPreRoll() << "s" << std::endl;
+            return ipc::json{{"seconds", audioEngine_->getRecordingPreRoll()}};
+        });
+    }
+    
+    //==========================================================================
+    // Playback
+    //==========================================================================
+    void registerPlaybackHandlers() {
+        // Payload: megabytes of RAM for decoded clip files. Shrinking it evicts right away.
+        messageHandler_.registerHandler(ipc::CommandType::AUDIO_CACHE_SET_BUDGET, [this](const ipc::Command& cmd) {
+            const double megabytes = juce::jlimit(0.0, 65536.0, cmd.payload.value("megabytes", 512.0));
+            audioEngine_->setAudioCacheBudget((size_t)(megabytes * 1024.0 * 1024.0));
+            
+            const auto statistics = audioEngine_->getAudioCacheStatistics();
+            std::cout << "[Playback] Sample cache budget: " << megabytes << " MB" << std::endl;
+            return ipc::json{
+                {"budgetBytes", statistics.budgetBytes},
+                {"bytesUsed", statistics.bytesUsed},
+                {"numEntries", statistics.numEntries}
+            };
+        });
+    }
+    
+    //==========================================================================
+    // Waveform Peaks
+    //==========================================================================
+    void registerPeakHandlers() {
+        messageHandler_.registerHandler(ipc::CommandType::CLIP_GET_PEAKS, [this](const ipc::Command& cmd) {
+            return handleGetPeaks(cmd);
+        });
+        audioEngine_->getPeakCache().addChangeListener(this);
+    }
+    
+    // Payload: path, start and secondsPerPixel (in seconds of the file), numPixels.
+    // Costs O(numPixels) at any zoom; request only the visible part of a clip.
+    ipc::json handleGetPeaks(const ipc::Command& cmd) {
+        constexpr int maxPixels = 16384;
+        juce::File file(juce::String(cmd.payload.value("path", "")));
+        double start = cmd.payload.value("start", 0.0);
+        double secondsPerPixel = cmd.payload.value("secondsPerPixel", 0.0);
+        int numPixels = juce::jlimit(0, maxPixels, cmd.payload.value("numPixels", 0));
+        
+        auto& peakCache = audioEngine_->getPeakCache();
+        PeakCache::Info info;
+        if (secondsPerPixel <= 0.0 || !peakCache.getInfo(file, info)) {
+            // Queued for analysis: a peaksUpdated event follows
+            return {{"ready", false}};
+        }
+        
+        std::vector<PeakCache::Peak> peaks((size_t)numPixels);
+        ipc::json channels = ipc::json::array();
+        
+        for (int ch = 0; ch < info.numChannels; ++ch) {
+            peakCache.getPeaks(file, ch, start * info.sampleRate, secondsPerPixel * info.sampleRate, peaks.data(), numPixels);
+            
+            ipc::json min = ipc::json::array(), max = ipc::json::array(), rms = ipc::json::array();
+            for (const auto& peak : peaks) {
+                min.push_back(peak.min);
+                max.push_back(peak.max);
+                rms.push_back(peak.rms);
+            }
+            channels.push_back({{"min", min}, {"max", max}, {"rms", rms}});
+        }
+        
+        return {
+            {"ready", true},
+            {"complete", info.complete},
+            {"sampleRate", info.sampleRate},
+            {"lengthSeconds", info.lengthInSamples / info.sampleRate},
+            {"channels", channels}
+        };
+    }
+    
+    // Peaks grew (analysis or recording): clients re-request what they show
+    void changeListenerCallback(juce::ChangeBroadcaster*) override {
+        if (wsServer_.getClientCount() > 0) {
+            wsServer_.broadcast(ipc::Event{ipc::EventType::PEAKS_UPDATED, "", ipc::json::object()}.toJson().dump());
+        }
+    }
 };
 
 //==============================================================================
@@ -146,7 +427,35 @@ int main(int argc, char* argv[]) {
     std::signal(SIGINT, signalHandler);
     std::signal(SIGTERM, signalHandler);
     
-    EngineApplication app;
+    juce::ArgumentList args(argc, argv);
+    
+    if (args.containsOption(PluginScanner::workerOption)) {
+        juce::ScopedJuceInitialiser_GUI juceInitialiser;
+        return PluginScanner::runWorker(juce::File(args.getValueForOption(PluginScanner::workerOption)));
+    }
+    
+    juce::StringArray arguments;
+    for (int i = 1; i < argc; ++i) {
+        arguments.add(argv[i]);
+    }
+    
+    const auto commandLine = arguments.joinIntoString(" ");
+    if (PluginSandbox::isHostCommandLine(commandLine)) {
+        juce::ScopedJuceInitialiser_GUI juceInitialiser;
+        auto host = PluginSandbox::createHost(commandLine, [] {
+            juce::MessageManager::getInstance()->stopDispatchLoop();
+        });
+        if (!host) {
+            return 1;
+        }
+        juce::MessageManager::getInstance()->runDispatchLoop();
+        return 0;
+    }
+    
+    auto driverSettings = audio::DriverSettings::fromArguments(args);
+    int port = args.containsOption("--port") ? args.getValueForOption("--port").getIntValue() : 9001;
+    
+    EngineApplication app(driverSettings, port);
     
     if (!app.initialize()) {
         return 1;
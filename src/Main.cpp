@@ -1,4 +1,6 @@
 #include "MainComponent.h"
+#include "engine/PluginSandbox.h"
+#include "engine/PluginScanner.h"
 #include <juce_gui_extra/juce_gui_extra.h> // DocumentWindow など
 
 class AiceCubeApplication : public juce::JUCEApplication {
@@ -7,11 +9,33 @@ public:
   const juce::String getApplicationVersion() override { return "0.1.0"; }
   bool moreThanOneInstanceAllowed() override { return true; }
 
-  void initialise(const juce::String &) override {
+  void initialise(const juce::String &commandLine) override {
+    // Plugin scan worker (see PluginScanner): no window, exit when done
+    juce::ArgumentList args(getApplicationName(), commandLine);
+    if (args.containsOption(PluginScanner::workerOption)) {
+      juce::File jobFile(args.getValueForOption(PluginScanner::workerOption).unquoted());
+      setApplicationReturnValue(PluginScanner::runWorker(jobFile));
+      quit();
+      return;
+    }
+
+    // Plugin host (see PluginSandbox): no window of its own, exit with the engine
+    if (PluginSandbox::isHostCommandLine(commandLine)) {
+      pluginHost = PluginSandbox::createHost(commandLine, [this] { quit(); });
+      if (pluginHost == nullptr) {
+        setApplicationReturnValue(1);
+        quit();
+      }
+      return;
+    }
+
     mainWindow.reset(new MainWindow(getApplicationName()));
   }
 
-  void shutdown() override { mainWindow = nullptr; }
+  void shutdown() override {
+    mainWindow = nullptr;
+    pluginHost = nullptr;
+  }
 
   void systemRequestedQuit() override { quit(); }
 
@@ -37,6 +61,7 @@ public:
 
 private:
   std::unique_ptr<MainWindow> mainWindow;
+  std::unique_ptr<juce::ChildProcessWorker> pluginHost;
 };
 
 START_JUCE_APPLICATION(AiceCubeApplication)
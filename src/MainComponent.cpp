@@ -7,7 +7,7 @@ MainComponent::MainComponent()
       commandExecutor(projectState, apiClient),
       transportBar(projectState),
       trackHeaders(projectState, audioEngine),
-      timeline(projectState),
+      timeline(projectState, audioEngine.getPeakCache()),
       mixer(projectState, audioEngine),
       pianoRoll(projectState),
       resizer(&bottomPanel, nullptr, juce::ResizableEdgeComponent::topEdge)
@@ -28,10 +28,17 @@ MainComponent::MainComponent()
     };
     
     transportBar.onRecordClicked = [this] {
-        audioEngine.startRecording();
+        juce::String error;
+        if (!audioEngine.startRecording(error))
+            juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "Recording", error);
+        
         projectState.isPlaying = true;
     };
     
+    audioEngine.onError = [](const juce::String& message) {
+        juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "AiceCube", message);
+    };
+    
     transportBar.onSaveClicked = [this] { saveProject(); };
     
     transportBar.onSettingsClicked = [this] {
@@ -69,6 +76,8 @@ MainComponent::MainComponent()
             commandExecutor.execute(cmd, 
                 [this](const juce::String& msg) { agentPanel.logMessage(msg); },
                 [this] { 
+                    projectState.markDirty();
+                    
                     juce::MessageManager::callAsync([this] {
                         trackHeaders.updateTrackList();
                         timeline.updateTimeline();
@@ -95,9 +104,12 @@ MainComponent::MainComponent()
         resized();
     };
 
-    // Initialize Plugins
-    // audioEngine.scanPlugins();
-    audioEngine.scanPluginsAsync(nullptr, nullptr);
+    // Initialize Plugins: the known list is loaded already, bring it up to date once the UI is up
+    juce::Component::SafePointer<MainComponent> safeThis(this);
+    juce::MessageManager::callAsync([safeThis] {
+        if (safeThis != nullptr)
+            safeThis->audioEngine.scanPluginsAsync(nullptr, nullptr);
+    });
     
     setSize(1600, 900);
 
@@ -121,29 +133,35 @@ MainComponent::MainComponent()
     addAndMakeVisible(resizer);
     
     addAndMakeVisible(agentPanel);
+    
+    // Playhead repaint (the audio thread must not post messages)
+    startTimerHz(30);
 }
 
 MainComponent::~MainComponent()
 {
+    stopTimer();
     shutdownAudio();
     juce::LookAndFeel::setDefaultLookAndFeel(nullptr);
 }
 
 void MainComponent::prepareToPlay(int samplesPerBlockExpected, double sampleRate)
 {
+    midiMessages.ensureSize(64 * 1024);
     audioEngine.prepareToPlay(sampleRate, samplesPerBlockExpected);
 }
 
 void MainComponent::getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill)
 {
-    juce::MidiBuffer midiMessages;
+    midiMessages.clear();
     audioEngine.processAudio(bufferToFill, midiMessages);
-    
+}
+
+void MainComponent::timerCallback()
+{
     // Update playhead if playing
     if (projectState.isPlaying)
-    {
-        juce::MessageManager::callAsync([this] { timeline.repaint(); });
-    }
+        timeline.repaint();
 }
 
 void MainComponent::releaseResources()
@@ -260,17 +278,19 @@ void MainComponent::loadProject()
             auto json = file.loadFileAsString();
             ProjectSerializer::fromJSON(projectState, json);
             
-            // Restore plugins
-            audioEngine.updateGraph();
-            for (auto& track : projectState.tracks)
-            {
-                if (track->instrumentPlugin && track->instrumentPlugin->identifier.isNotEmpty())
+            // Plugins load in the background; those on tracks that can't be heard yet wait for them
+            audioEngine.restorePlugins(true, [this](const AudioEngine::PluginRestoreProgress& progress) {
+                if (progress.isFinished())
                 {
-                    juce::PluginDescription desc;
-                    desc.fileOrIdentifier = track->instrumentPlugin->identifier;
-                    audioEngine.setInstrumentPlugin(track.get(), desc);
+                    transportBar.setStatusText(progress.failed > 0 ? juce::String(progress.failed) + " plugin(s) failed to load" : juce::String());
+                    if (!progress.problems.isEmpty())
+                        juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "Plugins",
+                                                               progress.problems.joinIntoString("\n"));
                 }
-            }
+                else
+                    transportBar.setStatusText("Loading plugins " + juce::String(progress.loaded + progress.failed)
+                                               + "/" + juce::String(progress.total - progress.deferred));
+            });
             
             resized(); // Re-layout
             timeline.updateTimeline();
@@ -279,6 +299,94 @@ void MainComponent::loadProject()
     });
 }
 
+// Tempo and time signature events (wherever they are in the file) become the project's tempo map
+static void importTempoMap(const juce::MidiFile& midiFile, double ticksPerQuarter, ProjectState& state)
+{
+    std::vector<TempoChange> tempos;
+    std::vector<MeterChange> meters;
+    
+    for (int i = 0; i < midiFile.getNumTracks(); ++i)
+    {
+        for (const auto* event : *midiFile.getTrack(i))
+        {
+            const auto& msg = event->message;
+            const double beat = msg.getTimeStamp() / ticksPerQuarter;
+            
+            if (msg.isTempoMetaEvent() && msg.getTempoSecondsPerQuarterNote() > 0.0)
+            {
+                tempos.push_back({ beat, 60.0 / msg.getTempoSecondsPerQuarterNote(), false });
+            }
+            else if (msg.isTimeSignatureMetaEvent())
+            {
+                int numerator = 4, denominator = 4;
+                msg.getTimeSignatureInfo(numerator, denominator);
+                meters.push_back({ beat, numerator, denominator });
+            }
+        }
+    }
+    
+    if (tempos.empty() && meters.empty()) return;
+    
+    // What applies at beat 0 (or first) is the project's start, the rest are changes
+    const TempoMap map(tempos, meters);
+    const auto& mapTempos = map.getTempoChanges();
+    const auto& mapMeters = map.getMeters();
+    
+    if (!tempos.empty())
+    {
+        state.tempo = mapTempos.front().bpm;
+        state.tempoRamp = false;
+        state.tempoChanges.assign(mapTempos.begin() + 1, mapTempos.end());
+    }
+    
+    if (!meters.empty())
+    {
+        state.timeSignatureNumerator = mapMeters.front().numerator;
+        state.timeSignatureDenominator = mapMeters.front().denominator;
+        state.meterChanges.clear();
+        for (size_t i = 1; i < mapMeters.size(); ++i)
+            state.meterChanges.push_back({ mapMeters[i].beat, mapMeters[i].numerator, mapMeters[i].denominator });
+    }
+}
+
+// MIDI has no tempo ramps: they are written as steps, each as long as that part of the ramp
+static juce::MidiMessageSequence createConductorTrack(const TempoMap& tempoMap, double ticksPerQuarter)
+{
+    constexpr double rampStep = 0.5; // Beats
+    juce::MidiMessageSequence conductor;
+    
+    auto addTempo = [&](double beat, double bpm) {
+        auto msg = juce::MidiMessage::tempoMetaEvent((int)std::round(60000000.0 / bpm));
+        msg.setTimeStamp(beat * ticksPerQuarter);
+        conductor.addEvent(msg);
+    };
+    
+    const auto& tempos = tempoMap.getTempoChanges();
+    for (size_t i = 0; i < tempos.size(); ++i)
+    {
+        if (!tempos[i].ramp || i + 1 == tempos.size())
+        {
+            addTempo(tempos[i].beat, tempos[i].bpm);
+            continue;
+        }
+        
+        for (double beat = tempos[i].beat; beat < tempos[i + 1].beat; beat += rampStep)
+        {
+            const double length = std::min(rampStep, tempos[i + 1].beat - beat);
+            addTempo(beat, 60.0 * length / (tempoMap.beatToSeconds(beat + length) - tempoMap.beatToSeconds(beat)));
+        }
+    }
+    
+    for (const auto& meter : tempoMap.getMeters())
+    {
+        auto msg = juce::MidiMessage::timeSignatureMetaEvent(meter.numerator, meter.denominator);
+        msg.setTimeStamp(meter.beat * ticksPerQuarter);
+        conductor.addEvent(msg);
+    }
+    
+    return conductor;
+}
+
 void MainComponent::importMidi()
 {
     fileChooser = std::make_unique<juce::FileChooser>("Import MIDI",
@@ -298,10 +406,11 @@ void MainComponent::importMidi()
                     double ticksPerQuarter = midiFile.getTimeFormat();
                     if (ticksPerQuarter < 0) ticksPerQuarter = 960.0; // SMPTE fallback
                     
+                    importTempoMap(midiFile, ticksPerQuarter, projectState);
+                    
                     for (int i = 0; i < midiFile.getNumTracks(); ++i)
                     {
                         auto* trackSeq = midiFile.getTrack(i);
-                        auto track = projectState.addTrack(TrackType::Midi, "Imported MIDI " + juce::String(i+1));
                         
                         Clip clip;
                         clip.name = "MIDI Clip";
@@ -311,19 +420,27 @@ void MainComponent::importMidi()
                         
                         clip.isMidi = true;
                         
-                        // Convert events to beats
+                        // Convert events to beats (tempo and meter are in the tempo map now)
                         for (int j = 0; j < trackSeq->getNumEvents(); ++j)
                         {
                             auto msg = trackSeq->getEventPointer(j)->message;
+                            if (msg.isMetaEvent()) continue;
+                            
                             msg.setTimeStamp(msg.getTimeStamp() / ticksPerQuarter);
                             clip.midiSequence.addEvent(msg);
                         }
                         clip.midiSequence.updateMatchedPairs();
                         
+                        // A conductor track has nothing left
+                        if (clip.midiSequence.getNumEvents() == 0) continue;
+                        
+                        auto track = projectState.addTrack(TrackType::Midi, "Imported MIDI " + juce::String(i+1));
                         clip.trackIndex = 0;
                         track->clips.push_back(clip);
                     }
                     
+                    projectState.markDirty();
+                    
                     juce::MessageManager::callAsync([this] {
                         trackHeaders.updateTrackList();
                         timeline.updateTimeline();
@@ -347,6 +464,7 @@ void MainComponent::exportMidi()
             {
                 juce::MidiFile midiFile;
                 midiFile.setTicksPerQuarterNote(960);
+                midiFile.addTrack(createConductorTrack(projectState.createTempoMap(), 960.0));
                 
                 for (const auto& track : projectState.tracks)
                 {
@@ -13,7 +13,7 @@
 #include "CommandExecutor.h"
 #include "AgentLogic.h"
 
-class MainComponent : public juce::AudioAppComponent, public juce::DragAndDropContainer
+class MainComponent : public juce::AudioAppComponent, public juce::DragAndDropContainer, private juce::Timer
 {
 public:
     MainComponent();
@@ -34,9 +34,12 @@ public:
     void exportMidi();
 
 private:
+    void timerCallback() override;
+
     // Model & Engine
     ProjectState projectState;
     AudioEngine audioEngine;
+    juce::MidiBuffer midiMessages; // Reused every block; sized in prepareToPlay
 
     // Agent
     ApiClient apiClient;
@@ -1,13 +1,35 @@
 #include "ClipComponent.h"
 
-ClipComponent::ClipComponent(Clip& c, double ppb)
-    : clip(c), pixelsPerBeat(ppb)
+ClipComponent::ClipComponent(Clip& c, double ppb, PeakCache* cache, std::shared_ptr<const TempoMap> map)
+    : clip(c), pixelsPerBeat(ppb), peakCache(cache), tempoMap(map != nullptr ? std::move(map) : std::make_shared<const TempoMap>())
 {
+    // Repaint as peaks get built (or recorded)
+    if (peakCache != nullptr && !clip.isMidi)
+        peakCache->addChangeListener(this);
+}
+
+ClipComponent::~ClipComponent()
+{
+    if (peakCache != nullptr)
+        peakCache->removeChangeListener(this);
+}
+
+void ClipComponent::changeListenerCallback(juce::ChangeBroadcaster*)
+{
+    // Every file's progress is broadcast: only repaint when this clip's has moved on
+    PeakCache::Info info;
+    if (peakCache->getInfo(clip.audioFile, info)
+        && (info.lengthInSamples != paintedInfo.lengthInSamples || info.complete != paintedInfo.complete))
+        repaint();
 }
 
 void ClipComponent::paint(juce::Graphics& g)
 {
     g.fillAll(clip.clipColor.withAlpha(0.8f));
+    
+    if (peakCache != nullptr && !clip.isMidi)
+        drawWaveform(g);
+    
     g.setColour(juce::Colours::black);
     g.drawRect(getLocalBounds(), 1);
     g.drawText(clip.name, getLocalBounds().reduced(2), juce::Justification::centred, true);
@@ -15,6 +37,59 @@ void ClipComponent::paint(juce::Graphics& g)
     // Resize handles
     g.setColour(juce::Colours::white.withAlpha(0.3f));
     g.fillRect(getWidth() - 5, 0, 5, getHeight());
+    if (!clip.isMidi)
+        g.fillRect(0, 0, 5, getHeight());
+}
+
+void ClipComponent::drawWaveform(juce::Graphics& g)
+{
+    PeakCache::Info info;
+    if (!peakCache->getInfo(clip.audioFile, info)) return;
+    paintedInfo = info;
+    
+    // Only the columns being repainted are fetched
+    auto area = g.getClipBounds().getIntersection(getLocalBounds());
+    if (area.isEmpty()) return;
+    
+    // File position of each column edge, through the tempo map like the engine plays it
+    TempoMap::Cursor cursor(*tempoMap, info.sampleRate);
+    const double clipStartSample = cursor.beatToSample(clip.startBeat) - clip.sourceOffset * info.sampleRate;
+    std::vector<double> edges((size_t)area.getWidth() + 1);
+    for (size_t i = 0; i < edges.size(); ++i)
+        edges[i] = cursor.beatToSample(clip.startBeat + (area.getX() + (int)i) / pixelsPerBeat) - clipStartSample;
+    
+    const int numChannels = std::min(info.numChannels, 2);
+    const float laneHeight = getHeight() / (float)numChannels;
+    peaks.resize((size_t)area.getWidth());
+    
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        // Columns of equal width (a constant tempo) are fetched in one go, ramps column by column
+        for (int run = 0, end; run < area.getWidth(); run = end)
+        {
+            const double samplesPerPixel = edges[(size_t)run + 1] - edges[(size_t)run];
+            for (end = run + 1; end < area.getWidth(); ++end)
+                if (std::abs(edges[(size_t)end + 1] - edges[(size_t)end] - samplesPerPixel) > samplesPerPixel * 1.0e-6)
+                    break;
+            
+            peakCache->getPeaks(clip.audioFile, ch, edges[(size_t)run], samplesPerPixel, peaks.data() + run, end - run);
+        }
+        
+        const float centre = laneHeight * (ch + 0.5f);
+        const float scale = laneHeight * 0.5f * clip.gain;
+        
+        for (int i = 0; i < area.getWidth(); ++i)
+        {
+            const auto& peak = peaks[(size_t)i];
+            const int x = area.getX() + i;
+            
+            g.setColour(juce::Colours::black.withAlpha(0.45f));
+            g.drawVerticalLine(x, centre - peak.max * scale, centre - peak.min * scale);
+            
+            g.setColour(juce::Colours::black.withAlpha(0.7f));
+            g.drawVerticalLine(x, centre - peak.rms * scale, centre + peak.rms * scale);
+        }
+    }
 }
 
 void ClipComponent::mouseDown(const juce::MouseEvent& e)
@@ -34,15 +109,22 @@ void ClipComponent::mouseDown(const juce::MouseEvent& e)
         return;
     }
 
-    if (e.x > getWidth() - 10)
-        isResizing = true;
-    else
-        isResizing = false;
+    isResizing = e.x > getWidth() - 10;
+    isTrimmingStart = !isResizing && !clip.isMidi && e.x < 10;
 }
 
 void ClipComponent::mouseDrag(const juce::MouseEvent& e)
 {
-    if (isResizing)
+    if (isTrimmingStart)
+    {
+        // The component moves with the edge, so measure the drag on screen
+        double diffBeats = (e.getScreenX() - e.getMouseDownScreenX()) / pixelsPerBeat;
+        double newStart = ProjectState::trimClipStart(clip, originalStartBeat + diffBeats, *tempoMap);
+        
+        setBounds((int)(newStart * pixelsPerBeat), getY(), (int)(clip.lengthBeats * pixelsPerBeat), getHeight());
+        repaint(); // The waveform shifts with the file position
+    }
+    else if (isResizing)
     {
         double diffBeats = (e.getPosition().x - e.getMouseDownX()) / pixelsPerBeat;
         double newLength = originalLength + diffBeats;
@@ -1,12 +1,19 @@
 #pragma once
 #include <juce_gui_basics/juce_gui_basics.h>
 #include "../model/MusicData.h"
+#include "../model/TempoMap.h"
+#include "../model/ProjectState.h"
+#include "../engine/PeakCache.h"
 
-class ClipComponent : public juce::Component
+class ClipComponent : public juce::Component,
+                      private juce::ChangeListener
 {
 public:
-    ClipComponent(Clip& clip, double pixelsPerBeat);
-    ~ClipComponent() override = default;
+    // Audio clips draw their waveform from peakCache, if there is one, following the tempo map
+    // (120 BPM without one) from beats on screen to time in the file
+    ClipComponent(Clip& clip, double pixelsPerBeat, PeakCache* peakCache = nullptr,
+                  std::shared_ptr<const TempoMap> tempoMap = nullptr);
+    ~ClipComponent() override;
 
     void paint(juce::Graphics& g) override;
     void mouseDrag(const juce::MouseEvent& e) override;
@@ -17,10 +24,18 @@ public:
     std::function<void(Clip&, const juce::MouseEvent&)> onClipRightClicked;
 
 private:
+    void drawWaveform(juce::Graphics& g);
+    void changeListenerCallback(juce::ChangeBroadcaster*) override;
+    
     Clip& clip;
     double pixelsPerBeat;
+    PeakCache* peakCache;
+    std::shared_ptr<const TempoMap> tempoMap;
+    std::vector<PeakCache::Peak> peaks;
+    PeakCache::Info paintedInfo; // What the waveform was last drawn from
     
     bool isResizing = false;
+    bool isTrimmingStart = false; // Audio clips: the left edge, back into the file's earlier audio
     double originalStartBeat = 0.0;
     double originalLength = 0.0;
 
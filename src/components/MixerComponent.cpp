@@ -16,26 +16,26 @@ public:
         volumeSlider.setSliderStyle(juce::Slider::LinearVertical);
         volumeSlider.setTextBoxStyle(juce::Slider::TextBoxBelow, false, 50, 20);
         volumeSlider.setRange(0.0, 1.0);
-        volumeSlider.setValue(track->volume, juce::dontSendNotification);
-        volumeSlider.onValueChange = [this] { track->volume = (float)volumeSlider.getValue(); };
+        volumeSlider.setValue(track->mixer->volume.load(), juce::dontSendNotification);
+        volumeSlider.onValueChange = [this] { track->mixer->volume = (float)volumeSlider.getValue(); };
         
         addAndMakeVisible(panSlider);
         panSlider.setSliderStyle(juce::Slider::RotaryHorizontalVerticalDrag);
         panSlider.setTextBoxStyle(juce::Slider::NoTextBox, false, 0, 0);
         panSlider.setRange(-1.0, 1.0);
-        panSlider.setValue(track->pan, juce::dontSendNotification);
-        panSlider.onValueChange = [this] { track->pan = (float)panSlider.getValue(); };
+        panSlider.setValue(track->mixer->pan.load(), juce::dontSendNotification);
+        panSlider.onValueChange = [this] { track->mixer->pan = (float)panSlider.getValue(); };
         
         addAndMakeVisible(muteButton);
         muteButton.setClickingTogglesState(true);
-        muteButton.setToggleState(track->mute, juce::dontSendNotification);
-        muteButton.onClick = [this] { track->mute = muteButton.getToggleState(); };
+        muteButton.setToggleState(track->mixer->mute.load(), juce::dontSendNotification);
+        muteButton.onClick = [this] { track->mixer->mute = muteButton.getToggleState(); };
         muteButton.setColour(juce::TextButton::buttonOnColourId, juce::Colours::red);
         
         addAndMakeVisible(soloButton);
         soloButton.setClickingTogglesState(true);
-        soloButton.setToggleState(track->solo, juce::dontSendNotification);
-        soloButton.onClick = [this] { track->solo = soloButton.getToggleState(); };
+        soloButton.setToggleState(track->mixer->solo.load(), juce::dontSendNotification);
+        soloButton.onClick = [this] { track->mixer->solo = soloButton.getToggleState(); projectState.markDirty(); };
         soloButton.setColour(juce::TextButton::buttonOnColourId, juce::Colours::yellow);
         
         // Instrument (MIDI only)
@@ -74,6 +74,7 @@ public:
             sendSliders.add(slider);
             slider->onValueChange = [this, i] { 
                 if (i < track->sends.size()) track->sends[i].amount = (float)sendSliders[i]->getValue(); 
+                projectState.markDirty();
             };
         }
         updateSendControls();
@@ -106,8 +107,13 @@ public:
             menu.addItem("Remove", [this] {
                 audioEngine.closePluginWindow(track->instrumentPlugin->instance.get());
                 track->instrumentPlugin = nullptr;
+                projectState.markDirty();
                 updateInstrumentButton();
             });
+            menu.addItem("Run in Sandbox", true, track->instrumentPlugin->sandboxed, [this] {
+                if (track->instrumentPlugin)
+                    audioEngine.setPluginSandboxed(track.get(), -1, !track->instrumentPlugin->sandboxed);
+            });
             menu.addSeparator();
         }
         
@@ -120,8 +126,10 @@ public:
             if (desc.isInstrument)
             {
                 menu.addItem(desc.name, [this, desc] {
-                    audioEngine.setInstrumentPlugin(track.get(), desc);
-                    updateInstrumentButton();
+                    juce::Component::SafePointer<MixerChannelStrip> safeThis(this);
+                    audioEngine.setInstrumentPlugin(track.get(), desc, [safeThis] {
+                        if (safeThis != nullptr) safeThis->updateInstrumentButton();
+                    });
                 });
             }
         }
@@ -156,8 +164,13 @@ public:
             menu.addItem("Remove", [this, slotIndex] {
                 audioEngine.closePluginWindow(track->insertPlugins[slotIndex]->instance.get());
                 track->insertPlugins[slotIndex] = nullptr;
+                projectState.markDirty();
                 updateInsertButtons();
             });
+            menu.addItem("Run in Sandbox", true, track->insertPlugins[slotIndex]->sandboxed, [this, slotIndex] {
+                if (track->insertPlugins[slotIndex])
+                    audioEngine.setPluginSandboxed(track.get(), slotIndex, !track->insertPlugins[slotIndex]->sandboxed);
+            });
             menu.addSeparator();
         }
         
@@ -167,8 +180,10 @@ public:
         for (const auto& desc : types)
         {
             menu.addItem(desc.name, [this, slotIndex, desc] {
-                audioEngine.addPluginToTrack(track.get(), slotIndex, desc);
-                updateInsertButtons();
+                juce::Component::SafePointer<MixerChannelStrip> safeThis(this);
+                audioEngine.addPluginToTrack(track.get(), slotIndex, desc, [safeThis] {
+                    if (safeThis != nullptr) safeThis->updateInsertButtons();
+                });
             });
         }
         
@@ -211,7 +226,10 @@ public:
         {
             if (t->type == TrackType::Bus && t->id != track->id)
             {
-                menu.addItem(t->name, [this, slotIndex, t] {
+                // Buses may feed other buses, but never back into themselves
+                bool allowed = !RoutingGraph::wouldCreateCycle(projectState, track->id, t->id);
+                
+                menu.addItem(t->name, allowed, false, [this, slotIndex, t] {
                     if (track->sends.size() <= slotIndex)
                         track->sends.resize(slotIndex + 1);
                         
@@ -219,6 +237,7 @@ public:
                     track->sends[slotIndex].amount = 0.5f;
                     track->sends[slotIndex].active = true;
                     
+                    projectState.markDirty();
                     updateSendControls();
                 });
             }
@@ -228,6 +247,7 @@ public:
             if (slotIndex < track->sends.size())
             {
                 track->sends.erase(track->sends.begin() + slotIndex);
+                projectState.markDirty();
                 updateSendControls();
             }
         });
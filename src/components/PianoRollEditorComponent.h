@@ -342,6 +342,7 @@ public:
                     clip->midiSequence.addEvent(off);
                     
                     clip->midiSequence.updateMatchedPairs();
+                    projectState.markDirty();
                     repaint();
                 }
             }
@@ -416,6 +417,7 @@ public:
             {
                 clip->midiSequence.sort();
                 clip->midiSequence.updateMatchedPairs();
+                projectState.markDirty();
             }
             isDragging = false;
             isResizing = false;
@@ -54,6 +54,23 @@ SettingsComponent::SettingsComponent(juce::AudioDeviceManager& deviceManager, Au
     };
     
     tabs.addTab("Plugins", juce::Colours::darkgrey, &pluginTab, false);
+    
+    // Recording Tab: armed inputs are kept this far back, so takes can be trimmed back into it
+    preRollSlider.setRange(0.0, 120.0, 1.0);
+    preRollSlider.setValue(audioEngine.getRecordingPreRoll(), juce::dontSendNotification);
+    preRollSlider.onValueChange = [this] { audioEngine.setRecordingPreRoll(preRollSlider.getValue()); };
+    recordingTab.addAndMakeVisible(preRollLabel);
+    recordingTab.addAndMakeVisible(preRollSlider);
+    tabs.addTab("Recording", juce::Colours::darkgrey, &recordingTab, false);
+    
+    // Playback Tab: RAM for decoded short and compressed clip files
+    cacheBudgetSlider.setRange(64.0, 8192.0, 64.0);
+    cacheBudgetSlider.setSkewFactorFromMidPoint(1024.0);
+    cacheBudgetSlider.setValue((double)(audioEngine.getAudioCacheBudget() >> 20), juce::dontSendNotification);
+    cacheBudgetSlider.onValueChange = [this] { audioEngine.setAudioCacheBudget((size_t)cacheBudgetSlider.getValue() << 20); };
+    playbackTab.addAndMakeVisible(cacheBudgetLabel);
+    playbackTab.addAndMakeVisible(cacheBudgetSlider);
+    tabs.addTab("Playback", juce::Colours::darkgrey, &playbackTab, false);
     addAndMakeVisible(tabs);
 }
 
@@ -83,6 +100,18 @@ void SettingsComponent::resized()
     area.removeFromTop(10);
     statusLabel.setBounds(area.removeFromBottom(20));
     pathList.setBounds(area);
+    
+    // Layout Recording Tab
+    auto recordingArea = recordingTab.getLocalBounds().reduced(10);
+    auto preRollRow = recordingArea.removeFromTop(30);
+    preRollLabel.setBounds(preRollRow.removeFromLeft(150));
+    preRollSlider.setBounds(preRollRow);
+    
+    // Layout Playback Tab
+    auto playbackArea = playbackTab.getLocalBounds().reduced(10);
+    auto cacheBudgetRow = playbackArea.removeFromTop(30);
+    cacheBudgetLabel.setBounds(cacheBudgetRow.removeFromLeft(150));
+    cacheBudgetSlider.setBounds(cacheBudgetRow);
 }
 
 int SettingsComponent::getNumRows()
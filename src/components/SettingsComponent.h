@@ -28,6 +28,16 @@ private:
     juce::TextButton scanButton { "Scan Plugins" };
     juce::Label statusLabel;
     
+    // Recording Tab
+    juce::Component recordingTab;
+    juce::Label preRollLabel { {}, "Pre-roll (seconds)" };
+    juce::Slider preRollSlider { juce::Slider::LinearHorizontal, juce::Slider::TextBoxRight };
+    
+    // Playback Tab
+    juce::Component playbackTab;
+    juce::Label cacheBudgetLabel { {}, "Sample cache (MB)" };
+    juce::Slider cacheBudgetSlider { juce::Slider::LinearHorizontal, juce::Slider::TextBoxRight };
+    
     AudioEngine& audioEngine;
     std::unique_ptr<juce::FileChooser> fileChooser;
 
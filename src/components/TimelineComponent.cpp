@@ -1,6 +1,6 @@
 #include "TimelineComponent.h"
 
-TimelineComponent::TimelineComponent(ProjectState& state) : projectState(state)
+TimelineComponent::TimelineComponent(ProjectState& state, PeakCache& peaks) : projectState(state), peakCache(peaks)
 {
     addKeyListener(this);
     setWantsKeyboardFocus(true);
@@ -161,6 +161,7 @@ void TimelineComponent::mouseDown(const juce::MouseEvent& e)
              projectState.loopStart = beat;
              projectState.loopEnd = beat;
              projectState.isLooping = true;
+             projectState.markDirty();
              repaint();
              return;
         }
@@ -236,6 +237,7 @@ void TimelineComponent::mouseDown(const juce::MouseEvent& e)
                     {
                         // Delete point
                         curve.points.erase(curve.points.begin() + i);
+                        projectState.markDirty();
                         repaint();
                         return;
                     }
@@ -260,6 +262,7 @@ void TimelineComponent::mouseDown(const juce::MouseEvent& e)
                     return a.time < b.time;
                 });
                 
+                projectState.markDirty();
                 repaint();
                 return;
             }
@@ -305,6 +308,7 @@ void TimelineComponent::mouseDrag(const juce::MouseEvent& e)
                 curve.points[draggingAutomationPointIndex].time = beat;
                 curve.points[draggingAutomationPointIndex].value = val;
                 
+                projectState.markDirty();
                 repaint();
             }
             break; // Only edit one curve
@@ -332,6 +336,7 @@ void TimelineComponent::mouseDrag(const juce::MouseEvent& e)
         // Ensure minimum loop length
         if (projectState.loopEnd <= projectState.loopStart) projectState.loopEnd = projectState.loopStart + 0.1;
         
+        projectState.markDirty();
         repaint();
         return;
     }
@@ -372,6 +377,7 @@ void TimelineComponent::mouseUp(const juce::MouseEvent& e)
         }
         draggingAutomationTrackIndex = -1;
         draggingAutomationPointIndex = -1;
+        projectState.markDirty();
         repaint();
         return;
     }
@@ -469,6 +475,7 @@ void TimelineComponent::deleteSelectedClips()
         track->clips.erase(it, track->clips.end());
     }
     selectedClips.clear();
+    projectState.markDirty();
     updateTimeline();
 }
 
@@ -509,18 +516,22 @@ void TimelineComponent::updateTimeline()
 {
     clipComponents.clear();
     
+    // Waveforms follow the tempo across their clip
+    const auto tempoMap = std::make_shared<const TempoMap>(projectState.createTempoMap());
+    
     int trackIndex = 0;
     for (auto& track : projectState.tracks)
     {
         for (auto& clip : track->clips)
         {
-            auto* cc = new ClipComponent(clip, pixelsPerBeat);
+            auto* cc = new ClipComponent(clip, pixelsPerBeat, &peakCache, tempoMap);
             int x = beatsToX(clip.startBeat);
             int w = (int)(clip.lengthBeats * pixelsPerBeat);
             int y = rulerHeight + trackIndex * trackHeight;
             int h = trackHeight - 2;
             
             cc->setBounds(x, y, w, h);
+            cc->onClipModified = [this] { projectState.markDirty(); };
             cc->onClipDoubleClicked = [this](Clip& c) {
                 if (onClipEditRequested) onClipEditRequested(c);
             };
@@ -6,7 +6,7 @@
 class TimelineComponent : public juce::Component, public juce::KeyListener
 {
 public:
-    TimelineComponent(ProjectState& state);
+    TimelineComponent(ProjectState& state, PeakCache& peakCache);
     ~TimelineComponent() override;
 
     void paint(juce::Graphics& g) override;
@@ -23,6 +23,7 @@ public:
 
 private:
     ProjectState& projectState;
+    PeakCache& peakCache;
     juce::OwnedArray<ClipComponent> clipComponents;
     
     double pixelsPerBeat = 40.0;
@@ -1,4 +1,6 @@
 #include "TrackHeaderComponent.h"
+#include "../engine/Automation.h"
+#include "../engine/MultiTrackRecorder.h"
 
 TrackHeaderComponent::TrackHeaderComponent(std::shared_ptr<Track> t) : track(t)
 {
@@ -9,18 +11,20 @@ TrackHeaderComponent::TrackHeaderComponent(std::shared_ptr<Track> t) : track(t)
     
     addAndMakeVisible(muteButton);
     muteButton.setClickingTogglesState(true);
-    muteButton.setToggleState(track->mute, juce::dontSendNotification);
-    muteButton.onClick = [this] { track->mute = muteButton.getToggleState(); };
+    muteButton.setToggleState(track->mixer->mute.load(), juce::dontSendNotification);
+    muteButton.onClick = [this] { track->mixer->mute = muteButton.getToggleState(); };
     muteButton.setColour(juce::TextButton::buttonOnColourId, juce::Colours::red);
     
     addAndMakeVisible(soloButton);
     soloButton.setClickingTogglesState(true);
-    soloButton.setToggleState(track->solo, juce::dontSendNotification);
-    soloButton.onClick = [this] { track->solo = soloButton.getToggleState(); };
+    soloButton.setToggleState(track->mixer->solo.load(), juce::dontSendNotification);
+    soloButton.onClick = [this] { track->mixer->solo = soloButton.getToggleState(); if (onTrackChanged) onTrackChanged(); };
     soloButton.setColour(juce::TextButton::buttonOnColourId, juce::Colours::yellow);
     
     addAndMakeVisible(recButton);
     recButton.setClickingTogglesState(true);
+    recButton.setToggleState(track->arm, juce::dontSendNotification);
+    recButton.onClick = [this] { track->arm = recButton.getToggleState(); if (onTrackChanged) onTrackChanged(); };
     recButton.setColour(juce::TextButton::buttonOnColourId, juce::Colours::red.darker());
     
     addAndMakeVisible(automationButton);
@@ -54,6 +58,8 @@ TrackHeaderComponent::TrackHeaderComponent(std::shared_ptr<Track> t) : track(t)
             track->automationCurves.push_back(curve);
         }
         
+        if (onTrackChanged) onTrackChanged();
+        
         // Trigger repaint of timeline (via parent or message)
         // Ideally we should use a listener, but for now we rely on periodic updates or manual refresh
         // MainComponent updates timeline periodically during playback, but we might want immediate feedback.
@@ -78,21 +84,146 @@ void TrackHeaderComponent::mouseDown(const juce::MouseEvent& e)
         juce::PopupMenu m;
         m.addItem(1, "Delete Track");
         
+        if (track->type == TrackType::Midi || track->type == TrackType::Audio)
+            m.addItem(2, track->freeze.frozen ? "Unfreeze Track" : "Freeze Track");
+        
+        // Keeps playing while other tracks are soloed
+        m.addItem("Solo Safe", true, track->mixer->soloSafe.load(), [this] {
+            track->mixer->soloSafe = !track->mixer->soloSafe.load();
+            if (onTrackChanged) onTrackChanged();
+        });
+        
+        // Recording input, mono or stereo pair
+        if (track->type == TrackType::Audio)
+        {
+            juce::PopupMenu inputMenu;
+            auto addInput = [this, &inputMenu](int firstChannel, int numChannels) {
+                auto name = numChannels == 1 ? juce::String(firstChannel + 1)
+                                             : juce::String(firstChannel + 1) + "/" + juce::String(firstChannel + 2);
+                bool ticked = track->inputChannel == firstChannel && track->numInputChannels == numChannels;
+                
+                inputMenu.addItem(name, true, ticked, [this, firstChannel, numChannels] {
+                    track->inputChannel = firstChannel;
+                    track->numInputChannels = numChannels;
+                    if (onTrackChanged) onTrackChanged();
+                });
+            };
+            
+            for (int channel = 0; channel < MultiTrackRecorder::maxInputChannels; channel += 2)
+                addInput(channel, 2);
+            
+            inputMenu.addSeparator();
+            for (int channel = 0; channel < MultiTrackRecorder::maxInputChannels; ++channel)
+                addInput(channel, 1);
+            
+            m.addSubMenu("Input", inputMenu);
+            
+            // Loop recording passes
+            if (!track->takeLanes.empty())
+            {
+                juce::PopupMenu takesMenu;
+                for (int lane = 0; lane < (int)track->takeLanes.size(); ++lane)
+                    takesMenu.addItem("Take " + juce::String(lane + 1), true, lane == track->activeTakeLane,
+                                      [this, lane] { selectTakeLane(lane); });
+                
+                m.addSubMenu("Takes", takesMenu);
+            }
+        }
+        
+        // Automation lanes for plugin parameters
+        juce::PopupMenu automateMenu;
+        auto addParameters = [this, &automateMenu](const std::shared_ptr<PluginSlot>& slot, int insertIndex) {
+            if (!slot || !slot->instance) return;
+            
+            juce::PopupMenu pluginMenu;
+            for (auto* parameter : slot->instance->getParameters())
+            {
+                auto target = insertIndex < 0 ? AutomationTarget::forInstrumentParameter(*parameter)
+                                              : AutomationTarget::forInsertParameter(insertIndex, *parameter);
+                float value = parameter->getValue();
+                
+                pluginMenu.addItem(parameter->getName(64), [this, target, value] { addAutomationCurve(target, value); });
+            }
+            automateMenu.addSubMenu(slot->instance->getName(), pluginMenu);
+        };
+        
+        addParameters(track->instrumentPlugin, -1);
+        for (int i = 0; i < (int)track->insertPlugins.size(); ++i)
+            addParameters(track->insertPlugins[(size_t)i], i);
+        
+        if (automateMenu.getNumItems() > 0)
+            m.addSubMenu("Automate", automateMenu);
+        
         m.showMenuAsync(juce::PopupMenu::Options(), [this](int result) {
             if (result == 1)
             {
                 if (onDeleteTrack) onDeleteTrack(track.get());
             }
+            else if (result == 2)
+            {
+                if (onToggleFreeze) onToggleFreeze(track.get());
+            }
         });
     }
 }
 
+void TrackHeaderComponent::selectTakeLane(int lane)
+{
+    if (lane == track->activeTakeLane) return;
+    
+    // Swap the active lane's clips for the chosen one's
+    if (track->activeTakeLane >= 0 && track->activeTakeLane < (int)track->takeLanes.size())
+    {
+        for (const auto& take : track->takeLanes[(size_t)track->activeTakeLane])
+        {
+            track->clips.erase(std::remove_if(track->clips.begin(), track->clips.end(),
+                                              [&take](const Clip& clip) { return !clip.isMidi && clip.audioFile == take.audioFile; }),
+                               track->clips.end());
+        }
+    }
+    
+    for (const auto& take : track->takeLanes[(size_t)lane])
+        track->clips.push_back(take);
+    
+    track->activeTakeLane = lane;
+    if (onTrackChanged) onTrackChanged();
+}
+
+void TrackHeaderComponent::addAutomationCurve(const juce::String& parameterID, float initialValue)
+{
+    for (auto& curve : track->automationCurves)
+    {
+        if (curve.parameterID == parameterID)
+        {
+            curve.active = true;
+            if (onTrackChanged) onTrackChanged();
+            return;
+        }
+    }
+    
+    // Flat line at the current value; points are edited on the timeline
+    AutomationCurve curve;
+    curve.parameterID = parameterID;
+    curve.active = true;
+    curve.points.push_back({ 0.0, initialValue });
+    curve.points.push_back({ 16.0, initialValue });
+    track->automationCurves.push_back(curve);
+    
+    if (onTrackChanged) onTrackChanged();
+}
+
 void TrackHeaderComponent::setSelected(bool s)
 {
     selected = s;
     repaint();
 }
 
+void TrackHeaderComponent::setFreezing(bool f)
+{
+    freezing = f;
+    repaint();
+}
+
 void TrackHeaderComponent::paint(juce::Graphics& g)
 {
     g.fillAll(juce::Colours::darkgrey.darker(0.1f));
@@ -120,6 +251,22 @@ void TrackHeaderComponent::paint(juce::Graphics& g)
     }
     g.setColour(typeColor);
     g.fillRect(0, 0, 5, getHeight());
+    
+    // Frozen tracks play a bounce, their plugins are suspended
+    if (track->freeze.frozen)
+    {
+        g.setColour(juce::Colours::lightblue.withAlpha(0.15f));
+        g.fillRect(getLocalBounds().withTrimmedLeft(5));
+    }
+    
+    // Being frozen: its plugins are busy with the bounce, so the track is silent meanwhile
+    if (freezing)
+    {
+        g.setColour(juce::Colours::lightblue.withAlpha(0.3f));
+        g.fillRect(getLocalBounds().withTrimmedLeft(5));
+        g.setColour(juce::Colours::white);
+        g.drawText("Freezing...", getLocalBounds().withTrimmedLeft(8).removeFromBottom(16), juce::Justification::centredLeft);
+    }
 }
 
 void TrackHeaderComponent::resized()
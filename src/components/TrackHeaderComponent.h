@@ -14,15 +14,22 @@ public:
     void mouseDown(const juce::MouseEvent& e) override;
     
     void setSelected(bool selected);
+    void setFreezing(bool freezing); // Silent until its bounce is ready
     std::function<void()> onSelect;
     std::function<void(Track*)> onPluginButtonClicked;
     std::function<void(Track*)> onDeleteTrack;
+    std::function<void(Track*)> onToggleFreeze;
+    std::function<void()> onTrackChanged;
 
 
 
 private:
+    void addAutomationCurve(const juce::String& parameterID, float initialValue);
+    void selectTakeLane(int lane);
+    
     std::shared_ptr<Track> track;
     bool selected = false;
+    bool freezing = false;
     
     juce::Label nameLabel;
     juce::TextButton muteButton{ "M" };
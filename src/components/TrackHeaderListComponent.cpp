@@ -71,6 +71,7 @@ void TrackHeaderListComponent::updateTrackList()
     for (int i = 0; i < projectState.tracks.size(); ++i)
     {
         auto* header = new TrackHeaderComponent(projectState.tracks[i]);
+        header->setFreezing(audioEngine.isFreezing(*projectState.tracks[i]));
         header->onPluginButtonClicked = [this](Track* t) {
             audioEngine.openPluginWindow(t);
         };
@@ -81,6 +82,7 @@ void TrackHeaderListComponent::updateTrackList()
                 headers[j]->setSelected(j == i);
         };
         header->setSelected(i == projectState.selectedTrackIndex);
+        header->onTrackChanged = [this] { projectState.markDirty(); };
         
         header->onDeleteTrack = [this](Track* t) {
             // Find index
@@ -101,6 +103,34 @@ void TrackHeaderListComponent::updateTrackList()
                 if (onTrackListChanged) onTrackListChanged();
             }
         };
+        
+        header->onToggleFreeze = [this, i](Track* t) {
+            if (t->freeze.frozen)
+            {
+                audioEngine.unfreezeTrack(t);
+                repaint();
+                return;
+            }
+            
+            juce::Component::SafePointer<TrackHeaderListComponent> safeThis(this);
+            juce::String error;
+            bool started = audioEngine.freezeTrack(t, nullptr, [safeThis](const OfflineRenderResult& result) {
+                if (safeThis != nullptr)
+                {
+                    for (auto* h : safeThis->headers)
+                        h->setFreezing(false);
+                    safeThis->repaint();
+                }
+                
+                if (result.error.isNotEmpty())
+                    juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "Freeze Track", result.error);
+            }, error);
+            
+            if (!started)
+                juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "Freeze Track", error);
+            else
+                headers[i]->setFreezing(true);
+        };
         headers.add(header);
         addAndMakeVisible(header);
     }
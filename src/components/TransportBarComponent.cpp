@@ -36,18 +36,21 @@ TransportBarComponent::TransportBarComponent(ProjectState& state) : projectState
     addAndMakeVisible(metronomeButton);
     metronomeButton.setClickingTogglesState(true);
     metronomeButton.setToggleState(projectState.metronomeEnabled, juce::dontSendNotification);
-    metronomeButton.onClick = [this] { projectState.metronomeEnabled = metronomeButton.getToggleState(); };
+    metronomeButton.onClick = [this] { projectState.metronomeEnabled = metronomeButton.getToggleState(); projectState.markDirty(); };
     
     addAndMakeVisible(loopButton);
     loopButton.setClickingTogglesState(true);
     loopButton.setToggleState(projectState.isLooping, juce::dontSendNotification);
-    loopButton.onClick = [this] { projectState.isLooping = loopButton.getToggleState(); };
+    loopButton.onClick = [this] { projectState.isLooping = loopButton.getToggleState(); projectState.markDirty(); };
     
     tempoLabel.setText("Tempo:", juce::dontSendNotification);
     
+    addAndMakeVisible(statusLabel);
+    statusLabel.setJustificationType(juce::Justification::centredRight);
+    
     tempoSlider.setRange(20.0, 300.0, 1.0);
     tempoSlider.setValue(projectState.tempo, juce::dontSendNotification);
-    tempoSlider.onValueChange = [this] { projectState.tempo = tempoSlider.getValue(); };
+    tempoSlider.onValueChange = [this] { projectState.tempo = tempoSlider.getValue(); projectState.markDirty(); };
 }
 
 void TransportBarComponent::paint(juce::Graphics& g)
@@ -86,4 +89,7 @@ void TransportBarComponent::resized()
     area.removeFromLeft(20);
     tempoLabel.setBounds(area.removeFromLeft(50));
     tempoSlider.setBounds(area.removeFromLeft(150));
+    
+    area.removeFromLeft(20);
+    statusLabel.setBounds(area);
 }
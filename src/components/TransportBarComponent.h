@@ -24,6 +24,7 @@ public:
 
     void setMixerButtonState(bool state) { mixerButton.setToggleState(state, juce::dontSendNotification); }
     void setEditorButtonState(bool state) { editorButton.setToggleState(state, juce::dontSendNotification); }
+    void setStatusText(const juce::String& text) { statusLabel.setText(text, juce::dontSendNotification); }
 
 private:
     ProjectState& projectState;
@@ -41,6 +42,7 @@ private:
     juce::TextButton loopButton{ "Loop" };
     juce::Label tempoLabel;
     juce::Slider tempoSlider;
+    juce::Label statusLabel; // Background work, e.g. plugins loading
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TransportBarComponent)
 };
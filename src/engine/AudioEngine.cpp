@@ -1,101 +1,188 @@
 #include "AudioEngine.h"
+#include "MixKernels.h"
+#include "RealtimeAllocationGuard.h"
+#include "TrackFreeze.h"
 #include "../components/PluginWindow.h"
 
 AudioEngine::AudioEngine(ProjectState& state) : projectState(state)
 {
-    mainProcessor = std::make_unique<juce::AudioProcessorGraph>();
     formatManager.registerBasicFormats();
-    pluginFormatManager.addFormat(new juce::VST3PluginFormat());
-    backgroundThread.startThread();
+    PluginScanner::addFormats(pluginFormatManager);
     loadPluginSearchPaths();
+    
+    if (auto xml = juce::parseXML(knownPluginListFile))
+        knownPluginList.recreateFromXml(*xml);
+    
+    peakCache.setCacheDirectory(juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+                                    .getChildFile("AiceCube").getChildFile("Peaks"));
+    
+    // Waveforms grow while recording
+    recorder.onFileStarted = [this](const juce::File& file) { return &peakCache.startRecording(file); };
+    recorder.onFileFinished = [this](const juce::File& file) { peakCache.finishRecording(file); };
+    
+    pluginSandbox.onProblem = [this](const juce::String& message) { if (onError) onError(message); };
+    
+    setNumRenderThreads(juce::jlimit(0, 8, juce::SystemStats::getNumCpus() - 1));
+    
+    updateMetronomeClicks();
+    publishSnapshot();
+    startTimer(20);
 }
 
 AudioEngine::~AudioEngine()
 {
-    mainProcessor = nullptr;
-    backgroundThread.stopThread(1000);
+    stopTimer();
+    pendingRender.reset();
+    cancelRender();
+    offlineRenderThread.reset();
+    
+    // Plugins may outlive the engine (they belong to the project)
+    for (const auto& track : projectState.tracks)
+    {
+        if (track->instrumentPlugin && track->instrumentPlugin->instance)
+            track->instrumentPlugin->instance->removeListener(this);
+        
+        for (const auto& slot : track->insertPlugins)
+            if (slot && slot->instance)
+                slot->instance->removeListener(this);
+    }
+    
+    recorder.stop();
+    renderWorkers.setNumWorkers(0);
 }
 
 void AudioEngine::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
     currentSampleRate = sampleRate;
     currentBlockSize = samplesPerBlock;
+    recorder.prepare(sampleRate);
+    updateMetronomeClicks();
     
-    mainProcessor->setPlayConfigDetails(2, 2, sampleRate, samplesPerBlock);
-    mainProcessor->prepareToPlay(sampleRate, samplesPerBlock);
-    
-    updateGraph();
-    
-    // Prepare all track plugins
+    // Prepare all track plugins (suspended ones are prepared when their track unfreezes)
     for (const auto& track : projectState.tracks)
-    {
-        if (track->instrumentPlugin && track->instrumentPlugin->instance)
-            track->instrumentPlugin->instance->prepareToPlay(sampleRate, samplesPerBlock);
-            
-        for (const auto& slot : track->insertPlugins)
-            if (slot && slot->instance)
-                slot->instance->prepareToPlay(sampleRate, samplesPerBlock);
-    }
+        for (auto* plugin : TrackFreeze::getPlugins(*track))
+            if (suspendedPlugins.count(plugin) == 0)
+                plugin->prepareToPlay(sampleRate, samplesPerBlock);
+    
+    // Re-size every track's scratch buffers for the new block size
+    publishSnapshot();
 }
 
 
 
 void AudioEngine::releaseResources()
 {
-    mainProcessor->releaseResources();
-    fileReaders.clear();
 }
 
 void AudioEngine::processAudio(const juce::AudioSourceChannelInfo& bufferToFill, juce::MidiBuffer& midiMessages)
 {
-    const juce::ScopedLock sl(processLock);
+    // An offline render owns the plugins meanwhile (it only starts once we have left)
+    liveCallbacksInFlight.fetch_add(1);
+    
+    if (offlineRenderActive.load())
+        bufferToFill.clearActiveBufferRegion();
+    else
+        renderLive(bufferToFill, midiMessages);
+    
+    liveCallbacksInFlight.fetch_sub(1);
+}
+
+void AudioEngine::renderLive(const juce::AudioSourceChannelInfo& bufferToFill, juce::MidiBuffer& midiMessages)
+{
+    const RealtimeAllocationGuard::ScopedRealtimeSection realtimeSection;
+    
+    // Wait-free: pins the current snapshot for the duration of this callback
+    SnapshotExchange<RenderSnapshot>::ScopedRead snapshot(snapshots);
+
+    // Capture input for recording (and pre-roll) before the buffer is rendered into
+    recorder.process(*bufferToFill.buffer, bufferToFill.startSample, bufferToFill.numSamples);
 
-    // Capture Input for Recording
-    if (isRecording && !trackRecorders.empty())
+    bufferToFill.clearActiveBufferRegion();
+    
+    if (snapshot.get() == nullptr || snapshot->maxBlockSize <= 0) return;
+    const auto& project = *snapshot.get();
+    
+    // Scratch buffers hold at most maxBlockSize samples, so split larger device blocks
+    for (int offset = 0; offset < bufferToFill.numSamples; offset += project.maxBlockSize)
     {
-        for (auto& pair : trackRecorders)
-        {
-            auto* writer = pair.second.get();
-            if (writer)
-            {
-                writer->write(bufferToFill.buffer->getArrayOfReadPointers(), bufferToFill.numSamples);
-            }
-        }
+        juce::AudioSourceChannelInfo chunk(bufferToFill.buffer,
+                                           bufferToFill.startSample + offset,
+                                           std::min(project.maxBlockSize, bufferToFill.numSamples - offset));
+        renderChunk(project, chunk, midiMessages, offset);
     }
+}
 
-    bufferToFill.clearActiveBufferRegion();
+void AudioEngine::renderChunk(const RenderSnapshot& project, const juce::AudioSourceChannelInfo& bufferToFill, juce::MidiBuffer& midiMessages, int midiSampleOffset)
+{
+    TempoMap::Cursor tempo(project.tempoMap, currentSampleRate);
+    
+    // The message thread may seek while we render; only advance the playhead if it didn't
+    double blockStartBeat = projectState.playheadBeat.load();
+    double playheadBeat = blockStartBeat;
     
-    double samplesPerBeat = (60.0 / projectState.tempo) * currentSampleRate;
+    const auto& meter = project.tempoMap.getMeterAt(playheadBeat);
+    Metronome::Settings click { project.metronomeClicks.get(), &project.tempoMap, meter.numerator, meter.denominator,
+                                project.metronomeLevel, project.metronomeOutputChannel };
     
     if (projectState.isPlaying)
     {
         int samplesRemaining = bufferToFill.numSamples;
         int currentSampleOffset = 0;
         
+        // Recording from a stopped transport counts in first, in the meter and tempo at the playhead
+        const double countInSamplesPerBeat = tempo.getSamplesPerBeatAt(playheadBeat);
+        if (!wasPlaying && project.countInBars > 0 && recorder.isRecording())
+            countInRemaining = (juce::int64)std::llround(project.countInBars * meter.getBeatsPerBar() * countInSamplesPerBeat);
+        
+        // A seek: the message thread primes the clips around the new playhead (see updateStreamCues)
+        if (wasPlaying && blockStartBeat != renderedPlayheadBeat)
+            playheadMoved.store(true);
+        wasPlaying = true;
+        
+        if (countInRemaining > 0)
+        {
+            // The playhead waits meanwhile; the count-in ends on beat 0 of its own grid
+            const int numCountIn = (int)std::min<juce::int64>(countInRemaining, samplesRemaining);
+            juce::AudioSourceChannelInfo countInInfo(bufferToFill.buffer, bufferToFill.startSample, numCountIn);
+            
+            auto countInClick = click;
+            countInClick.tempoMap = nullptr;
+            
+            renderSegment(project, countInInfo, midiMessages, midiSampleOffset, playheadBeat, countInSamplesPerBeat, false);
+            metronome.render(countInClick, *bufferToFill.buffer, bufferToFill.startSample, numCountIn,
+                             -countInRemaining / countInSamplesPerBeat, countInSamplesPerBeat, true);
+            
+            countInRemaining -= numCountIn;
+            currentSampleOffset += numCountIn;
+            samplesRemaining -= numCountIn;
+        }
+        
         int loopCount = 0;
         
-        while (samplesRemaining > 0 && loopCount++ < 5)
+        while (samplesRemaining > 0 && loopCount++ < 16)
         {
-            double currentStartBeat = projectState.playheadBeat;
-            int samplesToProcess = samplesRemaining;
+            double currentStartBeat = playheadBeat;
             
-            if (projectState.isLooping)
+            // Less than a sample short of the loop end counts as there, so the wrap always happens
+            // (the loop end rarely falls on a whole sample, least of all after a tempo ramp)
+            if (project.isLooping && tempo.beatToSample(project.loopEnd) - tempo.beatToSample(currentStartBeat) < 1.0)
             {
-                if (currentStartBeat >= projectState.loopEnd)
-                {
-                    projectState.playheadBeat = projectState.loopStart;
-                    currentStartBeat = projectState.loopStart;
-                }
+                playheadBeat = project.loopStart;
+                currentStartBeat = project.loopStart;
+                recorder.markLoopWrap(midiSampleOffset + currentSampleOffset);
+            }
+            
+            // Tempo jumps and the ends of ramps split the block, so each segment has one samplesPerBeat
+            const double startSample = tempo.beatToSample(currentStartBeat);
+            int samplesToProcess = tempo.getSamplesToNextChange(startSample, samplesRemaining);
+            
+            if (project.isLooping && currentStartBeat < project.loopEnd)
+            {
+                int samplesToLoopEnd = (int)(tempo.beatToSample(project.loopEnd) - startSample);
                 
-                if (currentStartBeat < projectState.loopEnd)
+                if (samplesToLoopEnd < samplesToProcess)
                 {
-                    double beatsToLoopEnd = projectState.loopEnd - currentStartBeat;
-                    int samplesToLoopEnd = (int)(beatsToLoopEnd * samplesPerBeat);
-                    
-                    if (samplesToLoopEnd < samplesRemaining)
-                    {
-                        samplesToProcess = samplesToLoopEnd;
-                    }
+                    samplesToProcess = samplesToLoopEnd;
                 }
             }
             
@@ -105,428 +192,1295 @@ void AudioEngine::processAudio(const juce::AudioSourceChannelInfo& bufferToFill,
                                                          bufferToFill.startSample + currentSampleOffset, 
                                                          samplesToProcess);
                 
-                renderSegment(segmentInfo, midiMessages, currentSampleOffset, currentStartBeat, samplesPerBeat, true);
+                const double endBeat = tempo.sampleToBeat(startSample + samplesToProcess);
+                const double samplesPerBeat = samplesToProcess / (endBeat - currentStartBeat);
+                
+                renderSegment(project, segmentInfo, midiMessages, midiSampleOffset + currentSampleOffset, currentStartBeat, samplesPerBeat, true);
+                recorder.markTimelinePosition(midiSampleOffset + currentSampleOffset, currentStartBeat);
                 
-                // Play Metronome for this segment (After rendering tracks)
-                playMetronome(segmentInfo, currentStartBeat, samplesPerBeat);
+                // Clicks go on top of the mix; tails keep ringing when it's switched off
+                metronome.render(click, *bufferToFill.buffer, segmentInfo.startSample, samplesToProcess,
+                                 currentStartBeat, samplesPerBeat, project.metronomeEnabled);
                 
                 currentSampleOffset += samplesToProcess;
                 samplesRemaining -= samplesToProcess;
-                projectState.playheadBeat += samplesToProcess / samplesPerBeat;
+                playheadBeat = endBeat;
             }
             else
             {
                 break;
             }
         }
+        
+        // If it fails, the seek is picked up at the start of the next block
+        if (projectState.playheadBeat.compare_exchange_strong(blockStartBeat, playheadBeat))
+            renderedPlayheadBeat = playheadBeat;
     }
     else
     {
-        juce::MidiBuffer emptyMidi;
-        renderSegment(bufferToFill, emptyMidi, 0, projectState.playheadBeat, samplesPerBeat, false);
+        wasPlaying = false;
+        countInRemaining = 0;
+        renderedPlayheadBeat = blockStartBeat;
+        
+        const double samplesPerBeat = tempo.getSamplesPerBeatAt(playheadBeat);
+        renderSegment(project, bufferToFill, midiMessages, midiSampleOffset, playheadBeat, samplesPerBeat, false);
+        metronome.render(click, *bufferToFill.buffer, bufferToFill.startSample, bufferToFill.numSamples,
+                         playheadBeat, samplesPerBeat, false);
     }
-    
-    // mainProcessor->processBlock(*bufferToFill.buffer, midiMessages);
 }
 
-void AudioEngine::renderSegment(const juce::AudioSourceChannelInfo& bufferToFill, juce::MidiBuffer& midiMessages, int globalSampleOffset, double startBeat, double samplesPerBeat, bool generateMidi)
+// Fader, pan and mute changes are spread over this long, which is enough to avoid clicks
+static constexpr double mixerSmoothingSeconds = 0.02;
+
+// Position in a clip's file at 'beat' (at least its start): audio plays at a fixed rate, whatever the tempo does
+static juce::int64 getClipSampleOffset(const TempoMap& tempoMap, const RenderClip& clip, double beat, double sampleRate)
+{
+    const double secondsIntoClip = juce::jmax(0.0, tempoMap.beatToSeconds(beat) - tempoMap.beatToSeconds(clip.startBeat));
+    return (juce::int64)((clip.sourceOffset + secondsIntoClip) * sampleRate);
+}
+
+static void processPlugin(juce::AudioPluginInstance& plugin, juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midi)
 {
-    double endBeat = startBeat + (bufferToFill.numSamples / samplesPerBeat);
+    // Third-party code is outside our allocation checks
+    const RealtimeAllocationGuard::ScopedAllowAllocations allowAllocations;
+    plugin.processBlock(buffer, midi);
+}
+
+// Adds the first numSignalChannels of 'signal' to 'dest' with a gain ramp. With a pan, the
+// first two channels go through the constant-power pan law (mono signals feed both sides);
+// otherwise channels map one to one, mono to all.
+static void mixInto(juce::AudioBuffer<float>& dest, int destStartSample, const juce::AudioBuffer<float>& signal,
+                    int numSignalChannels, int numSamples, float startGain, float endGain,
+                    const MixKernels::PanGains* panStart = nullptr, const MixKernels::PanGains* panEnd = nullptr)
+{
+    if (startGain == 0.0f && endGain == 0.0f) return;
     
-    // 0. Prepare Bus Buffers
-    for (const auto& track : projectState.tracks)
+    const auto& kernels = MixKernels::get();
+    int firstUnpannedChannel = 0;
+    
+    if (panStart != nullptr && dest.getNumChannels() >= 2)
     {
-        if (track->type == TrackType::Bus)
+        float* left = dest.getWritePointer(0, destStartSample);
+        float* right = dest.getWritePointer(1, destStartSample);
+        const float leftStart = startGain * panStart->left, leftEnd = endGain * panEnd->left;
+        const float rightStart = startGain * panStart->right, rightEnd = endGain * panEnd->right;
+        
+        if (numSignalChannels == 1)
+        {
+            kernels.addMonoPanned(left, right, signal.getReadPointer(0), numSamples, leftStart, leftEnd, rightStart, rightEnd);
+        }
+        else
         {
-            auto& busBuf = busBuffers[track->id];
-            busBuf.setSize(2, bufferToFill.numSamples, false, false, true);
-            busBuf.clear();
+            kernels.addWithRamp(left, signal.getReadPointer(0), numSamples, leftStart, leftEnd);
+            kernels.addWithRamp(right, signal.getReadPointer(1), numSamples, rightStart, rightEnd);
         }
+        
+        firstUnpannedChannel = 2;
     }
     
-    // 1. Process Audio/Midi Tracks
-    for (const auto& track : projectState.tracks)
+    for (int ch = firstUnpannedChannel; ch < dest.getNumChannels(); ++ch)
+    {
+        int sourceCh = numSignalChannels == 1 ? 0 : ch;
+        if (sourceCh >= numSignalChannels) continue;
+        
+        float* destData = dest.getWritePointer(ch, destStartSample);
+        const float* sourceData = signal.getReadPointer(sourceCh);
+        
+        if (startGain == 1.0f && endGain == 1.0f)
+            kernels.add(destData, sourceData, numSamples);
+        else
+            kernels.addWithRamp(destData, sourceData, numSamples, startGain, endGain);
+    }
+}
+
+//==============================================================================
+// One task per track, wired up by the snapshot's compiled routing graph.
+class AudioEngine::SegmentGraph : public RenderWorkerPool::TaskGraph
+{
+public:
+    SegmentGraph(AudioEngine& e, const SegmentContext& c) : engine(e), context(c) {}
+
+    int getNumTasks() const override { return (int)context.snapshot.tracks.size(); }
+    int getNumDependencies(int task) const override { return (int)node(task).inputs.size(); }
+    int getNumDependents(int task) const override { return (int)node(task).dependents.size(); }
+    int getDependent(int task, int index) const override { return node(task).dependents[(size_t)index]; }
+    void performTask(int task) override { engine.renderTrack(context, task); }
+
+private:
+    const RoutingGraph::Node& node(int index) const { return context.snapshot.routing->nodes[(size_t)index]; }
+
+    AudioEngine& engine;
+    const SegmentContext& context;
+};
+
+void AudioEngine::renderSegment(const RenderSnapshot& snapshot, const juce::AudioSourceChannelInfo& bufferToFill, juce::MidiBuffer& midiMessages, int globalSampleOffset, double startBeat, double samplesPerBeat, bool generateMidi)
+{
+    // Nothing in here may allocate: all scratch storage lives in each track's TrackRenderState,
+    // sized on the message thread, and setSize(..., avoidReallocating = true) only shrinks views.
+    SegmentContext context { snapshot, bufferToFill.numSamples, startBeat,
+                             startBeat + (bufferToFill.numSamples / samplesPerBeat),
+                             samplesPerBeat, generateMidi };
+    
+    const auto& routing = *snapshot.routing;
+    const int numSamples = context.numSamples;
+    
+    // 1. Render every track into its own buffer, in parallel where the routing allows
+    if (bufferToFill.numSamples >= minParallelBlockSize.load())
     {
-        if (track->mute) continue;
-        if (track->type == TrackType::Bus) continue;
+        SegmentGraph graph(*this, context);
+        renderWorkers.run(graph);
+    }
+    else
+    {
+        for (int index : routing.order)
+            renderTrack(context, index);
+    }
+    
+    // 2. Mix to Main (serially, in track order)
+    for (size_t i = 0; i < snapshot.tracks.size(); ++i)
+    {
+        const auto& track = snapshot.tracks[i];
+        auto& state = *track.renderState;
+        auto& trackBuffer = state.buffer;
+        
+        // Tracks routed through the master track were already summed into it
+        if (!routing.nodes[i].feedsMainOutput) continue;
         
-        // Apply Automation
-        for (const auto& curve : track->automationCurves)
+        // Delay compensated tracks keep feeding their delay line (silence while muted)
+        const auto* signal = &trackBuffer;
+        if (track.outputDelay > 0)
         {
-            if (!curve.active || curve.points.empty()) continue;
-            
-            float value = 0.0f;
-            auto it = std::lower_bound(curve.points.begin(), curve.points.end(), startBeat, 
-                [](const AutomationPoint& p, double b) { return p.time < b; });
-            
-            if (it == curve.points.begin()) value = it->value;
-            else if (it == curve.points.end()) value = curve.points.back().value;
-            else
-            {
-                auto& p2 = *it;
-                auto& p1 = *(it - 1);
-                double t = (startBeat - p1.time) / (p2.time - p1.time);
-                value = p1.value + (p2.value - p1.value) * (float)t;
-            }
-            
-            if (curve.parameterID == "Volume") track->volume = value;
-            else if (curve.parameterID == "Pan") track->pan = value;
+            state.outputDelay.process(trackBuffer, state.delayBuffer, numSamples, track.outputDelay);
+            signal = &state.delayBuffer;
+        }
+        
+        if (state.silent) continue;
+        
+        mixInto(*bufferToFill.buffer, bufferToFill.startSample, *signal, trackBuffer.getNumChannels(), numSamples,
+                state.gainRampStart, state.outputGain, &state.panRampStart, &state.panGains);
+    }
+    
+    // 3. Sequenced MIDI out (muted tracks only contribute the note-offs of notes they cut)
+    for (const auto& track : snapshot.tracks)
+        midiMessages.addEvents(track.renderState->outgoingMidi, 0, numSamples, globalSampleOffset);
+}
+
+void AudioEngine::renderTrack(const SegmentContext& context, int trackIndex)
+{
+    const auto& snapshot = context.snapshot;
+    const auto& track = snapshot.tracks[(size_t)trackIndex];
+    const int numSamples = context.numSamples;
+    const double startBeat = context.startBeat;
+    const double endBeat = context.endBeat;
+    const double samplesPerBeat = context.samplesPerBeat;
+    
+    auto& state = *track.renderState;
+    if (!state.rendered.load(std::memory_order_relaxed))
+        state.takeOverPlayback();
+    
+    auto& trackBuffer = state.buffer;
+    auto& trackMidi = state.midi;
+    trackBuffer.setSize(track.numChannels, numSamples, false, false, true);
+    trackBuffer.clear();
+    trackMidi.clear();
+    state.outgoingMidi.clear();
+    
+    // Mixer parameters are read once per block and smoothed per sample, mute included
+    const auto& mixer = *track.mixer;
+    const bool audible = track.ignoreMute || !(mixer.mute.load() || track.soloSilenced);
+    
+    if (state.smoothingSampleRate != currentSampleRate)
+    {
+        state.smoothingSampleRate = currentSampleRate;
+        state.volumeSmoother.reset(currentSampleRate, mixerSmoothingSeconds);
+        state.panSmoother.reset(currentSampleRate, mixerSmoothingSeconds);
+        state.audibleSmoother.reset(currentSampleRate, mixerSmoothingSeconds);
+        state.volumeSmoother.setCurrentAndTargetValue(mixer.volume.load());
+        state.panSmoother.setCurrentAndTargetValue(mixer.pan.load());
+        state.audibleSmoother.setCurrentAndTargetValue(audible ? 1.0f : 0.0f);
+    }
+    
+    state.audibleSmoother.setTargetValue(audible ? 1.0f : 0.0f);
+    state.audibleRampStart = state.audibleSmoother.getCurrentValue();
+    state.audible = state.audibleSmoother.skip(numSamples);
+    state.silent = state.audibleRampStart == 0.0f && state.audible == 0.0f;
+    
+    if (state.silent)
+    {
+        // Let the instrument hear the note-offs before the track goes quiet
+        if (state.midiCursor.stop(trackMidi, state.outgoingMidi) && track.instrument)
+        {
+            processPlugin(*track.instrument, trackBuffer, trackMidi);
+            trackBuffer.clear();
         }
+        return;
+    }
+    
+    // Buses and master: sum their (already rendered) sources
+    const auto& inputs = snapshot.routing->nodes[(size_t)trackIndex].inputs;
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        const auto& input = inputs[i];
+        const auto& source = snapshot.tracks[(size_t)input.sourceIndex];
+        const auto& sourceState = *source.renderState;
         
-        // Determine required channels based on plugin requirements
-        int maxChannels = 2;
-        if (track->type == TrackType::Midi && track->instrumentPlugin && track->instrumentPlugin->instance)
+        // Inputs with less plugin latency than the slowest one are delayed to line up with it
+        // (fed even while the source is muted, so unmuting doesn't replay old audio)
+        const auto* signal = &sourceState.buffer;
+        if (track.inputDelays[i] > 0)
         {
-            auto* instance = track->instrumentPlugin->instance.get();
-            int ins = instance->getTotalNumInputChannels();
-            int outs = instance->getTotalNumOutputChannels();
-            maxChannels = std::max(ins, outs);
-            if (maxChannels < 2) maxChannels = 2; // Ensure at least stereo for safety
+            state.inputDelays[i].process(sourceState.buffer, state.delayBuffer, numSamples, track.inputDelays[i]);
+            signal = &state.delayBuffer;
         }
         
-        // Allocate buffer with sufficient channels for the plugin
-        juce::AudioBuffer<float> trackBuffer(maxChannels, bufferToFill.numSamples);
-        trackBuffer.clear();
-        juce::MidiBuffer trackMidi;
+        if (sourceState.silent) continue;
+        
+        // Sends tap the source pre-fader (but after mute), the master feed post-fader and post-pan
+        if (input.sendIndex >= 0)
+        {
+            float amount = source.sendAmounts[(size_t)input.sendIndex];
+            mixInto(trackBuffer, 0, *signal, sourceState.buffer.getNumChannels(), numSamples,
+                    amount * sourceState.audibleRampStart, amount * sourceState.audible);
+        }
+        else
+        {
+            mixInto(trackBuffer, 0, *signal, sourceState.buffer.getNumChannels(), numSamples,
+                    sourceState.gainRampStart, sourceState.outputGain, &sourceState.panRampStart, &sourceState.panGains);
+        }
+    }
+    
+    // Apply Automation
+    // Fader and pan moves are smoothed; automation lanes replace them and are evaluated at
+    // both ends of the block, so either way the gains come out as per-sample ramps.
+    // Plugin parameters are set once per block, before the plugin runs.
+    state.volumeSmoother.setTargetValue(mixer.volume.load());
+    state.panSmoother.setTargetValue(mixer.pan.load());
+    float volumeStart = state.volumeSmoother.getCurrentValue();
+    float volumeEnd = state.volumeSmoother.skip(numSamples);
+    float panStart = state.panSmoother.getCurrentValue();
+    float panEnd = state.panSmoother.skip(numSamples);
+    
+    for (size_t i = 0; i < track.automation.size(); ++i)
+    {
+        const auto& lane = track.automation[i];
+        auto& cursor = state.automationCursors[i];
         
-        // Generate Audio/MIDI
-        if (track->type == TrackType::Audio)
+        switch (lane.target)
+        {
+            case AutomationLane::Target::Volume:
+                volumeStart = cursor.getValueAt(lane.points, startBeat);
+                volumeEnd = cursor.getValueAt(lane.points, endBeat);
+                break;
+                
+            case AutomationLane::Target::Pan:
+                panStart = cursor.getValueAt(lane.points, startBeat);
+                panEnd = cursor.getValueAt(lane.points, endBeat);
+                break;
+                
+            case AutomationLane::Target::PluginParameter:
+            {
+                float value = cursor.getValueAt(lane.points, startBeat);
+                if (value != lane.parameter->getValue())
+                    lane.parameter->setValue(value);
+                break;
+            }
+        }
+    }
+    
+    state.gainRampStart = volumeStart * state.audibleRampStart;
+    state.outputGain = volumeEnd * state.audible;
+    state.panRampStart = MixKernels::constantPowerPan(panStart);
+    state.panGains = MixKernels::constantPowerPan(panEnd);
+    
+    // Generate Audio/MIDI
+    if (track.type == TrackType::Audio)
+    {
+        if (context.generateMidi)
         {
-            if (generateMidi)
+            for (const auto& clip : track.clips)
             {
-                for (const auto& clip : track->clips)
+                if (clip.isMidi) continue;
+                
+                if (clip.getEndBeat() > startBeat && clip.startBeat < endBeat)
                 {
-                    if (clip.isMidi) continue;
+                    double clipStartInBlockBeats = clip.startBeat - startBeat;
+                    int startSampleInBlock = 0;
+                    int numSamplesToCopy = numSamples;
+                    const auto fileReadStartSample = getClipSampleOffset(snapshot.tempoMap, clip, startBeat, currentSampleRate);
+                    
+                    if (clipStartInBlockBeats > 0)
+                    {
+                        startSampleInBlock = (int)(clipStartInBlockBeats * samplesPerBeat);
+                        numSamplesToCopy -= startSampleInBlock;
+                    }
                     
-                    if (clip.getEndBeat() > startBeat && clip.startBeat < endBeat)
+                    double clipEndInBlockBeats = clip.getEndBeat() - startBeat;
+                    int endSampleInBlock = (int)(clipEndInBlockBeats * samplesPerBeat);
+                    if (endSampleInBlock < numSamples)
                     {
-                        double clipStartInBlockBeats = clip.startBeat - startBeat;
-                        int startSampleInBlock = 0;
-                        int numSamplesToCopy = bufferToFill.numSamples;
-                        int fileReadStartSample = 0;
+                        numSamplesToCopy = std::min(numSamplesToCopy, endSampleInBlock - startSampleInBlock);
+                    }
+                    
+                    if (numSamplesToCopy <= 0) continue;
+                    
+                    if (clip.stream)
+                    {
+                        auto& clipBuffer = state.clipBuffer;
+                        clipBuffer.setSize(2, numSamplesToCopy, false, false, true);
+                        clip.stream->read(clipBuffer, numSamplesToCopy, fileReadStartSample);
                         
-                        if (clipStartInBlockBeats > 0)
-                        {
-                            startSampleInBlock = (int)(clipStartInBlockBeats * samplesPerBeat);
-                            numSamplesToCopy -= startSampleInBlock;
-                        }
-                        else
-                        {
-                            fileReadStartSample = (int)((startBeat - clip.startBeat) * samplesPerBeat);
-                        }
+                        // Equal-power fades (lengths in beats), then clip gain while summing
+                        const auto& kernels = MixKernels::get();
+                        const double beatInClip = startBeat + startSampleInBlock / samplesPerBeat - clip.startBeat;
+                        const double beatsToEnd = clip.lengthBeats - beatInClip;
+                        const double segmentBeats = numSamplesToCopy / samplesPerBeat;
                         
-                        double clipEndInBlockBeats = clip.getEndBeat() - startBeat;
-                        int endSampleInBlock = (int)(clipEndInBlockBeats * samplesPerBeat);
-                        if (endSampleInBlock < bufferToFill.numSamples)
+                        for (int ch = 0; ch < clipBuffer.getNumChannels(); ++ch)
                         {
-                            numSamplesToCopy = std::min(numSamplesToCopy, endSampleInBlock - startSampleInBlock);
+                            if (clip.fadeIn > 0.0 && beatInClip < clip.fadeIn)
+                                kernels.applyFade(clipBuffer.getWritePointer(ch), numSamplesToCopy,
+                                                  (float)(beatInClip / clip.fadeIn), (float)(1.0 / (clip.fadeIn * samplesPerBeat)));
+                            
+                            if (clip.fadeOut > 0.0 && beatsToEnd - segmentBeats < clip.fadeOut)
+                                kernels.applyFade(clipBuffer.getWritePointer(ch), numSamplesToCopy,
+                                                  (float)(beatsToEnd / clip.fadeOut), (float)(-1.0 / (clip.fadeOut * samplesPerBeat)));
                         }
                         
-                        if (numSamplesToCopy <= 0) continue;
-                        
-                        auto* reader = getReaderFor(clip.audioFile);
-                        if (reader)
+                        for (int ch = 0; ch < std::min(trackBuffer.getNumChannels(), clipBuffer.getNumChannels()); ++ch)
                         {
-                            juce::AudioBuffer<float> clipBuffer(2, numSamplesToCopy);
-                            reader->read(&clipBuffer, 0, numSamplesToCopy, fileReadStartSample, true, true);
-                            
-                            for (int ch = 0; ch < std::min(trackBuffer.getNumChannels(), clipBuffer.getNumChannels()); ++ch)
-                            {
-                                trackBuffer.addFrom(ch, startSampleInBlock, clipBuffer, ch, 0, numSamplesToCopy, 1.0f);
-                            }
+                            kernels.addWithRamp(trackBuffer.getWritePointer(ch, startSampleInBlock), clipBuffer.getReadPointer(ch),
+                                                numSamplesToCopy, clip.gain, clip.gain);
                         }
                     }
                 }
             }
         }
-        else if (track->type == TrackType::Midi)
+    }
+    else if (track.type == TrackType::Midi)
+    {
+        if (context.generateMidi)
+            state.midiCursor.render(track.midiEvents, snapshot.revision, startBeat, endBeat, samplesPerBeat, numSamples, trackMidi, state.outgoingMidi);
+        else
+            state.midiCursor.stop(trackMidi, state.outgoingMidi);
+        
+        if (track.instrument)
+        {
+            processPlugin(*track.instrument, trackBuffer, trackMidi);
+        }
+    }
+    
+    // Process Inserts
+    for (auto& insert : track.inserts)
+    {
+        // Ensure buffer has enough channels for insert too?
+        // Ideally we should check all plugins in chain and max out channels.
+        // For now, assume inserts work with what instrument provided or stereo.
+        processPlugin(*insert, trackBuffer, trackMidi);
+    }
+}
+
+bool AudioEngine::startRecording(juce::String& error)
+{
+    if (isRecording) return true;
+    
+    recordingStartBeat = projectState.playheadBeat;
+    recordingTracks.clear();
+    
+    auto docDir = juce::File::getSpecialLocation(juce::File::userDocumentsDirectory)
+                  .getChildFile("AiceCube").getChildFile("Recordings");
+    docDir.createDirectory();
+    
+    std::vector<MultiTrackRecorder::Input> inputs;
+    for (auto& track : projectState.tracks)
+    {
+        if (track->type == TrackType::Audio && track->arm)
+        {
+            auto filename = track->name + "_" + juce::Time::getCurrentTime().formatted("%Y%m%d_%H%M%S");
+            
+            MultiTrackRecorder::Input input;
+            input.file = docDir.getNonexistentChildFile(juce::File::createLegalFileName(filename), ".wav", false);
+            input.firstChannel = track->inputChannel;
+            input.numChannels = juce::jlimit(1, 2, track->numInputChannels);
+            
+            inputs.push_back(input);
+            recordingTracks.push_back(track.get());
+        }
+    }
+    
+    if (inputs.empty()) return true;
+    
+    // Pre-roll can't reach before the start of the timeline
+    const auto preRollSamples = (juce::int64)(projectState.createTempoMap().beatToSeconds(recordingStartBeat) * currentSampleRate);
+    const bool loopTakes = projectState.isLooping; // The transport usually starts right after
+    
+    if (!recorder.start(inputs, recordingBitDepth, preRollSamples, loopTakes, error))
+    {
+        recordingTracks.clear();
+        return false;
+    }
+    
+    isRecording = true;
+    return true;
+}
+
+void AudioEngine::setRecordingBitDepth(int bitsPerSample)
+{
+    jassert(bitsPerSample == 24 || bitsPerSample == 32);
+    recordingBitDepth = bitsPerSample == 32 ? 32 : 24; // Applies to the next take
+}
+
+void AudioEngine::stopRecording()
+{
+    if (!isRecording) return;
+    
+    isRecording = false;
+    auto takes = recorder.stop(); // Writes what is still buffered and closes the files
+    
+    // Create Clips, lined up with where the playhead started to move (after any count-in)
+    const auto tempoMap = projectState.createTempoMap();
+    juce::int64 anchorOffset = 0;
+    double anchorBeat = recordingStartBeat;
+    recorder.getTimelineAnchor(anchorOffset, anchorBeat);
+    const double anchorSeconds = tempoMap.beatToSeconds(anchorBeat);
+    
+    for (size_t i = 0; i < recordingTracks.size(); ++i)
+    {
+        Track* track = recordingTracks[i];
+        if (track == nullptr) continue;
+        
+        std::vector<Clip> passes;
+        
+        for (const auto& take : takes)
+        {
+            if (take.inputIndex != (int)i) continue;
+            
+            // Pre-roll and count-in audio stays in the file, but the clip starts where the playhead did
+            const juce::int64 skipped = take.pass == 0 ? juce::jmax<juce::int64>(0, anchorOffset - take.startOffset) : 0;
+            if (skipped >= take.numSamples) continue;
+            
+            Clip newClip;
+            newClip.name = take.file.getFileNameWithoutExtension();
+            const double startSeconds = take.pass == 0 ? anchorSeconds + (take.startOffset + skipped - anchorOffset) / currentSampleRate
+                                                       : tempoMap.beatToSeconds(projectState.loopStart);
+            newClip.startBeat = tempoMap.secondsToBeat(startSeconds);
+            newClip.lengthBeats = tempoMap.secondsToBeat(startSeconds + (take.numSamples - skipped) / currentSampleRate) - newClip.startBeat;
+            newClip.isMidi = false;
+            newClip.audioFile = take.file;
+            newClip.sourceOffset = skipped / currentSampleRate;
+            newClip.trackIndex = 0;
+            passes.push_back(newClip);
+        }
+        
+        if (passes.empty()) continue;
+        
+        // Loop passes replace the previous take lanes and the clip that was playing from them,
+        // the newest one plays
+        if (passes.size() > 1)
+        {
+            for (const auto& lane : track->takeLanes)
+                for (const auto& take : lane)
+                    track->clips.erase(std::remove_if(track->clips.begin(), track->clips.end(),
+                                                      [&take](const Clip& c) { return c.audioFile == take.audioFile; }),
+                                       track->clips.end());
+            
+            track->takeLanes.clear();
+            for (const auto& clip : passes)
+                track->takeLanes.push_back({ clip });
+            track->activeTakeLane = (int)passes.size() - 1;
+        }
+        
+        track->clips.push_back(passes.back());
+    }
+    
+    recordingTracks.clear();
+    projectState.markDirty();
+}
+
+void AudioEngine::updateCapturedInputs()
+{
+    juce::BigInteger channels;
+    
+    for (const auto& track : projectState.tracks)
+    {
+        if (track->type != TrackType::Audio || !track->arm) continue;
+        
+        for (int c = 0; c < juce::jlimit(1, 2, track->numInputChannels); ++c)
+            if (track->inputChannel + c < MultiTrackRecorder::maxInputChannels)
+                channels.setBit(track->inputChannel + c);
+    }
+    
+    recorder.setCapturedInputs(channels);
+}
+
+//==============================================================================
+class AudioEngine::OfflineRenderThread : public juce::Thread
+{
+public:
+    OfflineRenderThread(AudioEngine& e, std::unique_ptr<RenderSnapshot> s, OfflineRenderJob j)
+        : juce::Thread("Offline Render"), engine(e), snapshot(std::move(s)), job(std::move(j))
+    {
+    }
+
+    ~OfflineRenderThread() override { stopThread(10000); }
+
+    void run() override
+    {
+        result = render();
+        job.writer.reset(); // Removes the partial file unless finished
+    }
+    
+    // Message thread, once the thread has exited: back to realtime settings before the
+    // audio callback gets the plugins back
+    void restorePlugins()
+    {
+        for (size_t i = 0; i < snapshot->tracks.size(); ++i)
+        {
+            const auto& track = snapshot->tracks[i];
+            if (job.trackIndex >= 0 && (int)i != job.trackIndex) continue;
+            
+            if (track.instrument) restorePlugin(*track.instrument);
+            for (const auto& insert : track.inserts)
+                if (insert) restorePlugin(*insert);
+        }
+    }
+    
+    void notifyFinished()
+    {
+        if (job.onFinished)
+            job.onFinished(result);
+    }
+
+private:
+    OfflineRenderResult render()
+    {
+        OfflineRenderResult result;
+        result.file = job.file;
+        
+        const double sampleRate = engine.currentSampleRate;
+        TempoMap::Cursor tempo(snapshot->tempoMap, sampleRate);
+        const double firstSample = tempo.beatToSample(job.startBeat);
+        const int blockSize = snapshot->maxBlockSize;
+        const auto numSamples = (juce::int64)std::ceil(tempo.beatToSample(job.endBeat) - firstSample + job.tailSeconds * sampleRate);
+        
+        // Delay compensation delays the whole mix by the slowest chain (a single track by its
+        // own chain): render that much longer and drop the start, so the file lines up with the timeline
+        juce::int64 numToSkip = job.trackIndex >= 0 ? snapshot->tracks[(size_t)job.trackIndex].latencySamples
+                                                    : snapshot->outputLatencySamples;
+        
+        juce::AudioBuffer<float> buffer(2, blockSize);
+        juce::MidiBuffer midi;
+        juce::int64 numRendered = 0, numWritten = 0;
+        double lastReported = 0.0;
+        const double startTime = juce::Time::getMillisecondCounterHiRes();
+        
+        while (numWritten < numSamples)
         {
-            if (generateMidi)
+            if (threadShouldExit())
             {
-                for (const auto& clip : track->clips)
+                result.cancelled = true;
+                return result;
+            }
+            
+            buffer.clear();
+            midi.clear();
+            
+            // Tempo changes split the block, as they do live
+            for (int offset = 0; offset < blockSize;)
+            {
+                const double startSample = firstSample + (double)(numRendered + offset);
+                const int count = tempo.getSamplesToNextChange(startSample, blockSize - offset);
+                const double startBeat = tempo.sampleToBeat(startSample);
+                const double samplesPerBeat = count / (tempo.sampleToBeat(startSample + count) - startBeat);
+                
+                if (job.trackIndex >= 0)
                 {
-                    if (!clip.isMidi) continue;
-                    
-                    auto& seq = clip.midiSequence;
-                    for (int i = 0; i < seq.getNumEvents(); ++i)
-                    {
-                        auto* event = seq.getEventPointer(i);
-                        double eventAbsBeat = clip.startBeat + event->message.getTimeStamp();
-                        
-                        if (eventAbsBeat >= startBeat && eventAbsBeat < endBeat)
-                        {
-                            int sampleOffset = (int)((eventAbsBeat - startBeat) * samplesPerBeat);
-                            if (sampleOffset >= 0 && sampleOffset < bufferToFill.numSamples)
-                            {
-                                trackMidi.addEvent(event->message, sampleOffset);
-                                midiMessages.addEvent(event->message, globalSampleOffset + sampleOffset);
-                            }
-                        }
-                    }
+                    renderTrack(buffer, offset, count, startBeat, samplesPerBeat);
+                }
+                else
+                {
+                    const juce::AudioSourceChannelInfo info(&buffer, offset, count);
+                    engine.renderSegment(*snapshot, info, midi, offset, startBeat, samplesPerBeat, true);
                 }
+                
+                offset += count;
             }
+            numRendered += blockSize;
+            
+            const int skip = (int)std::min<juce::int64>(numToSkip, blockSize);
+            const int numToWrite = (int)std::min<juce::int64>(blockSize - skip, numSamples - numWritten);
+            numToSkip -= skip;
             
-            if (track->instrumentPlugin && track->instrumentPlugin->instance && !track->instrumentPlugin->bypassed)
+            if (!job.writer->write(buffer, skip, numToWrite))
             {
-                track->instrumentPlugin->instance->processBlock(trackBuffer, trackMidi);
+                result.error = "Error writing " + job.file.getFullPathName();
+                return result;
             }
+            
+            numWritten += numToWrite;
+            
+            const double progress = (double)numWritten / (double)numSamples;
+            if (job.onProgress && progress - lastReported >= 0.01)
+            {
+                job.onProgress(progress);
+                lastReported = progress;
+            }
+        }
+        
+        if (!job.writer->finish())
+        {
+            result.error = "Can't move the render to " + job.file.getFullPathName();
+            return result;
         }
         
-        // Process Inserts
-        for (auto& slot : track->insertPlugins)
+        result.completed = true;
+        result.audioSeconds = (double)numSamples / sampleRate;
+        result.renderSeconds = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+        return result;
+    }
+    
+    // The track's own output, before fader, pan and sends (stereo, mono is duplicated)
+    void renderTrack(juce::AudioBuffer<float>& buffer, int startSample, int numSamples, double startBeat, double samplesPerBeat)
+    {
+        const SegmentContext context { *snapshot, numSamples, startBeat, startBeat + numSamples / samplesPerBeat,
+                                       samplesPerBeat, true };
+        engine.renderTrack(context, job.trackIndex);
+        
+        const auto& trackBuffer = snapshot->tracks[(size_t)job.trackIndex].renderState->buffer;
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+            buffer.copyFrom(ch, startSample, trackBuffer, std::min(ch, trackBuffer.getNumChannels() - 1), 0, numSamples);
+    }
+    
+    void restorePlugin(juce::AudioPluginInstance& plugin)
+    {
+        plugin.setNonRealtime(false);
+        plugin.prepareToPlay(engine.currentSampleRate, engine.currentBlockSize);
+    }
+
+    AudioEngine& engine;
+    std::unique_ptr<RenderSnapshot> snapshot;
+    OfflineRenderJob job;
+    OfflineRenderResult result;
+};
+
+bool AudioEngine::startRender(const OfflineRenderSettings& settings, std::function<void(double progress)> onProgress,
+                              std::function<void(const OfflineRenderResult&)> onFinished, juce::String& error)
+{
+    if (isRendering())
+    {
+        error = "A render is already running";
+        return false;
+    }
+    
+    if (isRecording)
+    {
+        error = "Can't render while recording";
+        return false;
+    }
+    
+    double startBeat = settings.startBeat, endBeat = settings.endBeat;
+    if (settings.range == OfflineRenderSettings::Range::Song)
+    {
+        startBeat = 0.0;
+        endBeat = getSongEndBeat();
+    }
+    else if (settings.range == OfflineRenderSettings::Range::Loop)
+    {
+        startBeat = projectState.loopStart;
+        endBeat = projectState.loopEnd;
+    }
+    
+    if (endBeat <= startBeat)
+    {
+        error = "Nothing to render";
+        return false;
+    }
+    
+    OfflineRenderJob job;
+    job.writer = OfflineRenderWriter::create(settings, currentSampleRate, 2, error);
+    if (job.writer == nullptr)
+        return false;
+    
+    job.file = settings.file;
+    job.startBeat = startBeat;
+    job.endBeat = endBeat;
+    job.tailSeconds = settings.tailSeconds;
+    job.onProgress = std::move(onProgress);
+    job.onFinished = std::move(onFinished);
+    
+    beginOfflineRender(std::move(job));
+    return true;
+}
+
+void AudioEngine::beginOfflineRender(OfflineRenderJob job)
+{
+    if (job.trackId.isNull())
+    {
+        // Take plugins and render state away from the audio callback
+        offlineRenderActive = true;
+    }
+    else
+    {
+        // A freeze only needs its own track: live snapshots leave that track's chain out
+        freezingTrackId = job.trackId;
+        publishSnapshot();
+    }
+    
+    pendingRender = std::make_unique<OfflineRenderJob>(std::move(job));
+    startPendingRender();
+}
+
+void AudioEngine::startPendingRender()
+{
+    // Plugins get bigger blocks offline: fewer calls, better throughput
+    constexpr int offlineBlockSize = 2048;
+    
+    if (pendingRender->trackId.isNull())
+    {
+        // From now on the audio callback only clears its buffer, so it's out again within
+        // microseconds. Until it is, the timer tries again instead of blocking this thread.
+        if (liveCallbacksInFlight.load() != 0) return;
+    }
+    else
+    {
+        // Once no snapshot that still processes the frozen track's chain can be in use
+        snapshots.collectGarbage();
+        if (snapshots.getNumPendingReclamations() != 0) return;
+    }
+    
+    auto job = std::move(*pendingRender);
+    pendingRender.reset();
+    
+    if (!job.trackId.isNull())
+    {
+        for (size_t i = 0; i < projectState.tracks.size(); ++i)
+            if (projectState.tracks[i]->id == job.trackId)
+                job.trackIndex = (int)i;
+        
+        if (job.trackIndex < 0)
+        {
+            freezingTrackId = juce::Uuid::null();
+            job.writer.reset();
+            
+            OfflineRenderResult result;
+            result.file = job.file;
+            result.error = "The track was deleted";
+            if (job.onFinished)
+                job.onFinished(result);
+            return;
+        }
+    }
+    
+    // Frozen tracks render from their bounce, their plugins stay suspended
+    for (size_t i = 0; i < projectState.tracks.size(); ++i)
+    {
+        const auto& track = *projectState.tracks[i];
+        if (track.freeze.frozen || (job.trackIndex >= 0 && (int)i != job.trackIndex)) continue;
+        
+        for (auto* plugin : TrackFreeze::getPlugins(track))
+        {
+            plugin->setNonRealtime(true);
+            plugin->prepareToPlay(currentSampleRate, offlineBlockSize);
+            plugin->reset();
+        }
+    }
+    
+    // A private snapshot (fresh render state, high quality streams that wait for the disk)
+    auto snapshot = RenderSnapshot::createFrom(projectState, nullptr, offlineBlockSize);
+    
+    if (job.trackIndex >= 0)
+    {
+        // Only the frozen track plays: no streams for the others, and mute doesn't apply
+        for (size_t i = 0; i < snapshot->tracks.size(); ++i)
+            if ((int)i != job.trackIndex)
+                snapshot->tracks[i].clips.clear();
+        
+        snapshot->tracks[(size_t)job.trackIndex].ignoreMute = true;
+    }
+    
+    openStreams(*snapshot, "offline|", ResamplingQuality::High, true);
+    
+    for (const auto& track : snapshot->tracks)
+    {
+        for (const auto& clip : track.clips)
+        {
+            if (!clip.stream) continue;
+            
+            clip.stream->setBlocking(true);
+            bool inside = job.startBeat > clip.startBeat && job.startBeat < clip.getEndBeat();
+            clip.stream->setCue(getClipSampleOffset(snapshot->tempoMap, clip, inside ? job.startBeat : clip.startBeat, currentSampleRate));
+        }
+    }
+    
+    offlineRenderThread = std::make_unique<OfflineRenderThread>(*this, std::move(snapshot), std::move(job));
+    offlineRenderThread->startThread();
+}
+
+void AudioEngine::finishOfflineRender()
+{
+    auto thread = std::move(offlineRenderThread);
+    thread->restorePlugins();
+    offlineRenderActive = false;
+    
+    // The frozen track gets its chain back, or plays the bounce (see applyFinishedFreezes)
+    if (!freezingTrackId.isNull())
+    {
+        freezingTrackId = juce::Uuid::null();
+        projectState.markDirty();
+    }
+    
+    // Last, so onFinished may start the next render
+    thread->notifyFinished();
+}
+
+void AudioEngine::cancelRender()
+{
+    if (pendingRender != nullptr)
+    {
+        // Never started: the plugins are untouched
+        auto job = std::move(pendingRender);
+        offlineRenderActive = false;
+        job->writer.reset();
+        
+        if (!freezingTrackId.isNull())
+        {
+            freezingTrackId = juce::Uuid::null();
+            projectState.markDirty();
+        }
+        
+        OfflineRenderResult result;
+        result.file = job->file;
+        result.cancelled = true;
+        if (job->onFinished)
+            job->onFinished(result);
+    }
+    else if (offlineRenderThread != nullptr)
+    {
+        offlineRenderThread->signalThreadShouldExit();
+    }
+}
+
+double AudioEngine::getSongEndBeat() const
+{
+    double end = 0.0;
+    for (const auto& track : projectState.tracks)
+        for (const auto& clip : track->clips)
+            end = std::max(end, clip.getEndBeat());
+    
+    return end;
+}
+
+//==============================================================================
+bool AudioEngine::freezeTrack(Track* track, std::function<void(double progress)> onProgress,
+                              std::function<void(const OfflineRenderResult&)> onFinished, juce::String& error)
+{
+    int trackIndex = -1;
+    for (size_t i = 0; i < projectState.tracks.size(); ++i)
+        if (projectState.tracks[i].get() == track)
+            trackIndex = (int)i;
+    
+    if (trackIndex < 0 || !TrackFreeze::canFreeze(*track))
+    {
+        error = "Only MIDI and audio tracks can be frozen";
+        return false;
+    }
+    
+    if (track->freeze.frozen)
+    {
+        error = "The track is already frozen";
+        return false;
+    }
+    
+    if (isRendering())
+    {
+        error = "A render is already running";
+        return false;
+    }
+    
+    if (isRecording)
+    {
+        error = "Can't freeze while recording";
+        return false;
+    }
+    
+    double endBeat = 0.0;
+    for (const auto& clip : track->clips)
+        endBeat = std::max(endBeat, clip.getEndBeat());
+    
+    if (endBeat <= 0.0)
+    {
+        error = "Nothing to freeze";
+        return false;
+    }
+    
+    // Float WAV: the bounce is an intermediate, so no dither and no clipping
+    OfflineRenderSettings settings;
+    settings.file = TrackFreeze::createCacheFile(*track);
+    settings.format = OfflineRenderSettings::Format::Wav;
+    settings.bitDepth = 32;
+    settings.dither = false;
+    
+    OfflineRenderJob job;
+    job.writer = OfflineRenderWriter::create(settings, currentSampleRate, 2, error);
+    if (job.writer == nullptr)
+        return false;
+    
+    // Two seconds of tail for reverbs and releases past the last clip
+    constexpr double tailSeconds = 2.0;
+    const auto tempoMap = projectState.createTempoMap();
+    const double lengthBeats = tempoMap.secondsToBeat(tempoMap.beatToSeconds(endBeat) + tailSeconds);
+    
+    job.file = settings.file;
+    job.endBeat = endBeat;
+    job.tailSeconds = tailSeconds;
+    job.trackId = track->id;
+    job.onProgress = std::move(onProgress);
+    
+    // Applied by the timer: the track may have changed (or gone) by the time the render ends
+    job.onFinished = [this, trackId = track->id, lengthBeats, signature = TrackFreeze::createSignature(*track, tempoMap),
+                      onFinished = std::move(onFinished)](const OfflineRenderResult& result) {
+        const juce::ScopedLock sl(finishedFreezesLock);
+        finishedFreezes.push_back({ trackId, result, lengthBeats, signature, onFinished });
+    };
+    
+    beginOfflineRender(std::move(job));
+    return true;
+}
+
+void AudioEngine::unfreezeTrack(Track* track)
+{
+    if (track == nullptr || !track->freeze.frozen) return;
+    
+    thawTrack(*track);
+    projectState.markDirty();
+    publishSnapshot();
+}
+
+void AudioEngine::thawTrack(Track& track)
+{
+    if (!track.freeze.frozen) return;
+    
+    // Plugins are ready again before the first snapshot that uses them goes out.
+    // They kept their state while suspended, so nothing is reloaded.
+    for (auto* plugin : TrackFreeze::getPlugins(track))
+        if (suspendedPlugins.erase(plugin) > 0)
+            plugin->prepareToPlay(currentSampleRate, currentBlockSize);
+    
+    pendingSuspensions.erase(std::remove(pendingSuspensions.begin(), pendingSuspensions.end(), track.id), pendingSuspensions.end());
+    
+    // An offline render may still be streaming it (a bounce is never reused, so it's safe to go)
+    track.freeze.file.deleteFile();
+    track.freeze = {};
+}
+
+Track* AudioEngine::findTrack(const juce::Uuid& id) const
+{
+    for (const auto& track : projectState.tracks)
+        if (track->id == id)
+            return track.get();
+    
+    return nullptr;
+}
+
+void AudioEngine::applyFinishedFreezes()
+{
+    std::vector<FinishedFreeze> finished;
+    {
+        const juce::ScopedLock sl(finishedFreezesLock);
+        finished.swap(finishedFreezes);
+    }
+    
+    for (auto& freeze : finished)
+    {
+        auto& result = freeze.result;
+        auto* track = findTrack(freeze.trackId);
+        
+        if (result.completed && (track == nullptr || track->freeze.frozen
+                                 || TrackFreeze::createSignature(*track, projectState.createTempoMap()) != freeze.signature))
         {
-            if (slot && slot->instance && !slot->bypassed)
-            {
-                // Ensure buffer has enough channels for insert too?
-                // Ideally we should check all plugins in chain and max out channels.
-                // For now, assume inserts work with what instrument provided or stereo.
-                slot->instance->processBlock(trackBuffer, trackMidi);
-            }
+            result.completed = false;
+            result.error = "The track changed while it was being frozen";
         }
         
-        // Process Sends
-        for (const auto& send : track->sends)
+        if (result.completed)
         {
-            if (send.active && send.amount > 0.0f)
-            {
-                if (busBuffers.count(send.targetTrackId))
-                {
-                    auto& busBuf = busBuffers[send.targetTrackId];
-                    for (int ch = 0; ch < std::min(trackBuffer.getNumChannels(), busBuf.getNumChannels()); ++ch)
-                    {
-                        busBuf.addFrom(ch, 0, trackBuffer, ch, 0, trackBuffer.getNumSamples(), send.amount);
-                    }
-                }
-            }
+            track->freeze.frozen = true;
+            track->freeze.file = result.file;
+            track->freeze.lengthBeats = freeze.lengthBeats;
+            track->freeze.signature = freeze.signature;
+            track->freeze.pluginStateHash = TrackFreeze::createPluginStateHash(*track);
+            
+            projectState.markDirty();
+            publishSnapshot(); // Also queues the plugins for suspension
         }
-        
-        // Mix to Main
-        for (int ch = 0; ch < bufferToFill.buffer->getNumChannels(); ++ch)
+        else
         {
-            // If track is mono, mix to both L and R (or pan)
-            // If track is stereo, mix L->L, R->R
-            // If track has more channels, we usually just take first 2 for main mix
-            
-            int sourceCh = ch;
-            if (trackBuffer.getNumChannels() == 1) sourceCh = 0;
-            
-            if (sourceCh < trackBuffer.getNumChannels())
-            {
-                bufferToFill.buffer->addFrom(ch, bufferToFill.startSample, trackBuffer, sourceCh, 0, trackBuffer.getNumSamples(), track->volume);
-            }
+            result.file.deleteFile();
         }
+        
+        if (freeze.onFinished)
+            freeze.onFinished(result);
     }
+}
+
+void AudioEngine::suspendFrozenPlugins()
+{
+    if (pendingSuspensions.empty() || isRendering()) return;
     
-    // 2. Process Bus Tracks
-    for (const auto& track : projectState.tracks)
+    // Only once no snapshot that still processes the plugins can be in use
+    snapshots.collectGarbage();
+    if (publishedRevision != projectState.getRevision() || snapshots.getNumPendingReclamations() != 0) return;
+    
+    for (const auto& id : pendingSuspensions)
     {
-        if (track->mute) continue;
-        if (track->type != TrackType::Bus) continue;
+        auto* track = findTrack(id);
+        if (track == nullptr || !track->freeze.frozen) continue;
         
-        if (busBuffers.count(track->id))
-        {
-            auto& busBuf = busBuffers[track->id];
-            juce::MidiBuffer busMidi;
-            
-            // Process Inserts
-            for (auto& slot : track->insertPlugins)
-            {
-                if (slot && slot->instance && !slot->bypassed)
-                {
-                    slot->instance->processBlock(busBuf, busMidi);
-                }
-            }
-            
-            // Mix Bus to Main
-            for (int ch = 0; ch < bufferToFill.buffer->getNumChannels(); ++ch)
-            {
-                bufferToFill.buffer->addFrom(ch, bufferToFill.startSample, busBuf, ch, 0, busBuf.getNumSamples(), track->volume);
-            }
-        }
+        for (auto* plugin : TrackFreeze::getPlugins(*track))
+            if (suspendedPlugins.insert(plugin).second)
+                plugin->releaseResources();
     }
+    
+    pendingSuspensions.clear();
 }
 
-void AudioEngine::startRecording()
+bool AudioEngine::invalidateFreezes(bool checkPluginState)
 {
-    if (isRecording) return;
-    
-    recordingStartBeat = projectState.playheadBeat;
-    trackRecorders.clear();
-    recordingFiles.clear();
-    
-    auto docDir = juce::File::getSpecialLocation(juce::File::userDocumentsDirectory)
-                  .getChildFile("AiceCube").getChildFile("Recordings");
-    docDir.createDirectory();
+    bool changed = false;
+    const auto tempoMap = projectState.createTempoMap();
     
-    for (auto& track : projectState.tracks)
+    for (const auto& track : projectState.tracks)
     {
-        if (track->type == TrackType::Audio && track->arm)
+        auto& freeze = track->freeze;
+        if (!freeze.frozen) continue;
+        
+        if (!freeze.file.existsAsFile() || TrackFreeze::createSignature(*track, tempoMap) != freeze.signature
+            || (checkPluginState && !TrackFreeze::hasUnloadedPlugins(*track)
+                && TrackFreeze::createPluginStateHash(*track) != freeze.pluginStateHash))
         {
-            auto filename = track->name + "_" + juce::Time::getCurrentTime().formatted("%Y%m%d_%H%M%S") + ".wav";
-            auto file = docDir.getChildFile(filename);
-            recordingFiles[track.get()] = file;
-            
-            if (auto fileStream = std::unique_ptr<juce::FileOutputStream>(file.createOutputStream()))
-            {
-                juce::WavAudioFormat wavFormat;
-                if (auto writer = wavFormat.createWriterFor(fileStream.get(), currentSampleRate, 2, 16, {}, 0))
-                {
-                    fileStream.release(); // Writer takes ownership
-                    
-                    trackRecorders[track.get()] = std::make_unique<juce::AudioFormatWriter::ThreadedWriter>(
-                        writer, backgroundThread, 32768);
-                }
-            }
+            thawTrack(*track);
+            changed = true;
+            continue;
         }
+        
+        // Just frozen, or frozen when loaded: suspend the plugins once the audio thread is done with them
+        bool suspended = true;
+        for (auto* plugin : TrackFreeze::getPlugins(*track))
+            suspended = suspended && suspendedPlugins.count(plugin) > 0;
+        
+        if (!suspended && std::find(pendingSuspensions.begin(), pendingSuspensions.end(), track->id) == pendingSuspensions.end())
+            pendingSuspensions.push_back(track->id);
     }
     
-    if (!trackRecorders.empty())
-    {
-        isRecording = true;
-    }
+    return changed;
 }
 
-void AudioEngine::stopRecording()
+void AudioEngine::setResamplingQuality(ResamplingQuality quality)
 {
-    if (!isRecording) return;
+    resamplingQuality = quality;
+    publishSnapshot(); // Reopens foreign-rate streams with the new quality
+}
+
+void AudioEngine::setResampleCacheEnabled(bool shouldBeEnabled)
+{
+    auto directory = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+                         .getChildFile("AiceCube").getChildFile("ResampleCache");
+    diskStreamer.setResampleCacheDirectory(shouldBeEnabled ? directory : juce::File());
+}
+
+void AudioEngine::setNumRenderThreads(int numThreads)
+{
+    renderWorkers.setNumWorkers(numThreads);
+}
+
+void AudioEngine::publishSnapshot()
+{
+    // Stale bounces are dropped before the snapshot is built, so it never plays one
+    if (invalidateFreezes(false))
+        projectState.markDirty();
     
-    isRecording = false;
-    trackRecorders.clear(); // Flushes and closes writers
+    const auto* previous = snapshots.getLatest();
+    auto snapshot = RenderSnapshot::createFrom(projectState, previous, currentBlockSize, freezingTrackId);
+    
+    // Told once per routing change, not on every snapshot
+    const bool routingChanged = previous == nullptr || previous->routing != snapshot->routing;
+    if (routingChanged && snapshot->routing->numRejectedSends > 0 && onError)
+        onError("Ignored " + juce::String(snapshot->routing->numRejectedSends) + " send(s) that would create a feedback loop");
     
-    // Create Clips
-    double endBeat = projectState.playheadBeat;
-    double length = endBeat - recordingStartBeat;
+    // Streams are opened on the disk streamer's threads, the snapshot gets those that are ready
+    openStreams(*snapshot, {}, resamplingQuality, false);
+    updateStreamCues(*snapshot);
     
-    if (length > 0)
+    // What the project plays is the last the RAM cache should drop
+    std::vector<juce::File> usedFiles;
+    for (const auto& track : snapshot->tracks)
+        for (const auto& clip : track.clips)
+            if (!clip.isMidi)
+                usedFiles.push_back(clip.audioFile);
+    diskStreamer.getFileCache().markUsed(usedFiles);
+    
+    snapshot->metronomeClicks = metronomeClicks; // Only live snapshots click
+    
+    publishedRevision = snapshot->revision;
+    outputLatency = snapshot->outputLatencySamples;
+    snapshots.publish(std::move(snapshot));
+    diskStreamer.removeUnusedStreams();
+}
+
+void AudioEngine::openStreams(RenderSnapshot& snapshot, const juce::String& keyPrefix, ResamplingQuality quality, bool offline)
+{
+    // Keyed by track and the n-th use of a file on it, so moving a clip keeps its stream.
+    // Offline renders wait for streams that are still opening (see ClipStream::setBlocking),
+    // live snapshots go without them and are rebuilt once they're ready (see timerCallback).
+    for (auto& track : snapshot.tracks)
     {
-        for (auto& pair : recordingFiles)
+        std::map<juce::String, int> fileUses;
+        
+        for (auto& clip : track.clips)
         {
-            Track* track = pair.first;
-            juce::File file = pair.second;
-            
-            Clip newClip;
-            newClip.name = file.getFileNameWithoutExtension();
-            newClip.startBeat = recordingStartBeat;
-            newClip.lengthBeats = length;
-            newClip.isMidi = false;
-            newClip.audioFile = file;
-            newClip.trackIndex = 0;
+            if (clip.isMidi) continue;
             
-            track->clips.push_back(newClip);
+            auto path = clip.audioFile.getFullPathName();
+            auto key = keyPrefix + track.id.toString() + "|" + path + "|" + juce::String(fileUses[path]++);
+            auto stream = diskStreamer.getStream(key, clip.audioFile, currentSampleRate, quality);
+            if (stream != nullptr && (offline || stream->isReady()))
+                clip.stream = std::move(stream);
         }
     }
-    
-    recordingFiles.clear();
 }
 
-juce::AudioFormatReader* AudioEngine::getReaderFor(const juce::File& file)
+void AudioEngine::updateStreamCues(const RenderSnapshot& snapshot)
 {
-    if (file == juce::File()) return nullptr;
+    // Prepare every clip for the next jump the transport will make: back to the loop start
+    // while looping, to the playhead while stopped. A seek while playing has just happened:
+    // the clips around the new playhead are primed to shorten the gap until their rings
+    // have caught up. Plain playback needs no cue.
+    double cueBeat;
+    if (!projectState.isPlaying || playheadMoved.exchange(false))
+        cueBeat = projectState.playheadBeat.load();
+    else if (snapshot.isLooping)
+        cueBeat = snapshot.loopStart;
+    else
+        return;
     
-    auto path = file.getFullPathName();
-    if (fileReaders.find(path) == fileReaders.end())
+    for (const auto& track : snapshot.tracks)
     {
-        auto* reader = formatManager.createReaderFor(file);
-        if (reader)
+        for (const auto& clip : track.clips)
         {
-            fileReaders[path].reset(reader);
-        }
-        else
-        {
-            return nullptr;
+            if (!clip.stream) continue;
+            
+            // A cue outside the clip means it will be entered from its start
+            bool inside = cueBeat > clip.startBeat && cueBeat < clip.getEndBeat();
+            clip.stream->setCue(getClipSampleOffset(snapshot.tempoMap, clip, inside ? cueBeat : clip.startBeat, currentSampleRate));
         }
     }
-    return fileReaders[path].get();
 }
 
-void AudioEngine::updateGraph()
+void AudioEngine::audioProcessorChanged(juce::AudioProcessor*, const ChangeDetails& details)
 {
-    mainProcessor->clear();
+    // May be called on any thread, including the audio thread
+    if (details.latencyChanged)
+        latencyChanged = true;
     
-    using AudioGraphIOProcessor = juce::AudioProcessorGraph::AudioGraphIOProcessor;
-    
-    audioInputNode = mainProcessor->addNode(std::make_unique<AudioGraphIOProcessor>(AudioGraphIOProcessor::audioInputNode));
-    audioOutputNode = mainProcessor->addNode(std::make_unique<AudioGraphIOProcessor>(AudioGraphIOProcessor::audioOutputNode));
-    midiInputNode = mainProcessor->addNode(std::make_unique<AudioGraphIOProcessor>(AudioGraphIOProcessor::midiInputNode));
-    midiOutputNode = mainProcessor->addNode(std::make_unique<AudioGraphIOProcessor>(AudioGraphIOProcessor::midiOutputNode));
+    // E.g. sandboxed plugins, whose host pushed a new state
+    if (details.nonParameterStateChanged)
+        pluginStateChanged = true;
 }
 
-void AudioEngine::scanPlugins()
+void AudioEngine::timerCallback()
 {
-    pluginFormatManager.addFormat(new juce::VST3PluginFormat());
+    if (pendingRender != nullptr)
+        startPendingRender();
+    else if (offlineRenderThread != nullptr && !offlineRenderThread->isThreadRunning())
+        finishOfflineRender();
     
-    juce::File appDir = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory);
-    knownPluginListFile = appDir.getChildFile("AiceCube").getChildFile("known_plugins.xml");
+    applyFinishedFreezes();
+    
+    // Parameter changes on a frozen track's plugins (e.g. from its editor) are only
+    // checked here, hashing plugin state is too slow for every snapshot
+    if (pluginStateChanged.exchange(false) && invalidateFreezes(true))
+        projectState.markDirty();
     
-    if (knownPluginListFile.exists())
+    if (latencyChanged.exchange(false) || projectState.getRevision() != publishedRevision || diskStreamer.takeOpenedStreams())
     {
-        auto xml = juce::parseXML(knownPluginListFile);
-        if (xml)
-            knownPluginList.recreateFromXml(*xml);
+        publishSnapshot();
     }
-    
-    juce::FileSearchPath searchPath;
-    // searchPath.add(juce::File("C:\\Program Files\\Common Files\\VST3"));
-    for (const auto& path : pluginSearchPaths)
-        searchPath.add(path);
-    
-    juce::AudioPluginFormat* vst3Format = nullptr;
-    for (int i = 0; i < pluginFormatManager.getNumFormats(); ++i)
+    else
     {
-        if (pluginFormatManager.getFormat(i)->getName() == "VST3")
-        {
-            vst3Format = pluginFormatManager.getFormat(i);
-            break;
-        }
+        snapshots.collectGarbage();
+        diskStreamer.removeUnusedStreams();
+        
+        if (auto* snapshot = snapshots.getLatest())
+            updateStreamCues(*snapshot);
     }
     
-    if (vst3Format)
+    suspendFrozenPlugins();
+    updateCapturedInputs();
+    
+    if (!deferredPlugins.empty())
+        restoreDeferredPlugins();
+    
+    reportPendingErrors();
+}
+
+void AudioEngine::reportError(const juce::String& message)
+{
+    const juce::ScopedLock sl(pendingErrorsLock);
+    pendingErrors.add(message);
+}
+
+void AudioEngine::reportPendingErrors()
+{
+    juce::StringArray errors;
     {
-        pluginScanner.reset(new juce::PluginDirectoryScanner(knownPluginList, *vst3Format, searchPath, true, juce::File()));
-        
-        juce::String pluginName;
-        while (pluginScanner->scanNextFile(true, pluginName))
-        {
-            // Scanning...
-        }
-        pluginScanner = nullptr;
+        const juce::ScopedLock sl(pendingErrorsLock);
+        errors.swapWith(pendingErrors);
     }
     
-    auto xml = knownPluginList.createXml();
-    xml->writeTo(knownPluginListFile);
+    if (onError)
+        for (const auto& error : errors)
+            onError(error);
 }
 
-void AudioEngine::scanPluginsAsync(std::function<void(const juce::String&)> onProgress, std::function<void()> onFinished)
+juce::FileSearchPath AudioEngine::getPluginSearchPath() const
 {
-    // Simple thread for scanning
-    juce::Thread::launch([this, onProgress, onFinished] {
-        juce::FileSearchPath searchPath;
-        for (const auto& path : pluginSearchPaths)
-            searchPath.add(path);
-            
-        juce::AudioPluginFormat* vst3Format = nullptr;
-        for (int i = 0; i < pluginFormatManager.getNumFormats(); ++i) {
-            if (pluginFormatManager.getFormat(i)->getName() == "VST3") {
-                vst3Format = pluginFormatManager.getFormat(i);
-                break;
-            }
-        }
-        
-        if (vst3Format)
-        {
-            juce::PluginDirectoryScanner scanner(knownPluginList, *vst3Format, searchPath, true, juce::File());
-            juce::String pluginName;
-            while (scanner.scanNextFile(true, pluginName))
-            {
-                if (onProgress) juce::MessageManager::callAsync([onProgress, pluginName] { onProgress(pluginName); });
-            }
-        }
-        
-        auto xml = knownPluginList.createXml();
+    juce::FileSearchPath searchPath;
+    for (const auto& path : pluginSearchPaths)
+        searchPath.add(path);
+    
+    return searchPath;
+}
+
+void AudioEngine::pluginScanFinished(const juce::StringArray& failedFiles)
+{
+    // Each file is only probed again once it changes, so this comes up once per file
+    if (!failedFiles.isEmpty() && onError)
+        onError("These plugins crashed or hung while being scanned and were blacklisted:\n"
+                + failedFiles.joinIntoString("\n"));
+    
+    if (auto xml = knownPluginList.createXml())
         xml->writeTo(knownPluginListFile);
-        
-        if (onFinished) juce::MessageManager::callAsync(onFinished);
-    });
+}
+
+void AudioEngine::scanPlugins()
+{
+    pluginScanFinished(pluginScanner.scan(getPluginSearchPath(), {}, nullptr));
+}
+
+void AudioEngine::scanPluginsAsync(std::function<void(const juce::String&)> onProgress, std::function<void()> onFinished)
+{
+    bool started = pluginScanner.startScan(getPluginSearchPath(), {},
+        [onProgress](const juce::String& file) {
+            auto name = juce::File::createFileWithoutCheckingPath(file).getFileName();
+            if (onProgress) juce::MessageManager::callAsync([onProgress, name] { onProgress(name); });
+        },
+        [this, onFinished](const juce::StringArray& failedFiles) {
+            pluginScanFinished(failedFiles);
+            if (onFinished) onFinished();
+        });
+    
+    // Already scanning: that scan covers this one
+    if (!started && onFinished)
+        juce::MessageManager::callAsync(onFinished);
 }
 
 void AudioEngine::addPluginSearchPath(const juce::File& path)
@@ -581,63 +1535,263 @@ void AudioEngine::loadPluginSearchPaths()
     }
 }
 
-std::shared_ptr<juce::AudioPluginInstance> AudioEngine::loadPlugin(const juce::PluginDescription& desc)
+void AudioEngine::addPluginToTrack(Track* track, int slotIndex, const juce::PluginDescription& desc, std::function<void()> onInstalled)
+{
+    loadPluginIntoSlot(track, slotIndex, desc, {}, true, std::move(onInstalled));
+}
+
+void AudioEngine::setInstrumentPlugin(Track* track, const juce::PluginDescription& desc, std::function<void()> onInstalled)
 {
-    juce::String error;
-    auto instance = pluginFormatManager.createPluginInstance(desc, currentSampleRate, currentBlockSize, error);
+    loadPluginIntoSlot(track, -1, desc, {}, true, std::move(onInstalled));
+}
+
+void AudioEngine::setPluginSandboxed(Track* track, int slotIndex, bool sandboxed, std::function<void()> onInstalled)
+{
+    if (track == nullptr || slotIndex >= (int)track->insertPlugins.size()) return;
     
-    if (instance)
-    {
-        return std::shared_ptr<juce::AudioPluginInstance>(instance.release());
-    }
-    return nullptr;
+    auto& slot = slotIndex < 0 ? track->instrumentPlugin : track->insertPlugins[(size_t)slotIndex];
+    if (slot == nullptr || slot->sandboxed == sandboxed) return;
+    
+    slot->sandboxed = sandboxed;
+    projectState.markDirty();
+    if (slot->instance == nullptr) return; // Loads that way when it's restored
+    
+    // The same plugin with the same state: the bounce of a frozen track still holds
+    auto desc = slot->instance->getPluginDescription();
+    slot->instance->getStateInformation(slot->state);
+    closePluginWindow(slot->instance.get());
+    loadPluginIntoSlot(track, slotIndex, desc, slot->state, false, std::move(onInstalled));
 }
 
-void AudioEngine::addPluginToTrack(Track* track, int slotIndex, const juce::PluginDescription& desc)
+// In this process through the plugin loader, or in a plugin host process
+void AudioEngine::loadPluginInstance(const juce::PluginDescription& desc, const juce::MemoryBlock& state, bool sandboxed,
+                                     PluginLoader::Callback onLoaded)
 {
-    auto instance = loadPlugin(desc);
-    if (instance)
+    if (sandboxed)
+        pluginSandbox.load(desc, currentSampleRate, currentBlockSize, state, std::move(onLoaded));
+    else
+        pluginLoader.load(desc, currentSampleRate, currentBlockSize, state, std::move(onLoaded));
+}
+
+void AudioEngine::loadPluginIntoSlot(Track* track, int slotIndex, const juce::PluginDescription& desc, const juce::MemoryBlock& state,
+                                     bool replacesPlugin, std::function<void()> onInstalled)
+{
+    if (track == nullptr) return;
+    
+    // The latest request for a slot wins; one that was overtaken is dropped when it arrives
+    const auto trackId = track->id;
+    const auto key = getPluginSlotKey(*track, slotIndex);
+    const int request = ++pluginLoadRequests[key];
+    
+    // Replaces whatever the project restore would have put there
+    if (deferredPlugins.erase(key) > 0)
     {
-        if (track->insertPlugins.size() <= slotIndex)
-            track->insertPlugins.resize(slotIndex + 1);
+        --pluginRestoreProgress.total;
+        --pluginRestoreProgress.deferred;
+    }
+    
+    // A new plugin runs where the slot's previous one did
+    auto* slot = slotIndex < 0 ? track->instrumentPlugin.get()
+                               : slotIndex < (int)track->insertPlugins.size() ? track->insertPlugins[(size_t)slotIndex].get() : nullptr;
+    
+    loadPluginInstance(desc, state, slot != nullptr && slot->sandboxed,
+        [this, trackId, slotIndex, key, request, desc, replacesPlugin, onInstalled](std::shared_ptr<juce::AudioPluginInstance> instance, const juce::String& error) {
+            auto* target = findTrack(trackId);
+            if (instance == nullptr || target == nullptr || pluginLoadRequests[key] != request)
+            {
+                if (instance == nullptr && onError)
+                    onError("Couldn't load " + desc.name + ": " + error);
+                
+                pluginLoader.release(std::move(instance));
+                return;
+            }
             
-        if (!track->insertPlugins[slotIndex])
-            track->insertPlugins[slotIndex] = std::make_shared<PluginSlot>();
+            auto* plugin = instance.get();
+            if (replacesPlugin)
+                thawTrack(*target); // A different plugin makes the bounce stale
             
-        track->insertPlugins[slotIndex]->instance = instance;
-        track->insertPlugins[slotIndex]->identifier = desc.fileOrIdentifier;
+            installPlugin(*target, slotIndex, std::move(instance), desc.createIdentifierString());
+            if (replacesPlugin)
+                showPluginWindow(plugin);
+            
+            if (onInstalled) onInstalled();
+        });
+}
+
+void AudioEngine::installPlugin(Track& track, int slotIndex, std::shared_ptr<juce::AudioPluginInstance> instance,
+                                const juce::String& identifier)
+{
+    if (slotIndex >= 0 && (int)track.insertPlugins.size() <= slotIndex)
+        track.insertPlugins.resize((size_t)slotIndex + 1);
+    
+    auto& slot = slotIndex < 0 ? track.instrumentPlugin : track.insertPlugins[(size_t)slotIndex];
+    if (!slot)
+        slot = std::make_shared<PluginSlot>();
+    
+    // Prepared by the loader, at the settings of the time
+    if (instance->getSampleRate() != currentSampleRate || instance->getBlockSize() != currentBlockSize)
+        instance->prepareToPlay(currentSampleRate, currentBlockSize);
+    
+    // Latency changes at runtime trigger a new snapshot with recomputed delay compensation
+    instance->addListener(this);
+    
+    auto previous = std::move(slot->instance);
+    slot->instance = std::move(instance);
+    slot->identifier = identifier;
+    
+    // The audio thread switches over at the next snapshot, which is swapped in lock-free.
+    // The old instance goes once the snapshots that still hold it are reclaimed.
+    projectState.markDirty();
+    publishSnapshot();
+    retirePlugin(std::move(previous));
+}
+
+juce::String AudioEngine::getPluginSlotKey(const Track& track, int slotIndex)
+{
+    return track.id.toString() + "/" + juce::String(slotIndex);
+}
+
+//==============================================================================
+void AudioEngine::restorePlugins(bool deferInactive, std::function<void(const PluginRestoreProgress&)> onProgress)
+{
+    pluginRestoreProgress = {};
+    onPluginRestoreProgress = std::move(onProgress);
+    deferredPlugins.clear();
+    
+    for (const auto& track : projectState.tracks)
+    {
+        const bool defer = deferInactive && !isTrackAudible(*track);
         
-        if (currentSampleRate > 0)
-            instance->prepareToPlay(currentSampleRate, currentBlockSize);
+        for (int slotIndex = -1; slotIndex < (int)track->insertPlugins.size(); ++slotIndex)
+        {
+            const auto& slot = slotIndex < 0 ? track->instrumentPlugin : track->insertPlugins[(size_t)slotIndex];
+            if (slot == nullptr || slot->instance != nullptr || slot->identifier.isEmpty()) continue;
+            
+            ++pluginRestoreProgress.total;
             
-        updateGraph();
-        showPluginWindow(instance.get());
+            if (defer)
+            {
+                deferredPlugins[getPluginSlotKey(*track, slotIndex)] = { track->id, slotIndex };
+                ++pluginRestoreProgress.deferred;
+            }
+            else
+            {
+                restorePlugin(*track, slotIndex);
+            }
+        }
     }
+    
+    if (onPluginRestoreProgress)
+        onPluginRestoreProgress(pluginRestoreProgress);
+}
+
+// Tracks whose plugins can't be heard yet: muted, frozen, or MIDI/audio tracks with nothing to
+// play (and not armed). Buses always count, they process whatever is sent to them.
+bool AudioEngine::isTrackAudible(const Track& track)
+{
+    if (track.mixer->mute.load() || track.freeze.frozen) return false;
+    
+    return track.type == TrackType::Bus || track.type == TrackType::Master || track.arm || !track.clips.empty();
 }
 
-void AudioEngine::setInstrumentPlugin(Track* track, const juce::PluginDescription& desc)
+void AudioEngine::restorePlugin(Track& track, int slotIndex)
 {
-    auto instance = loadPlugin(desc);
-    if (instance)
+    const auto& slot = slotIndex < 0 ? track.instrumentPlugin : track.insertPlugins[(size_t)slotIndex];
+    const auto key = getPluginSlotKey(track, slotIndex);
+    const auto trackId = track.id;
+    const int request = ++pluginLoadRequests[key];
+    
+    // Projects from before identifier strings only have the file, which is ambiguous for
+    // shells and bundles with several plugins: the first one in it is taken then
+    auto description = knownPluginList.getTypeForIdentifierString(slot->identifier);
+    if (description == nullptr)
+        description = knownPluginList.getTypeForFile(slot->identifier);
+    
+    if (description == nullptr)
     {
-        if (!track->instrumentPlugin)
-            track->instrumentPlugin = std::make_shared<PluginSlot>();
+        pluginRestoreProgress.problems.add(track.name + ": " + slot->identifier + " isn't installed");
+        ++pluginRestoreProgress.failed;
+        return;
+    }
+    
+    // The saved state goes in while loading, before anything can hear the plugin
+    loadPluginInstance(*description, slot->state, slot->sandboxed,
+        [this, trackId, slotIndex, key, request, identifier = description->createIdentifierString()](std::shared_ptr<juce::AudioPluginInstance> instance, const juce::String& error) {
+            auto* target = findTrack(trackId);
+            if (target == nullptr || pluginLoadRequests[key] != request)
+            {
+                pluginLoader.release(std::move(instance));
+                
+                // Still the same project, but the slot was given another plugin meanwhile
+                if (target != nullptr)
+                {
+                    --pluginRestoreProgress.total;
+                    if (onPluginRestoreProgress)
+                        onPluginRestoreProgress(pluginRestoreProgress);
+                }
+                return;
+            }
             
-        track->instrumentPlugin->instance = instance;
-        track->instrumentPlugin->identifier = desc.fileOrIdentifier;
-        
-        if (currentSampleRate > 0)
-            instance->prepareToPlay(currentSampleRate, currentBlockSize);
+            if (instance != nullptr)
+            {
+                installPlugin(*target, slotIndex, std::move(instance), identifier);
+                ++pluginRestoreProgress.loaded;
+            }
+            else
+            {
+                pluginRestoreProgress.problems.add(target->name + ": " + identifier + ": " + error);
+                ++pluginRestoreProgress.failed;
+            }
             
-        updateGraph();
-        showPluginWindow(instance.get());
+            if (onPluginRestoreProgress)
+                onPluginRestoreProgress(pluginRestoreProgress);
+        });
+}
+
+void AudioEngine::restoreDeferredPlugins()
+{
+    bool restored = false;
+    
+    for (auto it = deferredPlugins.begin(); it != deferredPlugins.end();)
+    {
+        auto* track = findTrack(it->second.trackId);
+        if (track != nullptr && !isTrackAudible(*track))
+        {
+            ++it;
+            continue;
+        }
+        
+        if (track != nullptr)
+        {
+            restorePlugin(*track, it->second.slotIndex);
+            restored = true;
+        }
+        
+        --pluginRestoreProgress.deferred;
+        it = deferredPlugins.erase(it);
     }
+    
+    if (restored && onPluginRestoreProgress)
+        onPluginRestoreProgress(pluginRestoreProgress);
+}
+
+void AudioEngine::retirePlugin(std::shared_ptr<juce::AudioPluginInstance> plugin)
+{
+    if (plugin == nullptr) return;
+    
+    closePluginWindow(plugin.get());
+    plugin->removeListener(this);
+    suspendedPlugins.erase(plugin.get());
+    pluginLoader.release(std::move(plugin));
 }
 
 void AudioEngine::showPluginWindow(juce::AudioPluginInstance* plugin)
 {
     if (!plugin) return;
     
+    // Sandboxed plugins show their editor from their host process
+    if (PluginSandbox::showEditor(*plugin)) return;
+    
     if (pluginWindows.find(plugin) != pluginWindows.end() && pluginWindows[plugin] != nullptr)
     {
         pluginWindows[plugin]->toFront(true);
@@ -687,48 +1841,61 @@ void AudioEngine::togglePluginWindow(Track* track)
     }
 }
 
-void AudioEngine::playMetronome(const juce::AudioSourceChannelInfo& bufferToFill, double startBeat, double samplesPerBeat)
+bool AudioEngine::setMetronomeSamples(const juce::File& accent, const juce::File& normal, juce::String& error)
 {
-    if (!projectState.metronomeEnabled) return;
-
-    double endBeat = startBeat + (bufferToFill.numSamples / samplesPerBeat);
+    if (accent != juce::File() && normal != juce::File()
+        && MetronomeClicks::load(accent, normal, currentSampleRate, formatManager, error) == nullptr)
+        return false;
     
-    int firstBeat = (int)std::ceil(startBeat);
-    int lastBeat = (int)std::floor(endBeat);
-    
-    for (int beat = firstBeat; beat <= lastBeat; ++beat)
+    metronomeAccentFile = accent;
+    metronomeNormalFile = normal;
+    updateMetronomeClicks();
+    publishSnapshot();
+    return true;
+}
+
+void AudioEngine::updateMetronomeClicks()
+{
+    // Tables are built at the session rate, so this runs again whenever it changes
+    if (metronomeAccentFile != juce::File() && metronomeNormalFile != juce::File())
     {
-        double beatTime = beat;
-        int sampleOffset = (int)((beatTime - startBeat) * samplesPerBeat);
+        juce::String error;
+        metronomeClicks = MetronomeClicks::load(metronomeAccentFile, metronomeNormalFile, currentSampleRate, formatManager, error);
+        if (metronomeClicks != nullptr) return;
         
-        if (sampleOffset >= 0 && sampleOffset < bufferToFill.numSamples)
-        {
-            float frequency = (beat % projectState.timeSignatureNumerator == 0) ? 1000.0f : 500.0f;
-            float length = 0.05f; 
-            int lengthSamples = (int)(length * currentSampleRate);
-            
-            for (int i = 0; i < lengthSamples; ++i)
-            {
-                if (sampleOffset + i >= bufferToFill.numSamples) break;
-                
-                float sample = std::sin(2.0f * juce::MathConstants<float>::pi * frequency * (i / currentSampleRate));
-                sample *= 0.8f; 
-                sample *= (1.0f - (float)i / lengthSamples);
-                
-                for (int ch = 0; ch < bufferToFill.buffer->getNumChannels(); ++ch)
-                {
-                    bufferToFill.buffer->addSample(ch, bufferToFill.startSample + sampleOffset + i, sample);
-                }
-            }
-        }
+        reportError("The metronome samples can't be used, the built-in clicks play instead: " + error);
     }
+    
+    metronomeClicks = MetronomeClicks::synthesize(currentSampleRate);
 }
 
 void AudioEngine::deleteTrack(int index)
 {
-    const juce::ScopedLock sl(processLock);
-    projectState.removeTrack(index);
-    updateGraph();
+    // The audio thread only sees the render snapshot, so the track can go right away.
+    // Publishing immediately keeps its plugins alive until the old snapshot is reclaimed.
+    if (index >= 0 && index < (int)projectState.tracks.size())
+    {
+        const auto& track = *projectState.tracks[(size_t)index];
+        if (track.freeze.frozen)
+            track.freeze.file.deleteFile();
+        
+        // Its take is still written, but gets no clip
+        std::replace(recordingTracks.begin(), recordingTracks.end(), projectState.tracks[(size_t)index].get(), (Track*)nullptr);
+        
+        // Unloaded once the snapshots are done with them
+        std::vector<std::shared_ptr<juce::AudioPluginInstance>> plugins;
+        if (track.instrumentPlugin)
+            plugins.push_back(track.instrumentPlugin->instance);
+        for (const auto& slot : track.insertPlugins)
+            if (slot)
+                plugins.push_back(slot->instance);
+        
+        projectState.removeTrack(index);
+        publishSnapshot();
+        
+        for (auto& plugin : plugins)
+            retirePlugin(std::move(plugin));
+    }
 }
 
 
@@ -2,12 +2,23 @@
 #include <juce_audio_utils/juce_audio_utils.h>
 #include <juce_audio_processors/juce_audio_processors.h>
 #include "../model/ProjectState.h"
+#include "MultiTrackRecorder.h"
+#include "OfflineRender.h"
+#include "PeakCache.h"
+#include "PluginLoader.h"
+#include "PluginSandbox.h"
+#include "PluginScanner.h"
+#include "RenderSnapshot.h"
+#include "RenderWorkerPool.h"
+#include "SnapshotExchange.h"
+#include <set>
 
-class AudioEngine
+class AudioEngine : private juce::Timer,
+                    private juce::AudioProcessorListener
 {
 public:
     AudioEngine(ProjectState& state);
-    ~AudioEngine();
+    ~AudioEngine() override;
 
     void prepareToPlay(double sampleRate, int samplesPerBlock);
     void releaseResources();
@@ -15,19 +26,77 @@ public:
     // Render audio and process graph
     void processAudio(const juce::AudioSourceChannelInfo& bufferToFill, juce::MidiBuffer& midiMessages);
 
-    juce::AudioProcessorGraph& getGraph() { return *mainProcessor; }
+    // Render Snapshot
+    // Rebuilds the immutable render copy of ProjectState and swaps it in for the audio thread.
+    // Message thread only. Also called periodically whenever ProjectState::getRevision() moves.
+    void publishSnapshot();
     
-    // Graph management
-    void updateGraph(); // Syncs graph with ProjectState
+    // Parallel Rendering
+    // Tracks that don't depend on each other render on a real-time worker pool; 0 = serial.
+    // Blocks shorter than the minimum size always render serially (sync overhead dominates).
+    void setNumRenderThreads(int numThreads);
+    int getNumRenderThreads() const { return renderWorkers.getNumWorkers(); }
+    void setMinimumParallelBlockSize(int numSamples) { minParallelBlockSize = numSamples; }
+    
+    // Plugin Delay Compensation
+    // Delay of the whole mix caused by the slowest plugin chain, as of the latest snapshot.
+    int getOutputLatencySamples() const { return outputLatency.load(); }
+    
+    // Disk Streaming
+    // Audio clip blocks that had to be (partly) silenced because the disk fell behind.
+    int getNumDiskUnderruns() const { return diskStreamer.getNumUnderruns(); }
+
+    // Audio File Cache
+    // Short and compressed clip files are decoded once into RAM (least recently used files
+    // go first once the budget is full); longer WAV/AIFF files are memory-mapped.
+    void setAudioCacheBudget(size_t bytes) { diskStreamer.getFileCache().setMemoryBudget(bytes); }
+    size_t getAudioCacheBudget() const { return diskStreamer.getFileCache().getMemoryBudget(); }
+    AudioFileCache::Statistics getAudioCacheStatistics() const { return diskStreamer.getFileCache().getStatistics(); }
+
+    // Sample Rate Conversion
+    // Clips recorded at another rate are converted while streaming. Realtime quality is cheap
+    // enough for playback; High is meant for offline renders. The optional cache keeps
+    // high quality copies on disk (per file content and rate) for streams opened later.
+    void setResamplingQuality(ResamplingQuality quality);
+    ResamplingQuality getResamplingQuality() const { return resamplingQuality; }
+    void setResampleCacheEnabled(bool shouldBeEnabled);
+    
+    // Waveform Overviews
+    // Min/max/RMS peaks of audio clips (and of recordings while they are being written).
+    PeakCache& getPeakCache() { return peakCache; }
+    
+    // Offline Rendering
+    // Bounces the project to a file on a background thread, as fast as the CPU allows. Live
+    // output is silenced and plugins run in non-realtime mode until it has finished.
+    // Progress comes from the render thread; onFinished is called on the message thread once
+    // the plugins are back in realtime mode. Returns false and sets 'error' if the render can't start.
+    bool startRender(const OfflineRenderSettings& settings, std::function<void(double progress)> onProgress,
+                     std::function<void(const OfflineRenderResult&)> onFinished, juce::String& error);
+    void cancelRender();
+    bool isRendering() const { return pendingRender != nullptr || offlineRenderThread != nullptr; }
+    
+    // Track Freeze
+    // Bounces a MIDI or audio track's instrument and inserts (pre-fader) to a cache file, which
+    // then plays in their place while the plugins are suspended. Edits to the track's clips,
+    // plugins, plugin state or plugin automation unfreeze it again. Renders like startRender(),
+    // except that the rest of the project keeps playing: only the track itself is silent until
+    // the bounce is ready, as its plugins run in the render thread meanwhile (see isFreezing).
+    bool freezeTrack(Track* track, std::function<void(double progress)> onProgress,
+                     std::function<void(const OfflineRenderResult&)> onFinished, juce::String& error);
+    void unfreezeTrack(Track* track);
+    bool isFreezing(const Track& track) const { return track.id == freezingTrackId; }
     
     // File Management
     // Plugin Management
     juce::AudioPluginFormatManager& getPluginFormatManager() { return pluginFormatManager; }
     juce::KnownPluginList& getKnownPluginList() { return knownPluginList; }
     
+    // Plugin files are probed by worker processes (see PluginScanner), so a crashing plugin
+    // only gets itself blacklisted. Only new and changed files are probed, and plugins whose
+    // files are gone are dropped, so a scan of an unchanged system is cheap.
+    // scanPlugins() blocks; the async version reports each file and the end on the message thread.
     void scanPlugins();
     void scanPluginsAsync(std::function<void(const juce::String&)> onProgress, std::function<void()> onFinished);
-    std::shared_ptr<juce::AudioPluginInstance> loadPlugin(const juce::PluginDescription& desc);
     
     void addPluginSearchPath(const juce::File& path);
     void removePluginSearchPath(int index);
@@ -35,49 +104,220 @@ public:
     void savePluginSearchPaths();
     void loadPluginSearchPaths();
     
-    void addPluginToTrack(Track* track, int slotIndex, const juce::PluginDescription& desc);
-    void setInstrumentPlugin(Track* track, const juce::PluginDescription& desc);
+    // Load asynchronously (see PluginLoader) and take over the slot when ready, opening the
+    // plugin's editor and then calling onInstalled. The replaced instance is unloaded once
+    // the audio thread is done with it.
+    void addPluginToTrack(Track* track, int slotIndex, const juce::PluginDescription& desc,
+                          std::function<void()> onInstalled = nullptr);
+    void setInstrumentPlugin(Track* track, const juce::PluginDescription& desc,
+                             std::function<void()> onInstalled = nullptr);
+    
+    // Moves the plugin in a slot (-1 = instrument) into a plugin host process or back (see
+    // PluginSandbox), reloading it with its current state. Plugins loaded into the slot later
+    // go the same way.
+    void setPluginSandboxed(Track* track, int slotIndex, bool sandboxed,
+                            std::function<void()> onInstalled = nullptr);
+    
+    // How long sandboxed plugins' blocks take there and back
+    PluginSandbox::Statistics getPluginSandboxStatistics() const { return pluginSandbox.getStatistics(); }
+    
+    // Project Restore
+    // Loads the plugins of a project that was just read (instruments and inserts, each with its
+    // saved state) side by side through the plugin loader, without opening editors. With deferInactive,
+    // plugins on muted or frozen tracks and on MIDI/audio tracks without clips are only loaded
+    // once that changes. onProgress is called on the message thread as plugins come in.
+    struct PluginRestoreProgress
+    {
+        int total = 0;
+        int loaded = 0;
+        int failed = 0;   // Not installed, or failed to load (the slot keeps its saved state)
+        int deferred = 0; // Waiting for their track to be needed
+        juce::StringArray problems; // One line per failed plugin: which one and why
+        
+        bool isFinished() const { return loaded + failed + deferred == total; }
+    };
+    void restorePlugins(bool deferInactive, std::function<void(const PluginRestoreProgress&)> onProgress);
+    const PluginRestoreProgress& getPluginRestoreProgress() const { return pluginRestoreProgress; }
+    
     void openPluginWindow(Track* track);
     void showPluginWindow(juce::AudioPluginInstance* plugin);
     void closePluginWindow(juce::AudioPluginInstance* plugin);
     void togglePluginWindow(Track* track);
 
     // Recording
-    void startRecording();
+    // Armed audio tracks record their own inputs (Track::inputChannel/numInputChannels) to
+    // 24-bit or 32-bit float WAV files. The audio thread only fills lock-free rings, a writer
+    // thread drains them; the statistics show how close the disk came to falling behind.
+    // The inputs of armed tracks are captured all the time, so takes start up to the pre-roll
+    // before recording was started. While looping, every pass becomes a take lane.
+    // Returns false and sets 'error' if the takes can't be started; with nothing armed there
+    // is nothing to start, which isn't an error.
+    bool startRecording(juce::String& error);
     void stopRecording();
+    void setRecordingBitDepth(int bitsPerSample); // 24 or 32 (float)
+    int getRecordingBitDepth() const { return recordingBitDepth; }
+    void setRecordingPreRoll(double seconds) { recorder.setPreRollSeconds(seconds); }
+    double getRecordingPreRoll() const { return recorder.getPreRollSeconds(); }
+    MultiTrackRecorder::Statistics getRecordingStatistics() const { return recorder.getStatistics(); }
 
     bool isRecording = false;
     
+    // Metronome
+    // Clicks play from precomputed tables (synthesized, or the user's samples decoded and
+    // resampled once) on their own output pair, ProjectState::metronomeOutputChannel.
+    // Bounces never contain them. With ProjectState::countInBars, recording from a stopped
+    // transport clicks that many bars before the playhead starts to move.
+    // Empty files go back to the synthesized clicks. Returns false and sets 'error' if a
+    // sample can't be read.
+    bool setMetronomeSamples(const juce::File& accent, const juce::File& normal, juce::String& error);
+    
     // Thread Safety
     void deleteTrack(int index);
-    juce::CriticalSection processLock;
+    
+    // Problems that come up in the background, where no call can return them (plugins that
+    // fail to load, plugin hosts, metronome samples ...). Message thread.
+    std::function<void(const juce::String& message)> onError;
 
 private:
     ProjectState& projectState;
-    std::unique_ptr<juce::AudioProcessorGraph> mainProcessor;
+    
+    // Render Snapshot (message thread -> audio thread)
+    SnapshotExchange<RenderSnapshot> snapshots;
+    juce::uint32 publishedRevision = 0;
+    void timerCallback() override;
+    
+    // Plugin Delay Compensation
+    std::atomic<bool> latencyChanged { false };
+    std::atomic<int> outputLatency { 0 };
+    void audioProcessorParameterChanged(juce::AudioProcessor*, int, float) override { pluginStateChanged = true; }
+    void audioProcessorChanged(juce::AudioProcessor*, const ChangeDetails& details) override;
+    
+    // Parallel Rendering
+    RenderWorkerPool renderWorkers;
+    std::atomic<int> minParallelBlockSize { 32 };
+    
     juce::AudioFormatManager formatManager;
     
+    // Audio clip streaming
+    DiskStreamer diskStreamer { formatManager };
+    ResamplingQuality resamplingQuality = ResamplingQuality::Realtime;
+    void openStreams(RenderSnapshot& snapshot, const juce::String& keyPrefix, ResamplingQuality quality, bool offline);
+    void updateStreamCues(const RenderSnapshot& snapshot);
+    double renderedPlayheadBeat = 0.0;          // Audio thread: where it left the playhead
+    std::atomic<bool> playheadMoved { false };  // Someone else moved it while playing (a seek)
+    
+    PeakCache peakCache { formatManager };
+    
     // Recording
-    juce::TimeSliceThread backgroundThread { "Audio Recorder Thread" };
-    std::map<Track*, std::unique_ptr<juce::AudioFormatWriter::ThreadedWriter>> trackRecorders;
+    MultiTrackRecorder recorder;
+    int recordingBitDepth = 24;
     double recordingStartBeat = 0.0;
-    std::map<Track*, juce::File> recordingFiles; // Keep track of files to create clips
+    std::vector<Track*> recordingTracks; // By recorder input index
+    void updateCapturedInputs();
+    
+    // Offline Rendering
+    struct OfflineRenderJob
+    {
+        std::unique_ptr<OfflineRenderWriter> writer;
+        juce::File file;
+        double startBeat = 0.0, endBeat = 0.0, tailSeconds = 0.0;
+        juce::Uuid trackId = juce::Uuid::null(); // Freeze: renders only this track, pre-fader
+        int trackIndex = -1; // Its index, looked up when the render starts; -1 = the whole mix
+        std::function<void(double)> onProgress;
+        std::function<void(const OfflineRenderResult&)> onFinished;
+    };
+    class OfflineRenderThread;
+    std::unique_ptr<OfflineRenderJob> pendingRender; // Waits for the audio callback to leave
+    std::unique_ptr<OfflineRenderThread> offlineRenderThread; // Until the timer has seen it finish
+    std::atomic<bool> offlineRenderActive { false }; // Audio callback keeps its hands off plugins and render state
+    juce::Uuid freezingTrackId = juce::Uuid::null(); // Its chain belongs to the freeze render meanwhile
+    std::atomic<int> liveCallbacksInFlight { 0 };
+    void renderLive(const juce::AudioSourceChannelInfo& bufferToFill, juce::MidiBuffer& midiMessages);
+    double getSongEndBeat() const;
+    void beginOfflineRender(OfflineRenderJob job);
+    void startPendingRender();
+    void finishOfflineRender();
     
-    // Buses
-    std::map<juce::Uuid, juce::AudioBuffer<float>> busBuffers;
+    // Track Freeze
+    struct FinishedFreeze
+    {
+        juce::Uuid trackId;
+        OfflineRenderResult result;
+        double lengthBeats;
+        juce::String signature;
+        std::function<void(const OfflineRenderResult&)> onFinished;
+    };
+    juce::CriticalSection finishedFreezesLock;
+    std::vector<FinishedFreeze> finishedFreezes;     // Filled by the render thread
+    std::vector<juce::Uuid> pendingSuspensions;      // Frozen, plugins may still be in use by the audio thread
+    std::set<juce::AudioPluginInstance*> suspendedPlugins;
+    std::atomic<bool> pluginStateChanged { false };
+    Track* findTrack(const juce::Uuid& id) const;
+    void applyFinishedFreezes();
+    void suspendFrozenPlugins();
+    bool invalidateFreezes(bool checkPluginState);
+    void thawTrack(Track& track);
+    
+    // Errors from other threads (e.g. the device's, which prepares playback), passed on to
+    // onError by the timer
+    juce::CriticalSection pendingErrorsLock;
+    juce::StringArray pendingErrors;
+    void reportError(const juce::String& message); // Any thread
+    void reportPendingErrors();
     
     // Metronome
-    double metronomePhase = 0.0;
-    void playMetronome(const juce::AudioSourceChannelInfo& bufferToFill, double startBeat, double samplesPerBeat);
+    std::shared_ptr<const MetronomeClicks> metronomeClicks; // At currentSampleRate
+    juce::File metronomeAccentFile, metronomeNormalFile;
+    void updateMetronomeClicks();
+    Metronome metronome;                // Audio thread
+    bool wasPlaying = false;            // Audio thread
+    juce::int64 countInRemaining = 0;   // Audio thread
     
     // Internal Rendering
-    void renderSegment(const juce::AudioSourceChannelInfo& bufferToFill, juce::MidiBuffer& midiMessages, int globalSampleOffset, double startBeat, double samplesPerBeat, bool generateMidi);
+    void renderChunk(const RenderSnapshot& project, const juce::AudioSourceChannelInfo& bufferToFill, juce::MidiBuffer& midiMessages, int midiSampleOffset);
+    void renderSegment(const RenderSnapshot& snapshot, const juce::AudioSourceChannelInfo& bufferToFill, juce::MidiBuffer& midiMessages, int globalSampleOffset, double startBeat, double samplesPerBeat, bool generateMidi);
+    
+    struct SegmentContext
+    {
+        const RenderSnapshot& snapshot;
+        int numSamples;
+        double startBeat;
+        double endBeat;
+        double samplesPerBeat;
+        bool generateMidi;
+    };
+    class SegmentGraph;
+    void renderTrack(const SegmentContext& context, int trackIndex); // Runs on any render thread
     
     // Plugins
     juce::AudioPluginFormatManager pluginFormatManager;
     juce::KnownPluginList knownPluginList;
-    std::unique_ptr<juce::PluginDirectoryScanner> pluginScanner;
-    juce::File knownPluginListFile;
+    const juce::File pluginDataDirectory = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory).getChildFile("AiceCube");
+    const juce::File knownPluginListFile = pluginDataDirectory.getChildFile("known_plugins.xml");
+    PluginScanner pluginScanner { pluginFormatManager, knownPluginList, pluginDataDirectory.getChildFile("plugin_scan_cache.xml"),
+                                  pluginDataDirectory.getChildFile("plugin_scan_pedal.txt") };
+    juce::FileSearchPath getPluginSearchPath() const;
+    void pluginScanFinished(const juce::StringArray& failedFiles);
+    
+    PluginLoader pluginLoader { pluginFormatManager };
+    PluginSandbox pluginSandbox;
+    std::map<juce::String, int> pluginLoadRequests; // Latest request per "track id/slot" (-1 = instrument)
+    void loadPluginInstance(const juce::PluginDescription& desc, const juce::MemoryBlock& state, bool sandboxed,
+                            PluginLoader::Callback onLoaded);
+    void loadPluginIntoSlot(Track* track, int slotIndex, const juce::PluginDescription& desc, const juce::MemoryBlock& state,
+                            bool replacesPlugin, std::function<void()> onInstalled);
+    void installPlugin(Track& track, int slotIndex, std::shared_ptr<juce::AudioPluginInstance> instance, const juce::String& identifier);
+    void retirePlugin(std::shared_ptr<juce::AudioPluginInstance> plugin);
+    static juce::String getPluginSlotKey(const Track& track, int slotIndex);
+    
+    // Project Restore
+    struct DeferredPlugin { juce::Uuid trackId; int slotIndex; };
+    std::map<juce::String, DeferredPlugin> deferredPlugins; // By slot key
+    PluginRestoreProgress pluginRestoreProgress;
+    std::function<void(const PluginRestoreProgress&)> onPluginRestoreProgress;
+    static bool isTrackAudible(const Track& track);
+    void restorePlugin(Track& track, int slotIndex);
+    void restoreDeferredPlugins();
     std::vector<juce::File> pluginSearchPaths;
     juce::File pluginSearchPathsFile;
     
@@ -86,15 +326,6 @@ private:
     // Key is the raw pointer to the plugin instance (which is owned by Track/PluginSlot)
     std::map<juce::AudioPluginInstance*, juce::Component::SafePointer<juce::DocumentWindow>> pluginWindows;
     
-    std::map<juce::String, std::unique_ptr<juce::AudioFormatReader>> fileReaders;
-    
-    juce::AudioFormatReader* getReaderFor(const juce::File& file);
-
-    // Nodes
-    juce::AudioProcessorGraph::Node::Ptr audioInputNode;
-    juce::AudioProcessorGraph::Node::Ptr audioOutputNode;
-    juce::AudioProcessorGraph::Node::Ptr midiInputNode;
-    juce::AudioProcessorGraph::Node::Ptr midiOutputNode;
     
     double currentSampleRate = 44100.0;
     int currentBlockSize = 512;
@@ -0,0 +1,187 @@
+#include "AudioFileCache.h"
+
+//==============================================================================
+// Reads from a decoded file. Holding on to the audio keeps it valid after eviction.
+class AudioFileCache::CachedAudioReader : public juce::AudioFormatReader
+{
+public:
+    explicit CachedAudioReader(std::shared_ptr<const CachedAudio> a)
+        : juce::AudioFormatReader(nullptr, a->formatName), audio(std::move(a))
+    {
+        sampleRate = audio->sampleRate;
+        numChannels = (unsigned int)audio->buffer.getNumChannels();
+        lengthInSamples = audio->buffer.getNumSamples();
+        bitsPerSample = 32;
+        usesFloatingPointData = true;
+    }
+
+    bool readSamples(int* const* destChannels, int numDestChannels, int startOffsetInDestBuffer,
+                     juce::int64 startSampleInFile, int numSamples) override
+    {
+        clearSamplesBeyondAvailableLength(destChannels, numDestChannels, startOffsetInDestBuffer,
+                                          startSampleInFile, numSamples, lengthInSamples);
+        if (numSamples <= 0) return true;
+
+        for (int ch = 0; ch < numDestChannels; ++ch)
+            if (destChannels[ch] != nullptr)
+                juce::FloatVectorOperations::copy(reinterpret_cast<float*>(destChannels[ch]) + startOffsetInDestBuffer,
+                                                  audio->buffer.getReadPointer(ch, (int)startSampleInFile), numSamples);
+
+        return true;
+    }
+
+private:
+    std::shared_ptr<const CachedAudio> audio;
+};
+
+//==============================================================================
+AudioFileCache::AudioFileCache(juce::AudioFormatManager& fm) : formatManager(fm)
+{
+}
+
+std::unique_ptr<juce::AudioFormatReader> AudioFileCache::createReader(const juce::File& file)
+{
+    const auto path = file.getFullPathName();
+    const auto identity = getIdentity(file);
+    size_t maxEntryBytes;
+    double maxSeconds;
+    {
+        const juce::ScopedLock sl(lock);
+
+        auto it = entries.find(path);
+        if (it != entries.end())
+        {
+            if (it->second.identity == identity)
+            {
+                lru.splice(lru.begin(), lru, it->second.lruPosition);
+                ++statistics.hits;
+                return std::make_unique<CachedAudioReader>(it->second.audio);
+            }
+
+            // Changed on disk since it was decoded
+            statistics.bytesUsed -= it->second.bytes;
+            lru.erase(it->second.lruPosition);
+            entries.erase(it);
+        }
+
+        // No single file may take more than a quarter of the budget
+        maxEntryBytes = budgetBytes / 4;
+        maxSeconds = maxUncompressedSeconds;
+    }
+
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+    if (reader == nullptr || reader->sampleRate <= 0.0)
+        return nullptr;
+
+    const bool uncompressed = file.hasFileExtension("wav;wave;bwf;aif;aiff");
+    const double seconds = (double)reader->lengthInSamples / reader->sampleRate;
+    const auto bytes = (size_t)reader->lengthInSamples * reader->numChannels * sizeof(float);
+
+    if ((!uncompressed || seconds <= maxSeconds) && bytes <= maxEntryBytes)
+    {
+        auto audio = decode(*reader, reader->getFormatName());
+
+        const juce::ScopedLock sl(lock);
+        evictDownTo(budgetBytes >= bytes ? budgetBytes - bytes : 0);
+
+        lru.push_front(path);
+        entries[path] = { audio, identity, bytes, lru.begin() };
+        statistics.bytesUsed += bytes;
+        ++statistics.misses;
+
+        return std::make_unique<CachedAudioReader>(audio);
+    }
+
+    // Mapped pages are cached by the OS and read on the I/O threads, like any other reader
+    if (uncompressed)
+    {
+        if (auto* format = formatManager.findFormatForFileExtension(file.getFileExtension()))
+        {
+            std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapped(format->createMemoryMappedReader(file));
+            if (mapped != nullptr && mapped->mapEntireFile())
+            {
+                const juce::ScopedLock sl(lock);
+                ++statistics.mappedOpens;
+                return mapped;
+            }
+        }
+    }
+
+    const juce::ScopedLock sl(lock);
+    ++statistics.streamedOpens;
+    return reader;
+}
+
+bool AudioFileCache::isInMemory(const juce::AudioFormatReader& reader)
+{
+    return dynamic_cast<const CachedAudioReader*>(&reader) != nullptr;
+}
+
+void AudioFileCache::markUsed(const std::vector<juce::File>& files)
+{
+    const juce::ScopedLock sl(lock);
+
+    for (const auto& file : files)
+    {
+        auto it = entries.find(file.getFullPathName());
+        if (it != entries.end())
+            lru.splice(lru.begin(), lru, it->second.lruPosition);
+    }
+}
+
+void AudioFileCache::setMemoryBudget(size_t bytes)
+{
+    const juce::ScopedLock sl(lock);
+    budgetBytes = bytes;
+    evictDownTo(budgetBytes);
+}
+
+size_t AudioFileCache::getMemoryBudget() const
+{
+    const juce::ScopedLock sl(lock);
+    return budgetBytes;
+}
+
+void AudioFileCache::setMaxUncompressedSeconds(double seconds)
+{
+    const juce::ScopedLock sl(lock);
+    maxUncompressedSeconds = seconds;
+}
+
+AudioFileCache::Statistics AudioFileCache::getStatistics() const
+{
+    const juce::ScopedLock sl(lock);
+    auto result = statistics;
+    result.budgetBytes = budgetBytes;
+    result.numEntries = (int)entries.size();
+    return result;
+}
+
+std::shared_ptr<const AudioFileCache::CachedAudio> AudioFileCache::decode(juce::AudioFormatReader& reader,
+                                                                          const juce::String& formatName) const
+{
+    auto audio = std::make_shared<CachedAudio>();
+    audio->sampleRate = reader.sampleRate;
+    audio->formatName = formatName;
+    audio->buffer.setSize((int)reader.numChannels, (int)reader.lengthInSamples);
+    reader.read(&audio->buffer, 0, (int)reader.lengthInSamples, 0, true, true);
+    return audio;
+}
+
+void AudioFileCache::evictDownTo(size_t bytes)
+{
+    while (statistics.bytesUsed > bytes && !lru.empty())
+    {
+        auto it = entries.find(lru.back());
+        statistics.bytesUsed -= it->second.bytes;
+        ++statistics.evictions;
+        entries.erase(it);
+        lru.pop_back();
+    }
+}
+
+juce::String AudioFileCache::getIdentity(const juce::File& file)
+{
+    return file.getFullPathName() + "|" + juce::String(file.getSize()) + "|"
+         + juce::String(file.getLastModificationTime().toMilliseconds());
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <list>
+#include <map>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+// Where clip streams get their readers from (on the disk streamer's I/O threads).
+//
+// Short files, and compressed files of any length that fit, are decoded once into
+// a RAM cache shared by every stream that plays them, so loop-based sessions with
+// many small samples do no disk I/O at all. Other WAV/AIFF files are memory-mapped,
+// and only what is left is read through buffered file I/O.
+//
+// The RAM cache drops the least recently used files to stay within its budget: a file
+// counts as used when it's opened, and whenever the engine builds a snapshot that plays
+// it (see markUsed). A dropped file's memory is freed once the last stream playing it
+// has gone.
+class AudioFileCache
+{
+public:
+    struct Statistics
+    {
+        juce::int64 hits = 0;          // Opened from RAM
+        juce::int64 misses = 0;        // Decoded into RAM
+        juce::int64 evictions = 0;
+        juce::int64 mappedOpens = 0;   // Memory-mapped
+        juce::int64 streamedOpens = 0; // Buffered file reads
+        size_t bytesUsed = 0;
+        size_t budgetBytes = 0;
+        int numEntries = 0;
+    };
+
+    explicit AudioFileCache(juce::AudioFormatManager& formatManager);
+
+    // Returns nullptr if the file can't be read
+    std::unique_ptr<juce::AudioFormatReader> createReader(const juce::File& file);
+
+    // Whether 'reader' (from createReader) reads from the RAM cache. Those readers only copy,
+    // so they may be read on the audio thread.
+    static bool isInMemory(const juce::AudioFormatReader& reader);
+
+    // Streams keep their readers for as long as a clip plays the file, so opening alone
+    // would let files the project still plays age out before ones it has stopped using.
+    // Files that aren't cached are ignored.
+    void markUsed(const std::vector<juce::File>& files);
+
+    // Shrinking the budget evicts right away
+    void setMemoryBudget(size_t bytes);
+    size_t getMemoryBudget() const;
+
+    // Uncompressed files up to this long go to RAM, longer ones are memory-mapped
+    void setMaxUncompressedSeconds(double seconds);
+
+    Statistics getStatistics() const;
+
+private:
+    struct CachedAudio
+    {
+        juce::AudioBuffer<float> buffer;
+        double sampleRate = 0.0;
+        juce::String formatName;
+    };
+
+    struct Entry
+    {
+        std::shared_ptr<const CachedAudio> audio;
+        juce::String identity;
+        size_t bytes = 0;
+        std::list<juce::String>::iterator lruPosition;
+    };
+
+    class CachedAudioReader;
+
+    std::shared_ptr<const CachedAudio> decode(juce::AudioFormatReader& reader, const juce::String& formatName) const;
+    void evictDownTo(size_t bytes);
+    static juce::String getIdentity(const juce::File& file);
+
+    juce::AudioFormatManager& formatManager;
+
+    juce::CriticalSection lock;
+    std::map<juce::String, Entry> entries; // By path
+    std::list<juce::String> lru;           // Most recently used first
+    size_t budgetBytes = (size_t)512 * 1024 * 1024;
+    double maxUncompressedSeconds = 60.0;
+    Statistics statistics;
+
+    JUCE_DECLARE_NON_COPYABLE(AudioFileCache)
+};
@@ -0,0 +1,107 @@
+#include "Automation.h"
+#include <algorithm>
+
+static juce::String getParameterKey(const juce::AudioProcessorParameter& parameter)
+{
+    if (auto* hosted = dynamic_cast<const juce::HostedAudioProcessorParameter*>(&parameter))
+        if (hosted->getParameterID().isNotEmpty())
+            return hosted->getParameterID();
+
+    return juce::String(parameter.getParameterIndex());
+}
+
+juce::String AutomationTarget::forInstrumentParameter(const juce::AudioProcessorParameter& parameter)
+{
+    return "Instrument:" + getParameterKey(parameter);
+}
+
+juce::String AutomationTarget::forInsertParameter(int slotIndex, const juce::AudioProcessorParameter& parameter)
+{
+    return "Insert" + juce::String(slotIndex) + ":" + getParameterKey(parameter);
+}
+
+static juce::AudioProcessorParameter* findParameter(const std::shared_ptr<PluginSlot>& slot, const juce::String& key)
+{
+    if (slot == nullptr || slot->instance == nullptr || slot->bypassed)
+        return nullptr;
+
+    for (auto* parameter : slot->instance->getParameters())
+        if (getParameterKey(*parameter) == key)
+            return parameter;
+
+    return nullptr;
+}
+
+bool AutomationLane::resolve(const Track& track, const AutomationCurve& curve, AutomationLane& lane)
+{
+    const auto& id = curve.parameterID;
+
+    if (id == AutomationTarget::volume)
+    {
+        lane.target = Target::Volume;
+    }
+    else if (id == AutomationTarget::pan)
+    {
+        lane.target = Target::Pan;
+    }
+    else
+    {
+        auto slotName = id.upToFirstOccurrenceOf(":", false, false);
+        auto key = id.fromFirstOccurrenceOf(":", false, false);
+
+        if (slotName == "Instrument")
+        {
+            lane.parameter = findParameter(track.instrumentPlugin, key);
+        }
+        else if (slotName.startsWith("Insert"))
+        {
+            int slotIndex = slotName.substring(6).getIntValue();
+            if (slotIndex >= 0 && slotIndex < (int)track.insertPlugins.size())
+                lane.parameter = findParameter(track.insertPlugins[(size_t)slotIndex], key);
+        }
+
+        if (lane.parameter == nullptr)
+            return false;
+
+        lane.target = Target::PluginParameter;
+    }
+
+    lane.points = curve.points;
+    std::stable_sort(lane.points.begin(), lane.points.end(), [](const AutomationPoint& a, const AutomationPoint& b) {
+        return a.time < b.time;
+    });
+
+    return true;
+}
+
+//==============================================================================
+float AutomationCursor::getValueAt(const std::vector<AutomationPoint>& points, double beat)
+{
+    const size_t numPoints = points.size();
+    if (numPoints == 0) return 0.0f;
+
+    auto isValid = [&] {
+        return upper <= numPoints
+            && (upper == 0 || points[upper - 1].time <= beat)
+            && (upper == numPoints || points[upper].time > beat);
+    };
+
+    if (!isValid())
+    {
+        // Playback moves forward: try the next few segments before searching
+        for (int step = 0; step < 4 && upper < numPoints && points[upper].time <= beat; ++step)
+            ++upper;
+
+        if (!isValid())
+            upper = (size_t)(std::upper_bound(points.begin(), points.end(), beat,
+                [](double b, const AutomationPoint& p) { return b < p.time; }) - points.begin());
+    }
+
+    if (upper == 0) return points.front().value;
+    if (upper == numPoints) return points.back().value;
+
+    const auto& p1 = points[upper - 1];
+    const auto& p2 = points[upper];
+    double t = (beat - p1.time) / (p2.time - p1.time);
+    return p1.value + (p2.value - p1.value) * (float)t;
+}
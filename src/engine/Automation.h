@@ -0,0 +1,44 @@
+#pragma once
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "../model/MusicData.h"
+#include <vector>
+
+//==============================================================================
+// AutomationCurve::parameterID is either "Volume", "Pan", or a plugin
+// parameter written as "Instrument:<id>" / "Insert<slot>:<id>", where <id> is
+// the hosted parameter's ID (or its index if the plugin has no IDs).
+namespace AutomationTarget
+{
+    const juce::String volume { "Volume" };
+    const juce::String pan { "Pan" };
+
+    juce::String forInstrumentParameter(const juce::AudioProcessorParameter& parameter);
+    juce::String forInsertParameter(int slotIndex, const juce::AudioProcessorParameter& parameter);
+}
+
+//==============================================================================
+// An active curve, resolved once on the message thread.
+struct AutomationLane
+{
+    enum class Target { Volume, Pan, PluginParameter };
+
+    Target target = Target::Volume;
+    juce::AudioProcessorParameter* parameter = nullptr; // Owned by a plugin the snapshot keeps alive
+    std::vector<AutomationPoint> points;                // Sorted by time
+
+    // Curves that don't resolve (unknown name, plugin gone) are skipped.
+    static bool resolve(const Track& track, const AutomationCurve& curve, AutomationLane& lane);
+};
+
+//==============================================================================
+// Audio-thread evaluation with a cached segment: sequential playback only
+// ever steps forward, so lookups are O(1) and binary search is only needed
+// after a jump.
+class AutomationCursor
+{
+public:
+    float getValueAt(const std::vector<AutomationPoint>& points, double beat);
+
+private:
+    size_t upper = 0; // First point after the current position
+};
@@ -0,0 +1,77 @@
+#include "DelayLine.h"
+
+void DelayLine::prepare(int numChannels, int maxDelaySamples, int maxBlockSize)
+{
+    writePosition = 0;
+
+    if (maxDelaySamples <= 0)
+    {
+        size = 0;
+        ring.setSize(0, 0);
+        return;
+    }
+
+    // Room for the longest delay plus one block, rounded up so that small latency
+    // changes don't force a new allocation
+    size = juce::nextPowerOfTwo(maxDelaySamples + maxBlockSize);
+    ring.setSize(numChannels, size);
+    ring.clear();
+}
+
+bool DelayLine::fits(int numChannels, int maxDelaySamples, int maxBlockSize) const
+{
+    if (maxDelaySamples <= 0)
+        return true;
+
+    return ring.getNumChannels() == numChannels && size >= maxDelaySamples + maxBlockSize;
+}
+
+void DelayLine::process(const juce::AudioBuffer<float>& source, juce::AudioBuffer<float>& delayed,
+                        int numSamples, int delaySamples)
+{
+    jassert(delaySamples >= 0 && delaySamples + numSamples <= size);
+    jassert(delayed.getNumChannels() >= std::min(ring.getNumChannels(), source.getNumChannels()));
+
+    const int mask = size - 1;
+    const int numChannels = std::min(ring.getNumChannels(), source.getNumChannels());
+    const int writeFirstPart = std::min(numSamples, size - writePosition);
+    const int readPosition = (writePosition - delaySamples) & mask;
+    const int readFirstPart = std::min(numSamples, size - readPosition);
+
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        // Write first, so delays shorter than the block read what was just written
+        ring.copyFrom(ch, writePosition, source, ch, 0, writeFirstPart);
+        if (writeFirstPart < numSamples)
+            ring.copyFrom(ch, 0, source, ch, writeFirstPart, numSamples - writeFirstPart);
+
+        delayed.copyFrom(ch, 0, ring, ch, readPosition, readFirstPart);
+        if (readFirstPart < numSamples)
+            delayed.copyFrom(ch, readFirstPart, ring, ch, 0, numSamples - readFirstPart);
+    }
+
+    writePosition = (writePosition + numSamples) & mask;
+}
+
+void DelayLine::takeOver(const DelayLine& other)
+{
+    if (size == 0 || other.size == 0)
+        return;
+
+    const int numChannels = std::min(ring.getNumChannels(), other.ring.getNumChannels());
+    int remaining = std::min(size, other.size);
+    int readPosition = (other.writePosition - remaining) & (other.size - 1);
+    int destPosition = (writePosition - remaining) & (size - 1);
+
+    while (remaining > 0)
+    {
+        const int run = std::min({ remaining, other.size - readPosition, size - destPosition });
+
+        for (int ch = 0; ch < numChannels; ++ch)
+            ring.copyFrom(ch, destPosition, other.ring, ch, readPosition, run);
+
+        readPosition = (readPosition + run) & (other.size - 1);
+        destPosition = (destPosition + run) & (size - 1);
+        remaining -= run;
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <juce_audio_basics/juce_audio_basics.h>
+
+//==============================================================================
+// Multichannel ring buffer used for plugin delay compensation.
+// Sized on the message thread; process() never allocates. The delay may
+// change between blocks as long as it stays within the prepared maximum.
+class DelayLine
+{
+public:
+    void prepare(int numChannels, int maxDelaySamples, int maxBlockSize);
+    bool fits(int numChannels, int maxDelaySamples, int maxBlockSize) const;
+
+    // Feeds numSamples of 'source' into the line and writes the signal from delaySamples
+    // ago to the same channels of 'delayed', which must have at least as many channels.
+    void process(const juce::AudioBuffer<float>& source, juce::AudioBuffer<float>& delayed,
+                 int numSamples, int delaySamples);
+
+    // Audio thread. Continues the signal 'other' has been fed (as much of it as fits), so
+    // that a line prepared anew doesn't start out silent.
+    void takeOver(const DelayLine& other);
+
+private:
+    juce::AudioBuffer<float> ring;
+    int size = 0; // Power of two, or 0 when unused
+    int writePosition = 0;
+};
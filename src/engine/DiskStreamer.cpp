@@ -0,0 +1,347 @@
+#include "DiskStreamer.h"
+
+//==============================================================================
+ClipStream::ClipStream(Opener o, std::atomic<int>& underrunCounter)
+    : opener(std::move(o)), totalUnderruns(underrunCounter)
+{
+}
+
+void ClipStream::open()
+{
+    reader = opener();
+    opener = nullptr;
+
+    if (reader == nullptr)
+    {
+        state.store(State::failed);
+        return;
+    }
+
+    inMemory = AudioFileCache::isInMemory(*reader);
+
+    if (!inMemory)
+    {
+        ring.setSize(2, ringSize);
+        ring.clear();
+        preroll.setSize(2, prerollSize);
+        preroll.clear();
+    }
+
+    state.store(State::ready);
+}
+
+void ClipStream::requestSeek(juce::int64 position)
+{
+    seekTarget.store(position);
+    readPosition.store(position);
+    seekGeneration.fetch_add(1);
+}
+
+bool ClipStream::read(juce::AudioBuffer<float>& dest, int numSamples, juce::int64 filePosition)
+{
+    if (blocking.load())
+        for (int waited = 0; state.load() == State::opening && waited < 10000; ++waited)
+            juce::Thread::sleep(1);
+
+    if (!isReady())
+    {
+        dest.clear(0, numSamples);
+        return false;
+    }
+
+    // RAM-cached: a copy, which neither locks nor allocates for up to two channels
+    if (inMemory)
+    {
+        reader->read(&dest, 0, numSamples, filePosition, true, true);
+        return true;
+    }
+
+    int done = 0;
+
+    // 1. Preroll (right after a jump to the cue position)
+    prerollReaders.fetch_add(1);
+    if (prerollValid.load())
+    {
+        auto start = prerollStart.load();
+        auto end = start + prerollSize;
+
+        if (filePosition >= start && filePosition < end)
+        {
+            done = (int)std::min<juce::int64>(numSamples, end - filePosition);
+
+            for (int ch = 0; ch < dest.getNumChannels(); ++ch)
+                dest.copyFrom(ch, 0, preroll, std::min(ch, 1), (int)(filePosition - start), done);
+
+            // Get the ring going from where the preroll ends
+            if (readPosition.load() != end)
+                requestSeek(end);
+        }
+    }
+    prerollReaders.fetch_sub(1);
+
+    if (done == numSamples)
+        return true;
+
+    // 2. Ring
+    const int remaining = numSamples - done;
+    auto position = filePosition + done;
+    auto expected = readPosition.load();
+
+    // Beat -> sample rounding can be off by a sample between consecutive blocks
+    if (std::abs(position - expected) <= 2)
+        position = expected;
+    else
+        requestSeek(position);
+
+    auto isAvailable = [&] { return validGeneration.load() == seekGeneration.load() && position + remaining <= writePosition.load(); };
+
+    if (blocking.load())
+    {
+        // Give up eventually, so a file that vanished can't hang a render
+        for (int waited = 0; !isAvailable() && waited < 10000; ++waited)
+            juce::Thread::sleep(1);
+    }
+
+    if (isAvailable())
+    {
+        const int mask = ringSize - 1;
+        const int index = (int)(position & mask);
+        const int firstPart = std::min(remaining, ringSize - index);
+
+        for (int ch = 0; ch < dest.getNumChannels(); ++ch)
+        {
+            dest.copyFrom(ch, done, ring, std::min(ch, 1), index, firstPart);
+
+            if (firstPart < remaining)
+                dest.copyFrom(ch, done + firstPart, ring, std::min(ch, 1), 0, remaining - firstPart);
+        }
+
+        readPosition.store(position + remaining);
+        return true;
+    }
+
+    // Underrun: keep moving with the playhead, the I/O thread skips ahead to catch up
+    dest.clear(done, remaining);
+    readPosition.store(position + remaining);
+    underruns.fetch_add(1);
+    totalUnderruns.fetch_add(1);
+    return false;
+}
+
+void ClipStream::setCue(juce::int64 filePosition)
+{
+    if (cuePosition.load() == filePosition && cueGeneration.load() != 0)
+        return;
+
+    cuePosition.store(filePosition);
+    cueGeneration.fetch_add(1);
+}
+
+bool ClipStream::service()
+{
+    if (state.load() == State::opening)
+    {
+        open();
+        return true;
+    }
+
+    if (!isReady() || inMemory)
+        return false;
+
+    bool didWork = false;
+
+    // Preroll
+    auto cueGen = cueGeneration.load();
+    if (cueGen != prerollGeneration)
+    {
+        auto cue = cuePosition.load();
+
+        // Take the preroll away from the audio thread before overwriting it
+        prerollValid.store(false);
+        while (prerollReaders.load() != 0)
+            juce::Thread::yield();
+
+        reader->read(&preroll, 0, prerollSize, cue, true, true);
+        prerollStart.store(cue);
+        prerollGeneration = cueGen;
+        prerollValid.store(true);
+        didWork = true;
+    }
+
+    // Ring
+    auto generation = seekGeneration.load();
+    if (generation != ringGeneration)
+    {
+        ringGeneration = generation;
+        writeCursor = seekTarget.load();
+        writePosition.store(writeCursor);
+        validGeneration.store(generation);
+    }
+
+    auto position = readPosition.load();
+    if (writeCursor < position)
+        writeCursor = position; // The audio thread ran ahead after an underrun
+
+    // Read in reasonably large chunks, disks prefer that
+    constexpr int minChunk = 8192;
+    constexpr int maxChunk = 32768;
+
+    const int space = (int)(position + ringSize - writeCursor);
+    if (space < minChunk)
+        return didWork;
+
+    const int numToRead = std::min(space, maxChunk);
+    const int index = (int)(writeCursor & (ringSize - 1));
+    const int firstPart = std::min(numToRead, ringSize - index);
+
+    reader->read(&ring, index, firstPart, writeCursor, true, true);
+    if (firstPart < numToRead)
+        reader->read(&ring, 0, numToRead - firstPart, writeCursor + firstPart, true, true);
+
+    // A seek arrived meanwhile: this data belongs to the old position, start over next round
+    if (seekGeneration.load() != generation)
+        return true;
+
+    writeCursor += numToRead;
+    writePosition.store(writeCursor);
+    return true;
+}
+
+//==============================================================================
+class DiskStreamer::IoThread : public juce::Thread
+{
+public:
+    IoThread(DiskStreamer& s, int index) : juce::Thread("Disk Streamer " + juce::String(index)), streamer(s) {}
+
+    ~IoThread() override { stopThread(2000); }
+
+    void run() override
+    {
+        std::vector<std::shared_ptr<ClipStream>> work, retired;
+
+        while (!threadShouldExit())
+        {
+            {
+                const juce::ScopedLock sl(streamer.streamLock);
+                work.clear();
+                for (const auto& entry : streamer.streams)
+                    work.push_back(entry.second);
+
+                retired.swap(streamer.retiredStreams);
+            }
+
+            // Closes the files of dropped streams (unless another I/O thread still holds one)
+            retired.clear();
+
+            bool didWork = false;
+
+            for (auto& stream : work)
+            {
+                if (threadShouldExit()) break;
+
+                bool expected = false;
+                if (!stream->claimed.compare_exchange_strong(expected, true))
+                    continue; // Another I/O thread has it
+
+                const bool wasReady = stream->isReady();
+                didWork = stream->service() || didWork;
+                stream->claimed.store(false);
+
+                if (!wasReady && stream->isReady())
+                    streamer.streamsOpened.store(true);
+            }
+
+            // Readers are destroyed here rather than on the message thread
+            work.clear();
+
+            if (!didWork)
+                wait(2);
+        }
+    }
+
+private:
+    DiskStreamer& streamer;
+};
+
+//==============================================================================
+DiskStreamer::DiskStreamer(juce::AudioFormatManager& fm, int numThreads) : formatManager(fm)
+{
+    for (int i = 0; i < std::max(1, numThreads); ++i)
+    {
+        auto* thread = threads.add(new IoThread(*this, i));
+        thread->startThread(juce::Thread::Priority::high);
+    }
+}
+
+DiskStreamer::~DiskStreamer()
+{
+    for (auto* thread : threads)
+        thread->signalThreadShouldExit();
+
+    threads.clear();
+}
+
+std::shared_ptr<ClipStream> DiskStreamer::getStream(const juce::String& key, const juce::File& file, double sampleRate,
+                                                    ResamplingQuality quality)
+{
+    // Positions depend on the rate and the sound on the quality: either changing means a new stream
+    const auto streamKey = key + "|" + juce::String(sampleRate) + "|" + juce::String((int)quality);
+
+    const juce::ScopedLock sl(streamLock);
+    auto& stream = streams[streamKey];
+
+    if (stream == nullptr)
+    {
+        // Runs on an I/O thread: decoding into the RAM cache or probing a converted copy
+        // can take a while
+        stream = std::make_shared<ClipStream>([this, file, sampleRate, quality, cache = resampleCache]() -> std::unique_ptr<juce::AudioFormatReader> {
+            auto reader = fileCache.createReader(file);
+            if (reader == nullptr || !ResamplingReader::needsResampling(reader->sampleRate, sampleRate))
+                return reader;
+
+            auto converted = cache != nullptr ? cache->getConvertedFile(file, sampleRate) : juce::File();
+            if (converted.existsAsFile())
+                if (auto cachedReader = fileCache.createReader(converted))
+                    return cachedReader;
+
+            return std::make_unique<ResamplingReader>(std::move(reader), sampleRate, quality);
+        }, underruns);
+
+        for (auto* thread : threads)
+            thread->notify();
+    }
+
+    // Dropped by removeUnusedStreams, so that it's tried again with the next snapshot
+    return stream->state.load() == ClipStream::State::failed ? nullptr : stream;
+}
+
+void DiskStreamer::setResampleCacheDirectory(const juce::File& directory)
+{
+    if (directory == juce::File())
+        resampleCache.reset();
+    else if (resampleCache == nullptr || resampleCache->getDirectory() != directory)
+        resampleCache = std::make_shared<ResampleCache>(formatManager, directory);
+}
+
+void DiskStreamer::removeUnusedStreams()
+{
+    const juce::ScopedLock sl(streamLock);
+
+    for (auto it = streams.begin(); it != streams.end();)
+    {
+        // Nothing but the map holds it (an I/O thread's work list may delay this by a round),
+        // and it's not waiting for its file to be opened
+        if (it->second.use_count() == 1 && it->second->state.load() != ClipStream::State::opening)
+        {
+            retiredStreams.push_back(std::move(it->second));
+            it = streams.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    if (!retiredStreams.empty())
+        threads.getFirst()->notify();
+}
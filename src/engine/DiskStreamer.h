@@ -0,0 +1,147 @@
+#pragma once
+#include "AudioFileCache.h"
+#include "ResampleCache.h"
+#include "ResamplingReader.h"
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+// Read-ahead buffer for one audio clip.
+//
+// An I/O thread keeps a lock-free ring buffer filled ahead of the position the
+// audio thread is reading from. Any jump in the read position (seek, loop wrap,
+// clip start) makes the ring refill from the new position; meanwhile a separate
+// preroll buffer, filled at the "cue" position chosen by the message thread
+// (loop start while looping, playhead while stopped), covers the gap. If data
+// isn't there in time the audio thread outputs silence and counts an underrun.
+//
+// The file is opened by the I/O thread too, which only then allocates the buffers,
+// and it is closed there when the stream is dropped. Files held in the RAM cache need
+// no buffers: they are read straight from memory.
+class ClipStream
+{
+public:
+    using Opener = std::function<std::unique_ptr<juce::AudioFormatReader>()>;
+
+    ClipStream(Opener opener, std::atomic<int>& underrunCounter);
+
+    // Any thread. Whether the file has been opened; only ready streams go to the audio thread.
+    bool isReady() const { return state.load() == State::ready; }
+
+    // Audio thread. Fills dest[0, numSamples) with the clip's audio starting at filePosition.
+    // Returns false (and leaves silence where data was missing) on an underrun.
+    bool read(juce::AudioBuffer<float>& dest, int numSamples, juce::int64 filePosition);
+
+    // Message thread. Where playback is expected to jump to next.
+    void setCue(juce::int64 filePosition);
+
+    // Offline renders: read() waits for the I/O thread (to open the file, then to fill the
+    // ring) instead of underrunning. Never set this on a stream the audio thread reads from.
+    void setBlocking(bool shouldBlock) { blocking = shouldBlock; }
+
+    // I/O thread. Returns true if there was anything to do.
+    bool service();
+
+    int getNumUnderruns() const { return underruns.load(); }
+
+    static constexpr int ringSize = 1 << 17;   // ~3 s at 44.1 kHz
+    static constexpr int prerollSize = 1 << 15; // ~0.75 s
+
+private:
+    friend class DiskStreamer;
+    std::atomic<bool> claimed { false }; // Serviced by at most one I/O thread at a time
+
+    void requestSeek(juce::int64 position);
+    void open(); // I/O thread
+
+    enum class State { opening, ready, failed };
+    std::atomic<State> state { State::opening };
+    Opener opener;                                 // I/O thread, until the file is open
+    std::unique_ptr<juce::AudioFormatReader> reader;
+    bool inMemory = false;                         // Read directly, no ring or preroll
+
+    // Ring: holds file samples [readPosition, writePosition) of the current seek generation
+    juce::AudioBuffer<float> ring;
+    std::atomic<juce::int64> readPosition { 0 };  // Written by the audio thread
+    std::atomic<juce::int64> writePosition { 0 }; // Written by the I/O thread
+    std::atomic<juce::int64> seekTarget { 0 };
+    std::atomic<juce::uint32> seekGeneration { 0 };
+    std::atomic<juce::uint32> validGeneration { 0 };
+    juce::uint32 ringGeneration = 0; // I/O thread only
+    juce::int64 writeCursor = 0;     // I/O thread only
+
+    // Preroll at the cue position
+    juce::AudioBuffer<float> preroll;
+    std::atomic<juce::int64> cuePosition { 0 };
+    std::atomic<juce::uint32> cueGeneration { 0 };
+    juce::uint32 prerollGeneration = 0; // I/O thread only
+    std::atomic<juce::int64> prerollStart { 0 };
+    std::atomic<bool> prerollValid { false };
+    std::atomic<int> prerollReaders { 0 };
+
+    std::atomic<int> underruns { 0 };
+    std::atomic<int>& totalUnderruns;
+    std::atomic<bool> blocking { false };
+
+    JUCE_DECLARE_NON_COPYABLE(ClipStream)
+};
+
+//==============================================================================
+// Owns the clip streams and the I/O threads that keep them filled.
+// Streams are requested on the message thread as soon as a clip shows up in a
+// render snapshot, and their files are opened on an I/O thread, so neither the
+// message thread nor the audio thread touches the file system. A stream goes
+// into the snapshots built once it is ready.
+//
+// Files recorded at another rate than the session are converted while they
+// stream (or read from the resample cache, if enabled and already converted),
+// so stream positions are always in session samples.
+class DiskStreamer
+{
+public:
+    explicit DiskStreamer(juce::AudioFormatManager& formatManager, int numThreads = 2);
+    ~DiskStreamer();
+
+    // Message thread. Returns the stream registered under 'key' for playback at sampleRate,
+    // converting foreign-rate files at the given quality. A new stream isn't ready until an
+    // I/O thread has opened its file. Returns nullptr if the file couldn't be read.
+    std::shared_ptr<ClipStream> getStream(const juce::String& key, const juce::File& file, double sampleRate,
+                                          ResamplingQuality quality);
+
+    // Message thread. True once after streams have become ready: snapshots built while they
+    // were opening went without them.
+    bool takeOpenedStreams() { return streamsOpened.exchange(false); }
+
+    // Message thread. Keep converted copies of foreign-rate files in 'directory';
+    // an empty File turns the cache off.
+    void setResampleCacheDirectory(const juce::File& directory);
+
+    // Message thread. Drops streams no render snapshot refers to any more; an I/O thread
+    // destroys them, so their files are closed there.
+    void removeUnusedStreams();
+
+    // Where streams get their readers: RAM cache, memory-mapped or buffered
+    AudioFileCache& getFileCache() { return fileCache; }
+    const AudioFileCache& getFileCache() const { return fileCache; }
+
+    int getNumUnderruns() const { return underruns.load(); }
+    void resetUnderrunCounter() { underruns = 0; }
+
+private:
+    class IoThread;
+
+    juce::AudioFormatManager& formatManager;
+    AudioFileCache fileCache { formatManager };
+    juce::CriticalSection streamLock; // Message thread vs. I/O threads, never the audio thread
+    std::map<juce::String, std::shared_ptr<ClipStream>> streams;
+    std::vector<std::shared_ptr<ClipStream>> retiredStreams; // Dropped, for an I/O thread to destroy
+    std::shared_ptr<ResampleCache> resampleCache; // Shared with streams still opening
+    juce::OwnedArray<IoThread> threads;
+    std::atomic<int> underruns { 0 };
+    std::atomic<bool> streamsOpened { false };
+
+    JUCE_DECLARE_NON_COPYABLE(DiskStreamer)
+};
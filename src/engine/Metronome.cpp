@@ -0,0 +1,151 @@
+#include "Metronome.h"
+#include <algorithm>
+#include <cmath>
+
+//==============================================================================
+static void synthesizeClick(juce::AudioBuffer<float>& table, double sampleRate, double frequency)
+{
+    // Decaying sine with a short attack, so it doesn't pop
+    const int length = (int)(0.05 * sampleRate);
+    const int attack = std::max(1, (int)(0.001 * sampleRate));
+    table.setSize(1, length);
+
+    auto* data = table.getWritePointer(0);
+    for (int i = 0; i < length; ++i)
+    {
+        const double envelope = std::min(1.0, (double)i / attack) * (1.0 - (double)i / length);
+        data[i] = (float)(std::sin(juce::MathConstants<double>::twoPi * frequency * i / sampleRate) * envelope);
+    }
+}
+
+std::shared_ptr<const MetronomeClicks> MetronomeClicks::synthesize(double sampleRate)
+{
+    auto clicks = std::make_shared<MetronomeClicks>();
+    synthesizeClick(clicks->accent, sampleRate, 1000.0);
+    synthesizeClick(clicks->normal, sampleRate, 500.0);
+    return clicks;
+}
+
+static bool loadClick(juce::AudioBuffer<float>& table, const juce::File& file, double sampleRate,
+                      juce::AudioFormatManager& formatManager, juce::String& error)
+{
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+    if (reader == nullptr || reader->lengthInSamples <= 0)
+    {
+        error = "Can't read " + file.getFullPathName();
+        return false;
+    }
+
+    // Clicks are short, cap them anyway
+    const int length = (int)std::min<juce::int64>(reader->lengthInSamples, (juce::int64)(reader->sampleRate * 2.0));
+    juce::AudioBuffer<float> source((int)reader->numChannels, length);
+    reader->read(&source, 0, length, 0, true, true);
+
+    // Down to mono
+    for (int ch = 1; ch < source.getNumChannels(); ++ch)
+        source.addFrom(0, 0, source, ch, 0, length);
+    source.applyGain(0, 0, length, 1.0f / (float)source.getNumChannels());
+
+    // To the session rate, once
+    const double ratio = reader->sampleRate / sampleRate;
+    table.setSize(1, (int)std::ceil(length / ratio));
+    juce::LagrangeInterpolator interpolator;
+    interpolator.process(ratio, source.getReadPointer(0), table.getWritePointer(0), table.getNumSamples(), length, 0);
+    return true;
+}
+
+std::shared_ptr<const MetronomeClicks> MetronomeClicks::load(const juce::File& accentFile, const juce::File& normalFile,
+                                                             double sampleRate, juce::AudioFormatManager& formatManager,
+                                                             juce::String& error)
+{
+    auto clicks = std::make_shared<MetronomeClicks>();
+    if (!loadClick(clicks->accent, accentFile, sampleRate, formatManager, error)
+        || !loadClick(clicks->normal, normalFile, sampleRate, formatManager, error))
+        return nullptr;
+
+    return clicks;
+}
+
+//==============================================================================
+void Metronome::render(const Settings& settings, juce::AudioBuffer<float>& buffer, int startSample, int numSamples,
+                       double startBeat, double samplesPerBeat, bool newClicks)
+{
+    if (settings.clicks == nullptr || numSamples <= 0) return;
+
+    // Tails of clicks from earlier blocks
+    for (int i = 0; i < numVoices;)
+    {
+        play(settings, voices[(size_t)i], buffer, startSample, numSamples);
+
+        const auto& table = voices[(size_t)i].accent ? settings.clicks->accent : settings.clicks->normal;
+        if (voices[(size_t)i].position >= table.getNumSamples())
+            voices[(size_t)i] = voices[(size_t)--numVoices];
+        else
+            ++i;
+    }
+
+    if (!newClicks) return;
+
+    const double endBeat = startBeat + numSamples / samplesPerBeat;
+
+    for (double beat = startBeat; beat < endBeat;)
+    {
+        // One meter at a time: a click per denominator note, counted from its first bar line
+        TempoMap::Meter meter;
+        meter.numerator = settings.numerator;
+        meter.denominator = settings.denominator;
+        double meterEnd = endBeat;
+
+        if (settings.tempoMap != nullptr)
+        {
+            meter = settings.tempoMap->getMeterAt(beat);
+            meterEnd = std::min(endBeat, settings.tempoMap->getNextMeterChange(beat));
+        }
+
+        const double interval = 4.0 / std::max(1, meter.denominator);
+        const int clicksPerBar = std::max(1, meter.numerator);
+
+        for (auto index = (juce::int64)std::ceil((beat - meter.beat) / interval - 1.0e-9);
+             meter.beat + index * interval < meterEnd; ++index)
+        {
+            const int offset = (int)std::llround((meter.beat + index * interval - startBeat) * samplesPerBeat);
+            if (offset >= numSamples) break;
+
+            // Steal the oldest click if too many overlap
+            if (numVoices == maxVoices)
+            {
+                std::move(voices.begin() + 1, voices.end(), voices.begin());
+                --numVoices;
+            }
+
+            auto& voice = voices[(size_t)numVoices++];
+            voice.accent = (index % clicksPerBar + clicksPerBar) % clicksPerBar == 0;
+            voice.position = 0;
+
+            const int start = std::max(0, offset);
+            play(settings, voice, buffer, startSample + start, numSamples - start);
+        }
+
+        beat = meterEnd;
+    }
+}
+
+void Metronome::play(const Settings& settings, Voice& voice, juce::AudioBuffer<float>& buffer, int startSample, int numSamples)
+{
+    const auto& table = voice.accent ? settings.clicks->accent : settings.clicks->normal;
+    const int count = std::min(numSamples, table.getNumSamples() - voice.position);
+    if (count <= 0)
+    {
+        voice.position = table.getNumSamples();
+        return;
+    }
+
+    const int firstChannel = settings.outputChannel < buffer.getNumChannels() ? settings.outputChannel : 0;
+    const int lastChannel = std::min(firstChannel + 2, buffer.getNumChannels());
+
+    for (int ch = firstChannel; ch < lastChannel; ++ch)
+        juce::FloatVectorOperations::addWithMultiply(buffer.getWritePointer(ch, startSample),
+                                                     table.getReadPointer(0, voice.position), settings.level, count);
+
+    voice.position += count;
+}
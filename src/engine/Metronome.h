@@ -0,0 +1,61 @@
+#pragma once
+#include <juce_audio_formats/juce_audio_formats.h>
+#include "../model/TempoMap.h"
+#include <array>
+#include <memory>
+
+//==============================================================================
+// Click sounds at the session rate. Built once on the message thread (synthesized,
+// or decoded and resampled from user samples) and shared by render snapshots.
+struct MetronomeClicks
+{
+    juce::AudioBuffer<float> accent; // Mono, first click of a bar
+    juce::AudioBuffer<float> normal; // Mono
+
+    static std::shared_ptr<const MetronomeClicks> synthesize(double sampleRate);
+
+    // Returns nullptr and sets 'error' if a file can't be read
+    static std::shared_ptr<const MetronomeClicks> load(const juce::File& accentFile, const juce::File& normalFile,
+                                                       double sampleRate, juce::AudioFormatManager& formatManager,
+                                                       juce::String& error);
+};
+
+//==============================================================================
+// Plays clicks on the meter's grid (one per denominator note, accented at the start
+// of each bar). Clicks are copied from the precomputed tables, and a click
+// that doesn't fit in a block carries on in the next one. Real-time safe.
+class Metronome
+{
+public:
+    struct Settings
+    {
+        const MetronomeClicks* clicks = nullptr;
+        const TempoMap* tempoMap = nullptr; // Meter changes; without a map the meter below holds throughout
+        int numerator = 4;
+        int denominator = 4;
+        float level = 0.8f;
+        int outputChannel = 0; // First of the output pair; falls back to 0 if the buffer has no such channel
+    };
+
+    // Renders numSamples starting at startBeat (beats are quarter notes, negative during a
+    // count-in) at a constant tempo: callers split blocks where the tempo changes.
+    // With newClicks false only the tails of clicks already playing are rendered.
+    void render(const Settings& settings, juce::AudioBuffer<float>& buffer, int startSample, int numSamples,
+                double startBeat, double samplesPerBeat, bool newClicks);
+
+    // Drops clicks that are still ringing
+    void reset() { numVoices = 0; }
+
+private:
+    struct Voice
+    {
+        bool accent = false;
+        int position = 0; // In the click table
+    };
+
+    void play(const Settings& settings, Voice& voice, juce::AudioBuffer<float>& buffer, int startSample, int numSamples);
+
+    static constexpr int maxVoices = 4;
+    std::array<Voice, maxVoices> voices;
+    int numVoices = 0;
+};
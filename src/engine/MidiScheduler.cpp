@@ -0,0 +1,144 @@
+#include "MidiScheduler.h"
+#include <algorithm>
+
+std::vector<ScheduledMidiEvent> buildMidiSchedule(const std::vector<Clip>& clips)
+{
+    std::vector<ScheduledMidiEvent> events;
+
+    for (const auto& clip : clips)
+    {
+        if (!clip.isMidi) continue;
+
+        std::array<std::bitset<128>, 16> sounding;
+        const auto& seq = clip.midiSequence;
+
+        for (int i = 0; i < seq.getNumEvents(); ++i)
+        {
+            const auto& message = seq.getEventPointer(i)->message;
+            double time = message.getTimeStamp();
+
+            // Anything at or after the clip end is cut; held notes are released below
+            if (time >= clip.lengthBeats) continue;
+
+            if (message.getChannel() > 0)
+            {
+                auto& notes = sounding[(size_t)message.getChannel() - 1];
+                if (message.isNoteOn()) notes.set((size_t)message.getNoteNumber());
+                else if (message.isNoteOff()) notes.reset((size_t)message.getNoteNumber());
+            }
+
+            events.push_back({ clip.startBeat + time, message });
+        }
+
+        double endBeat = clip.startBeat + clip.lengthBeats;
+
+        for (int channel = 1; channel <= 16; ++channel)
+            for (int note = 0; note < 128; ++note)
+                if (sounding[(size_t)channel - 1][(size_t)note])
+                    events.push_back({ endBeat, juce::MidiMessage::noteOff(channel, note) });
+    }
+
+    std::stable_sort(events.begin(), events.end(), [](const ScheduledMidiEvent& a, const ScheduledMidiEvent& b) {
+        if (a.beat != b.beat) return a.beat < b.beat;
+        return a.message.isNoteOff() && !b.message.isNoteOff();
+    });
+
+    return events;
+}
+
+//==============================================================================
+void MidiScheduleCursor::render(const std::vector<ScheduledMidiEvent>& events, juce::uint32 revision,
+                                double startBeat, double endBeat, double samplesPerBeat, int numSamples,
+                                juce::MidiBuffer& trackMidi, juce::MidiBuffer& outgoingMidi)
+{
+    // Consecutive blocks compute their beats the same way, so this only absorbs rounding noise
+    const bool continuous = positioned && std::abs(startBeat - nextBeat) < 1.0e-9;
+
+    if (!continuous)
+        releaseAll(trackMidi, outgoingMidi, 0);
+
+    if (!continuous || revision != scheduleRevision || cursor > events.size())
+    {
+        cursor = (size_t)(std::lower_bound(events.begin(), events.end(), startBeat,
+            [](const ScheduledMidiEvent& e, double beat) { return e.beat < beat; }) - events.begin());
+        scheduleRevision = revision;
+    }
+
+    for (; cursor < events.size() && events[cursor].beat < endBeat; ++cursor)
+    {
+        const auto& event = events[cursor];
+        int sampleOffset = juce::jlimit(0, numSamples - 1, (int)((event.beat - startBeat) * samplesPerBeat));
+
+        trackMidi.addEvent(event.message, sampleOffset);
+        outgoingMidi.addEvent(event.message, sampleOffset);
+        track(event.message);
+    }
+
+    nextBeat = endBeat;
+    positioned = true;
+}
+
+bool MidiScheduleCursor::stop(juce::MidiBuffer& trackMidi, juce::MidiBuffer& outgoingMidi)
+{
+    bool released = anythingHeld;
+    releaseAll(trackMidi, outgoingMidi, 0);
+    positioned = false;
+    return released;
+}
+
+void MidiScheduleCursor::releaseAll(juce::MidiBuffer& trackMidi, juce::MidiBuffer& outgoingMidi, int sampleOffset)
+{
+    if (!anythingHeld) return;
+
+    for (int channel = 1; channel <= 16; ++channel)
+    {
+        auto& notes = heldNotes[(size_t)channel - 1];
+
+        for (int note = 0; note < 128 && notes.any(); ++note)
+        {
+            if (!notes[(size_t)note]) continue;
+
+            auto noteOff = juce::MidiMessage::noteOff(channel, note);
+            trackMidi.addEvent(noteOff, sampleOffset);
+            outgoingMidi.addEvent(noteOff, sampleOffset);
+            notes.reset((size_t)note);
+        }
+
+        if (sustainDown[(size_t)channel - 1])
+        {
+            auto pedalUp = juce::MidiMessage::controllerEvent(channel, 64, 0);
+            trackMidi.addEvent(pedalUp, sampleOffset);
+            outgoingMidi.addEvent(pedalUp, sampleOffset);
+        }
+    }
+
+    sustainDown.reset();
+    anythingHeld = false;
+}
+
+void MidiScheduleCursor::track(const juce::MidiMessage& message)
+{
+    int channel = message.getChannel();
+    if (channel <= 0) return;
+
+    auto index = (size_t)channel - 1;
+
+    if (message.isNoteOn())
+    {
+        heldNotes[index].set((size_t)message.getNoteNumber());
+        anythingHeld = true;
+    }
+    else if (message.isNoteOff())
+    {
+        heldNotes[index].reset((size_t)message.getNoteNumber());
+    }
+    else if (message.isSustainPedalOn())
+    {
+        sustainDown.set(index);
+        anythingHeld = true;
+    }
+    else if (message.isSustainPedalOff())
+    {
+        sustainDown.reset(index);
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "../model/MusicData.h"
+#include <array>
+#include <bitset>
+#include <vector>
+
+//==============================================================================
+// A track's MIDI clips flattened into one list sorted by absolute beat.
+// Notes still sounding at the end of their clip get a note-off there, and at
+// equal beats note-offs come first so retriggered notes aren't cut short.
+struct ScheduledMidiEvent
+{
+    double beat = 0.0;
+    juce::MidiMessage message;
+};
+
+std::vector<ScheduledMidiEvent> buildMidiSchedule(const std::vector<Clip>& clips);
+
+//==============================================================================
+// Audio-thread playback position in a track's MIDI schedule.
+//
+// The cursor advances incrementally from block to block. Whenever playback
+// doesn't continue where the last block ended (seek, loop wrap) it is
+// repositioned by binary search, after sending note-offs for everything that
+// is still held. stop() does the same when the transport stops.
+class MidiScheduleCursor
+{
+public:
+    // Adds the events in [startBeat, endBeat) to both buffers, at sample accurate positions.
+    void render(const std::vector<ScheduledMidiEvent>& events, juce::uint32 revision,
+                double startBeat, double endBeat, double samplesPerBeat, int numSamples,
+                juce::MidiBuffer& trackMidi, juce::MidiBuffer& outgoingMidi);
+
+    // Releases held notes and sustain, and forgets the position.
+    // Returns true if anything had to be released.
+    bool stop(juce::MidiBuffer& trackMidi, juce::MidiBuffer& outgoingMidi);
+
+private:
+    void releaseAll(juce::MidiBuffer& trackMidi, juce::MidiBuffer& outgoingMidi, int sampleOffset);
+    void track(const juce::MidiMessage& message);
+
+    size_t cursor = 0;
+    double nextBeat = 0.0;
+    juce::uint32 scheduleRevision = 0;
+    bool positioned = false;
+
+    std::array<std::bitset<128>, 16> heldNotes;
+    std::bitset<16> sustainDown;
+    bool anythingHeld = false;
+};
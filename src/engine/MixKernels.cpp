@@ -0,0 +1,108 @@
+#include "MixKernelsImpl.h"
+#include <juce_core/juce_core.h>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+ #define AICECUBE_MIX_SSE2 1
+ #include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+ #define AICECUBE_MIX_NEON 1
+ #include <arm_neon.h>
+#endif
+
+namespace MixKernels
+{
+    struct ScalarOps
+    {
+        static constexpr int width = 1;
+        static float load(const float* p) { return *p; }
+        static void store(float* p, float v) { *p = v; }
+        static float set1(float v) { return v; }
+        static float ramp(float base, float) { return base; }
+        static float add(float a, float b) { return a + b; }
+        static float mul(float a, float b) { return a * b; }
+        static float min(float a, float b) { return a < b ? a : b; }
+        static float max(float a, float b) { return a > b ? a : b; }
+    };
+
+   #if AICECUBE_MIX_SSE2
+    struct SseOps
+    {
+        static constexpr int width = 4;
+        static __m128 load(const float* p) { return _mm_loadu_ps(p); }
+        static void store(float* p, __m128 v) { _mm_storeu_ps(p, v); }
+        static __m128 set1(float v) { return _mm_set1_ps(v); }
+        static __m128 ramp(float base, float step) { return _mm_setr_ps(base, base + step, base + 2.0f * step, base + 3.0f * step); }
+        static __m128 add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+        static __m128 mul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+        static __m128 min(__m128 a, __m128 b) { return _mm_min_ps(a, b); }
+        static __m128 max(__m128 a, __m128 b) { return _mm_max_ps(a, b); }
+    };
+   #endif
+
+   #if AICECUBE_MIX_NEON
+    struct NeonOps
+    {
+        static constexpr int width = 4;
+        static float32x4_t load(const float* p) { return vld1q_f32(p); }
+        static void store(float* p, float32x4_t v) { vst1q_f32(p, v); }
+        static float32x4_t set1(float v) { return vdupq_n_f32(v); }
+        static float32x4_t ramp(float base, float step)
+        {
+            const float values[4] = { base, base + step, base + 2.0f * step, base + 3.0f * step };
+            return vld1q_f32(values);
+        }
+        static float32x4_t add(float32x4_t a, float32x4_t b) { return vaddq_f32(a, b); }
+        static float32x4_t mul(float32x4_t a, float32x4_t b) { return vmulq_f32(a, b); }
+        static float32x4_t min(float32x4_t a, float32x4_t b) { return vminq_f32(a, b); }
+        static float32x4_t max(float32x4_t a, float32x4_t b) { return vmaxq_f32(a, b); }
+    };
+   #endif
+
+    const Table& getScalar()
+    {
+        static const Table table = makeTable<ScalarOps>("Scalar");
+        return table;
+    }
+
+    static const Table* getBaselineVectorTable()
+    {
+       #if AICECUBE_MIX_SSE2
+        static const Table table = makeTable<SseOps>("SSE2");
+        return juce::SystemStats::hasSSE2() ? &table : nullptr;
+       #elif AICECUBE_MIX_NEON
+        static const Table table = makeTable<NeonOps>("NEON");
+        return &table;
+       #else
+        return nullptr;
+       #endif
+    }
+
+    std::vector<const Table*> getAvailable()
+    {
+        std::vector<const Table*> tables { &getScalar() };
+
+        if (auto* baseline = getBaselineVectorTable())
+            tables.push_back(baseline);
+
+        // Don't even touch the AVX translation unit on CPUs without AVX
+        if (juce::SystemStats::hasAVX())
+            if (auto* avx = getAvxTable())
+                tables.push_back(avx);
+
+        return tables;
+    }
+
+    const Table& get()
+    {
+        // Tables are listed from slowest to fastest
+        static const Table* best = getAvailable().back();
+        return *best;
+    }
+
+    PanGains constantPowerPan(float pan)
+    {
+        const float angle = (juce::jlimit(-1.0f, 1.0f, pan) + 1.0f) * juce::MathConstants<float>::pi * 0.25f;
+        return { juce::MathConstants<float>::sqrt2 * std::cos(angle), juce::MathConstants<float>::sqrt2 * std::sin(angle) };
+    }
+}
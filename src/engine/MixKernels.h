@@ -0,0 +1,48 @@
+#pragma once
+#include <vector>
+
+//==============================================================================
+// Vectorised inner loops for the mixer: gain ramps, constant-power pan, clip
+// fades and summing into a bus.
+//
+// Each instruction set has its own table of kernels; get() picks the best one
+// for the CPU we are running on the first time it is called. The scalar table
+// is the reference the others are checked and benchmarked against.
+namespace MixKernels
+{
+    struct Table
+    {
+        const char* name;
+
+        // dest += src
+        void (*add)(float* dest, const float* src, int numSamples);
+
+        // dest += src * gain, gain moving linearly from startGain to endGain over the block
+        void (*addWithRamp)(float* dest, const float* src, int numSamples, float startGain, float endGain);
+
+        // data *= gain, ramped as above
+        void (*applyRamp)(float* data, int numSamples, float startGain, float endGain);
+
+        // left += src * leftGain, right += src * rightGain, both ramped, in a single pass
+        void (*addMonoPanned)(float* left, float* right, const float* src, int numSamples,
+                              float leftStart, float leftEnd, float rightStart, float rightEnd);
+
+        // data *= sin(x * pi / 2) with x = position + i * increment, clamped to [0, 1].
+        // Increasing x is an equal-power fade in, decreasing x a fade out.
+        void (*applyFade)(float* data, int numSamples, float position, float increment);
+    };
+
+    // Best table for this CPU
+    const Table& get();
+
+    // Plain C++ reference implementation
+    const Table& getScalar();
+
+    // Every table this build and CPU can run, scalar first (for tests and benchmarks)
+    std::vector<const Table*> getAvailable();
+
+    // Constant-power pan law (sin/cos), normalised to unity gain at centre.
+    // pan is -1 (left) .. +1 (right).
+    struct PanGains { float left, right; };
+    PanGains constantPowerPan(float pan);
+}
@@ -0,0 +1,40 @@
+// Compiled with AVX enabled (see CMakeLists.txt). Only reached after a runtime CPU check.
+#include "MixKernelsImpl.h"
+
+#if defined(__AVX__)
+ #include <immintrin.h>
+
+namespace MixKernels
+{
+    struct AvxOps
+    {
+        static constexpr int width = 8;
+        static __m256 load(const float* p) { return _mm256_loadu_ps(p); }
+        static void store(float* p, __m256 v) { _mm256_storeu_ps(p, v); }
+        static __m256 set1(float v) { return _mm256_set1_ps(v); }
+        static __m256 ramp(float base, float step)
+        {
+            return _mm256_add_ps(_mm256_set1_ps(base),
+                                 _mm256_mul_ps(_mm256_set1_ps(step), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f)));
+        }
+        static __m256 add(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+        static __m256 mul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+        static __m256 min(__m256 a, __m256 b) { return _mm256_min_ps(a, b); }
+        static __m256 max(__m256 a, __m256 b) { return _mm256_max_ps(a, b); }
+    };
+
+    const Table* getAvxTable()
+    {
+        static const Table table = makeTable<AvxOps>("AVX");
+        return &table;
+    }
+}
+
+#else
+
+namespace MixKernels
+{
+    const Table* getAvxTable() { return nullptr; }
+}
+
+#endif
@@ -0,0 +1,147 @@
+#pragma once
+#include "MixKernels.h"
+
+//==============================================================================
+// Kernel bodies shared by every instruction set. Each translation unit
+// instantiates them with its own vector type, so the AVX one can be compiled
+// with AVX enabled without the rest of the program depending on it.
+//
+// A vector type provides: width, load, store, set1, ramp (b, b+s, b+2s, ...),
+// add, mul, min, max.
+//
+// Nothing in here may call shared inline code (std::min etc.): the linker could
+// pick the copy compiled with AVX for callers that run on any CPU.
+namespace MixKernels
+{
+    // sin(x * pi / 2) on [0, 1]; Taylor series to the 7th power, error < 2e-4
+    template <typename V, typename R>
+    inline R equalPowerCurve(R x)
+    {
+        const R u  = V::mul(x, V::set1(1.57079633f));
+        const R u2 = V::mul(u, u);
+        R p = V::set1(-1.0f / 5040.0f);
+        p = V::add(V::mul(p, u2), V::set1(1.0f / 120.0f));
+        p = V::add(V::mul(p, u2), V::set1(-1.0f / 6.0f));
+        p = V::add(V::mul(p, u2), V::set1(1.0f));
+        return V::mul(p, u);
+    }
+
+    template <typename V>
+    struct Kernels
+    {
+        static void add(float* dest, const float* src, int numSamples)
+        {
+            int i = 0;
+            for (; i + V::width <= numSamples; i += V::width)
+                V::store(dest + i, V::add(V::load(dest + i), V::load(src + i)));
+
+            for (; i < numSamples; ++i)
+                dest[i] += src[i];
+        }
+
+        static void addWithRamp(float* dest, const float* src, int numSamples, float startGain, float endGain)
+        {
+            const float step = numSamples > 0 ? (endGain - startGain) / (float)numSamples : 0.0f;
+            auto gain = V::ramp(startGain, step);
+            const auto gainStep = V::set1(step * (float)V::width);
+
+            int i = 0;
+            for (; i + V::width <= numSamples; i += V::width)
+            {
+                V::store(dest + i, V::add(V::load(dest + i), V::mul(V::load(src + i), gain)));
+                gain = V::add(gain, gainStep);
+            }
+
+            for (; i < numSamples; ++i)
+                dest[i] += src[i] * (startGain + step * (float)i);
+        }
+
+        static void applyRamp(float* data, int numSamples, float startGain, float endGain)
+        {
+            const float step = numSamples > 0 ? (endGain - startGain) / (float)numSamples : 0.0f;
+            auto gain = V::ramp(startGain, step);
+            const auto gainStep = V::set1(step * (float)V::width);
+
+            int i = 0;
+            for (; i + V::width <= numSamples; i += V::width)
+            {
+                V::store(data + i, V::mul(V::load(data + i), gain));
+                gain = V::add(gain, gainStep);
+            }
+
+            for (; i < numSamples; ++i)
+                data[i] *= startGain + step * (float)i;
+        }
+
+        static void addMonoPanned(float* left, float* right, const float* src, int numSamples,
+                                  float leftStart, float leftEnd, float rightStart, float rightEnd)
+        {
+            const float leftStep = numSamples > 0 ? (leftEnd - leftStart) / (float)numSamples : 0.0f;
+            const float rightStep = numSamples > 0 ? (rightEnd - rightStart) / (float)numSamples : 0.0f;
+            auto leftGain = V::ramp(leftStart, leftStep);
+            auto rightGain = V::ramp(rightStart, rightStep);
+            const auto leftGainStep = V::set1(leftStep * (float)V::width);
+            const auto rightGainStep = V::set1(rightStep * (float)V::width);
+
+            int i = 0;
+            for (; i + V::width <= numSamples; i += V::width)
+            {
+                const auto s = V::load(src + i);
+                V::store(left + i, V::add(V::load(left + i), V::mul(s, leftGain)));
+                V::store(right + i, V::add(V::load(right + i), V::mul(s, rightGain)));
+                leftGain = V::add(leftGain, leftGainStep);
+                rightGain = V::add(rightGain, rightGainStep);
+            }
+
+            for (; i < numSamples; ++i)
+            {
+                left[i] += src[i] * (leftStart + leftStep * (float)i);
+                right[i] += src[i] * (rightStart + rightStep * (float)i);
+            }
+        }
+
+        static void applyFade(float* data, int numSamples, float position, float increment)
+        {
+            auto x = V::ramp(position, increment);
+            const auto xStep = V::set1(increment * (float)V::width);
+            const auto zero = V::set1(0.0f);
+            const auto one = V::set1(1.0f);
+
+            int i = 0;
+            for (; i + V::width <= numSamples; i += V::width)
+            {
+                const auto clamped = V::min(V::max(x, zero), one);
+                V::store(data + i, V::mul(V::load(data + i), equalPowerCurve<V>(clamped)));
+                x = V::add(x, xStep);
+            }
+
+            for (; i < numSamples; ++i)
+            {
+                float clamped = position + increment * (float)i;
+                clamped = clamped < 0.0f ? 0.0f : (clamped > 1.0f ? 1.0f : clamped);
+                data[i] *= ScalarCurve::evaluate(clamped);
+            }
+        }
+
+    private:
+        struct ScalarCurve
+        {
+            static float evaluate(float x)
+            {
+                const float u = x * 1.57079633f;
+                const float u2 = u * u;
+                return u * (1.0f + u2 * (-1.0f / 6.0f + u2 * (1.0f / 120.0f + u2 * (-1.0f / 5040.0f))));
+            }
+        };
+    };
+
+    template <typename V>
+    Table makeTable(const char* name)
+    {
+        return { name, &Kernels<V>::add, &Kernels<V>::addWithRamp, &Kernels<V>::applyRamp,
+                 &Kernels<V>::addMonoPanned, &Kernels<V>::applyFade };
+    }
+
+    // Defined in MixKernelsAvx.cpp; nullptr when the build has no AVX kernels
+    const Table* getAvxTable();
+}
@@ -0,0 +1,617 @@
+#include "MultiTrackRecorder.h"
+#include <limits>
+#include <utility>
+
+#if JUCE_LINUX || JUCE_MAC
+ #include <fcntl.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// Reserves disk blocks past the end of a file that is being written, so the file
+// system doesn't have to find space (or fragment the file) while the writer is
+// trying to keep up. Unused blocks are released when the file is closed.
+// A no-op where the platform has no way to do this without changing the file size.
+class DiskReservation
+{
+public:
+    ~DiskReservation() { close(); }
+
+    void open(const juce::File& file)
+    {
+       #if JUCE_LINUX || JUCE_MAC
+        fd = ::open(file.getFullPathName().toRawUTF8(), O_WRONLY);
+       #else
+        juce::ignoreUnused(file);
+       #endif
+    }
+
+    // Keeps at least aheadBytes reserved past usedBytes, in large steps
+    void ensure(juce::int64 usedBytes, juce::int64 aheadBytes)
+    {
+        if (fd < 0 || usedBytes + aheadBytes / 2 <= reserved)
+            return;
+
+        const auto end = usedBytes + aheadBytes;
+       #if JUCE_LINUX
+        if (::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)end) == 0)
+            reserved = end;
+       #elif JUCE_MAC
+        fstore_t store { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, (off_t)(end - reserved), 0 };
+        if (::fcntl(fd, F_PREALLOCATE, &store) == -1)
+        {
+            store.fst_flags = F_ALLOCATEALL;
+            if (::fcntl(fd, F_PREALLOCATE, &store) == -1)
+                return;
+        }
+        reserved = end;
+       #endif
+    }
+
+    // After the writer has closed the file
+    void close()
+    {
+       #if JUCE_LINUX || JUCE_MAC
+        if (fd >= 0)
+        {
+            // Blocks beyond the end stay allocated until the file is truncated
+            struct stat info;
+            if (::fstat(fd, &info) == 0)
+                juce::ignoreUnused(::ftruncate(fd, info.st_size));
+
+            ::close(fd);
+        }
+       #endif
+        fd = -1;
+        reserved = 0;
+    }
+
+private:
+    int fd = -1;
+    juce::int64 reserved = 0;
+};
+
+//==============================================================================
+struct MultiTrackRecorder::History
+{
+    explicit History(int size) : samples((size_t)size, 0.0f) {}
+
+    std::vector<float> samples; // Indexed by input position modulo size
+    std::atomic<juce::int64> validFrom { std::numeric_limits<juce::int64>::max() }; // Set by the first write
+};
+
+struct MultiTrackRecorder::TakeFile
+{
+    juce::File file;
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+    DiskReservation reservation;
+    juce::AudioFormatWriter::ThreadedWriter::IncomingDataReceiver* receiver = nullptr;
+    int pass = 0;
+    juce::int64 startPosition = 0;
+    juce::int64 numSamples = 0;
+};
+
+struct MultiTrackRecorder::Take
+{
+    int inputIndex = 0;
+    Input input;
+    std::array<History*, 2> sources {}; // nullptr: input the device doesn't have
+    int bytesPerFrame = 0;
+
+    // Writer thread
+    std::unique_ptr<TakeFile> current;
+    std::unique_ptr<TakeFile> next; // Opened ahead for the next loop pass
+    juce::int64 readPosition = 0;
+    size_t nextWrap = 0;
+    juce::AudioBuffer<float> buffer;
+};
+
+//==============================================================================
+class MultiTrackRecorder::WriterThread : public juce::Thread
+{
+public:
+    explicit WriterThread(MultiTrackRecorder& r) : juce::Thread("Recording Writer"), recorder(r) {}
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            recorder.readWraps();
+
+            bool wroteAnything = false;
+            for (auto& take : recorder.takes)
+                wroteAnything |= recorder.writeAvailable(*take);
+
+            // The audio thread can't signal without risking a lock, so poll
+            if (!wroteAnything)
+                wait(5);
+        }
+
+        // Stopped: write up to the stop position
+        recorder.readWraps();
+        for (auto& take : recorder.takes)
+            recorder.writeAvailable(*take);
+    }
+
+private:
+    MultiTrackRecorder& recorder;
+};
+
+//==============================================================================
+MultiTrackRecorder::MultiTrackRecorder() = default;
+
+MultiTrackRecorder::~MultiTrackRecorder()
+{
+    stop();
+
+    for (int channel = 0; channel < maxInputChannels; ++channel)
+        removeHistory(channel);
+}
+
+void MultiTrackRecorder::prepare(double newSampleRate)
+{
+    jassert(!recording.load());
+
+    sampleRate = newSampleRate;
+    safetyMargin = (int)(sampleRate * 0.5);
+    applyCapturedInputs(); // Resizes the rings
+}
+
+void MultiTrackRecorder::setPreRollSeconds(double seconds)
+{
+    preRollSeconds = juce::jmax(0.0, seconds);
+    applyCapturedInputs();
+}
+
+void MultiTrackRecorder::setCapturedInputs(const juce::BigInteger& channels)
+{
+    if (channels == capturedChannels) return;
+
+    capturedChannels = channels;
+    applyCapturedInputs();
+}
+
+void MultiTrackRecorder::applyCapturedInputs()
+{
+    const bool isBusy = recording.load();
+
+    for (int channel = 0; channel < maxInputChannels; ++channel)
+    {
+        auto& history = ownedHistories[(size_t)channel];
+        const bool wanted = preRollSeconds > 0.0 && capturedChannels[channel];
+
+        // Takes read from the rings until they stop
+        if (history != nullptr && !isBusy && (!wanted || (int)history->samples.size() != getHistorySize()))
+            removeHistory(channel);
+
+        if (history == nullptr && wanted)
+            createHistory(channel);
+    }
+}
+
+int MultiTrackRecorder::getHistorySize() const
+{
+    return (int)((preRollSeconds + fifoSeconds) * sampleRate);
+}
+
+void MultiTrackRecorder::createHistory(int channel)
+{
+    auto& history = ownedHistories[(size_t)channel];
+    history = std::make_unique<History>(getHistorySize());
+    histories[(size_t)channel] = history.get();
+}
+
+void MultiTrackRecorder::removeHistory(int channel)
+{
+    if (ownedHistories[(size_t)channel] == nullptr) return;
+
+    // Wait for the audio thread to let go of it
+    histories[(size_t)channel] = nullptr;
+    while (callbacksInFlight.load() != 0)
+        juce::Thread::yield();
+
+    ownedHistories[(size_t)channel].reset();
+}
+
+//==============================================================================
+bool MultiTrackRecorder::start(const std::vector<Input>& inputs, int bits, juce::int64 preRollSamples,
+                               bool loop, juce::String& error)
+{
+    jassert(!recording.load());
+    jassert(bits == 24 || bits == 32);
+
+    bitsPerSample = bits;
+    loopTakes = loop;
+    takes.clear();
+    recordedTakes.clear();
+    wraps.clear();
+    wraps.reserve(1024);
+    wrapFifo.reset();
+
+    // Recording needs the rings even without pre-roll
+    for (const auto& input : inputs)
+        for (int channel = input.firstChannel; channel < std::min(input.firstChannel + input.numChannels, maxInputChannels); ++channel)
+            if (ownedHistories[(size_t)channel] == nullptr)
+                createHistory(channel);
+
+    recordStart = inputPosition.load();
+    const auto firstPosition = recordStart - juce::jlimit<juce::int64>(0, (juce::int64)(preRollSeconds * sampleRate), preRollSamples);
+
+    auto abandon = [this] {
+        for (auto& take : takes)
+            for (auto* file : { take->current.get(), take->next.get() })
+                if (file != nullptr)
+                {
+                    file->writer.reset();
+                    file->reservation.close();
+                    file->file.deleteFile();
+                }
+
+        takes.clear();
+    };
+
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        auto take = std::make_unique<Take>();
+        take->inputIndex = (int)i;
+        take->input = inputs[i];
+        take->bytesPerFrame = take->input.numChannels * bitsPerSample / 8;
+        take->readPosition = firstPosition;
+        take->buffer.setSize(take->input.numChannels, 8192);
+
+        for (int c = 0; c < take->input.numChannels; ++c)
+        {
+            const int channel = take->input.firstChannel + c;
+            take->sources[(size_t)c] = channel < maxInputChannels ? ownedHistories[(size_t)channel].get() : nullptr;
+        }
+
+        take->current = openFile(take->input.file, take->input.numChannels, error);
+        if (take->current != nullptr && loopTakes)
+            take->next = openFile(getPassFile(*take, 1), take->input.numChannels, error);
+
+        const bool failed = take->current == nullptr || (loopTakes && take->next == nullptr);
+        takes.push_back(std::move(take));
+
+        if (failed)
+        {
+            abandon();
+            return false;
+        }
+    }
+
+    for (auto& take : takes)
+    {
+        take->current->startPosition = firstPosition;
+        activate(*take, *take->current);
+    }
+
+    resetStatistics();
+    stopPosition = std::numeric_limits<juce::int64>::max();
+    anchored = false;
+
+    writerThread = std::make_unique<WriterThread>(*this);
+    writerThread->startThread(juce::Thread::Priority::high);
+
+    recording = true;
+    return true;
+}
+
+std::vector<MultiTrackRecorder::RecordedTake> MultiTrackRecorder::stop()
+{
+    if (!recording.load()) return {};
+
+    // No more loop wraps; the writer finishes what the rings hold up to now
+    recording = false;
+    stopPosition = inputPosition.load();
+
+    writerThread->stopThread(10000);
+    writerThread.reset();
+
+    for (auto& take : takes)
+    {
+        finishFile(*take, std::move(take->current));
+
+        if (take->next != nullptr)
+        {
+            take->next->writer.reset();
+            take->next->reservation.close();
+            take->next->file.deleteFile();
+        }
+    }
+
+    takes.clear();
+    applyCapturedInputs(); // Drops rings only the takes needed
+
+    return std::move(recordedTakes);
+}
+
+//==============================================================================
+void MultiTrackRecorder::process(const juce::AudioBuffer<float>& deviceBuffer, int startSample, int numSamples)
+{
+    callbacksInFlight.fetch_add(1);
+
+    // The previous callback is complete now, its loop wraps included
+    inputPosition = callbackEnd;
+    callbackStart = callbackEnd;
+
+    for (int channel = 0; channel < maxInputChannels; ++channel)
+    {
+        auto* history = histories[(size_t)channel].load();
+        if (history == nullptr) continue;
+
+        if (history->validFrom.load() > callbackStart)
+            history->validFrom = callbackStart;
+
+        const int size = (int)history->samples.size();
+        const int index = (int)(callbackStart % size);
+        const int firstPart = std::min(numSamples, size - index);
+        auto* ring = history->samples.data();
+
+        // Inputs the device doesn't have (any more) record silence
+        if (channel < deviceBuffer.getNumChannels())
+        {
+            const auto* source = deviceBuffer.getReadPointer(channel, startSample);
+            juce::FloatVectorOperations::copy(ring + index, source, firstPart);
+            if (firstPart < numSamples)
+                juce::FloatVectorOperations::copy(ring, source + firstPart, numSamples - firstPart);
+        }
+        else
+        {
+            juce::FloatVectorOperations::clear(ring + index, firstPart);
+            if (firstPart < numSamples)
+                juce::FloatVectorOperations::clear(ring, numSamples - firstPart);
+        }
+    }
+
+    callbackEnd += numSamples;
+    callbacksInFlight.fetch_sub(1);
+}
+
+void MultiTrackRecorder::markLoopWrap(int sampleOffset)
+{
+    if (!recording.load() || !loopTakes) return;
+
+    int start1, size1, start2, size2;
+    wrapFifo.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 > 0)
+        wrapPositions[(size_t)start1] = callbackStart + sampleOffset;
+    wrapFifo.finishedWrite(size1);
+}
+
+void MultiTrackRecorder::markTimelinePosition(int sampleOffset, double beat)
+{
+    if (!recording.load() || anchored.load()) return;
+
+    anchorPosition = callbackStart + sampleOffset;
+    anchorBeat = beat;
+    anchored = true;
+}
+
+bool MultiTrackRecorder::getTimelineAnchor(juce::int64& sampleOffset, double& beat) const
+{
+    if (recording.load() || !anchored.load()) return false;
+
+    sampleOffset = anchorPosition - recordStart;
+    beat = anchorBeat;
+    return true;
+}
+
+//==============================================================================
+void MultiTrackRecorder::readWraps()
+{
+    int start1, size1, start2, size2;
+    wrapFifo.prepareToRead(wrapFifo.getNumReady(), start1, size1, start2, size2);
+
+    for (int i = 0; i < size1; ++i) wraps.push_back(wrapPositions[(size_t)(start1 + i)]);
+    for (int i = 0; i < size2; ++i) wraps.push_back(wrapPositions[(size_t)(start2 + i)]);
+
+    wrapFifo.finishedRead(size1 + size2);
+}
+
+bool MultiTrackRecorder::writeAvailable(Take& take)
+{
+    const auto end = std::min(inputPosition.load(), stopPosition.load());
+    if (take.readPosition >= end)
+        return false;
+
+    // Pre-roll is behind by design, only count from where recording started
+    const auto backlog = (int)(end - std::max(take.readPosition, recordStart));
+    if (backlog > fifoHighWater.load())
+        fifoHighWater = backlog;
+
+    while (take.readPosition < end)
+    {
+        auto limit = end;
+
+        if (loopTakes)
+        {
+            // Wraps from before this pass (or reported just as recording started) don't split
+            while (take.nextWrap < wraps.size() && wraps[take.nextWrap] <= std::max(take.current->startPosition, recordStart))
+                ++take.nextWrap;
+
+            if (take.nextWrap < wraps.size())
+            {
+                if (wraps[take.nextWrap] <= take.readPosition)
+                {
+                    switchToNextPass(take, take.readPosition);
+                    ++take.nextWrap;
+                    continue;
+                }
+
+                limit = std::min(limit, wraps[take.nextWrap]);
+            }
+        }
+
+        const int numSamples = (int)std::min<juce::int64>(limit - take.readPosition, take.buffer.getNumSamples());
+        read(take, take.readPosition, numSamples);
+        write(take, numSamples);
+        take.readPosition += numSamples;
+    }
+
+    return true;
+}
+
+void MultiTrackRecorder::read(Take& take, juce::int64 position, int numSamples)
+{
+    int ringSize = std::numeric_limits<int>::max();
+
+    for (int c = 0; c < take.input.numChannels; ++c)
+    {
+        auto* dest = take.buffer.getWritePointer(c);
+        auto* history = take.sources[(size_t)c];
+
+        if (history == nullptr)
+        {
+            juce::FloatVectorOperations::clear(dest, numSamples);
+            continue;
+        }
+
+        const int size = (int)history->samples.size();
+        const int index = (int)(position % size);
+        const int firstPart = std::min(numSamples, size - index);
+        ringSize = std::min(ringSize, size);
+
+        juce::FloatVectorOperations::copy(dest, history->samples.data() + index, firstPart);
+        if (firstPart < numSamples)
+            juce::FloatVectorOperations::copy(dest + firstPart, history->samples.data(), numSamples - firstPart);
+
+        // Before the ring was first written (armed just now)
+        const auto valid = (int)juce::jlimit<juce::int64>(0, numSamples, history->validFrom.load() - position);
+        juce::FloatVectorOperations::clear(dest, valid);
+    }
+
+    if (ringSize == std::numeric_limits<int>::max())
+        return;
+
+    // Whatever the audio thread may have overwritten meanwhile is lost
+    const auto oldestIntact = inputPosition.load() + safetyMargin - ringSize;
+    const auto lost = (int)juce::jlimit<juce::int64>(0, numSamples, oldestIntact - position);
+    if (lost > 0)
+    {
+        for (int c = 0; c < take.input.numChannels; ++c)
+            juce::FloatVectorOperations::clear(take.buffer.getWritePointer(c), lost);
+
+        droppedSamples.fetch_add(lost);
+    }
+}
+
+void MultiTrackRecorder::write(Take& take, int numSamples)
+{
+    auto& file = *take.current;
+    file.writer->writeFromFloatArrays(take.buffer.getArrayOfReadPointers(), take.input.numChannels, numSamples);
+
+    if (file.receiver != nullptr)
+        file.receiver->addBlock(file.numSamples, take.buffer, 0, numSamples);
+
+    file.numSamples += numSamples;
+    file.reservation.ensure(file.numSamples * take.bytesPerFrame,
+                            (juce::int64)(sampleRate * reserveAheadSeconds) * take.bytesPerFrame);
+}
+
+void MultiTrackRecorder::switchToNextPass(Take& take, juce::int64 position)
+{
+    const int pass = take.current->pass + 1;
+
+    // Normally opened during the previous pass
+    auto nextFile = std::move(take.next);
+    if (nextFile == nullptr)
+    {
+        juce::String error;
+        nextFile = openFile(getPassFile(take, pass), take.input.numChannels, error);
+        if (nextFile == nullptr) return; // Keep writing to the current file
+    }
+
+    nextFile->pass = pass;
+    nextFile->startPosition = position;
+    activate(take, *nextFile);
+
+    finishFile(take, std::exchange(take.current, std::move(nextFile)));
+
+    juce::String error;
+    take.next = openFile(getPassFile(take, pass + 1), take.input.numChannels, error);
+}
+
+void MultiTrackRecorder::activate(const Take& take, TakeFile& file) const
+{
+    if (onFileStarted != nullptr)
+        file.receiver = onFileStarted(file.file);
+
+    if (file.receiver != nullptr)
+        file.receiver->reset(take.input.numChannels, sampleRate, 0);
+}
+
+void MultiTrackRecorder::finishFile(const Take& take, std::unique_ptr<TakeFile> file)
+{
+    file->writer.reset(); // Flushes and updates the header
+    file->reservation.close();
+
+    if (file->receiver != nullptr && onFileFinished != nullptr)
+        onFileFinished(file->file);
+
+    if (file->numSamples == 0)
+    {
+        file->file.deleteFile();
+        return;
+    }
+
+    RecordedTake recorded;
+    recorded.inputIndex = take.inputIndex;
+    recorded.pass = file->pass;
+    recorded.file = file->file;
+    recorded.startOffset = file->pass == 0 ? file->startPosition - recordStart : 0;
+    recorded.numSamples = file->numSamples;
+    recordedTakes.push_back(recorded);
+}
+
+std::unique_ptr<MultiTrackRecorder::TakeFile> MultiTrackRecorder::openFile(const juce::File& file, int numChannels,
+                                                                          juce::String& error) const
+{
+    auto takeFile = std::make_unique<TakeFile>();
+    takeFile->file = file;
+
+    // A large stream buffer turns many small writes into few big ones
+    auto fileStream = file.createOutputStream(1 << 20);
+    if (fileStream != nullptr && fileStream->openedOk())
+    {
+        // 32 bits are written as float
+        juce::WavAudioFormat wavFormat;
+        takeFile->writer.reset(wavFormat.createWriterFor(fileStream.get(), sampleRate, (unsigned int)numChannels,
+                                                         bitsPerSample, {}, 0));
+        if (takeFile->writer != nullptr)
+            fileStream.release(); // Writer takes ownership
+    }
+
+    if (takeFile->writer == nullptr)
+    {
+        error = "Can't create " + file.getFullPathName();
+        return nullptr;
+    }
+
+    takeFile->reservation.open(file);
+    takeFile->reservation.ensure(0, (juce::int64)(sampleRate * reserveAheadSeconds) * numChannels * bitsPerSample / 8);
+    return takeFile;
+}
+
+juce::File MultiTrackRecorder::getPassFile(const Take& take, int pass) const
+{
+    const auto& first = take.input.file;
+    return first.getSiblingFile(first.getFileNameWithoutExtension() + "_take" + juce::String(pass + 1) + first.getFileExtension())
+                .getNonexistentSibling(false);
+}
+
+//==============================================================================
+MultiTrackRecorder::Statistics MultiTrackRecorder::getStatistics() const
+{
+    Statistics result;
+    result.droppedSamples = droppedSamples.load();
+    result.fifoHighWater = fifoHighWater.load();
+    result.fifoSize = (int)(sampleRate * fifoSeconds) - safetyMargin;
+    return result;
+}
+
+void MultiTrackRecorder::resetStatistics()
+{
+    droppedSamples = 0;
+    fifoHighWater = 0;
+}
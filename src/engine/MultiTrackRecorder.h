@@ -0,0 +1,164 @@
+#pragma once
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+// Records armed tracks, each from its own device inputs, without blocking the
+// audio thread.
+//
+// The audio callback writes every captured device input into a lock-free history
+// ring, whether recording or not. A writer thread reads the rings into 24-bit or
+// 32-bit float WAV files, reserving disk space ahead of what it has written. As
+// the rings always hold the last preRoll seconds, a take's file can start before
+// the moment recording was started.
+//
+// Loop recording: every loop wrap the audio thread reports starts a new pass, and
+// the writer thread switches each take to the next file (opened in advance), so
+// nothing stops or allocates at the wrap.
+//
+// If the disk falls behind for longer than the rings hold, the samples that were
+// overwritten are written as silence (so takes stay aligned with the timeline) and
+// counted.
+class MultiTrackRecorder
+{
+public:
+    static constexpr int maxInputChannels = 32;
+    static constexpr double fifoSeconds = 4.0;          // How far the writer may fall behind
+    static constexpr double reserveAheadSeconds = 30.0;
+
+    struct Input
+    {
+        juce::File file;      // Later passes go next to it, as "<name>_take<n>.wav"
+        int firstChannel = 0; // Device input channel
+        int numChannels = 2;  // 1 (mono) or 2 (stereo)
+    };
+
+    // One file of one input
+    struct RecordedTake
+    {
+        int inputIndex = 0;
+        int pass = 0;             // 0 until the first loop wrap, then one per wrap
+        juce::File file;
+        juce::int64 startOffset = 0; // Pass 0: samples relative to start() (negative with pre-roll);
+                                     // later passes: 0, they start at the loop start
+        juce::int64 numSamples = 0;
+    };
+
+    struct Statistics
+    {
+        juce::int64 droppedSamples = 0; // Written as silence because the writer fell too far behind
+        int fifoHighWater = 0;          // Most samples the writer was ever behind
+        int fifoSize = 0;
+    };
+
+    MultiTrackRecorder();
+    ~MultiTrackRecorder();
+
+    // Message thread, audio stopped. Sets the rate the rings are sized for.
+    void prepare(double sampleRate);
+
+    // Message thread. How much input the rings keep (30 s by default, 0 turns them off when not
+    // recording). The extra audio goes at the start of the file; clips start at the record point
+    // and can be trimmed back into it (ProjectState::trimClipStart).
+    void setPreRollSeconds(double seconds);
+    double getPreRollSeconds() const { return preRollSeconds; }
+
+    // Message thread. Device inputs to keep history of: those of armed tracks. Rings are
+    // only ever removed while not recording.
+    void setCapturedInputs(const juce::BigInteger& channels);
+
+    // Writer thread: called when a file starts and after it has been closed (peak analysis).
+    std::function<juce::AudioFormatWriter::ThreadedWriter::IncomingDataReceiver*(const juce::File&)> onFileStarted;
+    std::function<void(const juce::File&)> onFileFinished;
+
+    // Message thread. Creates the files and records from preRollSamples (as far as history
+    // goes) before now. bitsPerSample is 24 (integer) or 32 (float). With loopTakes every
+    // reported loop wrap starts a new pass. Returns false and sets 'error' if a file can't
+    // be created, in which case nothing is recorded.
+    bool start(const std::vector<Input>& inputs, int bitsPerSample, juce::int64 preRollSamples,
+               bool loopTakes, juce::String& error);
+
+    // Message thread. Writes what is still buffered, closes the files and returns them.
+    std::vector<RecordedTake> stop();
+
+    bool isRecording() const { return recording.load(); }
+
+    // Audio thread, at the start of every callback. No locks, no allocation.
+    void process(const juce::AudioBuffer<float>& deviceBuffer, int startSample, int numSamples);
+
+    // Audio thread. The playhead jumped back to the loop start this many samples into the callback.
+    void markLoopWrap(int sampleOffset);
+
+    // Audio thread. The timeline was at 'beat' this many samples into the callback. The first
+    // call after start() anchors the takes to the timeline (a count-in holds the playhead).
+    void markTimelinePosition(int sampleOffset, double beat);
+
+    // After stop(): the anchor, in samples relative to start(). False if the timeline never moved.
+    bool getTimelineAnchor(juce::int64& sampleOffset, double& beat) const;
+
+    Statistics getStatistics() const;
+    void resetStatistics();
+
+private:
+    struct History;
+    struct TakeFile;
+    struct Take;
+    class WriterThread;
+
+    void applyCapturedInputs();
+    void createHistory(int channel);
+    void removeHistory(int channel);
+    int getHistorySize() const;
+    std::unique_ptr<TakeFile> openFile(const juce::File& file, int numChannels, juce::String& error) const;
+    juce::File getPassFile(const Take& take, int pass) const;
+
+    bool writeAvailable(Take& take);
+    void read(Take& take, juce::int64 position, int numSamples);
+    void readWraps();
+    void write(Take& take, int numSamples);
+    void switchToNextPass(Take& take, juce::int64 position);
+    void activate(const Take& take, TakeFile& file) const;
+    void finishFile(const Take& take, std::unique_ptr<TakeFile> file);
+
+    double sampleRate = 44100.0;
+    double preRollSeconds = 30.0;
+    int bitsPerSample = 24;
+
+    // Input history, written by the audio thread
+    std::array<std::atomic<History*>, maxInputChannels> histories {};
+    std::array<std::unique_ptr<History>, maxInputChannels> ownedHistories;
+    juce::BigInteger capturedChannels;
+    int safetyMargin = 0;              // Covers the block being written
+    juce::int64 callbackStart = 0;     // Audio thread
+    juce::int64 callbackEnd = 0;
+    std::atomic<juce::int64> inputPosition { 0 }; // Everything before it is in the rings
+
+    // Loop wraps, audio thread -> writer thread
+    static constexpr int maxPendingWraps = 64;
+    juce::AbstractFifo wrapFifo { maxPendingWraps };
+    std::array<juce::int64, maxPendingWraps> wrapPositions {};
+    std::vector<juce::int64> wraps; // Writer thread
+
+    std::vector<std::unique_ptr<Take>> takes; // Fixed while recording
+    std::vector<RecordedTake> recordedTakes;  // Writer thread while recording
+    std::unique_ptr<WriterThread> writerThread;
+    juce::int64 recordStart = 0;
+    bool loopTakes = false;
+    std::atomic<juce::int64> stopPosition { 0 };
+
+    // Timeline anchor, written once by the audio thread
+    std::atomic<bool> anchored { false };
+    juce::int64 anchorPosition = 0;
+    double anchorBeat = 0.0;
+
+    std::atomic<bool> recording { false };
+    std::atomic<int> callbacksInFlight { 0 };
+    std::atomic<juce::int64> droppedSamples { 0 };
+    std::atomic<int> fifoHighWater { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(MultiTrackRecorder)
+};
@@ -0,0 +1,109 @@
+#include "OfflineRender.h"
+
+juce::String OfflineRenderSettings::validate() const
+{
+    if (file == juce::File())
+        return "No output file";
+
+    if (bitDepth != 16 && bitDepth != 24 && bitDepth != 32)
+        return "Unsupported bit depth: " + juce::String(bitDepth);
+
+    if (format == Format::Flac && bitDepth == 32)
+        return "FLAC supports 16 and 24 bits only";
+
+    if (range == Range::Custom && endBeat <= startBeat)
+        return "Empty render range";
+
+    return {};
+}
+
+//==============================================================================
+OfflineRenderWriter::OfflineRenderWriter(const juce::File& t, const juce::File& tmp, std::unique_ptr<juce::AudioFormatWriter> w,
+                                         int numChannels, float dither)
+    : target(t), temp(tmp), writer(std::move(w)), dithered(numChannels, 0), ditherAmplitude(dither)
+{
+}
+
+OfflineRenderWriter::~OfflineRenderWriter()
+{
+    // Not finished: throw the partial file away
+    if (writer != nullptr)
+    {
+        writer.reset();
+        temp.deleteFile();
+    }
+}
+
+std::unique_ptr<OfflineRenderWriter> OfflineRenderWriter::create(const OfflineRenderSettings& settings, double sampleRate,
+                                                                 int numChannels, juce::String& error)
+{
+    error = settings.validate();
+    if (error.isNotEmpty())
+        return nullptr;
+
+    std::unique_ptr<juce::AudioFormat> format;
+    if (settings.format == OfflineRenderSettings::Format::Flac)
+        format = std::make_unique<juce::FlacAudioFormat>();
+    else
+        format = std::make_unique<juce::WavAudioFormat>();
+
+    auto temp = settings.file.getSiblingFile(settings.file.getFileName() + ".part");
+    settings.file.getParentDirectory().createDirectory();
+    temp.deleteFile();
+
+    std::unique_ptr<juce::FileOutputStream> stream(temp.createOutputStream());
+    if (stream == nullptr)
+    {
+        error = "Can't write to " + temp.getFullPathName();
+        return nullptr;
+    }
+
+    std::unique_ptr<juce::AudioFormatWriter> writer(format->createWriterFor(stream.get(), sampleRate, (unsigned int)numChannels,
+                                                                            settings.bitDepth, {}, 0));
+    if (writer == nullptr)
+    {
+        stream.reset();
+        temp.deleteFile();
+        error = format->getFormatName() + " can't write " + juce::String(settings.bitDepth) + " bit audio at "
+              + juce::String(sampleRate) + " Hz";
+        return nullptr;
+    }
+
+    stream.release(); // Writer owns it now
+
+    const float ditherAmplitude = settings.dither && settings.bitDepth < 32 ? 1.0f / (float)(1 << (settings.bitDepth - 1)) : 0.0f;
+    return std::unique_ptr<OfflineRenderWriter>(new OfflineRenderWriter(settings.file, temp, std::move(writer),
+                                                                        numChannels, ditherAmplitude));
+}
+
+bool OfflineRenderWriter::write(const juce::AudioBuffer<float>& buffer, int startSample, int numSamples)
+{
+    if (numSamples <= 0)
+        return true;
+
+    if (ditherAmplitude == 0.0f)
+        return writer->writeFromAudioSampleBuffer(buffer, startSample, numSamples);
+
+    // TPDF: the sum of two uniform variables, spanning +-1 LSB, decorrelates the
+    // quantisation error from the signal
+    dithered.setSize(dithered.getNumChannels(), numSamples, false, false, true);
+
+    for (int ch = 0; ch < dithered.getNumChannels(); ++ch)
+    {
+        const float* in = buffer.getReadPointer(ch, startSample);
+        float* out = dithered.getWritePointer(ch);
+
+        for (int i = 0; i < numSamples; ++i)
+            out[i] = in[i] + (random.nextFloat() - random.nextFloat()) * ditherAmplitude;
+    }
+
+    return writer->writeFromAudioSampleBuffer(dithered, 0, numSamples);
+}
+
+bool OfflineRenderWriter::finish()
+{
+    writer.reset(); // Flushes the header and closes the stream
+
+    target.deleteFile();
+    return temp.moveFileTo(target);
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <memory>
+
+//==============================================================================
+// What to bounce and where to put it (see AudioEngine::startRender).
+struct OfflineRenderSettings
+{
+    enum class Format { Wav, Flac };
+    enum class Range { Song, Loop, Custom };
+
+    juce::File file;
+    Format format = Format::Wav;
+    int bitDepth = 24;          // 16 or 24; 32 writes floating point (WAV only)
+    bool dither = true;         // TPDF dither when writing 16 or 24 bits
+
+    Range range = Range::Song;  // Song: beat 0 to the end of the last clip
+    double startBeat = 0.0;     // Custom range only
+    double endBeat = 0.0;
+    double tailSeconds = 0.0;   // Keeps rendering past the range for reverb and delay tails
+
+    // Checks the combination of format and bit depth; returns an error message or an empty string
+    juce::String validate() const;
+};
+
+struct OfflineRenderResult
+{
+    bool completed = false;
+    bool cancelled = false;
+    juce::String error;
+    juce::File file;
+    double audioSeconds = 0.0;  // Length of the rendered audio
+    double renderSeconds = 0.0; // Wall clock time it took
+};
+
+//==============================================================================
+// Writes float blocks to the settings' file format, dithered down to its bit depth.
+// The audio goes to a temporary file next to the target, which only replaces the
+// target once finish() is called, so a cancelled render never leaves half a file.
+class OfflineRenderWriter
+{
+public:
+    static std::unique_ptr<OfflineRenderWriter> create(const OfflineRenderSettings& settings, double sampleRate,
+                                                       int numChannels, juce::String& error);
+    ~OfflineRenderWriter();
+
+    // 'buffer' must have the number of channels the writer was created with
+    bool write(const juce::AudioBuffer<float>& buffer, int startSample, int numSamples);
+    bool finish();
+
+private:
+    OfflineRenderWriter(const juce::File& target, const juce::File& temp, std::unique_ptr<juce::AudioFormatWriter> writer,
+                        int numChannels, float ditherAmplitude);
+
+    const juce::File target, temp;
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+    juce::AudioBuffer<float> dithered;
+    juce::Random random;
+    const float ditherAmplitude; // One LSB of the output format, or 0 for no dither
+
+    JUCE_DECLARE_NON_COPYABLE(OfflineRenderWriter)
+};
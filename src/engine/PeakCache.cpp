@@ -0,0 +1,502 @@
+#include "PeakCache.h"
+#include <juce_cryptography/juce_cryptography.h>
+
+namespace
+{
+    // Peaks are stored as 16 bit values, full scale = 1.0
+    struct StoredPeak
+    {
+        juce::int16 min = 0, max = 0, rms = 0;
+    };
+
+    juce::int16 toStored(float value)
+    {
+        return (juce::int16)juce::jlimit(-32767, 32767, juce::roundToInt(value * 32767.0f));
+    }
+
+    float fromStored(juce::int16 value)
+    {
+        return value / 32767.0f;
+    }
+
+    constexpr int fileMagic = 0x50434941; // "AICP"
+    constexpr int fileVersion = 1;
+}
+
+//==============================================================================
+struct PeakCache::PeakData
+{
+    juce::CriticalSection lock;
+    juce::String identity; // Of the file the peaks describe, empty while it is being recorded
+    int numChannels = 0;
+    double sampleRate = 0.0;
+    juce::int64 lengthInSamples = 0;
+    bool complete = false;
+
+    // Per level, interleaved: peak i of channel c is at i * numChannels + c
+    std::array<std::vector<StoredPeak>, numLevels> levels;
+
+    juce::int64 getNumPeaks(int level) const
+    {
+        return numChannels > 0 ? (juce::int64)levels[(size_t)level].size() / numChannels : 0;
+    }
+
+    // Appends one peak per channel to 'level', combining numPeaks peaks of the level below
+    void appendCombined(int level, juce::int64 firstPeak, juce::int64 numPeaks)
+    {
+        const auto& fine = levels[(size_t)level - 1];
+        auto& coarse = levels[(size_t)level];
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            StoredPeak combined { 32767, -32767, 0 };
+            float sumOfSquares = 0.0f;
+
+            for (auto i = firstPeak; i < firstPeak + numPeaks; ++i)
+            {
+                const auto& peak = fine[(size_t)(i * numChannels + ch)];
+                combined.min = std::min(combined.min, peak.min);
+                combined.max = std::max(combined.max, peak.max);
+                sumOfSquares += fromStored(peak.rms) * fromStored(peak.rms);
+            }
+
+            combined.rms = toStored(std::sqrt(sumOfSquares / (float)numPeaks));
+            coarse.push_back(combined);
+        }
+    }
+
+    // After a peak was added to 'level': complete groups move up the pyramid
+    void cascade(int level)
+    {
+        const auto numFine = getNumPeaks(level);
+        if (level + 1 >= numLevels || numFine % levelRatio != 0) return;
+
+        appendCombined(level + 1, numFine - levelRatio, levelRatio);
+        cascade(level + 1);
+    }
+};
+
+//==============================================================================
+// Turns a stream of samples into base level peaks (and everything above them).
+// Callers hold the PeakData's lock.
+class PeakCache::Builder
+{
+public:
+    explicit Builder(int numChannels) : state((size_t)numChannels) {}
+
+    void process(PeakData& data, const juce::AudioBuffer<float>& buffer, int startSample, int numSamples)
+    {
+        const int numChannels = std::min(data.numChannels, buffer.getNumChannels());
+        int position = 0;
+
+        while (position < numSamples)
+        {
+            const int count = std::min(numSamples - position, baseSamplesPerPeak - samplesInPeak);
+
+            for (int ch = 0; ch < numChannels; ++ch)
+            {
+                const float* samples = buffer.getReadPointer(ch, startSample + position);
+                auto& channel = state[(size_t)ch];
+
+                for (int i = 0; i < count; ++i)
+                {
+                    channel.min = std::min(channel.min, samples[i]);
+                    channel.max = std::max(channel.max, samples[i]);
+                    channel.sumOfSquares += samples[i] * samples[i];
+                }
+            }
+
+            samplesInPeak += count;
+            position += count;
+
+            if (samplesInPeak == baseSamplesPerPeak)
+                flush(data);
+        }
+
+        data.lengthInSamples += numSamples;
+    }
+
+    // End of the file: the partial peak and partial groups of every level are written out
+    void finish(PeakData& data)
+    {
+        if (samplesInPeak > 0)
+            flush(data);
+
+        for (int level = 1; level < numLevels; ++level)
+        {
+            const auto numFine = data.getNumPeaks(level - 1);
+            const auto covered = data.getNumPeaks(level) * levelRatio;
+
+            if (numFine > covered)
+                data.appendCombined(level, covered, numFine - covered);
+        }
+    }
+
+private:
+    struct ChannelState
+    {
+        float min = std::numeric_limits<float>::max();
+        float max = std::numeric_limits<float>::lowest();
+        float sumOfSquares = 0.0f;
+    };
+
+    void flush(PeakData& data)
+    {
+        auto& base = data.levels[0];
+
+        for (int ch = 0; ch < data.numChannels; ++ch)
+        {
+            auto& channel = state[(size_t)ch];
+            base.push_back({ toStored(channel.min), toStored(channel.max),
+                             toStored(std::sqrt(channel.sumOfSquares / (float)samplesInPeak)) });
+            channel = {};
+        }
+
+        samplesInPeak = 0;
+        data.cascade(0);
+    }
+
+    std::vector<ChannelState> state;
+    int samplesInPeak = 0;
+};
+
+//==============================================================================
+class PeakCache::BuildJob : public juce::ThreadPoolJob
+{
+public:
+    BuildJob(PeakCache& c, const juce::File& f, std::shared_ptr<PeakData> d, const juce::File& p)
+        : juce::ThreadPoolJob("Peaks " + f.getFileName()), cache(c), audioFile(f), data(std::move(d)), peakFile(p) {}
+
+    JobStatus runJob() override
+    {
+        if (!cache.load(*data, peakFile))
+            build();
+
+        cache.sendChangeMessage();
+        return jobHasFinished;
+    }
+
+private:
+    void build()
+    {
+        std::unique_ptr<juce::AudioFormatReader> reader(cache.formatManager.createReaderFor(audioFile));
+
+        {
+            const juce::ScopedLock sl(data->lock);
+            data->numChannels = reader != nullptr ? (int)reader->numChannels : 0;
+            data->sampleRate = reader != nullptr ? reader->sampleRate : 0.0;
+        }
+
+        if (reader == nullptr)
+            return; // Stays incomplete and empty: drawn as silence
+
+        constexpr int blockSize = 65536;
+        juce::AudioBuffer<float> buffer((int)reader->numChannels, blockSize);
+        Builder builder((int)reader->numChannels);
+
+        for (juce::int64 position = 0; position < reader->lengthInSamples; position += blockSize)
+        {
+            if (shouldExit())
+                return;
+
+            const int numSamples = (int)std::min<juce::int64>(blockSize, reader->lengthInSamples - position);
+            reader->read(&buffer, 0, numSamples, position, true, true);
+
+            const juce::ScopedLock sl(data->lock);
+            builder.process(*data, buffer, 0, numSamples);
+
+            // Long files show up while they are being analysed
+            if ((position / blockSize) % 16 == 15)
+                cache.sendChangeMessage();
+        }
+
+        {
+            const juce::ScopedLock sl(data->lock);
+            builder.finish(*data);
+            data->complete = true;
+        }
+
+        cache.save(*data, peakFile);
+    }
+
+    PeakCache& cache;
+    const juce::File audioFile;
+    std::shared_ptr<PeakData> data;
+    const juce::File peakFile;
+};
+
+//==============================================================================
+// Fed by the writer's background thread with every block it writes
+class PeakCache::RecordingReceiver : public juce::AudioFormatWriter::ThreadedWriter::IncomingDataReceiver
+{
+public:
+    RecordingReceiver(PeakCache& c, std::shared_ptr<PeakData> d) : cache(c), data(std::move(d)) {}
+
+    void reset(int numChannels, double sampleRate, juce::int64) override
+    {
+        const juce::ScopedLock sl(data->lock);
+        data->numChannels = numChannels;
+        data->sampleRate = sampleRate;
+        data->lengthInSamples = 0;
+        for (auto& level : data->levels)
+            level.clear();
+
+        builder = std::make_unique<Builder>(numChannels);
+    }
+
+    void addBlock(juce::int64, const juce::AudioBuffer<float>& buffer, int startOffset, int numSamples) override
+    {
+        {
+            const juce::ScopedLock sl(data->lock);
+            if (builder != nullptr)
+                builder->process(*data, buffer, startOffset, numSamples);
+        }
+
+        cache.sendChangeMessage();
+    }
+
+    void finish(const juce::String& identity)
+    {
+        const juce::ScopedLock sl(data->lock);
+        if (builder != nullptr)
+            builder->finish(*data);
+
+        data->identity = identity;
+        data->complete = true;
+    }
+
+    const std::shared_ptr<PeakData>& getData() const { return data; }
+
+private:
+    PeakCache& cache;
+    std::shared_ptr<PeakData> data;
+    std::unique_ptr<Builder> builder;
+};
+
+//==============================================================================
+PeakCache::PeakCache(juce::AudioFormatManager& fm) : formatManager(fm)
+{
+}
+
+PeakCache::~PeakCache()
+{
+    pool.removeAllJobs(true, 10000);
+}
+
+void PeakCache::setCacheDirectory(const juce::File& newDirectory)
+{
+    const juce::ScopedLock sl(lock);
+    directory = newDirectory;
+
+    if (directory != juce::File())
+        directory.createDirectory();
+}
+
+bool PeakCache::getInfo(const juce::File& audioFile, Info& info)
+{
+    auto data = findOrQueue(audioFile);
+    if (data == nullptr) return false;
+
+    const juce::ScopedLock sl(data->lock);
+    if (data->numChannels == 0) return false;
+
+    info.numChannels = data->numChannels;
+    info.sampleRate = data->sampleRate;
+    info.lengthInSamples = data->lengthInSamples;
+    info.complete = data->complete;
+    return true;
+}
+
+bool PeakCache::getPeaks(const juce::File& audioFile, int channel, double startSample, double samplesPerPixel,
+                         Peak* dest, int numPixels)
+{
+    std::fill(dest, dest + numPixels, Peak());
+
+    auto data = findOrQueue(audioFile);
+    if (data == nullptr || samplesPerPixel <= 0.0) return false;
+
+    const juce::ScopedLock sl(data->lock);
+    const int numChannels = data->numChannels;
+    if (numChannels == 0) return false;
+    if (channel < 0 || channel >= numChannels) return true;
+
+    // Coarsest level whose peaks are still no wider than a pixel: at most levelRatio + 1 per pixel
+    int level = 0;
+    double samplesPerPeak = baseSamplesPerPeak;
+    while (level + 1 < numLevels && samplesPerPeak * levelRatio <= samplesPerPixel)
+    {
+        ++level;
+        samplesPerPeak *= levelRatio;
+    }
+
+    const auto& peaks = data->levels[(size_t)level];
+    const auto numPeaks = data->getNumPeaks(level);
+
+    for (int i = 0; i < numPixels; ++i)
+    {
+        const double pixelStart = startSample + i * samplesPerPixel;
+        auto first = std::max<juce::int64>(0, (juce::int64)std::floor(pixelStart / samplesPerPeak));
+        auto last = std::min(numPeaks, std::max(first + 1, (juce::int64)std::ceil((pixelStart + samplesPerPixel) / samplesPerPeak)));
+        if (first >= last) continue;
+
+        float min = 1.0f, max = -1.0f, sumOfSquares = 0.0f;
+        for (auto p = first; p < last; ++p)
+        {
+            const auto& peak = peaks[(size_t)(p * numChannels + channel)];
+            min = std::min(min, fromStored(peak.min));
+            max = std::max(max, fromStored(peak.max));
+            sumOfSquares += fromStored(peak.rms) * fromStored(peak.rms);
+        }
+
+        dest[i] = { min, max, std::sqrt(sumOfSquares / (float)(last - first)) };
+    }
+
+    return true;
+}
+
+juce::AudioFormatWriter::ThreadedWriter::IncomingDataReceiver& PeakCache::startRecording(const juce::File& file)
+{
+    const juce::ScopedLock sl(lock);
+
+    auto data = std::make_shared<PeakData>();
+    auto& receiver = recordings[file.getFullPathName()];
+    receiver = std::make_unique<RecordingReceiver>(*this, data);
+    files[file.getFullPathName()] = data;
+
+    return *receiver;
+}
+
+void PeakCache::finishRecording(const juce::File& file)
+{
+    std::unique_ptr<RecordingReceiver> receiver;
+    {
+        const juce::ScopedLock sl(lock);
+        auto it = recordings.find(file.getFullPathName());
+        if (it == recordings.end()) return;
+
+        receiver = std::move(it->second);
+        recordings.erase(it);
+    }
+
+    // The file is closed now, so its identity is final
+    const auto identity = getIdentity(file);
+    receiver->finish(identity);
+    save(*receiver->getData(), getPeakFile(identity));
+    sendChangeMessage();
+}
+
+std::shared_ptr<PeakCache::PeakData> PeakCache::findOrQueue(const juce::File& audioFile)
+{
+    const juce::ScopedLock sl(lock);
+    const auto path = audioFile.getFullPathName();
+
+    auto it = files.find(path);
+    if (it != files.end())
+    {
+        auto data = it->second;
+        bool stale;
+        {
+            // Finished peaks of a file that was changed since are rebuilt
+            const juce::ScopedLock dl(data->lock);
+            stale = data->complete && data->identity != getIdentity(audioFile);
+        }
+
+        if (!stale)
+            return data;
+
+        files.erase(it);
+    }
+
+    if (!audioFile.existsAsFile())
+        return nullptr;
+
+    auto data = std::make_shared<PeakData>();
+    data->identity = getIdentity(audioFile);
+    files[path] = data;
+    pool.addJob(new BuildJob(*this, audioFile, data, getPeakFile(data->identity)), true);
+
+    return data;
+}
+
+juce::String PeakCache::getIdentity(const juce::File& audioFile)
+{
+    return audioFile.getFullPathName() + "|" + juce::String(audioFile.getSize()) + "|"
+         + juce::String(audioFile.getLastModificationTime().toMilliseconds());
+}
+
+juce::File PeakCache::getPeakFile(const juce::String& identity) const
+{
+    const juce::ScopedLock sl(lock);
+    if (directory == juce::File()) return {};
+
+    return directory.getChildFile(juce::MD5(identity.toUTF8()).toHexString() + ".peaks");
+}
+
+bool PeakCache::load(PeakData& data, const juce::File& peakFile)
+{
+    juce::FileInputStream in(peakFile);
+    if (peakFile == juce::File() || !in.openedOk()) return false;
+
+    if (in.readInt() != fileMagic || in.readInt() != fileVersion) return false;
+
+    const int numChannels = in.readInt();
+    const double sampleRate = in.readDouble();
+    const juce::int64 lengthInSamples = in.readInt64();
+
+    if (in.readInt() != baseSamplesPerPeak || in.readInt() != levelRatio || in.readInt() != numLevels
+        || numChannels <= 0 || numChannels > 256)
+        return false;
+
+    std::array<std::vector<StoredPeak>, numLevels> levels;
+    for (auto& level : levels)
+    {
+        const auto count = in.readInt64();
+        if (count < 0 || count * (juce::int64)sizeof(StoredPeak) > in.getNumBytesRemaining()) return false;
+
+        level.resize((size_t)count);
+        in.read(level.data(), (int)(count * (juce::int64)sizeof(StoredPeak)));
+    }
+
+    const juce::ScopedLock sl(data.lock);
+    data.numChannels = numChannels;
+    data.sampleRate = sampleRate;
+    data.lengthInSamples = lengthInSamples;
+    data.levels = std::move(levels);
+    data.complete = true;
+    return true;
+}
+
+void PeakCache::save(const PeakData& data, const juce::File& peakFile)
+{
+    if (peakFile == juce::File()) return;
+
+    // Written next to the target and renamed, so a half-written file is never loaded
+    auto temp = peakFile.withFileExtension(".tmp");
+    temp.deleteFile();
+
+    {
+        juce::FileOutputStream out(temp);
+        if (!out.openedOk()) return;
+
+        const juce::ScopedLock sl(data.lock);
+        out.writeInt(fileMagic);
+        out.writeInt(fileVersion);
+        out.writeInt(data.numChannels);
+        out.writeDouble(data.sampleRate);
+        out.writeInt64(data.lengthInSamples);
+        out.writeInt(baseSamplesPerPeak);
+        out.writeInt(levelRatio);
+        out.writeInt(numLevels);
+
+        for (const auto& level : data.levels)
+        {
+            out.writeInt64((juce::int64)level.size());
+            out.write(level.data(), level.size() * sizeof(StoredPeak));
+        }
+
+        out.flush();
+        if (out.getStatus().failed()) return;
+    }
+
+    temp.moveFileTo(peakFile);
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <array>
+#include <map>
+#include <memory>
+
+//==============================================================================
+// Min/max/RMS overviews of audio files for drawing waveforms.
+//
+// Each file gets a pyramid of levels: the finest has one peak per
+// baseSamplesPerPeak samples, each coarser one combines levelRatio peaks of the
+// level below. Queries pick the coarsest level that still resolves a pixel,
+// so they cost O(pixels) at any zoom, for any file length.
+//
+// Peaks are built on a background thread, published as they grow (listeners get
+// a change message) and saved to the cache directory, keyed by path, size and
+// modification time. Recordings are analysed while they are being written.
+// All public functions are thread-safe.
+class PeakCache : public juce::ChangeBroadcaster
+{
+public:
+    struct Peak
+    {
+        float min = 0.0f;
+        float max = 0.0f;
+        float rms = 0.0f;
+    };
+
+    struct Info
+    {
+        int numChannels = 0;
+        double sampleRate = 0.0;
+        juce::int64 lengthInSamples = 0; // Analysed so far
+        bool complete = false;
+    };
+
+    static constexpr int baseSamplesPerPeak = 256;
+    static constexpr int levelRatio = 4;
+    static constexpr int numLevels = 6; // 256 to 262144 samples per peak
+
+    explicit PeakCache(juce::AudioFormatManager& formatManager);
+    ~PeakCache() override;
+
+    // Where peak files are kept (created if needed). Without one, peaks only live in memory.
+    void setCacheDirectory(const juce::File& directory);
+
+    // False while nothing is known about the file yet; queues it for analysis.
+    bool getInfo(const juce::File& audioFile, Info& info);
+
+    // Fills 'dest' with numPixels peaks of 'channel', pixel i covering the samples from
+    // startSample + i * samplesPerPixel on. Pixels that aren't analysed yet (or lie past
+    // the end) are left silent. Returns false while nothing is known about the file yet.
+    bool getPeaks(const juce::File& audioFile, int channel, double startSample, double samplesPerPixel,
+                  Peak* dest, int numPixels);
+
+    // Recording: analyses what a ThreadedWriter writes to 'file' (pass the result to its
+    // setDataReceiver()). finishRecording() must come after the writer has been deleted.
+    juce::AudioFormatWriter::ThreadedWriter::IncomingDataReceiver& startRecording(const juce::File& file);
+    void finishRecording(const juce::File& file);
+
+private:
+    struct PeakData;
+    class Builder;
+    class BuildJob;
+    class RecordingReceiver;
+
+    std::shared_ptr<PeakData> findOrQueue(const juce::File& audioFile);
+    juce::File getPeakFile(const juce::String& identity) const;
+    static juce::String getIdentity(const juce::File& audioFile);
+
+    bool load(PeakData& data, const juce::File& peakFile);
+    void save(const PeakData& data, const juce::File& peakFile);
+
+    juce::AudioFormatManager& formatManager;
+
+    juce::CriticalSection lock;
+    juce::File directory;
+    std::map<juce::String, std::shared_ptr<PeakData>> files;                // By path
+    std::map<juce::String, std::unique_ptr<RecordingReceiver>> recordings; // By path
+
+    juce::ThreadPool pool { 1 };
+
+    JUCE_DECLARE_NON_COPYABLE(PeakCache)
+};
@@ -0,0 +1,90 @@
+#include "PluginLoader.h"
+
+//==============================================================================
+PluginLoader::PluginLoader(juce::AudioPluginFormatManager& fm)
+    : formatManager(fm)
+{
+}
+
+PluginLoader::~PluginLoader()
+{
+    // Whatever still holds one of these drops it itself
+    stopTimer();
+    released.clear();
+    masterReference.clear();
+}
+
+void PluginLoader::load(const juce::PluginDescription& description, double sampleRate, int blockSize,
+                        const juce::MemoryBlock& state, Callback onLoaded)
+{
+    ++numPendingLoads;
+    juce::WeakReference<PluginLoader> weakThis(this);
+
+    formatManager.createPluginInstanceAsync(description, sampleRate, blockSize,
+        [weakThis, sampleRate, blockSize, state, onLoaded](std::unique_ptr<juce::AudioPluginInstance> created, const juce::String& error) {
+            if (weakThis == nullptr) return;
+
+            if (created == nullptr)
+            {
+                --weakThis->numPendingLoads;
+                onLoaded(nullptr, error.isNotEmpty() ? error : juce::String("Can't create the plugin"));
+                return;
+            }
+
+            std::shared_ptr<juce::AudioPluginInstance> instance(created.release());
+
+            // State and preparation go in as separate messages, so other loads and the UI
+            // get a turn in between
+            juce::MessageManager::callAsync([weakThis, instance, sampleRate, blockSize, state, onLoaded] {
+                if (weakThis == nullptr) return;
+
+                if (!state.isEmpty())
+                    instance->setStateInformation(state.getData(), (int)state.getSize());
+
+                juce::MessageManager::callAsync([weakThis, instance, sampleRate, blockSize, onLoaded] {
+                    if (weakThis == nullptr) return;
+
+                    if (sampleRate > 0)
+                        instance->prepareToPlay(sampleRate, blockSize);
+
+                    --weakThis->numPendingLoads;
+                    onLoaded(instance, {});
+                });
+            });
+        });
+}
+
+void PluginLoader::release(std::shared_ptr<juce::AudioPluginInstance> instance)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+
+    if (instance == nullptr) return;
+
+    released.push_back(std::move(instance));
+    timerCallback();
+}
+
+void PluginLoader::timerCallback()
+{
+    // Snapshots that still hold one are reclaimed within a few blocks. The rest are destroyed
+    // once they're out of the list, in case a destructor releases another.
+    std::vector<std::shared_ptr<juce::AudioPluginInstance>> unused;
+
+    for (auto it = released.begin(); it != released.end();)
+    {
+        if (it->use_count() == 1)
+        {
+            unused.push_back(std::move(*it));
+            it = released.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    if (released.empty())
+        stopTimer();
+    else if (!isTimerRunning())
+        startTimer(20);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+// Loads plugin instances without holding up the message thread longer than the plugin
+// format insists on. Instances are created through createPluginInstanceAsync (VST3
+// still creates them on the message thread, but between other messages rather than in a
+// blocking call). Restoring their state and preparing them stay on the message thread
+// too, since VST3 and AU plugins expect those calls there, but each is its own message so
+// the UI keeps running between the steps of several loads.
+//
+// Instances that are no longer needed are dropped on the message thread once nobody else
+// holds them (render snapshots may still do, for a block or two): plugins whose
+// destructor talks to the message thread would deadlock if it were blocked waiting for
+// them, or if they went on another thread.
+class PluginLoader : private juce::Timer
+{
+public:
+    // Called on the message thread: the prepared instance, or nullptr and an error
+    using Callback = std::function<void(std::shared_ptr<juce::AudioPluginInstance> instance, const juce::String& error)>;
+
+    explicit PluginLoader(juce::AudioPluginFormatManager& formatManager);
+    ~PluginLoader() override;
+
+    // Message thread. 'state' (from getStateInformation) is applied unless it's empty.
+    // Nothing is called back once the loader is gone.
+    void load(const juce::PluginDescription& description, double sampleRate, int blockSize,
+              const juce::MemoryBlock& state, Callback onLoaded);
+
+    // Message thread. Drops 'instance' after every other owner let go of it.
+    void release(std::shared_ptr<juce::AudioPluginInstance> instance);
+
+    // Loads that haven't called back yet
+    int getNumPendingLoads() const { return numPendingLoads.load(); }
+
+private:
+    void timerCallback() override; // Drops released instances nobody else holds any more
+
+    juce::AudioPluginFormatManager& formatManager;
+    std::vector<std::shared_ptr<juce::AudioPluginInstance>> released;
+    std::atomic<int> numPendingLoads { 0 };
+
+    JUCE_DECLARE_WEAK_REFERENCEABLE(PluginLoader)
+    JUCE_DECLARE_NON_COPYABLE(PluginLoader)
+};
@@ -0,0 +1,1323 @@
+#include "PluginSandbox.h"
+#include "../components/PluginWindow.h"
+#include "PluginScanner.h"
+#include <array>
+#include <map>
+
+#if JUCE_LINUX
+ #include <linux/futex.h>
+ #include <sys/syscall.h>
+ #include <unistd.h>
+ #include <climits>
+#endif
+
+static const char* hostProcessId = "aicecube-plugin-host";
+
+//==============================================================================
+// What the engine and a host share: a header, then one region per plugin. Both sides are
+// this executable, so the layout only has to agree with itself.
+namespace
+{
+    constexpr juce::uint32 layoutMagic = 0x41435342;
+    constexpr int maxChannels = 16;
+    constexpr int maxBlockSize = 2048;   // Longer blocks go over in parts
+    constexpr int maxMidiEvents = 512;   // Per part; the rest is dropped
+
+    static_assert(std::atomic<juce::uint32>::is_always_lock_free, "The shared counters must work across processes");
+
+    struct SharedMidiEvent
+    {
+        juce::int32 samplePosition;
+        juce::int32 numBytes;
+        juce::uint8 data[8];             // Longer messages (SysEx) don't go through
+    };
+
+    struct SharedHeader
+    {
+        juce::uint32 magic;
+        juce::int32 numRegions;
+        std::atomic<juce::uint32> doorbell;    // Engine: bumped after every request
+        std::atomic<juce::uint32> hostAsleep;  // Host: waiting on the doorbell, needs waking
+    };
+
+    struct SharedRegion
+    {
+        std::atomic<juce::uint32> requested;   // Engine: the block in the region is ready
+        std::atomic<juce::uint32> completed;   // Host: set to 'requested' once it's processed
+        juce::int32 numChannels, numSamples;
+        juce::int32 numMidiIn, numMidiOut;
+        SharedMidiEvent midiIn[maxMidiEvents];
+        SharedMidiEvent midiOut[maxMidiEvents];
+        float audio[maxChannels][maxBlockSize];
+    };
+
+    constexpr size_t headerSize = (sizeof(SharedHeader) + 63) & ~(size_t)63;
+    constexpr size_t regionSize = (sizeof(SharedRegion) + 63) & ~(size_t)63;
+
+    size_t getSharedSize(int numRegions) { return headerSize + regionSize * (size_t)numRegions; }
+
+    SharedHeader& getHeader(void* memory) { return *static_cast<SharedHeader*>(memory); }
+
+    SharedRegion& getRegion(void* memory, int index)
+    {
+        return *reinterpret_cast<SharedRegion*>(static_cast<char*>(memory) + headerSize + regionSize * (size_t)index);
+    }
+
+    //==========================================================================
+    // Sleeps while 'word' holds 'expected', for at most 'timeoutUs'. The futex is the shared
+    // kind (no FUTEX_PRIVATE_FLAG): the other side is another process.
+    void sleepOnAddress(std::atomic<juce::uint32>& word, juce::uint32 expected, int timeoutUs)
+    {
+       #if JUCE_LINUX
+        const timespec timeout { timeoutUs / 1000000, (long)(timeoutUs % 1000000) * 1000 };
+        syscall(SYS_futex, reinterpret_cast<juce::uint32*>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+       #else
+        juce::ignoreUnused(word, expected, timeoutUs);
+        juce::Thread::yield();
+       #endif
+    }
+
+    void wakeAddress(std::atomic<juce::uint32>& word)
+    {
+       #if JUCE_LINUX
+        syscall(SYS_futex, reinterpret_cast<juce::uint32*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+       #else
+        juce::ignoreUnused(word);
+       #endif
+    }
+
+    double getMicroseconds()
+    {
+        return juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks()) * 1.0e6;
+    }
+
+    // Spins for up to 'spinUs' while 'word' holds 'value'; true once it doesn't. The other
+    // side usually answers within microseconds, and a wake-up costs more than that. On a
+    // single core spinning only keeps the other side from running, so it returns right away.
+    bool spinForChange(std::atomic<juce::uint32>& word, juce::uint32 value, int spinUs)
+    {
+        static const bool canSpin = juce::SystemStats::getNumCpus() > 1;
+        const double start = getMicroseconds();
+
+        while (word.load(std::memory_order_acquire) == value)
+            if (!canSpin || getMicroseconds() - start >= spinUs)
+                return false;
+
+        return true;
+    }
+
+    // Waits until 'word' is no longer 'value', spinning at first and sleeping after. False on timeout.
+    bool waitForChange(std::atomic<juce::uint32>& word, juce::uint32 value, int spinUs, int timeoutUs)
+    {
+        if (spinForChange(word, value, spinUs)) return true;
+
+        const double start = getMicroseconds();
+        for (double elapsed = 0; word.load(std::memory_order_acquire) == value; elapsed = getMicroseconds() - start)
+        {
+            if (elapsed >= timeoutUs) return false;
+            sleepOnAddress(word, value, juce::jmax(1, timeoutUs - (int)elapsed));
+        }
+
+        return true;
+    }
+
+    //==========================================================================
+    // Control messages go over the child process pipe as XML
+    juce::MemoryBlock toMessage(const juce::XmlElement& xml)
+    {
+        const auto text = xml.toString(juce::XmlElement::TextFormat().singleLine().withoutHeader());
+        return juce::MemoryBlock(text.toRawUTF8(), text.getNumBytesAsUTF8());
+    }
+
+    std::shared_ptr<juce::XmlElement> fromMessage(const juce::MemoryBlock& message)
+    {
+        return juce::parseXML(message.toString());
+    }
+}
+
+//==============================================================================
+// Round trip times, as a histogram (audio threads add, any thread reads)
+struct PluginSandbox::RoundTrips
+{
+    static constexpr int bucketUs = 5;
+    static constexpr int numBuckets = 200; // The last one takes everything from 995 µs on
+
+    std::array<std::atomic<juce::uint32>, numBuckets> histogram {};
+    std::atomic<juce::int64> count { 0 }, timeouts { 0 };
+    std::atomic<juce::int64> totalNs { 0 }, maxNs { 0 };
+
+    void add(double microseconds)
+    {
+        const auto ns = (juce::int64)(microseconds * 1000.0);
+        histogram[(size_t)juce::jlimit(0, numBuckets - 1, (int)(microseconds / bucketUs))].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        totalNs.fetch_add(ns, std::memory_order_relaxed);
+
+        for (auto max = maxNs.load(std::memory_order_relaxed); ns > max;)
+            if (maxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed)) break;
+    }
+
+    // Middle of the bucket the fraction falls in
+    double getPercentile(double fraction) const
+    {
+        const auto total = count.load();
+        juce::int64 seen = 0;
+
+        for (int i = 0; i < numBuckets; ++i)
+            if ((seen += histogram[(size_t)i].load()) > (juce::int64)(fraction * (double)total))
+                return (i + 0.5) * bucketUs;
+
+        return 0.0;
+    }
+};
+
+//==============================================================================
+// Engine side of one host process
+class PluginSandbox::Host : public juce::ChildProcessCoordinator,
+                            public std::enable_shared_from_this<Host>
+{
+public:
+    Host(const Options& o, std::shared_ptr<RoundTrips> r)
+        : options(o), numRegions(juce::jlimit(1, 64, o.pluginsPerHost)), roundTrips(std::move(r))
+    {
+        for (int i = 0; i < numRegions; ++i)
+            regions.push_back(std::make_unique<Region>());
+    }
+
+    ~Host() override
+    {
+        killWorkerProcess();
+        memory.reset();
+        memoryFile.deleteFile();
+    }
+
+    // Message thread
+    bool start()
+    {
+        // In RAM where there's a choice, so the pages are never written back to disk
+        const juce::File shm("/dev/shm");
+        const auto directory = shm.isDirectory() ? shm : juce::File::getSpecialLocation(juce::File::tempDirectory);
+        memoryFile = directory.getNonexistentChildFile("aicecube-plugin-host", ".shm", false);
+
+        const auto size = getSharedSize(numRegions);
+        juce::MemoryBlock zeros(size, true);
+        if (!memoryFile.replaceWithData(zeros.getData(), size)) return false;
+
+        memory = std::make_unique<juce::MemoryMappedFile>(memoryFile, juce::MemoryMappedFile::readWrite);
+        if (memory->getData() == nullptr || memory->getSize() < size) return false;
+
+        getHeader(memory->getData()).magic = layoutMagic;
+        getHeader(memory->getData()).numRegions = numRegions;
+        return launch();
+    }
+
+    bool hasRoom() const
+    {
+        for (const auto& region : regions)
+            if (!region->reserved) return true;
+
+        return false;
+    }
+
+    bool isUsable() const { return !failed; }
+
+    //==========================================================================
+    // Message thread. Loads a plugin into a free region; 'onLoaded' gets its stand-in.
+    void load(const juce::PluginDescription& description, double sampleRate, int blockSize,
+              const juce::MemoryBlock& state, PluginLoader::Callback onLoaded);
+
+    // Message thread. Restarts the process if it crashed, or if a block has been waiting
+    // for longer than the hang timeout. A restart completes on a later call if an audio
+    // thread was still inside process().
+    void checkHealth();
+
+    // Message thread. Whether it has had no plugins for at least 'timeoutMs'.
+    bool isIdleFor(int timeoutMs);
+
+    // Message thread. Crashes, restarts and reloads that failed since the last call.
+    juce::StringArray takeProblems()
+    {
+        juce::StringArray taken;
+        taken.swapWith(problems);
+        return taken;
+    }
+
+    // Any thread
+    void attach(int index, SandboxedPlugin* plugin);
+    void detach(int index);
+    void prepare(int index, double sampleRate, int blockSize);
+    void setNonRealtime(int index, bool nonRealtime);
+    void setState(int index, const juce::MemoryBlock& state);
+    void showEditor(int index);
+
+    // Audio thread. Runs a block through the plugin in region 'index'. Returns false if the
+    // host isn't there or didn't answer in time: the buffer then holds its input.
+    bool process(int index, juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midi,
+                 juce::MidiBuffer& midiOutput, int timeoutUs);
+
+private:
+    struct Region
+    {
+        std::atomic<bool> reserved { false };
+        std::atomic<bool> ready { false };     // Loaded in the current process
+        SandboxedPlugin* owner = nullptr;      // regionLock
+        juce::PluginDescription description;
+        juce::MemoryBlock loadedState;        // What it was loaded with, until its stand-in has it
+        double sampleRate = 0;
+        int blockSize = 0;
+        std::atomic<juce::uint32> stateGeneration { 0 }; // Bumped by setState: older pushes are stale
+
+        // Hang detection (message thread)
+        juce::uint32 stuckRequest = 0, stuckSince = 0;
+    };
+
+    bool launch()
+    {
+        lost = false;
+        const auto executable = juce::File::getSpecialLocation(juce::File::currentExecutableFile);
+        if (!launchWorkerProcess(executable, hostProcessId, 0, 0)) return false;
+
+        juce::XmlElement init("Init");
+        init.setAttribute("memory", memoryFile.getFullPathName());
+        init.setAttribute("regions", numRegions);
+        return sendMessageToWorker(toMessage(init));
+    }
+
+    void restart();
+    void finishRestart();
+    juce::String getPluginNames() const;
+    void sendLoad(int index, const juce::MemoryBlock& state, int id);
+    void handleLoaded(const juce::XmlElement& reply);
+    void handleLatency(const juce::XmlElement& message);
+    void handleState(const juce::XmlElement& message);
+
+    void handleMessageFromWorker(const juce::MemoryBlock& message) override;
+    void handleConnectionLost() override { lost = true; }
+
+    const Options options;
+    const int numRegions;
+    std::vector<std::unique_ptr<Region>> regions;
+    juce::CriticalSection regionLock;
+    const std::shared_ptr<RoundTrips> roundTrips;
+
+    juce::File memoryFile;
+    std::unique_ptr<juce::MemoryMappedFile> memory;
+
+    std::atomic<bool> lost { false };      // The process is gone
+    std::atomic<int> numProcessing { 0 };  // Audio threads inside process()
+    bool failed = false;                   // Crashed too often: stays down
+    bool restarting = false;               // Regions taken away, waiting for the audio threads to leave
+    juce::Array<juce::uint32> restartTimes;
+    juce::uint32 idleSince = 0;            // Message thread, 0 while it has plugins
+    juce::StringArray problems;            // Message thread, see takeProblems
+
+    // Replies
+    std::atomic<int> nextMessageId { 1 };
+    std::map<int, PluginLoader::Callback> pendingLoads;   // Message thread
+
+    JUCE_DECLARE_NON_COPYABLE(Host)
+};
+
+//==============================================================================
+// Stands in for a sandboxed plugin in the engine
+class PluginSandbox::SandboxedPlugin : public juce::AudioPluginInstance
+{
+public:
+    SandboxedPlugin(std::shared_ptr<Host> h, int index, const juce::PluginDescription& d,
+                    double sampleRate, int blockSize, const juce::MemoryBlock& state)
+        : juce::AudioPluginInstance(getBuses(d)), host(std::move(h)), region(index), description(d), savedState(state)
+    {
+        setRateAndBufferSizeDetails(sampleRate, blockSize);
+        reserveMidiOutput(blockSize);
+        host->attach(region, this);
+    }
+
+    ~SandboxedPlugin() override
+    {
+        host->detach(region);
+    }
+
+    static BusesProperties getBuses(const juce::PluginDescription& d)
+    {
+        BusesProperties buses;
+        if (d.numInputChannels > 0)
+            buses = buses.withInput("Input", juce::AudioChannelSet::canonicalChannelSet(juce::jmin(d.numInputChannels, maxChannels)), true);
+        if (d.numOutputChannels > 0)
+            buses = buses.withOutput("Output", juce::AudioChannelSet::canonicalChannelSet(juce::jmin(d.numOutputChannels, maxChannels)), true);
+
+        return buses;
+    }
+
+    Host& getHost() { return *host; }
+    int getRegion() const { return region; }
+
+    // Host side information, from its Loaded reply (message thread)
+    void setLoaded(int latency, double tail, bool midiIn, bool midiOut)
+    {
+        tailSeconds = tail;
+        acceptsMidiEvents = midiIn;
+        producesMidiEvents = midiOut;
+        setLatencySamples(latency);
+    }
+
+    juce::MemoryBlock getSavedState() const
+    {
+        const juce::ScopedLock sl(stateLock);
+        return savedState;
+    }
+
+    // The plugin's state as its host pushed it after a change (message thread). The engine
+    // hears of it like of any plugin whose state changed outside of its parameters.
+    void setPushedState(const juce::MemoryBlock& state)
+    {
+        {
+            const juce::ScopedLock sl(stateLock);
+            if (state == savedState) return;
+            savedState = state;
+        }
+
+        updateHostDisplay(ChangeDetails().withNonParameterStateChanged(true));
+    }
+
+    //==========================================================================
+    const juce::String getName() const override { return description.name; }
+    void fillInPluginDescription(juce::PluginDescription& d) const override { d = description; }
+
+    void prepareToPlay(double sampleRate, int blockSize) override
+    {
+        setRateAndBufferSizeDetails(sampleRate, blockSize);
+        reserveMidiOutput(blockSize);
+        host->prepare(region, sampleRate, blockSize);
+    }
+
+    void releaseResources() override {}
+
+    void setNonRealtime(bool nonRealtime) noexcept override
+    {
+        juce::AudioPluginInstance::setNonRealtime(nonRealtime);
+        host->setNonRealtime(region, nonRealtime);
+    }
+
+    void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midi) override
+    {
+        // In real time a quarter of the block, the rest of the graph still has to run in it;
+        // offline there is no hurry
+        constexpr double realtimeBudget = 0.25;
+        const double rate = getSampleRate() > 0 ? getSampleRate() : 44100.0;
+        const int timeoutUs = isNonRealtime() ? 10000000
+                                              : juce::jmax(50, (int)(buffer.getNumSamples() / rate * 1.0e6 * realtimeBudget));
+
+        if (!host->process(region, buffer, midi, midiOutput, timeoutUs))
+            midi.clear();
+    }
+
+    using juce::AudioPluginInstance::processBlock;
+
+    double getTailLengthSeconds() const override { return tailSeconds; }
+    bool acceptsMidi() const override { return acceptsMidiEvents; }
+    bool producesMidi() const override { return producesMidiEvents; }
+
+    // The editor opens in the host process (see PluginSandbox::showEditor)
+    bool hasEditor() const override { return false; }
+    juce::AudioProcessorEditor* createEditor() override { return nullptr; }
+
+    int getNumPrograms() override { return 1; }
+    int getCurrentProgram() override { return 0; }
+    void setCurrentProgram(int) override {}
+    const juce::String getProgramName(int) override { return {}; }
+    void changeProgramName(int, const juce::String&) override {}
+
+    // The state as of the host's last push: asking the host would be a round trip, and this
+    // is called for every save and every freeze check
+    void getStateInformation(juce::MemoryBlock& destData) override
+    {
+        const juce::ScopedLock sl(stateLock);
+        destData = savedState;
+    }
+
+    void setStateInformation(const void* data, int sizeInBytes) override
+    {
+        {
+            const juce::ScopedLock sl(stateLock);
+            savedState.replaceAll(data, (size_t)sizeInBytes);
+        }
+        host->setState(region, getSavedState());
+    }
+
+private:
+    // Every part of a block (see maxBlockSize) can bring back maxMidiEvents events of up to
+    // 16 bytes each in the buffer, so adding them never allocates on the audio thread
+    void reserveMidiOutput(int blockSize)
+    {
+        const int numParts = juce::jmax(1, (blockSize + maxBlockSize - 1) / maxBlockSize);
+        midiOutput.ensureSize((size_t)(numParts * maxMidiEvents * 16));
+    }
+
+    std::shared_ptr<Host> host;
+    const int region;
+    const juce::PluginDescription description;
+
+    juce::CriticalSection stateLock;
+    juce::MemoryBlock savedState;
+    juce::MidiBuffer midiOutput;
+
+    std::atomic<double> tailSeconds { 0.0 };
+    std::atomic<bool> acceptsMidiEvents { false }, producesMidiEvents { false };
+
+    JUCE_DECLARE_NON_COPYABLE(SandboxedPlugin)
+};
+
+//==============================================================================
+void PluginSandbox::Host::load(const juce::PluginDescription& description, double sampleRate, int blockSize,
+                               const juce::MemoryBlock& state, PluginLoader::Callback onLoaded)
+{
+    int index = 0;
+    while (regions[(size_t)index]->reserved) ++index;
+
+    auto& region = *regions[(size_t)index];
+    region.reserved = true;
+    region.description = description;
+    region.loadedState = state;
+    region.sampleRate = sampleRate;
+    region.blockSize = blockSize;
+
+    const int id = nextMessageId++;
+    pendingLoads[id] = std::move(onLoaded);
+    sendLoad(index, state, id);
+}
+
+void PluginSandbox::Host::sendLoad(int index, const juce::MemoryBlock& state, int id)
+{
+    const auto& region = *regions[(size_t)index];
+
+    juce::XmlElement message("Load");
+    message.setAttribute("id", id);
+    message.setAttribute("region", index);
+    message.setAttribute("sampleRate", region.sampleRate);
+    message.setAttribute("blockSize", region.blockSize);
+    message.setAttribute("state", state.toBase64Encoding());
+    message.setAttribute("generation", (int)region.stateGeneration.load());
+    message.addChildElement(region.description.createXml().release());
+    sendMessageToWorker(toMessage(message));
+}
+
+void PluginSandbox::Host::handleMessageFromWorker(const juce::MemoryBlock& message)
+{
+    auto xml = fromMessage(message);
+    if (xml == nullptr) return;
+
+    std::weak_ptr<Host> weakThis = weak_from_this(); // Empty while it's being destroyed
+    juce::MessageManager::callAsync([weakThis, xml] {
+        // Replies from a process that is being restarted are stale
+        if (auto host = weakThis.lock(); host != nullptr && !host->restarting)
+        {
+            if (xml->hasTagName("Loaded")) host->handleLoaded(*xml);
+            else if (xml->hasTagName("Latency")) host->handleLatency(*xml);
+            else if (xml->hasTagName("State")) host->handleState(*xml);
+        }
+    });
+}
+
+void PluginSandbox::Host::handleLoaded(const juce::XmlElement& reply)
+{
+    const int index = reply.getIntAttribute("region", -1);
+    if (!juce::isPositiveAndBelow(index, numRegions)) return;
+    auto& region = *regions[(size_t)index];
+
+    PluginLoader::Callback onLoaded;
+    auto pending = pendingLoads.find(reply.getIntAttribute("id"));
+    if (pending != pendingLoads.end())
+    {
+        onLoaded = std::move(pending->second);
+        pendingLoads.erase(pending);
+    }
+
+    const auto error = reply.getStringAttribute("error");
+    if (error.isNotEmpty())
+    {
+        if (onLoaded)
+        {
+            region.reserved = false;
+            onLoaded(nullptr, error);
+        }
+        else
+        {
+            // Reloaded after a restart: nobody is waiting for it, it stays bypassed
+            problems.add(region.description.name + " couldn't be loaded again after its plugin host restarted: " + error);
+        }
+        return;
+    }
+
+    std::shared_ptr<SandboxedPlugin> plugin;
+    if (onLoaded)
+    {
+        plugin = std::make_shared<SandboxedPlugin>(shared_from_this(), index, region.description,
+                                                   region.sampleRate, region.blockSize, region.loadedState);
+        region.loadedState.reset();
+    }
+
+    {
+        const juce::ScopedLock sl(regionLock);
+        if (region.owner != nullptr)
+            region.owner->setLoaded(reply.getIntAttribute("latency"), reply.getDoubleAttribute("tail"),
+                                    reply.getBoolAttribute("acceptsMidi"), reply.getBoolAttribute("producesMidi"));
+    }
+
+    region.ready = true;
+    if (onLoaded) onLoaded(std::move(plugin), {});
+}
+
+void PluginSandbox::Host::handleLatency(const juce::XmlElement& message)
+{
+    const int index = message.getIntAttribute("region", -1);
+    if (!juce::isPositiveAndBelow(index, numRegions)) return;
+
+    const juce::ScopedLock sl(regionLock);
+    if (auto* owner = regions[(size_t)index]->owner)
+        owner->setLatencySamples(message.getIntAttribute("samples"));
+}
+
+void PluginSandbox::Host::handleState(const juce::XmlElement& message)
+{
+    const int index = message.getIntAttribute("region", -1);
+    if (!juce::isPositiveAndBelow(index, numRegions)) return;
+    auto& region = *regions[(size_t)index];
+
+    // Pushed before a setState the host hadn't seen yet
+    if ((juce::uint32)message.getIntAttribute("generation") != region.stateGeneration.load()) return;
+
+    juce::MemoryBlock state;
+    if (!state.fromBase64Encoding(message.getStringAttribute("state"))) return;
+
+    const juce::ScopedLock sl(regionLock);
+    if (region.owner != nullptr)
+        region.owner->setPushedState(state);
+}
+
+//==============================================================================
+void PluginSandbox::Host::attach(int index, SandboxedPlugin* plugin)
+{
+    const juce::ScopedLock sl(regionLock);
+    regions[(size_t)index]->owner = plugin;
+}
+
+void PluginSandbox::Host::detach(int index)
+{
+    auto& region = *regions[(size_t)index];
+    {
+        const juce::ScopedLock sl(regionLock);
+        region.owner = nullptr;
+        region.ready = false;
+    }
+
+    juce::XmlElement message("Unload");
+    message.setAttribute("region", index);
+    sendMessageToWorker(toMessage(message));
+    region.reserved = false;
+}
+
+void PluginSandbox::Host::prepare(int index, double sampleRate, int blockSize)
+{
+    {
+        const juce::ScopedLock sl(regionLock);
+        regions[(size_t)index]->sampleRate = sampleRate;
+        regions[(size_t)index]->blockSize = blockSize;
+    }
+
+    juce::XmlElement message("Prepare");
+    message.setAttribute("region", index);
+    message.setAttribute("sampleRate", sampleRate);
+    message.setAttribute("blockSize", blockSize);
+    sendMessageToWorker(toMessage(message));
+}
+
+void PluginSandbox::Host::setNonRealtime(int index, bool nonRealtime)
+{
+    juce::XmlElement message("NonRealtime");
+    message.setAttribute("region", index);
+    message.setAttribute("value", nonRealtime);
+    sendMessageToWorker(toMessage(message));
+}
+
+void PluginSandbox::Host::setState(int index, const juce::MemoryBlock& state)
+{
+    juce::XmlElement message("SetState");
+    message.setAttribute("region", index);
+    message.setAttribute("state", state.toBase64Encoding());
+    message.setAttribute("generation", (int)++regions[(size_t)index]->stateGeneration);
+    sendMessageToWorker(toMessage(message));
+}
+
+void PluginSandbox::Host::showEditor(int index)
+{
+    juce::XmlElement message("ShowEditor");
+    message.setAttribute("region", index);
+    sendMessageToWorker(toMessage(message));
+}
+
+//==============================================================================
+bool PluginSandbox::Host::process(int index, juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midi,
+                                  juce::MidiBuffer& midiOutput, int timeoutUs)
+{
+    // Counted, so that a restart doesn't reset the region under our feet
+    ++numProcessing;
+    struct Leave { std::atomic<int>& count; ~Leave() { --count; } } leave { numProcessing };
+
+    if (lost || !regions[(size_t)index]->ready) return false;
+
+    auto* data = memory->getData();
+    auto& header = getHeader(data);
+    auto& shared = getRegion(data, index);
+
+    // Still on a block that timed out earlier
+    if (shared.completed.load(std::memory_order_acquire) != shared.requested.load(std::memory_order_relaxed))
+        return false;
+
+    const int numChannels = juce::jmin(buffer.getNumChannels(), maxChannels);
+    midiOutput.clear();
+
+    for (int start = 0; start < buffer.getNumSamples(); start += maxBlockSize)
+    {
+        const int numSamples = juce::jmin(maxBlockSize, buffer.getNumSamples() - start);
+
+        shared.numChannels = numChannels;
+        shared.numSamples = numSamples;
+        for (int channel = 0; channel < numChannels; ++channel)
+            std::memcpy(shared.audio[channel], buffer.getReadPointer(channel, start), sizeof(float) * (size_t)numSamples);
+
+        int numMidiIn = 0;
+        for (const auto event : midi)
+        {
+            if (event.samplePosition < start || event.samplePosition >= start + numSamples) continue;
+            if (event.numBytes > (int)sizeof(SharedMidiEvent::data) || numMidiIn == maxMidiEvents) continue;
+
+            auto& sharedEvent = shared.midiIn[numMidiIn++];
+            sharedEvent.samplePosition = event.samplePosition - start;
+            sharedEvent.numBytes = event.numBytes;
+            std::memcpy(sharedEvent.data, event.data, (size_t)event.numBytes);
+        }
+        shared.numMidiIn = numMidiIn;
+
+        // Ring: the host sleeps on the doorbell only when there was nothing to do for a while
+        const double requestedAt = getMicroseconds();
+        const auto ticket = shared.requested.load(std::memory_order_relaxed) + 1;
+        shared.requested.store(ticket, std::memory_order_release);
+        header.doorbell.fetch_add(1);
+        if (header.hostAsleep.load())
+            wakeAddress(header.doorbell);
+
+        if (!waitForChange(shared.completed, ticket - 1, 20, timeoutUs))
+        {
+            roundTrips->timeouts.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        roundTrips->add(getMicroseconds() - requestedAt);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            std::memcpy(buffer.getWritePointer(channel, start), shared.audio[channel], sizeof(float) * (size_t)numSamples);
+
+        for (int i = 0; i < juce::jmin(shared.numMidiOut, maxMidiEvents); ++i)
+        {
+            const auto& event = shared.midiOut[i];
+            midiOutput.addEvent(event.data, juce::jlimit(0, (int)sizeof(event.data), event.numBytes), start + event.samplePosition);
+        }
+    }
+
+    // Copied rather than swapped, so each buffer keeps the room reserved for it
+    midi.clear();
+    midi.addEvents(midiOutput, 0, -1, 0);
+    return true;
+}
+
+//==============================================================================
+void PluginSandbox::Host::checkHealth()
+{
+    if (failed) return;
+
+    if (restarting)
+    {
+        finishRestart();
+        return;
+    }
+
+    bool hung = false;
+    const auto now = juce::Time::getMillisecondCounter();
+    auto* data = memory->getData();
+
+    for (int i = 0; i < numRegions; ++i)
+    {
+        auto& region = *regions[(size_t)i];
+        const auto& shared = getRegion(data, i);
+        const auto requested = shared.requested.load();
+
+        if (!region.ready || shared.completed.load() == requested)
+        {
+            region.stuckSince = 0;
+            continue;
+        }
+
+        if (region.stuckSince == 0 || region.stuckRequest != requested)
+        {
+            region.stuckRequest = requested;
+            region.stuckSince = now;
+        }
+        else if (now - region.stuckSince > (juce::uint32)options.hangTimeoutMs)
+        {
+            hung = true;
+        }
+    }
+
+    if (lost || hung)
+        restart();
+}
+
+juce::String PluginSandbox::Host::getPluginNames() const
+{
+    juce::StringArray names;
+    for (const auto& region : regions)
+        if (region->reserved)
+            names.add(region->description.name);
+
+    return names.joinIntoString(", ");
+}
+
+bool PluginSandbox::Host::isIdleFor(int timeoutMs)
+{
+    bool inUse = !pendingLoads.empty();
+    for (const auto& region : regions)
+        inUse = inUse || region->reserved;
+
+    const auto now = juce::Time::getMillisecondCounter();
+    if (inUse)
+        idleSince = 0;
+    else if (idleSince == 0)
+        idleSince = juce::jmax((juce::uint32)1, now);
+
+    return idleSince != 0 && now - idleSince >= (juce::uint32)timeoutMs;
+}
+
+void PluginSandbox::Host::restart()
+{
+    const auto now = juce::Time::getMillisecondCounter();
+    restartTimes.removeIf([now](juce::uint32 time) { return now - time > 60000; });
+    restartTimes.add(now);
+
+    // Take the regions away from the audio threads before resetting them
+    for (auto& region : regions)
+        region->ready = false;
+
+    restarting = true;
+    finishRestart();
+}
+
+void PluginSandbox::Host::finishRestart()
+{
+    // Blocks are short: an audio thread that is still inside is gone by the next timer tick
+    if (numProcessing > 0) return;
+    restarting = false;
+
+    killWorkerProcess();
+
+    if (restartTimes.size() > options.maxRestarts)
+    {
+        problems.add("A plugin host crashed " + juce::String(restartTimes.size())
+                     + " times in a minute; its plugins stay bypassed: " + getPluginNames());
+        failed = lost = true;
+        return;
+    }
+
+    auto* data = memory->getData();
+    getHeader(data).hostAsleep = 0;
+    for (int i = 0; i < numRegions; ++i)
+        getRegion(data, i).completed = getRegion(data, i).requested.load();
+
+    // Loads still waiting for an answer have lost theirs
+    for (auto& pending : pendingLoads)
+        juce::MessageManager::callAsync([onLoaded = std::move(pending.second)] { onLoaded(nullptr, "The plugin host crashed"); });
+    pendingLoads.clear();
+
+    for (auto& region : regions)
+        if (region->owner == nullptr)
+            region->reserved = false;
+
+    problems.add("A plugin host crashed or stopped responding and was restarted: " + getPluginNames());
+    if (!launch())
+    {
+        lost = true;
+        return;
+    }
+
+    const juce::ScopedLock sl(regionLock);
+    for (int i = 0; i < numRegions; ++i)
+        if (auto* owner = regions[(size_t)i]->owner)
+            sendLoad(i, owner->getSavedState(), nextMessageId++);
+}
+
+//==============================================================================
+// Host process side: loads the plugins and serves the engine's blocks on one thread
+class PluginSandbox::HostWorker : public juce::ChildProcessWorker,
+                                  private juce::Thread,
+                                  private juce::Timer,
+                                  private juce::AudioProcessorListener
+{
+public:
+    explicit HostWorker(std::function<void()> exit)
+        : juce::Thread("Plugin Host"), onExit(std::move(exit))
+    {
+        PluginScanner::addFormats(formatManager);
+    }
+
+    ~HostWorker() override
+    {
+        stopTimer();
+        stopProcessing();
+        for (auto& slot : slots)
+            unload(*slot);
+
+        masterReference.clear();
+    }
+
+    void handleMessageFromCoordinator(const juce::MemoryBlock& message) override
+    {
+        auto xml = fromMessage(message);
+        if (xml == nullptr) return;
+
+        // Everything but the audio happens on the message thread, in order
+        juce::WeakReference<HostWorker> weakThis(this);
+        juce::MessageManager::callAsync([weakThis, xml] {
+            if (weakThis != nullptr)
+                weakThis->handleControl(*xml);
+        });
+    }
+
+    void handleConnectionLost() override
+    {
+        juce::MessageManager::callAsync(onExit);
+    }
+
+private:
+    // Notes changes to the plugin's state (from any thread) for the timer to send on
+    struct Slot : public juce::AudioProcessorListener
+    {
+        juce::CriticalSection lock;  // Held while processing
+        std::unique_ptr<juce::AudioPluginInstance> plugin;
+        juce::AudioBuffer<float> buffer;
+        juce::MidiBuffer midi;
+        juce::Component::SafePointer<PluginWindow> window;
+
+        std::atomic<bool> stateChanged { false };
+        juce::uint32 stateGeneration = 0; // Of the engine's last setState
+        juce::MemoryBlock sentState;
+
+        void audioProcessorParameterChanged(juce::AudioProcessor*, int, float) override { stateChanged = true; }
+        void audioProcessorChanged(juce::AudioProcessor*, const ChangeDetails& details) override
+        {
+            if (details.programChanged || details.nonParameterStateChanged)
+                stateChanged = true;
+        }
+    };
+
+    void handleControl(const juce::XmlElement& message)
+    {
+        if (message.hasTagName("Init"))
+        {
+            init(message);
+            return;
+        }
+
+        const int index = message.getIntAttribute("region", -1);
+        if (!juce::isPositiveAndBelow(index, (int)slots.size())) return;
+        auto& slot = *slots[(size_t)index];
+
+        if (message.hasTagName("Load"))
+        {
+            load(slot, index, message);
+        }
+        else if (message.hasTagName("Unload"))
+        {
+            unload(slot);
+        }
+        else if (message.hasTagName("Prepare"))
+        {
+            const juce::ScopedLock sl(slot.lock);
+            if (slot.plugin != nullptr)
+                slot.plugin->prepareToPlay(message.getDoubleAttribute("sampleRate"), message.getIntAttribute("blockSize"));
+        }
+        else if (message.hasTagName("NonRealtime"))
+        {
+            const juce::ScopedLock sl(slot.lock);
+            if (slot.plugin != nullptr)
+                slot.plugin->setNonRealtime(message.getBoolAttribute("value"));
+        }
+        else if (message.hasTagName("SetState"))
+        {
+            juce::MemoryBlock state;
+            state.fromBase64Encoding(message.getStringAttribute("state"));
+
+            slot.stateGeneration = (juce::uint32)message.getIntAttribute("generation");
+            slot.sentState = state;
+
+            const juce::ScopedLock sl(slot.lock);
+            if (slot.plugin != nullptr && !state.isEmpty())
+                slot.plugin->setStateInformation(state.getData(), (int)state.getSize());
+        }
+        else if (message.hasTagName("ShowEditor"))
+        {
+            if (slot.window != nullptr)
+                slot.window->toFront(true);
+            else if (slot.plugin != nullptr && slot.plugin->hasEditor())
+                if (auto* editor = slot.plugin->createEditor())
+                    slot.window = new PluginWindow(*slot.plugin, editor);
+        }
+    }
+
+    void init(const juce::XmlElement& message)
+    {
+        stopProcessing();
+
+        const int numRegions = message.getIntAttribute("regions");
+        memory = std::make_unique<juce::MemoryMappedFile>(juce::File(message.getStringAttribute("memory")),
+                                                          juce::MemoryMappedFile::readWrite);
+
+        if (memory->getData() == nullptr || memory->getSize() < getSharedSize(numRegions)
+            || getHeader(memory->getData()).magic != layoutMagic)
+        {
+            memory.reset();
+            return;
+        }
+
+        while ((int)slots.size() < numRegions)
+            slots.push_back(std::make_unique<Slot>());
+
+        startThread(juce::Thread::Priority::highest);
+        startTimer(statePushIntervalMs);
+    }
+
+    void load(Slot& slot, int index, const juce::XmlElement& message)
+    {
+        unload(slot);
+
+        juce::XmlElement reply("Loaded");
+        reply.setAttribute("id", message.getIntAttribute("id"));
+        reply.setAttribute("region", index);
+
+        juce::PluginDescription description;
+        auto* descriptionXml = message.getFirstChildElement();
+        const double sampleRate = message.getDoubleAttribute("sampleRate");
+        const int blockSize = message.getIntAttribute("blockSize");
+
+        juce::String error;
+        std::unique_ptr<juce::AudioPluginInstance> plugin;
+        if (descriptionXml == nullptr || !description.loadFromXml(*descriptionXml))
+            error = "Bad plugin description";
+        else
+            plugin = formatManager.createPluginInstance(description, sampleRate, blockSize, error);
+
+        if (plugin == nullptr)
+        {
+            reply.setAttribute("error", error.isNotEmpty() ? error : juce::String("Can't create the plugin"));
+            sendMessageToCoordinator(toMessage(reply));
+            return;
+        }
+
+        juce::MemoryBlock state;
+        state.fromBase64Encoding(message.getStringAttribute("state"));
+        if (!state.isEmpty())
+            plugin->setStateInformation(state.getData(), (int)state.getSize());
+
+        plugin->prepareToPlay(sampleRate, blockSize);
+        plugin->addListener(this);
+        plugin->addListener(&slot);
+        slot.stateGeneration = (juce::uint32)message.getIntAttribute("generation");
+        slot.sentState = state;
+        slot.stateChanged = false;
+
+        reply.setAttribute("latency", plugin->getLatencySamples());
+        reply.setAttribute("tail", plugin->getTailLengthSeconds());
+        reply.setAttribute("acceptsMidi", plugin->acceptsMidi());
+        reply.setAttribute("producesMidi", plugin->producesMidi());
+
+        {
+            const int numChannels = juce::jmax(maxChannels, plugin->getTotalNumInputChannels(), plugin->getTotalNumOutputChannels());
+            const juce::ScopedLock sl(slot.lock);
+            slot.buffer.setSize(numChannels, maxBlockSize);
+            slot.midi.ensureSize(maxMidiEvents * 16);
+            slot.plugin = std::move(plugin);
+        }
+
+        sendMessageToCoordinator(toMessage(reply));
+    }
+
+    void unload(Slot& slot)
+    {
+        if (slot.window != nullptr)
+            delete slot.window.getComponent();
+
+        std::unique_ptr<juce::AudioPluginInstance> plugin;
+        {
+            const juce::ScopedLock sl(slot.lock);
+            plugin = std::move(slot.plugin);
+        }
+
+        if (plugin != nullptr)
+        {
+            plugin->removeListener(this);
+            plugin->removeListener(&slot);
+        }
+    }
+
+    // Sends the state of plugins that changed, so the engine never has to ask for it. Editors
+    // don't always tell about their changes, so plugins with one open are checked now and then.
+    void timerCallback() override
+    {
+        const bool checkEditors = ++numStateTicks % 4 == 0;
+
+        for (int i = 0; i < (int)slots.size(); ++i)
+        {
+            auto& slot = *slots[(size_t)i];
+            if (slot.plugin == nullptr) continue;
+            if (!slot.stateChanged.exchange(false) && !(checkEditors && slot.window != nullptr)) continue;
+
+            juce::MemoryBlock state;
+            slot.plugin->getStateInformation(state);
+            if (state == slot.sentState) continue;
+
+            juce::XmlElement message("State");
+            message.setAttribute("region", i);
+            message.setAttribute("generation", (int)slot.stateGeneration);
+            message.setAttribute("state", state.toBase64Encoding());
+            sendMessageToCoordinator(toMessage(message));
+            slot.sentState = std::move(state);
+        }
+    }
+
+    void stopProcessing()
+    {
+        signalThreadShouldExit();
+        if (memory != nullptr)
+            wakeAddress(getHeader(memory->getData()).doorbell);
+
+        stopThread(-1);
+    }
+
+    //==========================================================================
+    void run() override
+    {
+        auto* data = memory->getData();
+        auto& header = getHeader(data);
+
+        while (!threadShouldExit())
+        {
+            const auto doorbell = header.doorbell.load();
+
+            bool served = false;
+            for (int i = 0; i < (int)slots.size(); ++i)
+                served = serve(*slots[(size_t)i], getRegion(data, i)) || served;
+
+            if (served) continue;
+
+            // Requests for a block come in a row (one per sandboxed plugin): stay up for the next
+            if (spinForChange(header.doorbell, doorbell, 50)) continue;
+
+            header.hostAsleep = 1;
+            if (header.doorbell.load() == doorbell)
+                sleepOnAddress(header.doorbell, doorbell, 100000);
+            header.hostAsleep = 0;
+        }
+    }
+
+    bool serve(Slot& slot, SharedRegion& shared)
+    {
+        const auto ticket = shared.requested.load(std::memory_order_acquire);
+        if (ticket == shared.completed.load(std::memory_order_relaxed)) return false;
+
+        const int numChannels = juce::jlimit(0, maxChannels, (int)shared.numChannels);
+        const int numSamples = juce::jlimit(0, maxBlockSize, (int)shared.numSamples);
+        shared.numMidiOut = 0;
+
+        {
+            const juce::ScopedLock sl(slot.lock);
+
+            // Without a plugin the block goes back as it came
+            if (slot.plugin != nullptr)
+            {
+                const int numPluginChannels = juce::jmax(numChannels, slot.plugin->getTotalNumInputChannels(),
+                                                         slot.plugin->getTotalNumOutputChannels());
+                juce::AudioBuffer<float> block(slot.buffer.getArrayOfWritePointers(), numPluginChannels, numSamples);
+
+                for (int channel = 0; channel < numPluginChannels; ++channel)
+                {
+                    if (channel < numChannels)
+                        block.copyFrom(channel, 0, shared.audio[channel], numSamples);
+                    else
+                        block.clear(channel, 0, numSamples);
+                }
+
+                slot.midi.clear();
+                for (int i = 0; i < juce::jlimit(0, maxMidiEvents, (int)shared.numMidiIn); ++i)
+                {
+                    const auto& event = shared.midiIn[i];
+                    slot.midi.addEvent(event.data, juce::jlimit(0, (int)sizeof(event.data), event.numBytes), event.samplePosition);
+                }
+
+                slot.plugin->processBlock(block, slot.midi);
+
+                for (int channel = 0; channel < numChannels; ++channel)
+                    std::memcpy(shared.audio[channel], block.getReadPointer(channel), sizeof(float) * (size_t)numSamples);
+
+                int numMidiOut = 0;
+                for (const auto event : slot.midi)
+                {
+                    if (event.numBytes > (int)sizeof(SharedMidiEvent::data) || numMidiOut == maxMidiEvents) continue;
+
+                    auto& sharedEvent = shared.midiOut[numMidiOut++];
+                    sharedEvent.samplePosition = event.samplePosition;
+                    sharedEvent.numBytes = event.numBytes;
+                    std::memcpy(sharedEvent.data, event.data, (size_t)event.numBytes);
+                }
+                shared.numMidiOut = numMidiOut;
+            }
+        }
+
+        shared.completed.store(ticket, std::memory_order_release);
+        wakeAddress(shared.completed);
+        return true;
+    }
+
+    //==========================================================================
+    void audioProcessorParameterChanged(juce::AudioProcessor*, int, float) override {}
+
+    void audioProcessorChanged(juce::AudioProcessor* processor, const ChangeDetails& details) override
+    {
+        if (!details.latencyChanged) return;
+
+        for (int i = 0; i < (int)slots.size(); ++i)
+        {
+            if (slots[(size_t)i]->plugin.get() != processor) continue;
+
+            juce::XmlElement message("Latency");
+            message.setAttribute("region", i);
+            message.setAttribute("samples", processor->getLatencySamples());
+            sendMessageToCoordinator(toMessage(message));
+        }
+    }
+
+    static constexpr int statePushIntervalMs = 250;
+
+    std::function<void()> onExit;
+    juce::AudioPluginFormatManager formatManager;
+    std::unique_ptr<juce::MemoryMappedFile> memory;
+    std::vector<std::unique_ptr<Slot>> slots;
+    int numStateTicks = 0;
+
+    JUCE_DECLARE_WEAK_REFERENCEABLE(HostWorker)
+    JUCE_DECLARE_NON_COPYABLE(HostWorker)
+};
+
+//==============================================================================
+PluginSandbox::PluginSandbox(const Options& o) : options(o), roundTrips(std::make_shared<RoundTrips>())
+{
+}
+
+PluginSandbox::~PluginSandbox()
+{
+    stopTimer();
+}
+
+void PluginSandbox::load(const juce::PluginDescription& description, double sampleRate, int blockSize,
+                         const juce::MemoryBlock& state, PluginLoader::Callback onLoaded)
+{
+    std::shared_ptr<Host> host;
+    for (auto& candidate : hosts)
+        if (candidate->isUsable() && candidate->hasRoom())
+            host = candidate;
+
+    if (host == nullptr)
+    {
+        host = std::make_shared<Host>(options, roundTrips);
+        if (!host->start())
+        {
+            onLoaded(nullptr, "Can't start a plugin host");
+            return;
+        }
+
+        hosts.push_back(host);
+        startTimer(100);
+    }
+
+    host->load(description, sampleRate, blockSize, state, std::move(onLoaded));
+}
+
+void PluginSandbox::timerCallback()
+{
+    for (auto it = hosts.begin(); it != hosts.end();)
+    {
+        (*it)->checkHealth();
+
+        for (const auto& problem : (*it)->takeProblems())
+            if (onProblem)
+                onProblem(problem);
+
+        // A stand-in on its way out may still hold it for a moment
+        if ((*it)->isIdleFor(options.idleHostTimeoutMs) && it->use_count() == 1)
+            it = hosts.erase(it);
+        else
+            ++it;
+    }
+
+    if (hosts.empty())
+        stopTimer();
+}
+
+PluginSandbox::Statistics PluginSandbox::getStatistics() const
+{
+    Statistics statistics;
+    statistics.numBlocks = roundTrips->count.load();
+    statistics.numTimeouts = roundTrips->timeouts.load();
+    statistics.maxMicroseconds = roundTrips->maxNs.load() / 1000.0;
+
+    if (statistics.numBlocks > 0)
+    {
+        statistics.meanMicroseconds = roundTrips->totalNs.load() / 1000.0 / (double)statistics.numBlocks;
+        statistics.medianMicroseconds = roundTrips->getPercentile(0.5);
+        statistics.p99Microseconds = roundTrips->getPercentile(0.99);
+    }
+
+    return statistics;
+}
+
+void PluginSandbox::resetStatistics()
+{
+    for (auto& bucket : roundTrips->histogram)
+        bucket = 0;
+
+    roundTrips->count = 0;
+    roundTrips->timeouts = 0;
+    roundTrips->totalNs = 0;
+    roundTrips->maxNs = 0;
+}
+
+bool PluginSandbox::showEditor(juce::AudioPluginInstance& instance)
+{
+    auto* plugin = dynamic_cast<SandboxedPlugin*>(&instance);
+    if (plugin == nullptr) return false;
+
+    plugin->getHost().showEditor(plugin->getRegion());
+    return true;
+}
+
+bool PluginSandbox::isHostCommandLine(const juce::String& commandLine)
+{
+    return commandLine.contains("--" + juce::String(hostProcessId) + ":");
+}
+
+std::unique_ptr<juce::ChildProcessWorker> PluginSandbox::createHost(const juce::String& commandLine,
+                                                                    std::function<void()> onExit)
+{
+    auto host = std::make_unique<HostWorker>(std::move(onExit));
+    if (!host->initialiseFromCommandLine(commandLine, hostProcessId))
+        return nullptr;
+
+    return host;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "PluginLoader.h"
+#include <memory>
+#include <vector>
+
+//==============================================================================
+// Runs selected plugins in separate host processes, so that one that crashes or leaks
+// takes down its host rather than the engine.
+//
+// A host is this executable started as a JUCE child process (see createHost). Loading,
+// state and editors go over its message pipe; audio and MIDI go through a memory-mapped
+// file shared with it, one region per plugin. Each block, the plugin's stand-in (a
+// juce::AudioPluginInstance in the PluginSlot like any other) writes its buffers there,
+// rings the host and waits for the result, in real time for at most a quarter of the
+// block: futexes on the shared counters on Linux, spinning and yielding elsewhere. Several plugins share a host, served by one thread,
+// so a block costs a wake-up per plugin rather than a thread per plugin.
+//
+// A host that crashes, or stops answering for longer than hangTimeoutMs, is restarted
+// and its plugins are loaded again with their last known state. Hosts push a plugin's
+// state whenever it changes, so the engine never waits for it. The plugins play their
+// input through (silence, for instruments) until they are back. A host left without
+// plugins for idleHostTimeoutMs is shut down.
+class PluginSandbox : private juce::Timer
+{
+public:
+    struct Options
+    {
+        int pluginsPerHost = 8;
+        int hangTimeoutMs = 2000;    // No block answered for this long: the host is restarted
+        int maxRestarts = 3;         // A host that crashes this often in a minute stays down
+        int idleHostTimeoutMs = 10000;
+    };
+
+    // Round trips of blocks through the hosts, per plugin: from handing a block over until
+    // its result is back. The shared memory transport is meant to keep these well under
+    // 50 µs. Counted since the sandbox was created or last reset.
+    struct Statistics
+    {
+        juce::int64 numBlocks = 0;
+        juce::int64 numTimeouts = 0;        // Played through unprocessed
+        double meanMicroseconds = 0.0;
+        double medianMicroseconds = 0.0;    // Percentiles to within 5 µs
+        double p99Microseconds = 0.0;
+        double maxMicroseconds = 0.0;
+    };
+
+    explicit PluginSandbox(const Options& options);
+    PluginSandbox() : PluginSandbox(Options()) {}
+    ~PluginSandbox() override;
+
+    // Message thread. Loads 'description' in a host (starting one if they're all full) and
+    // calls back on the message thread with its stand-in, like PluginLoader::load.
+    void load(const juce::PluginDescription& description, double sampleRate, int blockSize,
+              const juce::MemoryBlock& state, PluginLoader::Callback onLoaded);
+
+    // Message thread. Opens the plugin's editor in its host's own window; false if it can't.
+    static bool showEditor(juce::AudioPluginInstance& instance);
+
+    // Message thread. Hosts that crashed or hung and were restarted (or gave up on), and
+    // plugins that couldn't be loaded again afterwards.
+    std::function<void(const juce::String& message)> onProblem;
+
+    // Any thread
+    Statistics getStatistics() const;
+    void resetStatistics();
+
+    // Host side: recognises the command line a host is started with, and connects to the
+    // engine that started it. 'onExit' is called (on the message thread) once the engine
+    // is gone; the process should quit then. Returns nullptr if it can't connect.
+    static bool isHostCommandLine(const juce::String& commandLine);
+    static std::unique_ptr<juce::ChildProcessWorker> createHost(const juce::String& commandLine,
+                                                                std::function<void()> onExit);
+
+private:
+    class Host;
+    class SandboxedPlugin;
+    class HostWorker;
+    struct RoundTrips;
+
+    void timerCallback() override; // Restarts hosts that crashed or hung, shuts down idle ones
+
+    const Options options;
+    std::vector<std::shared_ptr<Host>> hosts;
+    std::shared_ptr<RoundTrips> roundTrips; // Shared with the hosts, which may outlive the sandbox
+
+    JUCE_DECLARE_NON_COPYABLE(PluginSandbox)
+};
@@ -0,0 +1,170 @@
+#include "PluginScanCache.h"
+#include <juce_cryptography/juce_cryptography.h>
+#include <algorithm>
+#include <set>
+
+PluginScanCache::PluginScanCache(const juce::File& file) : indexFile(file)
+{
+    load();
+}
+
+//==============================================================================
+// The files that make up a plugin: itself, or everything in its bundle but the resources
+juce::Array<juce::File> PluginScanCache::getContents(const juce::File& file)
+{
+    juce::Array<juce::File> contents;
+    if (!file.isDirectory())
+    {
+        contents.add(file);
+        return contents;
+    }
+
+    for (const auto& entry : juce::RangedDirectoryIterator(file, true, "*", juce::File::findFiles))
+        if (!entry.getFile().getRelativePathFrom(file).containsIgnoreCase("Resources"))
+            contents.add(entry.getFile());
+
+    contents.sort(); // Hash in a stable order
+    return contents;
+}
+
+void PluginScanCache::getIdentity(const juce::File& file, juce::int64& size, juce::int64& modified)
+{
+    size = 0;
+    modified = 0;
+
+    for (const auto& part : getContents(file))
+    {
+        size += part.getSize();
+        modified = std::max(modified, part.getLastModificationTime().toMilliseconds());
+    }
+}
+
+juce::String PluginScanCache::getContentHash(const juce::File& file)
+{
+    juce::MemoryOutputStream hashes;
+    for (const auto& part : getContents(file))
+        hashes << juce::MD5(part).toHexString();
+
+    return juce::MD5(hashes.getMemoryBlock()).toHexString();
+}
+
+//==============================================================================
+bool PluginScanCache::isUnchanged(const juce::String& path, int numTypes, bool failed)
+{
+    juce::int64 size, modified;
+    getIdentity(juce::File(path), size, modified);
+
+    juce::String hash;
+    {
+        const juce::ScopedLock sl(lock);
+        auto it = entries.find(path);
+        if (it == entries.end() || it->second.numTypes != numTypes || it->second.failed != failed) return false;
+        if (it->second.size == size && it->second.modified == modified) return true;
+        if (it->second.hash.isEmpty()) return false;
+        hash = it->second.hash;
+    }
+
+    // Looks different: it's the contents that count
+    if (getContentHash(juce::File(path)) != hash) return false;
+
+    const juce::ScopedLock sl(lock);
+    auto& entry = entries[path];
+    entry.size = size;
+    entry.modified = modified;
+    return true;
+}
+
+void PluginScanCache::setProbed(const juce::String& path, int numTypes, bool failed)
+{
+    Entry entry;
+    getIdentity(juce::File(path), entry.size, entry.modified);
+    entry.hash = getContentHash(juce::File(path));
+    entry.numTypes = numTypes;
+    entry.failed = failed;
+
+    const juce::ScopedLock sl(lock);
+    entries[path] = entry;
+}
+
+void PluginScanCache::adopt(const juce::String& path, int numTypes)
+{
+    Entry entry;
+    getIdentity(juce::File(path), entry.size, entry.modified);
+    entry.numTypes = numTypes;
+
+    const juce::ScopedLock sl(lock);
+    entries[path] = entry;
+}
+
+juce::StringArray PluginScanCache::removeMissing(const juce::StringArray& existingFiles)
+{
+    std::set<juce::String> existing(existingFiles.begin(), existingFiles.end());
+    juce::StringArray removed;
+
+    const juce::ScopedLock sl(lock);
+    for (auto it = entries.begin(); it != entries.end();)
+    {
+        if (existing.count(it->first) == 0)
+        {
+            removed.add(it->first);
+            it = entries.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    return removed;
+}
+
+bool PluginScanCache::getEntry(const juce::String& path, Entry& entry) const
+{
+    const juce::ScopedLock sl(lock);
+    auto it = entries.find(path);
+    if (it == entries.end()) return false;
+
+    entry = it->second;
+    return true;
+}
+
+//==============================================================================
+void PluginScanCache::load()
+{
+    auto xml = juce::parseXML(indexFile);
+    if (xml == nullptr) return;
+
+    const juce::ScopedLock sl(lock);
+    for (auto* child : xml->getChildWithTagNameIterator("Entry"))
+    {
+        Entry entry;
+        entry.size = child->getStringAttribute("size").getLargeIntValue();
+        entry.modified = child->getStringAttribute("modified").getLargeIntValue();
+        entry.hash = child->getStringAttribute("hash");
+        entry.numTypes = child->getIntAttribute("types");
+        entry.failed = child->getBoolAttribute("failed");
+        entries[child->getStringAttribute("file")] = entry;
+    }
+}
+
+void PluginScanCache::save() const
+{
+    juce::XmlElement xml("PluginScanCache");
+
+    {
+        const juce::ScopedLock sl(lock);
+        for (const auto& entry : entries)
+        {
+            auto* child = xml.createNewChildElement("Entry");
+            child->setAttribute("file", entry.first);
+            child->setAttribute("size", juce::String(entry.second.size));
+            child->setAttribute("modified", juce::String(entry.second.modified));
+            child->setAttribute("hash", entry.second.hash);
+            child->setAttribute("types", entry.second.numTypes);
+            child->setAttribute("failed", entry.second.failed);
+        }
+    }
+
+    indexFile.getParentDirectory().createDirectory();
+    xml.writeTo(indexFile);
+}
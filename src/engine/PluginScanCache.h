@@ -0,0 +1,56 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <map>
+
+//==============================================================================
+// What earlier scans found out about each plugin file, so that a scan only probes
+// files that are new or have changed.
+//
+// A file is recognised by its path, size and modification time (for bundles, summed
+// over the files inside), which is cheap enough to check hundreds of plugins in a few
+// milliseconds. Only when those differ is the content hash compared, so touching or
+// reinstalling the same version of a plugin doesn't cause a probe.
+class PluginScanCache
+{
+public:
+    explicit PluginScanCache(const juce::File& indexFile);
+
+    struct Entry
+    {
+        juce::int64 size = 0;
+        juce::int64 modified = 0;  // Milliseconds
+        juce::String hash;         // MD5 of the contents, empty if it was never needed
+        int numTypes = 0;          // Plugins found in the file
+        bool failed = false;       // Crashed or timed out: blacklisted
+    };
+
+    // Thread safe. True if 'file' was probed before, with the outcome the plugin list still
+    // shows (its number of plugins, or blacklisted), and hasn't changed since. An entry whose
+    // file only looks different but hashes the same is updated.
+    bool isUnchanged(const juce::String& file, int numTypes, bool failed);
+
+    // Thread safe. Records the current state of 'file' after probing it.
+    void setProbed(const juce::String& file, int numTypes, bool failed);
+
+    // Records a file that was already in the known plugin list, without hashing it
+    void adopt(const juce::String& file, int numTypes);
+
+    // Forgets everything about files that aren't in 'existingFiles'; returns what it forgot
+    juce::StringArray removeMissing(const juce::StringArray& existingFiles);
+
+    bool getEntry(const juce::String& file, Entry& entry) const;
+
+    void load();
+    void save() const;
+
+private:
+    static void getIdentity(const juce::File& file, juce::int64& size, juce::int64& modified);
+    static juce::String getContentHash(const juce::File& file);
+    static juce::Array<juce::File> getContents(const juce::File& file);
+
+    const juce::File indexFile;
+    juce::CriticalSection lock;
+    std::map<juce::String, Entry> entries; // By path
+
+    JUCE_DECLARE_NON_COPYABLE(PluginScanCache)
+};
@@ -0,0 +1,398 @@
+#include "PluginScanner.h"
+#include <iostream>
+#include <map>
+
+// Worker output lines start with this; anything else on stdout (plugins print too) is ignored
+static const juce::String outputPrefix = "[PluginScan] ";
+
+//==============================================================================
+struct PluginScanner::Shard
+{
+    juce::StringArray formats, files;   // Parallel: what to probe each file as
+    int next = 0;                        // First file not done yet
+    juce::StringArray failedFiles;
+
+    // Watchdog
+    juce::CriticalSection processLock;
+    juce::ChildProcess* process = nullptr;
+    std::atomic<juce::uint32> lastActivity { 0 }; // Millisecond counter at the worker's start or last file boundary, 0 without a worker
+    std::atomic<bool> finished { false };
+
+    void kill()
+    {
+        const juce::ScopedLock sl(processLock);
+        if (process != nullptr)
+            process->kill();
+    }
+};
+
+class PluginScanner::ShardThread : public juce::Thread
+{
+public:
+    ShardThread(PluginScanner& s, Shard& sh) : juce::Thread("Plugin Scan"), scanner(s), shard(sh) {}
+    ~ShardThread() override { stopThread(-1); }
+
+    void run() override
+    {
+        while (shard.next < shard.files.size() && !scanner.cancelled)
+        {
+            if (!scanner.runWorkerProcess(shard))
+            {
+                scanner.probeInProcess(shard);
+                break;
+            }
+        }
+
+        shard.finished = true;
+    }
+
+private:
+    PluginScanner& scanner;
+    Shard& shard;
+};
+
+//==============================================================================
+PluginScanner::PluginScanner(juce::AudioPluginFormatManager& fm, juce::KnownPluginList& list,
+                             const juce::File& cacheFile, const juce::File& pedal)
+    : juce::Thread("Plugin Scanner"), formatManager(fm), knownPlugins(list), cache(cacheFile), deadMansPedal(pedal)
+{
+}
+
+PluginScanner::~PluginScanner()
+{
+    cancel();
+    stopThread(-1);
+}
+
+void PluginScanner::cancel()
+{
+    cancelled = true;
+}
+
+juce::AudioPluginFormat* PluginScanner::findFormat(const juce::String& name) const
+{
+    for (int i = 0; i < formatManager.getNumFormats(); ++i)
+        if (formatManager.getFormat(i)->getName() == name)
+            return formatManager.getFormat(i);
+
+    return nullptr;
+}
+
+juce::StringArray PluginScanner::scan(const juce::FileSearchPath& searchPath, const Options& options,
+                                      std::function<void(const juce::String&)> progress)
+{
+    const juce::ScopedLock sl(scanLock);
+    if (juce::Thread::getCurrentThread() != this) // startScan() resets it before the thread starts
+        cancelled = false;
+    onProgress = std::move(progress);
+
+    // Whatever crashed an in-process probe last time
+    juce::PluginDirectoryScanner::applyBlacklistingsFromDeadMansPedal(knownPlugins, deadMansPedal);
+
+    // Deal the files that need probing out round-robin, so one vendor's folder doesn't end up in one shard
+    std::vector<std::unique_ptr<Shard>> shards;
+    for (int i = 0; i < std::max(1, options.numWorkers); ++i)
+        shards.push_back(std::make_unique<Shard>());
+
+    std::map<juce::String, juce::Array<juce::PluginDescription>> knownTypes; // By file
+    for (const auto& type : knownPlugins.getTypes())
+        knownTypes[type.fileOrIdentifier].add(type);
+
+    const auto blacklist = knownPlugins.getBlacklistedFiles();
+    juce::StringArray allFiles;
+    size_t numFiles = 0;
+
+    for (int i = 0; i < formatManager.getNumFormats(); ++i)
+    {
+        auto* format = formatManager.getFormat(i);
+        if (!format->canScanForPlugins()) continue;
+
+        for (const auto& file : format->searchPathsForPlugins(searchPath, true, true))
+        {
+            allFiles.add(file);
+            if (!needsProbe(file, *format, knownTypes[file], blacklist.contains(file))) continue;
+
+            auto& shard = *shards[numFiles++ % shards.size()];
+            shard.formats.add(format->getName());
+            shard.files.add(file);
+        }
+    }
+
+    // Uninstalled plugins, or ones whose folder is no longer searched
+    cache.removeMissing(allFiles);
+
+    for (const auto& known : knownTypes)
+        if (!allFiles.contains(known.first))
+            for (const auto& type : known.second)
+                knownPlugins.removeType(type);
+
+    for (const auto& file : blacklist)
+        if (!allFiles.contains(file))
+            knownPlugins.removeFromBlacklist(file);
+
+    std::vector<std::unique_ptr<ShardThread>> threads;
+    for (auto& shard : shards)
+    {
+        if (shard->files.isEmpty()) continue;
+        threads.push_back(std::make_unique<ShardThread>(*this, *shard));
+        threads.back()->startThread();
+    }
+
+    // Watchdog: kills workers that hang on a file or outside of one, or all of them when cancelled
+    for (bool running = !threads.empty(); running;)
+    {
+        juce::Thread::sleep(50);
+        running = false;
+
+        for (auto& shard : shards)
+        {
+            if (shard->files.isEmpty() || shard->finished) continue;
+            running = true;
+
+            const auto since = shard->lastActivity.load();
+            if (cancelled || (since != 0 && juce::Time::getMillisecondCounter() - since > (juce::uint32)options.fileTimeoutMs))
+                shard->kill();
+        }
+    }
+
+    threads.clear();
+    cache.save();
+
+    juce::StringArray failedFiles;
+    for (const auto& shard : shards)
+        failedFiles.addArray(shard->failedFiles);
+
+    return failedFiles;
+}
+
+bool PluginScanner::startScan(const juce::FileSearchPath& searchPath, const Options& options,
+                              std::function<void(const juce::String&)> progress,
+                              std::function<void(const juce::StringArray&)> finished)
+{
+    if (isThreadRunning()) return false;
+
+    pendingSearchPath = searchPath;
+    pendingOptions = options;
+    pendingProgress = std::move(progress);
+    pendingFinished = std::move(finished);
+    cancelled = false;
+    startThread();
+    return true;
+}
+
+void PluginScanner::run()
+{
+    auto failedFiles = scan(pendingSearchPath, pendingOptions, pendingProgress);
+
+    // Cancelled means the owner may be going away: don't call back into it
+    if (pendingFinished && !cancelled)
+        juce::MessageManager::callAsync([finished = pendingFinished, failedFiles] { finished(failedFiles); });
+}
+
+//==============================================================================
+// Whether 'file' is new or has changed since it was last probed. Drops what the list
+// has from a file that is going to be probed again.
+bool PluginScanner::needsProbe(const juce::String& file, juce::AudioPluginFormat& format,
+                               const juce::Array<juce::PluginDescription>& knownTypes, bool blacklisted)
+{
+    PluginScanCache::Entry entry;
+    const bool cached = cache.getEntry(file, entry);
+
+    if (blacklisted)
+    {
+        // Blacklisted outside of a worker (the dead man's pedal, or by hand): take it as given
+        if (!cached || !entry.failed)
+        {
+            cache.setProbed(file, 0, true);
+            return false;
+        }
+
+        // Failed before; an update may have fixed it
+        if (cache.isUnchanged(file, 0, true)) return false;
+        knownPlugins.removeFromBlacklist(file);
+    }
+    else
+    {
+        // Scanned before there was a cache
+        if (!cached && !knownTypes.isEmpty() && knownPlugins.isListingUpToDate(file, format))
+        {
+            cache.adopt(file, knownTypes.size());
+            return false;
+        }
+
+        if (cache.isUnchanged(file, knownTypes.size(), false)) return false;
+    }
+
+    for (const auto& type : knownTypes)
+        knownPlugins.removeType(type);
+
+    return true;
+}
+
+//==============================================================================
+// Runs one worker over the rest of the shard. Returns false if it couldn't probe anything,
+// i.e. workers don't work here.
+bool PluginScanner::runWorkerProcess(Shard& shard)
+{
+    auto jobFile = juce::File::createTempFile(".plugin-scan");
+    juce::String job;
+    for (int i = shard.next; i < shard.files.size(); ++i)
+        job << shard.formats[i] << "\t" << shard.files[i] << "\n";
+
+    if (!jobFile.replaceWithText(job)) return false;
+
+    juce::ChildProcess process;
+    const auto executable = juce::File::getSpecialLocation(juce::File::currentExecutableFile);
+    if (!process.start(juce::StringArray { executable.getFullPathName(), juce::String(workerOption) + "=" + jobFile.getFullPathName() },
+                       juce::ChildProcess::wantStdOut))
+    {
+        jobFile.deleteFile();
+        return false;
+    }
+
+    {
+        const juce::ScopedLock sl(shard.processLock);
+        shard.process = &process;
+    }
+
+    // A worker that hangs before its first file, or on its way out, is killed all the same
+    shard.lastActivity = juce::jmax((juce::uint32)1, juce::Time::getMillisecondCounter());
+
+    bool progressed = false, probing = false;
+    int numTypes = 0;
+    std::string output;
+    char buffer[4096];
+
+    // Until the worker exits (or is killed), which closes the pipe
+    for (int numRead; (numRead = process.readProcessOutput(buffer, (int)sizeof(buffer))) > 0;)
+    {
+        output.append(buffer, (size_t)numRead);
+
+        for (size_t end; (end = output.find('\n')) != std::string::npos; output.erase(0, end + 1))
+        {
+            const auto line = juce::String::fromUTF8(output.data(), (int)end).trimEnd();
+            const int prefix = line.indexOf(outputPrefix);
+            if (prefix < 0) continue;
+
+            const auto message = line.substring(prefix + outputPrefix.length());
+            const auto value = message.fromFirstOccurrenceOf(" ", false, false);
+
+            if (message.startsWith("begin "))
+            {
+                probing = progressed = true;
+                numTypes = 0;
+                shard.lastActivity = juce::jmax((juce::uint32)1, juce::Time::getMillisecondCounter());
+                if (onProgress) onProgress(value);
+            }
+            else if (message.startsWith("type "))
+            {
+                juce::PluginDescription description;
+                if (auto xml = juce::parseXML(value))
+                    if (description.loadFromXml(*xml))
+                    {
+                        knownPlugins.addType(description);
+                        ++numTypes;
+                    }
+            }
+            else if (message.startsWith("end ") && probing)
+            {
+                probing = false;
+                shard.lastActivity = juce::jmax((juce::uint32)1, juce::Time::getMillisecondCounter());
+                cache.setProbed(shard.files[shard.next++], numTypes, false);
+            }
+        }
+    }
+
+    {
+        const juce::ScopedLock sl(shard.processLock);
+        shard.process = nullptr;
+    }
+
+    shard.lastActivity = 0;
+
+    if (!process.waitForProcessToFinish(1000)) // Closed its output but went on
+        process.kill();
+
+    jobFile.deleteFile();
+
+    // Crashed or hung in the middle of a file: that file is the culprit
+    if (probing && !cancelled)
+    {
+        knownPlugins.addToBlacklist(shard.files[shard.next]);
+        shard.failedFiles.add(shard.files[shard.next]);
+        cache.setProbed(shard.files[shard.next++], 0, true);
+    }
+
+    return progressed || cancelled;
+}
+
+void PluginScanner::probeInProcess(Shard& shard)
+{
+    for (; shard.next < shard.files.size() && !cancelled; ++shard.next)
+    {
+        auto* format = findFormat(shard.formats[shard.next]);
+        const auto& file = shard.files[shard.next];
+        if (format == nullptr) continue;
+
+        const juce::ScopedLock sl(inProcessLock);
+        if (onProgress) onProgress(file);
+
+        // If this crashes us, the next scan blacklists the file
+        deadMansPedal.getParentDirectory().createDirectory();
+        deadMansPedal.replaceWithText(file);
+
+        juce::OwnedArray<juce::PluginDescription> found;
+        knownPlugins.scanAndAddFile(file, true, found, *format);
+
+        deadMansPedal.deleteFile();
+        cache.setProbed(file, found.size(), false);
+    }
+}
+
+//==============================================================================
+void PluginScanner::addFormats(juce::AudioPluginFormatManager& formats)
+{
+    formats.addFormat(new juce::VST3PluginFormat());
+}
+
+int PluginScanner::runWorker(const juce::File& jobFile)
+{
+    juce::StringArray lines;
+    lines.addLines(jobFile.loadFileAsString());
+    lines.removeEmptyStrings();
+
+    if (lines.isEmpty()) return 1;
+
+    juce::AudioPluginFormatManager formats;
+    addFormats(formats);
+
+    auto writeLine = [](const juce::String& message) {
+        std::cout << (outputPrefix + message).toStdString() << std::endl;
+    };
+
+    for (const auto& line : lines)
+    {
+        const auto formatName = line.upToFirstOccurrenceOf("\t", false, false);
+        const auto file = line.fromFirstOccurrenceOf("\t", false, false);
+
+        juce::AudioPluginFormat* format = nullptr;
+        for (int i = 0; i < formats.getNumFormats(); ++i)
+            if (formats.getFormat(i)->getName() == formatName)
+                format = formats.getFormat(i);
+
+        writeLine("begin " + file);
+
+        if (format != nullptr)
+        {
+            juce::OwnedArray<juce::PluginDescription> found;
+            format->findAllTypesForFile(found, file);
+
+            for (const auto* description : found)
+                writeLine("type " + description->createXml()->toString(juce::XmlElement::TextFormat().singleLine().withoutHeader()));
+        }
+
+        writeLine("end " + file);
+    }
+
+    return 0;
+}
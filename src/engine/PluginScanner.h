@@ -0,0 +1,88 @@
+#pragma once
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "PluginScanCache.h"
+#include <atomic>
+#include <functional>
+
+//==============================================================================
+// Finds plugins without putting the host at risk. Only files that are new or have changed
+// since the last scan are probed (see PluginScanCache), and plugins whose files are gone
+// are removed from the list, so a rescan of an unchanged system probes nothing.
+//
+// The files to probe are split into
+// shards, and each shard is worked through by a worker process: this executable started
+// with --scan-plugins (see runWorker). Workers report what they find over their stdout
+// pipe, and it is merged into the KnownPluginList as it comes in.
+//
+// A file whose worker crashes, or that takes longer than the timeout, is blacklisted
+// and a new worker carries on with the rest of the shard. A worker that goes quiet for
+// as long outside of a file (starting up, or exiting) is killed without blaming a file.
+// If workers can't be started
+// at all, the files are probed in this process after all, guarded by a dead man's pedal
+// so that a crash still gets its file blacklisted at the next scan.
+class PluginScanner : private juce::Thread
+{
+public:
+    struct Options
+    {
+        int numWorkers = juce::jlimit(1, 8, juce::SystemStats::getNumCpus());
+        int fileTimeoutMs = 60000; // Probing one file takes longer than this: it's blacklisted. Also bounds a worker's start and exit.
+    };
+
+    PluginScanner(juce::AudioPluginFormatManager& formatManager, juce::KnownPluginList& knownPlugins,
+                  const juce::File& cacheFile, const juce::File& deadMansPedal);
+    ~PluginScanner() override;
+
+    // Brings the list up to date with the plugin files under 'searchPath'.
+    // Blocks until done or cancelled; returns the files that were blacklisted.
+    // onProgress gets each file as its probing starts, from the scanning threads.
+    juce::StringArray scan(const juce::FileSearchPath& searchPath, const Options& options,
+                           std::function<void(const juce::String& file)> onProgress);
+
+    // The same on a background thread, unless a scan is running already (returns false then).
+    // onFinished is called on the message thread, unless the scan was cancelled.
+    bool startScan(const juce::FileSearchPath& searchPath, const Options& options,
+                   std::function<void(const juce::String& file)> onProgress,
+                   std::function<void(const juce::StringArray& failedFiles)> onFinished);
+
+    // Any thread. Kills the workers; an in-process probe finishes its current file first.
+    void cancel();
+    bool isScanning() const { return isThreadRunning(); }
+
+    // The plugin formats the engine hosts (and so the workers probe)
+    static void addFormats(juce::AudioPluginFormatManager& formats);
+
+    // Worker side: the command line option (--scan-plugins=<job file>), and what the executable runs when it gets it.
+    // 'jobFile' lists the files to probe, as "<format name>\t<file>" lines.
+    static constexpr const char* workerOption = "--scan-plugins";
+    static int runWorker(const juce::File& jobFile);
+
+private:
+    struct Shard;
+    class ShardThread;
+
+    void run() override;
+    bool needsProbe(const juce::String& file, juce::AudioPluginFormat& format,
+                    const juce::Array<juce::PluginDescription>& knownTypes, bool blacklisted);
+    bool runWorkerProcess(Shard& shard);
+    void probeInProcess(Shard& shard);
+    juce::AudioPluginFormat* findFormat(const juce::String& name) const;
+
+    juce::AudioPluginFormatManager& formatManager;
+    juce::KnownPluginList& knownPlugins;
+    PluginScanCache cache;
+    const juce::File deadMansPedal;
+
+    juce::CriticalSection scanLock;      // One scan at a time
+    juce::CriticalSection inProcessLock; // One in-process probe at a time (the pedal holds one file)
+    std::atomic<bool> cancelled { false };
+    std::function<void(const juce::String&)> onProgress;
+
+    // startScan()
+    juce::FileSearchPath pendingSearchPath;
+    Options pendingOptions;
+    std::function<void(const juce::String&)> pendingProgress;
+    std::function<void(const juce::StringArray&)> pendingFinished;
+
+    JUCE_DECLARE_NON_COPYABLE(PluginScanner)
+};
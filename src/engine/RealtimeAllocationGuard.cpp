@@ -0,0 +1,79 @@
+#include "RealtimeAllocationGuard.h"
+
+#if AICECUBE_CHECK_REALTIME_ALLOCATIONS
+
+#include <juce_core/juce_core.h>
+#include <cstdlib>
+#include <new>
+
+namespace RealtimeAllocationGuard
+{
+    static thread_local int realtimeDepth = 0;
+    static thread_local int suspendDepth = 0;
+
+    void enterRealtimeSection() { ++realtimeDepth; }
+    void exitRealtimeSection()  { --realtimeDepth; }
+    void suspend() { ++suspendDepth; }
+    void resume()  { --suspendDepth; }
+
+    static void checkAllocation()
+    {
+        if (realtimeDepth > 0 && suspendDepth == 0)
+        {
+            // Let the assertion machinery itself allocate
+            const ScopedAllowAllocations allow;
+            jassertfalse; // Heap allocation on the audio thread
+        }
+    }
+}
+
+#if JUCE_LINUX && defined(__GLIBC__)
+// JUCE containers (AudioBuffer, MidiBuffer, Array) allocate through malloc rather
+// than operator new, so on glibc we interpose the C allocator as well.
+extern "C"
+{
+    void* __libc_malloc(size_t);
+    void* __libc_calloc(size_t, size_t);
+    void* __libc_realloc(void*, size_t);
+
+    void* malloc(size_t size)
+    {
+        RealtimeAllocationGuard::checkAllocation();
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        RealtimeAllocationGuard::checkAllocation();
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* p, size_t size)
+    {
+        RealtimeAllocationGuard::checkAllocation();
+        return __libc_realloc(p, size);
+    }
+}
+#endif
+
+void* operator new(std::size_t size)
+{
+    RealtimeAllocationGuard::checkAllocation();
+
+    if (auto* p = std::malloc(size == 0 ? 1 : size))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+#endif
@@ -0,0 +1,34 @@
+#pragma once
+
+//==============================================================================
+// Debug aid for the real-time path.
+//
+// When AICECUBE_CHECK_REALTIME_ALLOCATIONS is enabled (see the CMake option
+// AICECUBE_CHECK_RT_ALLOCATIONS), the global operator new asserts if it is
+// called on a thread that is inside a ScopedRealtimeSection. Third-party code
+// we can't fix (plugin processBlock) is wrapped in ScopedAllowAllocations.
+// In normal builds both scopes compile to nothing.
+namespace RealtimeAllocationGuard
+{
+#if AICECUBE_CHECK_REALTIME_ALLOCATIONS
+    void enterRealtimeSection();
+    void exitRealtimeSection();
+    void suspend();
+    void resume();
+
+    struct ScopedRealtimeSection
+    {
+        ScopedRealtimeSection() { enterRealtimeSection(); }
+        ~ScopedRealtimeSection() { exitRealtimeSection(); }
+    };
+
+    struct ScopedAllowAllocations
+    {
+        ScopedAllowAllocations() { suspend(); }
+        ~ScopedAllowAllocations() { resume(); }
+    };
+#else
+    struct ScopedRealtimeSection {};
+    struct ScopedAllowAllocations {};
+#endif
+}
@@ -0,0 +1,330 @@
+#include "RenderSnapshot.h"
+
+// Widest signal that passes through one of the track's delay lines
+static int getNumDelayChannels(const RenderSnapshot& snapshot, int trackIndex)
+{
+    const auto& track = snapshot.tracks[(size_t)trackIndex];
+    const auto& inputs = snapshot.routing->nodes[(size_t)trackIndex].inputs;
+    int channels = track.outputDelay > 0 ? track.numChannels : 0;
+
+    for (size_t i = 0; i < inputs.size(); ++i)
+        if (track.inputDelays[i] > 0)
+            channels = std::max(channels, snapshot.tracks[(size_t)inputs[i].sourceIndex].numChannels);
+
+    return channels;
+}
+
+void TrackRenderState::prepare(const RenderSnapshot& snapshot, int trackIndex)
+{
+    const auto& track = snapshot.tracks[(size_t)trackIndex];
+    const auto& inputs = snapshot.routing->nodes[(size_t)trackIndex].inputs;
+    const int blockSize = snapshot.maxBlockSize;
+
+    numChannels = track.numChannels;
+    maxBlockSize = blockSize;
+    buffer.setSize(numChannels, blockSize);
+    clipBuffer.setSize(2, blockSize);
+    midi.ensureSize(midiBufferBytes);
+    outgoingMidi.ensureSize(midiBufferBytes);
+    automationCursors.resize(track.automation.size());
+
+    inputDelays.resize(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i)
+        inputDelays[i].prepare(snapshot.tracks[(size_t)inputs[i].sourceIndex].numChannels, track.inputDelays[i], blockSize);
+
+    outputDelay.prepare(numChannels, track.outputDelay, blockSize);
+    delayBuffer.setSize(getNumDelayChannels(snapshot, trackIndex), blockSize);
+}
+
+bool TrackRenderState::fits(const RenderSnapshot& snapshot, int trackIndex) const
+{
+    const auto& track = snapshot.tracks[(size_t)trackIndex];
+    const auto& inputs = snapshot.routing->nodes[(size_t)trackIndex].inputs;
+    const int blockSize = snapshot.maxBlockSize;
+
+    if (numChannels != track.numChannels || maxBlockSize < blockSize || inputDelays.size() != inputs.size()
+        || automationCursors.size() != track.automation.size())
+        return false;
+
+    for (size_t i = 0; i < inputs.size(); ++i)
+        if (!inputDelays[i].fits(snapshot.tracks[(size_t)inputs[i].sourceIndex].numChannels, track.inputDelays[i], blockSize))
+            return false;
+
+    return outputDelay.fits(numChannels, track.outputDelay, blockSize)
+        && delayBuffer.getNumChannels() >= getNumDelayChannels(snapshot, trackIndex);
+}
+
+void TrackRenderState::takeOverPlayback()
+{
+    // A state that was replaced again before it got to play has nothing new: look further back
+    const TrackRenderState* from = replaced.get();
+    while (from != nullptr && !from->rendered.load(std::memory_order_acquire))
+        from = from->replaced.get();
+
+    if (from != nullptr)
+    {
+        midiCursor = from->midiCursor;
+        outputGain = from->outputGain;
+        gainRampStart = from->gainRampStart;
+        audible = from->audible;
+        audibleRampStart = from->audibleRampStart;
+        panGains = from->panGains;
+        panRampStart = from->panRampStart;
+        silent = from->silent;
+
+        volumeSmoother = from->volumeSmoother;
+        panSmoother = from->panSmoother;
+        audibleSmoother = from->audibleSmoother;
+        smoothingSampleRate = from->smoothingSampleRate;
+
+        // Input lines start empty: their sources may have changed with the layout
+        outputDelay.takeOver(from->outputDelay);
+    }
+
+    rendered.store(true, std::memory_order_release);
+}
+
+static RenderClip createRenderClip(const Clip& clip)
+{
+    RenderClip rc;
+    rc.startBeat = clip.startBeat;
+    rc.lengthBeats = clip.lengthBeats;
+    rc.isMidi = clip.isMidi;
+    rc.gain = clip.gain;
+    rc.fadeIn = clip.fadeIn;
+    rc.fadeOut = clip.fadeOut;
+
+    if (!clip.isMidi)
+    {
+        rc.audioFile = clip.audioFile;
+        rc.sourceOffset = clip.sourceOffset;
+    }
+
+    return rc;
+}
+
+// A frozen track plays its bounce like an audio track with a single clip. Its plugins are
+// left out (they get suspended), and so is their automation, which the bounce already has.
+static RenderTrack createFrozenRenderTrack(const Track& track, RenderTrack rt)
+{
+    rt.type = TrackType::Audio;
+
+    RenderClip clip;
+    clip.isMidi = false;
+    clip.lengthBeats = track.freeze.lengthBeats;
+    clip.audioFile = track.freeze.file;
+    rt.clips.push_back(clip);
+
+    for (const auto& curve : track.automationCurves)
+    {
+        AutomationLane lane;
+        if (curve.active && !curve.points.empty() && AutomationLane::resolve(track, curve, lane)
+            && lane.target != AutomationLane::Target::PluginParameter)
+            rt.automation.push_back(std::move(lane));
+    }
+
+    return rt;
+}
+
+// The track being frozen plays nothing live: no clips, no plugins and no plugin automation.
+// It keeps its latency, so the rest of the mix doesn't move meanwhile.
+static void takeChainAway(RenderTrack& rt)
+{
+    rt.clips.clear();
+    rt.midiEvents.clear();
+    rt.instrument.reset();
+    rt.inserts.clear();
+    rt.automation.erase(std::remove_if(rt.automation.begin(), rt.automation.end(), [](const AutomationLane& lane) {
+        return lane.target == AutomationLane::Target::PluginParameter;
+    }), rt.automation.end());
+}
+
+static RenderTrack createRenderTrack(const Track& track)
+{
+    RenderTrack rt;
+    rt.id = track.id;
+    rt.type = track.type;
+    rt.mixer = track.mixer;
+
+    rt.sendAmounts.reserve(track.sends.size());
+    for (const auto& send : track.sends)
+        rt.sendAmounts.push_back(send.active ? send.amount : 0.0f);
+
+    if (track.freeze.frozen)
+        return createFrozenRenderTrack(track, std::move(rt));
+
+    rt.clips.reserve(track.clips.size());
+    for (const auto& clip : track.clips)
+        rt.clips.push_back(createRenderClip(clip));
+
+    if (track.type == TrackType::Midi)
+        rt.midiEvents = buildMidiSchedule(track.clips);
+
+    if (track.instrumentPlugin && track.instrumentPlugin->instance && !track.instrumentPlugin->bypassed)
+    {
+        rt.instrument = track.instrumentPlugin->instance;
+
+        // Size the track buffer for the instrument's bus layout (at least stereo)
+        int ins = rt.instrument->getTotalNumInputChannels();
+        int outs = rt.instrument->getTotalNumOutputChannels();
+        rt.numChannels = std::max(2, std::max(ins, outs));
+    }
+
+    for (const auto& slot : track.insertPlugins)
+        if (slot && slot->instance && !slot->bypassed)
+            rt.inserts.push_back(slot->instance);
+
+    if (rt.instrument)
+        rt.latencySamples += std::max(0, rt.instrument->getLatencySamples());
+
+    for (const auto& insert : rt.inserts)
+        rt.latencySamples += std::max(0, insert->getLatencySamples());
+
+    for (const auto& curve : track.automationCurves)
+    {
+        AutomationLane lane;
+        if (curve.active && !curve.points.empty() && AutomationLane::resolve(track, curve, lane))
+            rt.automation.push_back(std::move(lane));
+    }
+
+    return rt;
+}
+
+static std::shared_ptr<const RoutingGraph> compileRouting(const ProjectState& state, const RenderSnapshot* previous)
+{
+    if (previous != nullptr && previous->routing != nullptr && previous->routing->key == RoutingGraph::createRoutingKey(state))
+        return previous->routing;
+    
+    return RoutingGraph::compile(state);
+}
+
+// Solo in place: soloed tracks, what feeds them (a soloed bus plays its sources) and what
+// they feed (buses, effect returns, the master) stay audible, and so do solo safe tracks.
+// Everything else is silenced. Worked out per snapshot, i.e. once per change.
+static void resolveSolo(RenderSnapshot& snapshot)
+{
+    const auto& routing = *snapshot.routing;
+    const size_t numTracks = snapshot.tracks.size();
+    std::vector<bool> feedsSolo(numTracks, false), fedBySolo(numTracks, false);
+    bool anySolo = false;
+
+    for (size_t i = 0; i < numTracks; ++i)
+    {
+        feedsSolo[i] = fedBySolo[i] = snapshot.tracks[i].mixer->solo.load();
+        anySolo = anySolo || feedsSolo[i];
+    }
+
+    if (!anySolo) return;
+
+    // Render order has sources first: backwards for what feeds a solo, forwards for what it feeds
+    for (auto it = routing.order.rbegin(); it != routing.order.rend(); ++it)
+        if (feedsSolo[(size_t)*it])
+            for (const auto& input : routing.nodes[(size_t)*it].inputs)
+                feedsSolo[(size_t)input.sourceIndex] = true;
+
+    for (int index : routing.order)
+        for (const auto& input : routing.nodes[(size_t)index].inputs)
+            if (fedBySolo[(size_t)input.sourceIndex])
+                fedBySolo[(size_t)index] = true;
+
+    for (size_t i = 0; i < numTracks; ++i)
+        snapshot.tracks[i].soloSilenced = !(feedsSolo[i] || fedBySolo[i] || snapshot.tracks[i].mixer->soloSafe.load());
+}
+
+// Plugin delay compensation: walk the routing in topological order, accumulating the latency
+// at which each track's output is ready, then delay every input and every main-output feed
+// so that they line up with the slowest path into the same destination.
+static void compensateLatencies(RenderSnapshot& snapshot)
+{
+    const auto& routing = *snapshot.routing;
+    std::vector<int> outputLatency(snapshot.tracks.size(), 0);
+
+    for (int index : routing.order)
+    {
+        auto& track = snapshot.tracks[(size_t)index];
+        const auto& inputs = routing.nodes[(size_t)index].inputs;
+
+        int inputLatency = 0;
+        for (const auto& input : inputs)
+            inputLatency = std::max(inputLatency, outputLatency[(size_t)input.sourceIndex]);
+
+        track.inputDelays.clear();
+        for (const auto& input : inputs)
+            track.inputDelays.push_back(inputLatency - outputLatency[(size_t)input.sourceIndex]);
+
+        outputLatency[(size_t)index] = inputLatency + track.latencySamples;
+    }
+
+    int mixLatency = 0;
+    for (size_t i = 0; i < snapshot.tracks.size(); ++i)
+        if (routing.nodes[i].feedsMainOutput)
+            mixLatency = std::max(mixLatency, outputLatency[i]);
+
+    for (size_t i = 0; i < snapshot.tracks.size(); ++i)
+        snapshot.tracks[i].outputDelay = routing.nodes[i].feedsMainOutput ? mixLatency - outputLatency[i] : 0;
+
+    snapshot.outputLatencySamples = mixLatency;
+}
+
+static std::shared_ptr<TrackRenderState> findRenderState(const RenderSnapshot* previous, const juce::Uuid& id)
+{
+    if (previous == nullptr) return nullptr;
+    
+    for (const auto& track : previous->tracks)
+        if (track.id == id)
+            return track.renderState;
+    
+    return nullptr;
+}
+
+std::unique_ptr<RenderSnapshot> RenderSnapshot::createFrom(const ProjectState& state, const RenderSnapshot* previous, int maxBlockSize,
+                                                          const juce::Uuid& freezingTrackId)
+{
+    auto snapshot = std::make_unique<RenderSnapshot>();
+    snapshot->tempoMap = state.createTempoMap();
+    snapshot->isLooping = state.isLooping;
+    snapshot->loopStart = state.loopStart;
+    snapshot->loopEnd = state.loopEnd;
+    snapshot->metronomeEnabled = state.metronomeEnabled;
+    snapshot->metronomeLevel = state.metronomeLevel;
+    snapshot->metronomeOutputChannel = state.metronomeOutputChannel;
+    snapshot->countInBars = state.countInBars;
+    snapshot->revision = state.getRevision();
+    snapshot->maxBlockSize = maxBlockSize;
+
+    snapshot->tracks.reserve(state.tracks.size());
+    for (const auto& track : state.tracks)
+    {
+        snapshot->tracks.push_back(createRenderTrack(*track));
+        if (track->id == freezingTrackId)
+            takeChainAway(snapshot->tracks.back());
+    }
+
+    snapshot->routing = compileRouting(state, previous);
+    compensateLatencies(*snapshot);
+    resolveSolo(*snapshot);
+
+    // Scratch buffers: reuse what the audio thread already has, allocate only on layout changes
+    for (size_t i = 0; i < snapshot->tracks.size(); ++i)
+    {
+        auto& track = snapshot->tracks[i];
+        auto existing = findRenderState(previous, track.id);
+        
+        // The audio thread only follows 'replaced' from states it hasn't rendered yet
+        if (existing != nullptr && existing->rendered.load(std::memory_order_acquire))
+            existing->replaced.reset();
+        
+        if (existing != nullptr && existing->fits(*snapshot, (int)i))
+        {
+            track.renderState = std::move(existing);
+        }
+        else
+        {
+            track.renderState = std::make_shared<TrackRenderState>();
+            track.renderState->prepare(*snapshot, (int)i);
+            track.renderState->replaced = std::move(existing);
+        }
+    }
+
+    return snapshot;
+}
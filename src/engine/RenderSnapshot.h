@@ -0,0 +1,148 @@
+#pragma once
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "../model/ProjectState.h"
+#include "DelayLine.h"
+#include "Automation.h"
+#include "DiskStreamer.h"
+#include "Metronome.h"
+#include "MidiScheduler.h"
+#include "MixKernels.h"
+#include "RoutingGraph.h"
+
+//==============================================================================
+// Immutable, render-ready copy of the project.
+// Built on the message thread from ProjectState and read by the audio thread,
+// so nothing in here may be modified once it has been published.
+// The one exception is TrackRenderState, which is scratch storage for the audio thread.
+
+struct RenderSnapshot;
+
+//==============================================================================
+// Per-track scratch storage, sized on the message thread so the audio thread never allocates.
+// Carried over to the next snapshot as long as the track's layout still fits. When it doesn't,
+// the new state takes the playback state (held notes, smoothing, output delay) over from the
+// one it replaces before its first block, so nothing hangs or jumps.
+struct TrackRenderState
+{
+    juce::AudioBuffer<float> buffer;     // Track output (bus input for buses)
+    juce::AudioBuffer<float> clipBuffer; // Audio clip reads
+    juce::MidiBuffer midi;
+    juce::MidiBuffer outgoingMidi;       // Sequenced events, merged into the engine's MIDI output
+    MidiScheduleCursor midiCursor;
+    float outputGain = 1.0f;             // Fader gain (with mute) at the end of this block
+    float gainRampStart = 1.0f;          // ... and at its start, consumers ramp between the two
+    float audible = 1.0f;                // Mute gain alone, for the pre-fader sends
+    float audibleRampStart = 1.0f;
+    MixKernels::PanGains panGains { 1.0f, 1.0f };     // Constant-power gains at the end of this block
+    MixKernels::PanGains panRampStart { 1.0f, 1.0f }; // ... and at its start
+    bool silent = false;                 // Muted and faded out: neither rendered nor mixed
+
+    // Fader, pan and mute smoothing
+    juce::SmoothedValue<float> volumeSmoother, panSmoother, audibleSmoother;
+    double smoothingSampleRate = 0.0;    // 0 until the first block
+    std::vector<AutomationCursor> automationCursors; // Per RenderTrack::automation lane
+
+    // Delay compensation: one line per routing input, one towards the main output
+    std::vector<DelayLine> inputDelays;
+    DelayLine outputDelay;
+    juce::AudioBuffer<float> delayBuffer; // Delayed copy of an input or of this track's output
+
+    int numChannels = 0;
+    int maxBlockSize = 0;
+
+    // The state this one replaced, kept until the audio thread has taken over from it
+    std::shared_ptr<TrackRenderState> replaced;
+    std::atomic<bool> rendered { false }; // Set by the audio thread after taking over
+
+    static constexpr int midiBufferBytes = 32 * 1024;
+
+    void prepare(const RenderSnapshot& snapshot, int trackIndex);
+    bool fits(const RenderSnapshot& snapshot, int trackIndex) const;
+
+    // Audio thread, before the first block
+    void takeOverPlayback();
+};
+
+//==============================================================================
+struct RenderClip
+{
+    double startBeat = 0.0;
+    double lengthBeats = 0.0;
+    bool isMidi = true;
+
+    juce::File audioFile;
+    double sourceOffset = 0.0;          // Seconds into the file where the clip starts
+    std::shared_ptr<ClipStream> stream; // Ready to read (see DiskStreamer), null while still opening
+
+    float gain = 1.0f;
+    double fadeIn = 0.0;
+    double fadeOut = 0.0;
+
+    double getEndBeat() const { return startBeat + lengthBeats; }
+};
+
+struct RenderTrack
+{
+    juce::Uuid id;
+    TrackType type = TrackType::Midi;
+
+    std::vector<RenderClip> clips;
+    std::vector<ScheduledMidiEvent> midiEvents; // All MIDI clips, sorted by beat
+
+    // Active (non-bypassed) plugins. Shared ownership keeps an instance alive
+    // while this snapshot is in use, even if the track drops it meanwhile.
+    std::shared_ptr<juce::AudioPluginInstance> instrument;
+    std::vector<std::shared_ptr<juce::AudioPluginInstance>> inserts;
+
+    std::vector<AutomationLane> automation; // Active, resolved curves
+
+    // Live fader settings, read once per block
+    std::shared_ptr<const MixerParameters> mixer;
+    bool soloSilenced = false; // Another track is soloed and this one isn't in its path
+    bool ignoreMute = false;   // Plays even while muted or soloed away (freeze bounces)
+
+    // Per entry of Track::sends (0 when inactive). Buses pull these from their sources,
+    // so parallel sources never write the same buffer.
+    std::vector<float> sendAmounts;
+
+    // Plugin delay compensation, in samples
+    int latencySamples = 0;       // Instrument + inserts on this track
+    std::vector<int> inputDelays; // Per routing input, aligns all inputs to the latest one
+    int outputDelay = 0;          // Aligns this track with the rest of the main output mix
+
+    int numChannels = 2;
+
+    std::shared_ptr<TrackRenderState> renderState;
+};
+
+struct RenderSnapshot
+{
+    // Transport settings
+    TempoMap tempoMap;
+    bool isLooping = false;
+    double loopStart = 0.0;
+    double loopEnd = 4.0;
+    bool metronomeEnabled = false;
+    float metronomeLevel = 0.8f;
+    int metronomeOutputChannel = 0;
+    int countInBars = 0;
+    std::shared_ptr<const MetronomeClicks> metronomeClicks; // Set by the engine
+
+    std::vector<RenderTrack> tracks;
+    
+    // Shared between snapshots until the routing changes
+    std::shared_ptr<const RoutingGraph> routing;
+    
+    // Latency of the longest path to the main output, i.e. what the whole mix is delayed by
+    int outputLatencySamples = 0;
+
+    // Project revision this snapshot was built from
+    juce::uint32 revision = 0;
+    int maxBlockSize = 0;
+
+    // Scratch state is reused from 'previous' (matched by track id) when it still fits,
+    // and so is the compiled routing when the routing key is unchanged. The track being
+    // frozen, if any, is left silent: its plugins belong to the freeze render.
+    static std::unique_ptr<RenderSnapshot> createFrom(const ProjectState& state, const RenderSnapshot* previous, int maxBlockSize,
+                                                      const juce::Uuid& freezingTrackId = juce::Uuid::null());
+};
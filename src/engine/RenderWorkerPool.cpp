@@ -0,0 +1,368 @@
+#include "RenderWorkerPool.h"
+#include "RealtimeAllocationGuard.h"
+
+#if JUCE_LINUX
+ #include <linux/futex.h>
+ #include <sys/syscall.h>
+ #include <unistd.h>
+#elif JUCE_MAC || JUCE_IOS
+ #include <dispatch/dispatch.h>
+#endif
+
+namespace
+{
+    // Idle participants spin briefly, as the task that unblocks more work usually finishes
+    // within microseconds, then yield the core to whoever is still working
+    constexpr int spinsBeforeYield = 64;
+
+    // A worker that has found nothing for this long leaves the rest of the block to the others
+    constexpr double maxWorkerIdleSeconds = 100.0e-6;
+}
+
+//==============================================================================
+// Parks a worker between blocks. post() takes no lock, so the audio thread can call it:
+// a futex on Linux (a system call only while the worker sleeps), a dispatch semaphore on
+// Apple platforms and a WaitableEvent elsewhere.
+class RenderWorkerPool::WakeSignal
+{
+public:
+   #if JUCE_LINUX
+    void post()
+    {
+        signalled.store(1);
+        if (sleeping.load())
+            syscall(SYS_futex, reinterpret_cast<juce::uint32*>(&signalled), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+
+    void wait(int timeoutMs)
+    {
+        if (signalled.exchange(0) != 0) return;
+
+        // Set before checking again, so a post() in between either is seen or wakes us
+        sleeping.store(true);
+        if (signalled.load() == 0)
+        {
+            const timespec timeout { timeoutMs / 1000, (long)(timeoutMs % 1000) * 1000000 };
+            syscall(SYS_futex, reinterpret_cast<juce::uint32*>(&signalled), FUTEX_WAIT_PRIVATE, 0, &timeout, nullptr, 0);
+        }
+        sleeping.store(false);
+        signalled.store(0);
+    }
+
+   private:
+    std::atomic<juce::uint32> signalled { 0 };
+    std::atomic<bool> sleeping { false };
+   #elif JUCE_MAC || JUCE_IOS
+    WakeSignal() : semaphore(dispatch_semaphore_create(0)) {}
+    ~WakeSignal() { dispatch_release(semaphore); }
+
+    void post() { dispatch_semaphore_signal(semaphore); }
+    void wait(int timeoutMs) { dispatch_semaphore_wait(semaphore, dispatch_time(DISPATCH_TIME_NOW, (int64_t)timeoutMs * 1000000)); }
+
+   private:
+    dispatch_semaphore_t semaphore;
+   #else
+    void post() { event.signal(); }
+    void wait(int timeoutMs) { event.wait(timeoutMs); }
+
+   private:
+    juce::WaitableEvent event;
+   #endif
+};
+
+//==============================================================================
+// Bounded Chase-Lev deque of task indices. push()/pop() are owner-only,
+// steal() may be called from any thread.
+class RenderWorkerPool::WorkStealingDeque
+{
+public:
+    static constexpr int empty = -1;
+
+    bool push(int task)
+    {
+        auto b = bottom.load(std::memory_order_relaxed);
+        auto t = top.load(std::memory_order_acquire);
+
+        if (b - t >= (long long)capacity)
+            return false;
+
+        slots[(size_t)(b & mask)].store(task, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    int pop()
+    {
+        auto b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto t = top.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return empty;
+        }
+
+        int task = slots[(size_t)(b & mask)].load(std::memory_order_relaxed);
+
+        if (t == b)
+        {
+            // Last element: race against thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                task = empty;
+
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+
+        return task;
+    }
+
+    int steal()
+    {
+        auto t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b)
+            return empty;
+
+        int task = slots[(size_t)(t & mask)].load(std::memory_order_relaxed);
+
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return empty; // Lost the race, caller tries elsewhere
+
+        return task;
+    }
+
+private:
+    static constexpr int capacity = RenderWorkerPool::maxTasks;
+    static constexpr long long mask = capacity - 1;
+    static_assert((capacity & (capacity - 1)) == 0, "Deque capacity must be a power of two");
+
+    std::atomic<long long> top { 0 };
+    std::atomic<long long> bottom { 0 };
+    std::atomic<int> slots[capacity] {};
+};
+
+//==============================================================================
+class RenderWorkerPool::Worker : public juce::Thread
+{
+public:
+    Worker(RenderWorkerPool& p, int index)
+        : juce::Thread("Render Worker " + juce::String(index)), pool(p), participant(index + 1)
+    {
+    }
+
+    ~Worker() override
+    {
+        signalThreadShouldExit();
+        wake();
+        stopThread(2000);
+    }
+
+    void wake() { wakeSignal.post(); }
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            wakeSignal.wait(100);
+
+            if (threadShouldExit())
+                break;
+
+            pool.activeWorkers.fetch_add(1);
+
+            // A late wake-up after the block finished sees no remaining tasks and leaves
+            // without touching the (possibly gone) graph.
+            if (pool.remainingTasks.load() > 0)
+                if (auto* graph = pool.currentGraph.load())
+                    pool.workOnGraph(*graph, participant);
+
+            pool.activeWorkers.fetch_sub(1);
+        }
+    }
+
+private:
+    RenderWorkerPool& pool;
+    const int participant;
+    WakeSignal wakeSignal;
+};
+
+//==============================================================================
+RenderWorkerPool::RenderWorkerPool()
+    : pendingDependencies(new std::atomic<int>[maxTasks])
+{
+    // Never reallocate: the serial path keeps using deques[0] while workers are swapped
+    deques.reserve(65);
+    deques.push_back(std::make_unique<WorkStealingDeque>());
+}
+
+RenderWorkerPool::~RenderWorkerPool()
+{
+    setNumWorkers(0);
+}
+
+void RenderWorkerPool::setNumWorkers(int numWorkers)
+{
+    numWorkers = juce::jlimit(0, 64, numWorkers);
+
+    if (numWorkers == (int)workers.size())
+        return;
+
+    // Wait for the audio thread to leave run(); it falls back to serial rendering meanwhile
+    enabled.store(false);
+    while (runsInFlight.load() != 0)
+        juce::Thread::yield();
+
+    workers.clear();
+    deques.resize(1);
+
+    for (int i = 0; i < numWorkers; ++i)
+    {
+        deques.push_back(std::make_unique<WorkStealingDeque>());
+        workers.push_back(std::make_unique<Worker>(*this, i));
+    }
+
+    for (auto& worker : workers)
+    {
+        // Same scheduling class as the audio callback where the platform allows it
+        if (!worker->startRealtimeThread(juce::Thread::RealtimeOptions{}.withPriority(10)))
+            worker->startThread(juce::Thread::Priority::highest);
+    }
+
+    enabled.store(!workers.empty());
+}
+
+void RenderWorkerPool::run(TaskGraph& graph, bool allowParallel)
+{
+    const int numTasks = graph.getNumTasks();
+
+    if (numTasks <= 0)
+        return;
+
+    runsInFlight.fetch_add(1);
+
+    if (!allowParallel || !enabled.load() || numTasks < 2 || numTasks > maxTasks)
+    {
+        runSerially(graph);
+        runsInFlight.fetch_sub(1);
+        return;
+    }
+
+    for (int i = 0; i < numTasks; ++i)
+        pendingDependencies[(size_t)i].store(graph.getNumDependencies(i), std::memory_order_relaxed);
+
+    currentGraph.store(&graph);
+    remainingTasks.store(numTasks);
+
+    for (int i = 0; i < numTasks; ++i)
+        if (graph.getNumDependencies(i) == 0)
+            deques[0]->push(i);
+
+    for (auto& worker : workers)
+        worker->wake();
+
+    workOnGraph(graph, 0);
+
+    // Tasks may reference our caller's stack, so nobody may still be inside the graph.
+    // Workers leave as soon as the last task is done.
+    for (int spins = 0; activeWorkers.load() != 0; ++spins)
+        if (spins >= spinsBeforeYield)
+            juce::Thread::yield();
+
+    currentGraph.store(nullptr);
+    runsInFlight.fetch_sub(1);
+}
+
+void RenderWorkerPool::runSerially(TaskGraph& graph)
+{
+    const int numTasks = std::min(graph.getNumTasks(), maxTasks);
+
+    for (int i = 0; i < numTasks; ++i)
+        pendingDependencies[(size_t)i].store(graph.getNumDependencies(i), std::memory_order_relaxed);
+
+    for (int i = 0; i < numTasks; ++i)
+        if (graph.getNumDependencies(i) == 0)
+            deques[0]->push(i);
+
+    for (int task = deques[0]->pop(); task != WorkStealingDeque::empty; task = deques[0]->pop())
+        completeTask(graph, task, 0);
+}
+
+void RenderWorkerPool::workOnGraph(TaskGraph& graph, int participant)
+{
+    const RealtimeAllocationGuard::ScopedRealtimeSection realtimeSection;
+
+    int idleSpins = 0;
+    juce::int64 idleSince = 0;
+
+    while (remainingTasks.load() > 0)
+    {
+        int task = findTask(participant);
+
+        if (task == WorkStealingDeque::empty)
+        {
+            // Another participant is finishing a task that will unblock more work. A worker
+            // that waits too long leaves: whoever runs that task takes what it unblocks, and
+            // the caller of run() stays until the end.
+            if (++idleSpins < spinsBeforeYield)
+                continue;
+
+            if (participant != 0)
+            {
+                const auto now = juce::Time::getHighResolutionTicks();
+                if (idleSince == 0)
+                    idleSince = now;
+                else if (juce::Time::highResolutionTicksToSeconds(now - idleSince) > maxWorkerIdleSeconds)
+                    return;
+            }
+
+            juce::Thread::yield();
+            continue;
+        }
+
+        idleSpins = 0;
+        idleSince = 0;
+        completeTask(graph, task, participant);
+        remainingTasks.fetch_sub(1);
+    }
+}
+
+int RenderWorkerPool::findTask(int participant)
+{
+    int task = deques[(size_t)participant]->pop();
+    if (task != WorkStealingDeque::empty)
+        return task;
+
+    const int numParticipants = (int)deques.size();
+    for (int i = 1; i < numParticipants; ++i)
+    {
+        task = deques[(size_t)((participant + i) % numParticipants)]->steal();
+        if (task != WorkStealingDeque::empty)
+            return task;
+    }
+
+    return WorkStealingDeque::empty;
+}
+
+void RenderWorkerPool::completeTask(TaskGraph& graph, int task, int participant)
+{
+    graph.performTask(task);
+
+    const int numDependents = graph.getNumDependents(task);
+    for (int i = 0; i < numDependents; ++i)
+    {
+        int dependent = graph.getDependent(task, i);
+
+        // The last input to finish schedules the dependent
+        if (pendingDependencies[(size_t)dependent].fetch_sub(1) == 1)
+        {
+            bool pushed = deques[(size_t)participant]->push(dependent);
+            jassert(pushed); // Capacity equals maxTasks, so this cannot overflow
+            juce::ignoreUnused(pushed);
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+// Real-time worker threads that execute a small dependency graph of render
+// tasks (one per track) for every audio block.
+//
+// Each participant owns a fixed-size Chase-Lev deque: finished tasks push the
+// dependents they unblock onto their own deque and idle participants steal
+// from the others. The audio thread that calls run() takes part as well and
+// returns only after every task has completed and every worker has left the
+// graph, so tasks may freely reference the caller's stack.
+//
+// Nothing on the run() path allocates or locks: parked workers are woken with a
+// futex or semaphore post. Idle participants spin briefly and then yield; workers
+// that stay idle leave the rest of the block to the others.
+class RenderWorkerPool
+{
+public:
+    // Work description for one block. Queried from several threads at once.
+    struct TaskGraph
+    {
+        virtual ~TaskGraph() = default;
+        virtual int getNumTasks() const = 0;
+        virtual int getNumDependencies(int task) const = 0; // Tasks that must finish first
+        virtual int getNumDependents(int task) const = 0;
+        virtual int getDependent(int task, int index) const = 0;
+        virtual void performTask(int task) = 0;
+    };
+
+    static constexpr int maxTasks = 1024;
+
+    RenderWorkerPool();
+    ~RenderWorkerPool();
+
+    // Message thread. 0 workers = everything runs on the calling thread.
+    void setNumWorkers(int numWorkers);
+    int getNumWorkers() const { return (int)workers.size(); }
+
+    // Audio thread. Runs all tasks of the graph, serially if allowParallel is
+    // false or the pool is disabled, empty or the graph is too large.
+    void run(TaskGraph& graph, bool allowParallel = true);
+
+private:
+    class WorkStealingDeque;
+    class WakeSignal;
+    class Worker;
+
+    void runSerially(TaskGraph& graph);
+    void workOnGraph(TaskGraph& graph, int participant);
+    int findTask(int participant);
+    void completeTask(TaskGraph& graph, int task, int participant);
+
+    std::vector<std::unique_ptr<WorkStealingDeque>> deques; // [0] belongs to the caller of run()
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    std::unique_ptr<std::atomic<int>[]> pendingDependencies;
+    std::atomic<TaskGraph*> currentGraph { nullptr };
+    std::atomic<int> remainingTasks { 0 };
+    std::atomic<int> activeWorkers { 0 };
+
+    // Handshake so setNumWorkers() never tears threads down under a running block
+    std::atomic<bool> enabled { false };
+    std::atomic<int> runsInFlight { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RenderWorkerPool)
+};
@@ -0,0 +1,159 @@
+#include "ResampleCache.h"
+#include <juce_cryptography/juce_cryptography.h>
+
+//==============================================================================
+class ResampleCache::ConversionJob : public juce::ThreadPoolJob
+{
+public:
+    ConversionJob(ResampleCache& c, const juce::File& s, double rate)
+        : juce::ThreadPoolJob("Resample " + s.getFileName()), cache(c), source(s), targetSampleRate(rate) {}
+
+    JobStatus runJob() override
+    {
+        const auto identity = getIdentity(source);
+        const auto pendingKey = identity + "|" + juce::String(targetSampleRate);
+
+        convert(identity);
+
+        const juce::ScopedLock sl(cache.lock);
+        cache.pending.erase(pendingKey);
+        return jobHasFinished;
+    }
+
+private:
+    void convert(const juce::String& identity)
+    {
+        juce::String hash;
+        {
+            const juce::ScopedLock sl(cache.lock);
+            auto it = cache.hashes.find(identity);
+            if (it != cache.hashes.end())
+                hash = it->second;
+        }
+
+        if (hash.isEmpty())
+        {
+            hash = juce::MD5(source).toHexString();
+
+            const juce::ScopedLock sl(cache.lock);
+            cache.hashes[identity] = hash;
+            cache.saveIndex();
+        }
+
+        auto target = cache.getCacheFile(hash, targetSampleRate);
+        if (target.existsAsFile())
+            return;
+
+        std::unique_ptr<juce::AudioFormatReader> sourceReader(cache.formatManager.createReaderFor(source));
+        if (sourceReader == nullptr)
+            return;
+
+        ResamplingReader reader(std::move(sourceReader), targetSampleRate, ResamplingQuality::High);
+
+        // Write next to the target and rename at the end, so a half-written file is never picked up
+        auto temp = target.withFileExtension(".tmp");
+        temp.deleteFile();
+
+        {
+            std::unique_ptr<juce::FileOutputStream> stream(temp.createOutputStream());
+            if (stream == nullptr)
+                return;
+
+            juce::WavAudioFormat wav;
+            std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(stream.get(), targetSampleRate,
+                                                                                reader.numChannels, 32, {}, 0));
+            if (writer == nullptr)
+                return;
+
+            stream.release(); // Writer owns it now
+
+            constexpr int blockSize = 32768;
+            juce::AudioBuffer<float> buffer((int)reader.numChannels, blockSize);
+
+            for (juce::int64 position = 0; position < reader.lengthInSamples; position += blockSize)
+            {
+                if (shouldExit())
+                {
+                    writer.reset();
+                    temp.deleteFile();
+                    return;
+                }
+
+                const int numSamples = (int)std::min<juce::int64>(blockSize, reader.lengthInSamples - position);
+                reader.read(&buffer, 0, numSamples, position, true, true);
+                writer->writeFromAudioSampleBuffer(buffer, 0, numSamples);
+            }
+        }
+
+        temp.moveFileTo(target);
+    }
+
+    ResampleCache& cache;
+    const juce::File source;
+    const double targetSampleRate;
+};
+
+//==============================================================================
+ResampleCache::ResampleCache(juce::AudioFormatManager& fm, const juce::File& dir)
+    : formatManager(fm), directory(dir)
+{
+    directory.createDirectory();
+    loadIndex();
+}
+
+ResampleCache::~ResampleCache()
+{
+    pool.removeAllJobs(true, 10000);
+}
+
+juce::File ResampleCache::getConvertedFile(const juce::File& source, double targetSampleRate)
+{
+    const auto identity = getIdentity(source);
+
+    const juce::ScopedLock sl(lock);
+
+    auto it = hashes.find(identity);
+    if (it != hashes.end())
+    {
+        auto file = getCacheFile(it->second, targetSampleRate);
+        if (file.existsAsFile())
+            return file;
+    }
+
+    if (pending.insert(identity + "|" + juce::String(targetSampleRate)).second)
+        pool.addJob(new ConversionJob(*this, source, targetSampleRate), true);
+
+    return {};
+}
+
+juce::String ResampleCache::getIdentity(const juce::File& source)
+{
+    return source.getFullPathName() + "|" + juce::String(source.getSize()) + "|"
+         + juce::String(source.getLastModificationTime().toMilliseconds());
+}
+
+juce::File ResampleCache::getCacheFile(const juce::String& hash, double targetSampleRate) const
+{
+    return directory.getChildFile(hash + "_" + juce::String(juce::roundToInt(targetSampleRate)) + ".wav");
+}
+
+void ResampleCache::loadIndex()
+{
+    if (auto xml = juce::parseXML(directory.getChildFile("index.xml")))
+        for (auto* entry : xml->getChildWithTagNameIterator("Entry"))
+            hashes[entry->getStringAttribute("identity")] = entry->getStringAttribute("hash");
+}
+
+void ResampleCache::saveIndex()
+{
+    juce::XmlElement xml("ResampleCache");
+
+    for (const auto& entry : hashes)
+    {
+        auto* child = xml.createNewChildElement("Entry");
+        child->setAttribute("identity", entry.first);
+        child->setAttribute("hash", entry.second);
+    }
+
+    xml.writeTo(directory.getChildFile("index.xml"));
+}
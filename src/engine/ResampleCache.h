@@ -0,0 +1,44 @@
+#pragma once
+#include "ResamplingReader.h"
+#include <map>
+#include <set>
+
+//==============================================================================
+// On-disk copies of audio files converted to another sample rate, so heavy
+// sessions only pay for high quality conversion once.
+//
+// Entries are keyed by the MD5 of the source file's contents and the target
+// rate. Hashing and converting happen on a background thread; an index from
+// path/size/modification time to hash lets later sessions find a converted
+// copy without hashing the file again.
+class ResampleCache
+{
+public:
+    ResampleCache(juce::AudioFormatManager& formatManager, const juce::File& directory);
+    ~ResampleCache();
+
+    // Any thread. Returns the converted copy of 'source' if there is one; otherwise
+    // queues its conversion and returns an empty File (play it through a ResamplingReader meanwhile).
+    juce::File getConvertedFile(const juce::File& source, double targetSampleRate);
+
+    const juce::File& getDirectory() const { return directory; }
+
+private:
+    class ConversionJob;
+
+    static juce::String getIdentity(const juce::File& source);
+    juce::File getCacheFile(const juce::String& hash, double targetSampleRate) const;
+    void loadIndex();
+    void saveIndex();
+
+    juce::AudioFormatManager& formatManager;
+    const juce::File directory;
+
+    juce::CriticalSection lock;
+    std::map<juce::String, juce::String> hashes; // Identity -> content hash
+    std::set<juce::String> pending;              // Identity and rate of queued conversions
+
+    juce::ThreadPool pool { 1 };
+
+    JUCE_DECLARE_NON_COPYABLE(ResampleCache)
+};
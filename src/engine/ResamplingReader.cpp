@@ -0,0 +1,105 @@
+#include "ResamplingReader.h"
+#include <cmath>
+#include <cstring>
+
+ResamplingReader::ResamplingReader(std::unique_ptr<juce::AudioFormatReader> s, double targetSampleRate, ResamplingQuality q)
+    : juce::AudioFormatReader(nullptr, s->getFormatName()),
+      source(std::move(s)),
+      ratio(source->sampleRate / targetSampleRate),
+      quality(q)
+{
+    sampleRate = targetSampleRate;
+    bitsPerSample = 32;
+    usesFloatingPointData = true;
+    numChannels = juce::jlimit(1u, 2u, source->numChannels);
+    lengthInSamples = (juce::int64)std::ceil((double)source->lengthInSamples / ratio);
+    metadataValues = source->metadataValues;
+
+    if (quality == ResamplingQuality::High)
+        sinc.resize(numChannels);
+    else
+        lagrange.resize(numChannels);
+
+    input.setSize((int)numChannels, (int)std::ceil(maxChunk * ratio) + 16);
+    discard.setSize(1, maxChunk);
+}
+
+float ResamplingReader::getLatency() const
+{
+    return quality == ResamplingQuality::High ? sinc.front().getBaseLatency() : lagrange.front().getBaseLatency();
+}
+
+bool ResamplingReader::readSamples(int* const* destChannels, int numDestChannels, int startOffsetInDestBuffer,
+                                   juce::int64 startSampleInFile, int numSamples)
+{
+    if (startSampleInFile != nextPosition)
+        restart(startSampleInFile);
+
+    produce(destChannels, numDestChannels, startOffsetInDestBuffer, numSamples);
+    nextPosition = startSampleInFile + numSamples;
+    return true;
+}
+
+void ResamplingReader::restart(juce::int64 position)
+{
+    for (auto& interpolator : lagrange) interpolator.reset();
+    for (auto& interpolator : sinc) interpolator.reset();
+
+    // Output lags input by the interpolator latency L (in source samples). Start early
+    // enough that the first output we keep sees 2L real samples around it, and throw
+    // away what comes before.
+    const float latency = getLatency();
+    const int numToDiscard = (int)std::ceil(2.0 * latency / ratio);
+
+    inputStart = inputEnd = 0;
+    sourcePosition = (juce::int64)std::llround(position * ratio + latency - numToDiscard * ratio);
+
+    produce(nullptr, 0, 0, numToDiscard);
+}
+
+void ResamplingReader::produce(int* const* destChannels, int numDestChannels, int startOffset, int numSamples)
+{
+    for (int done = 0; done < numSamples;)
+    {
+        const int chunk = std::min(maxChunk, numSamples - done);
+        ensureInput((int)std::ceil(chunk * ratio) + 4);
+
+        int used = 0;
+        for (int ch = 0; ch < (int)numChannels; ++ch)
+        {
+            const float* in = input.getReadPointer(ch, inputStart);
+            float* out = ch < numDestChannels && destChannels[ch] != nullptr
+                       ? reinterpret_cast<float*>(destChannels[ch]) + startOffset + done
+                       : discard.getWritePointer(0);
+
+            // Every channel has the same state, so they all consume the same amount
+            used = quality == ResamplingQuality::High ? sinc[(size_t)ch].process(ratio, in, out, chunk)
+                                                      : lagrange[(size_t)ch].process(ratio, in, out, chunk);
+        }
+
+        inputStart += used;
+        done += chunk;
+    }
+}
+
+void ResamplingReader::ensureInput(int numNeeded)
+{
+    if (inputEnd - inputStart >= numNeeded)
+        return;
+
+    // Move what's left to the front, then top up from the file
+    const int numLeft = inputEnd - inputStart;
+    for (int ch = 0; ch < input.getNumChannels(); ++ch)
+        std::memmove(input.getWritePointer(ch), input.getReadPointer(ch, inputStart), sizeof(float) * (size_t)numLeft);
+
+    inputStart = 0;
+    inputEnd = numLeft;
+
+    if (input.getNumSamples() < numNeeded)
+        input.setSize(input.getNumChannels(), numNeeded, true);
+
+    const int numToRead = input.getNumSamples() - inputEnd;
+    source->read(&input, inputEnd, numToRead, sourcePosition, true, true);
+    inputEnd += numToRead;
+    sourcePosition += numToRead;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+enum class ResamplingQuality
+{
+    Realtime, // 4th order Lagrange: cheap enough for many streams during playback
+    High      // Windowed sinc: for offline rendering and the resample cache
+};
+
+//==============================================================================
+// Presents an audio file recorded at another sample rate as if it had been
+// recorded at targetSampleRate (positions and length are in target samples).
+//
+// Conversion is streaming: consecutive reads continue the interpolators, any
+// other read restarts them a few source samples early so the output is
+// settled by the requested position. Like any reader it must only be used by
+// one thread at a time (for clip streams, the I/O thread servicing it).
+// Mono and stereo only, which is what the clip streams carry.
+class ResamplingReader : public juce::AudioFormatReader
+{
+public:
+    ResamplingReader(std::unique_ptr<juce::AudioFormatReader> source, double targetSampleRate, ResamplingQuality quality);
+
+    bool readSamples(int* const* destChannels, int numDestChannels, int startOffsetInDestBuffer,
+                     juce::int64 startSampleInFile, int numSamples) override;
+
+    // Rates that differ by less than this are played as they are
+    static bool needsResampling(double sourceSampleRate, double targetSampleRate)
+    {
+        return std::abs(sourceSampleRate - targetSampleRate) > 0.5;
+    }
+
+private:
+    static constexpr int maxChunk = 4096; // Output samples converted per step
+
+    void restart(juce::int64 position);
+    void produce(int* const* destChannels, int numDestChannels, int startOffset, int numSamples);
+    void ensureInput(int numNeeded);
+    float getLatency() const;
+
+    std::unique_ptr<juce::AudioFormatReader> source;
+    const double ratio; // Source samples per output sample
+    const ResamplingQuality quality;
+
+    std::vector<juce::LagrangeInterpolator> lagrange;
+    std::vector<juce::WindowedSincInterpolator> sinc;
+
+    juce::AudioBuffer<float> input;   // Source samples waiting to be consumed: [inputStart, inputEnd)
+    int inputStart = 0, inputEnd = 0;
+    juce::int64 sourcePosition = 0;   // File position of the sample after inputEnd
+    juce::AudioBuffer<float> discard; // Output of channels nobody asked for
+    juce::int64 nextPosition = -1;    // Output position a read can continue from
+
+    JUCE_DECLARE_NON_COPYABLE(ResamplingReader)
+};
@@ -0,0 +1,169 @@
+#include "RoutingGraph.h"
+
+static int findTrackIndex(const ProjectState& state, const juce::Uuid& id)
+{
+    for (size_t i = 0; i < state.tracks.size(); ++i)
+        if (state.tracks[i]->id == id)
+            return (int)i;
+
+    return -1;
+}
+
+static int findMasterIndex(const ProjectState& state)
+{
+    for (size_t i = 0; i < state.tracks.size(); ++i)
+        if (state.tracks[i]->type == TrackType::Master)
+            return (int)i;
+
+    return -1;
+}
+
+// Only buses take sends. The master is fed implicitly and never sends anywhere.
+static bool canSend(const ProjectState& state, int sourceIndex, int targetIndex, int masterIndex)
+{
+    return sourceIndex != targetIndex
+        && targetIndex >= 0
+        && sourceIndex != masterIndex
+        && state.tracks[(size_t)targetIndex]->type == TrackType::Bus;
+}
+
+// Depth-first search along the accepted send edges
+static bool reaches(const std::vector<std::vector<int>>& edges, int from, int to)
+{
+    std::vector<int> stack { from };
+    std::vector<bool> visited(edges.size(), false);
+
+    while (!stack.empty())
+    {
+        int index = stack.back();
+        stack.pop_back();
+
+        if (index == to) return true;
+        if (visited[(size_t)index]) continue;
+        visited[(size_t)index] = true;
+
+        for (int next : edges[(size_t)index])
+            stack.push_back(next);
+    }
+
+    return false;
+}
+
+// Adds every active send in project order, dropping the ones that would close a loop.
+// Returns the number of dropped sends.
+static int collectSendEdges(const ProjectState& state, int masterIndex, std::vector<std::vector<int>>& edges,
+                            std::vector<RoutingGraph::Node>* nodes)
+{
+    int rejected = 0;
+    edges.assign(state.tracks.size(), {});
+
+    for (size_t i = 0; i < state.tracks.size(); ++i)
+    {
+        const auto& sends = state.tracks[i]->sends;
+
+        for (size_t s = 0; s < sends.size(); ++s)
+        {
+            if (!sends[s].active) continue;
+
+            int target = findTrackIndex(state, sends[s].targetTrackId);
+            if (!canSend(state, (int)i, target, masterIndex)) continue;
+
+            if (reaches(edges, target, (int)i))
+            {
+                ++rejected;
+                continue;
+            }
+
+            edges[i].push_back(target);
+
+            if (nodes != nullptr)
+            {
+                (*nodes)[(size_t)target].inputs.push_back({ (int)i, (int)s });
+                (*nodes)[i].dependents.push_back(target);
+            }
+        }
+    }
+
+    return rejected;
+}
+
+juce::String RoutingGraph::createRoutingKey(const ProjectState& state)
+{
+    juce::String key;
+
+    for (const auto& track : state.tracks)
+    {
+        key << track->id.toString() << ':' << (int)track->type;
+
+        for (const auto& send : track->sends)
+            key << (send.active ? '>' : '-') << send.targetTrackId.toString();
+
+        key << ';';
+    }
+
+    return key;
+}
+
+std::shared_ptr<const RoutingGraph> RoutingGraph::compile(const ProjectState& state)
+{
+    auto graph = std::make_shared<RoutingGraph>();
+    const int numTracks = (int)state.tracks.size();
+
+    graph->key = createRoutingKey(state);
+    graph->nodes.resize((size_t)numTracks);
+    graph->masterIndex = findMasterIndex(state);
+
+    std::vector<std::vector<int>> edges;
+    graph->numRejectedSends = collectSendEdges(state, graph->masterIndex, edges, &graph->nodes);
+
+    // With a master track, everything else is summed into it and only the master reaches the output
+    if (graph->masterIndex >= 0)
+    {
+        auto& master = graph->nodes[(size_t)graph->masterIndex];
+
+        for (int i = 0; i < numTracks; ++i)
+        {
+            if (i == graph->masterIndex) continue;
+
+            master.inputs.push_back({ i, -1 });
+            graph->nodes[(size_t)i].dependents.push_back(graph->masterIndex);
+            graph->nodes[(size_t)i].feedsMainOutput = false;
+        }
+    }
+
+    // Kahn's algorithm, lowest index first so the order is stable across recompiles
+    std::vector<int> pending((size_t)numTracks);
+    for (int i = 0; i < numTracks; ++i)
+        pending[(size_t)i] = (int)graph->nodes[(size_t)i].inputs.size();
+
+    graph->order.reserve((size_t)numTracks);
+    for (int i = 0; i < numTracks; ++i)
+        if (pending[(size_t)i] == 0)
+            graph->order.push_back(i);
+
+    for (size_t next = 0; next < graph->order.size(); ++next)
+    {
+        for (int dependent : graph->nodes[(size_t)graph->order[next]].dependents)
+            if (--pending[(size_t)dependent] == 0)
+                graph->order.push_back(dependent);
+    }
+
+    jassert((int)graph->order.size() == numTracks); // Cycles were rejected above
+
+    return graph;
+}
+
+bool RoutingGraph::wouldCreateCycle(const ProjectState& state, const juce::Uuid& sourceId, const juce::Uuid& targetId)
+{
+    int source = findTrackIndex(state, sourceId);
+    int target = findTrackIndex(state, targetId);
+    int master = findMasterIndex(state);
+
+    if (source < 0 || !canSend(state, source, target, master))
+        return true;
+
+    std::vector<std::vector<int>> edges;
+    collectSendEdges(state, master, edges, nullptr);
+
+    return reaches(edges, target, source);
+}
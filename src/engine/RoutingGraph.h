@@ -0,0 +1,48 @@
+#pragma once
+#include "../model/ProjectState.h"
+#include <memory>
+#include <vector>
+
+//==============================================================================
+// Compiled routing for tracks, sends, buses and the master track.
+//
+// Track outputs, sends (to buses) and the implicit feed of every track into
+// the master track are turned into a dependency graph with preresolved track
+// indices and a topologically sorted render order. Compiling happens on the
+// message thread and only when the routing key changes; send amounts come from
+// the render snapshot, volumes and mutes are read live at render time.
+//
+// Sends that would close a cycle are rejected (first come, first served) so a
+// broken project still renders. The UI should check wouldCreateCycle() before
+// adding a send.
+class RoutingGraph
+{
+public:
+    struct Input
+    {
+        int sourceIndex = -1;
+        int sendIndex = -1; // Into the source's sends; -1 = the source's post-fader output (master feed)
+    };
+
+    struct Node
+    {
+        std::vector<Input> inputs;   // Must finish before this track renders
+        std::vector<int> dependents; // Wait for this track
+        bool feedsMainOutput = true; // False for everything routed through a master track
+    };
+
+    // Indices match ProjectState::tracks at compile time
+    std::vector<Node> nodes;
+    std::vector<int> order;
+    int masterIndex = -1;
+    int numRejectedSends = 0;
+
+    // Identifies the routing of a project. Equal keys compile to equal graphs.
+    juce::String key;
+
+    static juce::String createRoutingKey(const ProjectState& state);
+    static std::shared_ptr<const RoutingGraph> compile(const ProjectState& state);
+
+    // True if a send from source to target is invalid or would close a feedback loop.
+    static bool wouldCreateCycle(const ProjectState& state, const juce::Uuid& sourceId, const juce::Uuid& targetId);
+};
@@ -0,0 +1,98 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+// Hands immutable objects from the message thread to the audio thread.
+//
+// The message thread publishes a new object with a single atomic pointer swap.
+// The audio thread brackets every callback with a ScopedRead, which bumps a
+// reader epoch (odd = inside a callback) and loads the current pointer. Both
+// operations are wait-free.
+//
+// Retired objects are never deleted on the audio thread. collectGarbage() frees
+// a retired object once the reader epoch shows that no callback which could
+// still see it is running. Only one reader thread is supported.
+template <typename ObjectType>
+class SnapshotExchange
+{
+public:
+    SnapshotExchange() = default;
+
+    ~SnapshotExchange()
+    {
+        delete current.exchange(nullptr);
+        for (auto& entry : retired)
+            delete entry.object;
+    }
+
+    //==============================================================================
+    // Message thread
+    void publish(std::unique_ptr<ObjectType> newObject)
+    {
+        auto* previous = current.exchange(newObject.release());
+
+        if (previous != nullptr)
+            retired.push_back({ previous, readerEpoch.load() });
+
+        collectGarbage();
+    }
+
+    // The most recently published object (message thread only).
+    const ObjectType* getLatest() const { return current.load(); }
+
+    void collectGarbage()
+    {
+        auto epochNow = readerEpoch.load();
+
+        retired.erase(std::remove_if(retired.begin(), retired.end(), [epochNow](const RetiredObject& entry) {
+            // Even epoch at retirement: no callback was running, so nobody can hold it.
+            // Otherwise wait until the callback that was running has finished.
+            bool safe = (entry.epoch % 2 == 0) || (epochNow != entry.epoch);
+            if (safe) delete entry.object;
+            return safe;
+        }), retired.end());
+    }
+
+    int getNumPendingReclamations() const { return (int)retired.size(); }
+
+    //==============================================================================
+    // Audio thread
+    class ScopedRead
+    {
+    public:
+        explicit ScopedRead(SnapshotExchange& e) : exchange(e)
+        {
+            exchange.readerEpoch.fetch_add(1);
+            object = exchange.current.load();
+        }
+
+        ~ScopedRead() { exchange.readerEpoch.fetch_add(1); }
+
+        const ObjectType* get() const { return object; }
+        const ObjectType* operator->() const { return object; }
+
+    private:
+        SnapshotExchange& exchange;
+        const ObjectType* object = nullptr;
+
+        ScopedRead(const ScopedRead&) = delete;
+        ScopedRead& operator=(const ScopedRead&) = delete;
+    };
+
+private:
+    struct RetiredObject
+    {
+        ObjectType* object;
+        unsigned long long epoch;
+    };
+
+    std::atomic<ObjectType*> current { nullptr };
+    std::atomic<unsigned long long> readerEpoch { 0 };
+    std::vector<RetiredObject> retired;
+
+    SnapshotExchange(const SnapshotExchange&) = delete;
+    SnapshotExchange& operator=(const SnapshotExchange&) = delete;
+};
@@ -0,0 +1,125 @@
+#include "TrackFreeze.h"
+#include "Automation.h"
+#include <juce_cryptography/juce_cryptography.h>
+#include <algorithm>
+
+namespace TrackFreeze
+{
+    bool canFreeze(const Track& track)
+    {
+        return track.type == TrackType::Midi || track.type == TrackType::Audio;
+    }
+
+    static void writePluginSlot(juce::MemoryOutputStream& out, const std::shared_ptr<PluginSlot>& slot)
+    {
+        // What the slot holds, loaded or not: a bounce stays valid while a project's plugins are restored
+        out.writeBool(slot != nullptr && slot->identifier.isNotEmpty());
+        if (slot == nullptr) return;
+
+        out.writeString(slot->identifier);
+        out.writeBool(slot->bypassed);
+    }
+
+    juce::String createSignature(const Track& track, const TempoMap& tempoMap)
+    {
+        juce::MemoryOutputStream out;
+        out.writeInt((int)track.type);
+        tempoMap.writeTo(out);
+
+        out.writeInt((int)track.clips.size());
+        for (const auto& clip : track.clips)
+        {
+            out.writeDouble(clip.startBeat);
+            out.writeDouble(clip.lengthBeats);
+            out.writeBool(clip.isMidi);
+            out.writeFloat(clip.gain);
+            out.writeDouble(clip.fadeIn);
+            out.writeDouble(clip.fadeOut);
+            out.writeDouble(clip.sourceOffset);
+
+            if (clip.isMidi)
+            {
+                out.writeInt(clip.midiSequence.getNumEvents());
+                for (const auto* event : clip.midiSequence)
+                {
+                    out.writeDouble(event->message.getTimeStamp());
+                    out.write(event->message.getRawData(), (size_t)event->message.getRawDataSize());
+                }
+            }
+            else
+            {
+                out.writeString(clip.audioFile.getFullPathName());
+                out.writeInt64(clip.audioFile.getLastModificationTime().toMilliseconds());
+            }
+        }
+
+        writePluginSlot(out, track.instrumentPlugin);
+        out.writeInt((int)track.insertPlugins.size());
+        for (const auto& slot : track.insertPlugins)
+            writePluginSlot(out, slot);
+
+        // Volume and pan lanes stay live, plugin lanes are baked into the bounce
+        for (const auto& curve : track.automationCurves)
+        {
+            if (!curve.active || curve.parameterID == AutomationTarget::volume || curve.parameterID == AutomationTarget::pan) continue;
+
+            out.writeString(curve.parameterID);
+            out.writeInt((int)curve.points.size());
+            for (const auto& point : curve.points)
+            {
+                out.writeDouble(point.time);
+                out.writeFloat(point.value);
+            }
+        }
+
+        return juce::MD5(out.getMemoryBlock()).toHexString();
+    }
+
+    juce::String createPluginStateHash(const Track& track)
+    {
+        juce::MemoryOutputStream out;
+
+        for (auto* plugin : getPlugins(track))
+        {
+            juce::MemoryBlock state;
+            plugin->getStateInformation(state);
+            out.writeInt64((juce::int64)state.getSize());
+            out << state;
+        }
+
+        return juce::MD5(out.getMemoryBlock()).toHexString();
+    }
+
+    bool hasUnloadedPlugins(const Track& track)
+    {
+        auto isUnloaded = [](const std::shared_ptr<PluginSlot>& slot) {
+            return slot != nullptr && slot->instance == nullptr && slot->identifier.isNotEmpty();
+        };
+
+        return isUnloaded(track.instrumentPlugin)
+            || std::any_of(track.insertPlugins.begin(), track.insertPlugins.end(), isUnloaded);
+    }
+
+    std::vector<juce::AudioPluginInstance*> getPlugins(const Track& track)
+    {
+        std::vector<juce::AudioPluginInstance*> plugins;
+
+        if (track.instrumentPlugin && track.instrumentPlugin->instance)
+            plugins.push_back(track.instrumentPlugin->instance.get());
+
+        for (const auto& slot : track.insertPlugins)
+            if (slot && slot->instance)
+                plugins.push_back(slot->instance.get());
+
+        return plugins;
+    }
+
+    juce::File createCacheFile(const Track& track)
+    {
+        auto directory = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+                             .getChildFile("AiceCube").getChildFile("Freeze");
+        directory.createDirectory();
+
+        return directory.getNonexistentChildFile(track.id.toString() + "_" + juce::String(juce::Time::currentTimeMillis()), ".wav", false);
+    }
+}
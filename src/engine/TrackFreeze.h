@@ -0,0 +1,33 @@
+#pragma once
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "../model/MusicData.h"
+#include "../model/TempoMap.h"
+
+//==============================================================================
+// Track freeze bookkeeping (message thread).
+// A frozen track plays its instrument and inserts from a pre-fader bounce, so the
+// bounce stays valid for as long as everything that went into it is unchanged.
+// Volume, pan, sends and their automation are applied live and aren't part of it.
+namespace TrackFreeze
+{
+    // Only tracks that generate their own signal can be frozen
+    bool canFreeze(const Track& track);
+
+    // Cheap enough to compare on every snapshot: clips, plugin chain layout,
+    // plugin parameter automation and the tempo map
+    juce::String createSignature(const Track& track, const TempoMap& tempoMap);
+
+    // Saved state of the instrument and inserts (one getStateInformation() per plugin),
+    // only compared when a plugin reports a change
+    juce::String createPluginStateHash(const Track& track);
+
+    // Slots whose plugin isn't loaded (yet, see AudioEngine::restorePlugins); their state
+    // can't have changed, and a state hash without them means nothing
+    bool hasUnloadedPlugins(const Track& track);
+
+    // Instrument and inserts that are loaded, bypassed or not
+    std::vector<juce::AudioPluginInstance*> getPlugins(const Track& track);
+
+    // A new, unique bounce file in the freeze cache
+    juce::File createCacheFile(const Track& track);
+}
@@ -0,0 +1,125 @@
+// Times every mix kernel for each instruction set this CPU supports and prints
+// ns/sample next to the speedup over the scalar reference. Also checks each
+// table's output against the scalar one, so a broken kernel can't look fast.
+//
+//   AiceCube_MixKernelsBenchmark [blockSize] [iterations]
+#include "../MixKernels.h"
+#include <juce_core/juce_core.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+
+namespace
+{
+    struct Buffers
+    {
+        std::vector<float> src, dest, left, right;
+
+        explicit Buffers(int blockSize)
+            : src((size_t)blockSize), dest((size_t)blockSize), left((size_t)blockSize), right((size_t)blockSize)
+        {
+            juce::Random random(1234);
+            for (auto& s : src)
+                s = random.nextFloat() * 2.0f - 1.0f;
+            reset();
+        }
+
+        void reset()
+        {
+            std::fill(dest.begin(), dest.end(), 0.25f);
+            std::fill(left.begin(), left.end(), 0.25f);
+            std::fill(right.begin(), right.end(), 0.25f);
+        }
+    };
+
+    struct Benchmark
+    {
+        const char* name;
+        std::function<void(const MixKernels::Table&, Buffers&, int)> run;
+    };
+
+    std::vector<Benchmark> getBenchmarks()
+    {
+        return {
+            { "add", [](const MixKernels::Table& t, Buffers& b, int n) { t.add(b.dest.data(), b.src.data(), n); } },
+            { "addWithRamp", [](const MixKernels::Table& t, Buffers& b, int n) { t.addWithRamp(b.dest.data(), b.src.data(), n, 0.2f, 0.8f); } },
+            { "applyRamp", [](const MixKernels::Table& t, Buffers& b, int n) { t.applyRamp(b.dest.data(), n, 1.0f, 0.999f); } },
+            { "addMonoPanned", [](const MixKernels::Table& t, Buffers& b, int n)
+                {
+                    auto start = MixKernels::constantPowerPan(-0.3f), end = MixKernels::constantPowerPan(0.4f);
+                    t.addMonoPanned(b.left.data(), b.right.data(), b.src.data(), n, start.left, end.left, start.right, end.right);
+                } },
+            { "applyFade", [](const MixKernels::Table& t, Buffers& b, int n) { t.applyFade(b.dest.data(), n, 0.1f, 0.8f / (float)n); } },
+        };
+    }
+
+    float maxDifference(const std::vector<float>& a, const std::vector<float>& b)
+    {
+        float diff = 0.0f;
+        for (size_t i = 0; i < a.size(); ++i)
+            diff = std::max(diff, std::abs(a[i] - b[i]));
+        return diff;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const int blockSize = argc > 1 ? juce::jmax(1, juce::String(argv[1]).getIntValue()) : 512;
+    const int iterations = argc > 2 ? juce::jmax(1, juce::String(argv[2]).getIntValue()) : 20000;
+
+    const auto tables = MixKernels::getAvailable();
+    std::cout << "Block size " << blockSize << ", " << iterations << " iterations. Selected: " << MixKernels::get().name << "\n\n";
+
+    bool allMatch = true;
+
+    for (const auto& benchmark : getBenchmarks())
+    {
+        double scalarNsPerSample = 0.0;
+        Buffers reference(blockSize);
+        benchmark.run(MixKernels::getScalar(), reference, blockSize);
+
+        for (const auto* table : tables)
+        {
+            Buffers buffers(blockSize);
+            benchmark.run(*table, buffers, blockSize);
+
+            const float error = juce::jmax(maxDifference(buffers.dest, reference.dest),
+                                           maxDifference(buffers.left, reference.left),
+                                           maxDifference(buffers.right, reference.right));
+            allMatch = allMatch && error < 1.0e-4f;
+
+            // Warm up, then time; reset now and then so nothing drifts into denormals or infinities
+            for (int i = 0; i < 100; ++i)
+                benchmark.run(*table, buffers, blockSize);
+
+            const auto start = juce::Time::getHighResolutionTicks();
+            for (int i = 0; i < iterations; ++i)
+            {
+                if ((i & 1023) == 0) buffers.reset();
+                benchmark.run(*table, buffers, blockSize);
+            }
+            const auto elapsed = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+            const double nsPerSample = elapsed * 1.0e9 / ((double)iterations * blockSize);
+            if (table == tables.front())
+                scalarNsPerSample = nsPerSample;
+
+            std::cout << juce::String(benchmark.name).paddedRight(' ', 16)
+                      << juce::String(table->name).paddedRight(' ', 8)
+                      << juce::String(nsPerSample, 3).paddedLeft(' ', 9) << " ns/sample"
+                      << juce::String(scalarNsPerSample / nsPerSample, 2).paddedLeft(' ', 8) << "x"
+                      << "   max error " << error << "\n";
+        }
+
+        std::cout << "\n";
+    }
+
+    if (!allMatch)
+    {
+        std::cout << "Some kernels differ from the scalar reference\n";
+        return 1;
+    }
+
+    return 0;
+}
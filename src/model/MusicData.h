@@ -2,6 +2,7 @@
 #include <juce_core/juce_core.h>
 #include <juce_audio_basics/juce_audio_basics.h>
 #include <juce_audio_processors/juce_audio_processors.h>
+#include <atomic>
 #include <memory>
 #include <vector>
 
@@ -31,8 +32,9 @@ struct PluginSlot
 {
     std::shared_ptr<juce::AudioPluginInstance> instance;
     bool bypassed = false;
-    juce::String identifier;
+    juce::String identifier; // PluginDescription::createIdentifierString() (the file, in older projects)
     juce::MemoryBlock state;
+    bool sandboxed = false; // Runs in a plugin host process (see PluginSandbox)
 };
 
 //==============================================================================
@@ -50,13 +52,14 @@ struct Clip
     
     // Audio
     juce::File audioFile;
+    double sourceOffset = 0.0; // Seconds into the file where the clip starts
     
     // Appearance
     juce::Colour clipColor = juce::Colours::lightblue;
     
     // Audio properties
     float gain = 1.0f;
-    double fadeIn = 0.0;
+    double fadeIn = 0.0;  // Equal-power fade lengths, in beats
     double fadeOut = 0.0;
     
     // Helper
@@ -84,6 +87,20 @@ struct Send
     bool active = true;
 };
 
+//==============================================================================
+// Fader settings of a track. Written by any thread (UI, IPC) and read by the audio thread
+// once per block without rebuilding the render snapshot; the engine smooths every change.
+// Solo and solo safe decide which tracks are audible, which the render snapshot works
+// out once per change: call ProjectState::markDirty() after changing them.
+struct MixerParameters
+{
+    std::atomic<float> volume { 1.0f };
+    std::atomic<float> pan { 0.0f };
+    std::atomic<bool> mute { false };
+    std::atomic<bool> solo { false };
+    std::atomic<bool> soloSafe { false }; // Stays audible while other tracks are soloed (e.g. effect returns)
+};
+
 //==============================================================================
 struct Track
 {
@@ -101,14 +118,30 @@ struct Track
     // Automation
     std::vector<AutomationCurve> automationCurves;
     
-    // Mixer
-    float volume = 1.0f;
-    float pan = 0.0f;
-    bool mute = false;
-    bool solo = false;
+    // Mixer (shared with the render snapshots that read it)
+    std::shared_ptr<MixerParameters> mixer = std::make_shared<MixerParameters>();
     bool arm = false;
     
+    // Recording input: first device input channel, 1 (mono) or 2 (stereo) channels
+    int inputChannel = 0;
+    int numInputChannels = 2;
+    
     std::vector<Send> sends;
     
+    // Loop recording keeps each pass of the latest loop take as a lane; the clips of
+    // the active lane are also in 'clips', where they play
+    std::vector<std::vector<Clip>> takeLanes;
+    int activeTakeLane = -1;
+    
+    // Freeze: instrument and inserts bounced to a file that plays in their place
+    struct Freeze
+    {
+        bool frozen = false;
+        juce::File file;
+        double lengthBeats = 0.0;
+        juce::String signature;       // What the bounce was rendered from, see TrackFreeze
+        juce::String pluginStateHash;
+    } freeze;
+    
     juce::Colour trackColor = juce::Colours::grey;
 };
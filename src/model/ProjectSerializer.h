@@ -11,6 +11,32 @@ public:
         root->setProperty("tempo", state.tempo);
         root->setProperty("timeSignatureNum", state.timeSignatureNumerator);
         root->setProperty("timeSignatureDenom", state.timeSignatureDenominator);
+        root->setProperty("metronomeLevel", state.metronomeLevel);
+        root->setProperty("metronomeOutput", state.metronomeOutputChannel);
+        root->setProperty("countInBars", state.countInBars);
+        root->setProperty("tempoRamp", state.tempoRamp);
+        
+        juce::Array<juce::var> tempoArray;
+        for (const auto& change : state.tempoChanges)
+        {
+            juce::DynamicObject* obj = new juce::DynamicObject();
+            obj->setProperty("beat", change.beat);
+            obj->setProperty("bpm", change.bpm);
+            obj->setProperty("ramp", change.ramp);
+            tempoArray.add(juce::var(obj));
+        }
+        root->setProperty("tempoChanges", tempoArray);
+        
+        juce::Array<juce::var> meterArray;
+        for (const auto& change : state.meterChanges)
+        {
+            juce::DynamicObject* obj = new juce::DynamicObject();
+            obj->setProperty("beat", change.beat);
+            obj->setProperty("num", change.numerator);
+            obj->setProperty("denom", change.denominator);
+            meterArray.add(juce::var(obj));
+        }
+        root->setProperty("meterChanges", meterArray);
         
         juce::Array<juce::var> tracksArray;
         for (const auto& track : state.tracks)
@@ -30,6 +56,20 @@ public:
             state.tempo = rootVar["tempo"];
             state.timeSignatureNumerator = rootVar["timeSignatureNum"];
             state.timeSignatureDenominator = rootVar["timeSignatureDenom"];
+            state.metronomeLevel = (float)rootVar.getProperty("metronomeLevel", 0.8f);
+            state.metronomeOutputChannel = juce::jmax(0, (int)rootVar.getProperty("metronomeOutput", 0));
+            state.countInBars = juce::jmax(0, (int)rootVar.getProperty("countInBars", 0));
+            state.tempoRamp = rootVar.getProperty("tempoRamp", false);
+            
+            state.tempoChanges.clear();
+            if (auto* tempoArray = rootVar["tempoChanges"].getArray())
+                for (auto& t : *tempoArray)
+                    state.tempoChanges.push_back({ t["beat"], t["bpm"], t.getProperty("ramp", false) });
+            
+            state.meterChanges.clear();
+            if (auto* meterArray = rootVar["meterChanges"].getArray())
+                for (auto& m : *meterArray)
+                    state.meterChanges.push_back({ m["beat"], m["num"], m["denom"] });
             
             state.tracks.clear();
             auto tracksArray = rootVar["tracks"].getArray();
@@ -42,6 +82,8 @@ public:
                     state.tracks.push_back(track);
                 }
             }
+            
+            state.markDirty();
         }
     }
 
@@ -51,10 +93,13 @@ private:
         juce::DynamicObject* obj = new juce::DynamicObject();
         obj->setProperty("name", track.name);
         obj->setProperty("type", (int)track.type);
-        obj->setProperty("volume", track.volume);
-        obj->setProperty("pan", track.pan);
-        obj->setProperty("mute", track.mute);
-        obj->setProperty("solo", track.solo);
+        obj->setProperty("volume", track.mixer->volume.load());
+        obj->setProperty("pan", track.mixer->pan.load());
+        obj->setProperty("mute", track.mixer->mute.load());
+        obj->setProperty("solo", track.mixer->solo.load());
+        obj->setProperty("soloSafe", track.mixer->soloSafe.load());
+        obj->setProperty("inputChannel", track.inputChannel);
+        obj->setProperty("numInputChannels", track.numInputChannels);
         
         juce::Array<juce::var> clipsArray;
         for (const auto& clip : track.clips)
@@ -63,10 +108,27 @@ private:
         }
         obj->setProperty("clips", clipsArray);
         
+        if (!track.takeLanes.empty())
+        {
+            juce::Array<juce::var> lanesArray;
+            for (const auto& lane : track.takeLanes)
+            {
+                juce::Array<juce::var> laneClips;
+                for (const auto& clip : lane)
+                    laneClips.add(clipToVar(clip));
+                lanesArray.add(laneClips);
+            }
+            obj->setProperty("takeLanes", lanesArray);
+            obj->setProperty("activeTakeLane", track.activeTakeLane);
+        }
+        
         // Plugins & Automation
         // Instrument
         if (track.instrumentPlugin)
         {
+             if (track.instrumentPlugin->sandboxed)
+                 obj->setProperty("instrumentSandboxed", true);
+             
              if (track.instrumentPlugin->instance)
              {
                  track.instrumentPlugin->instance->getStateInformation(const_cast<juce::MemoryBlock&>(track.instrumentPlugin->state));
@@ -88,6 +150,9 @@ private:
             juce::DynamicObject* slotObj = new juce::DynamicObject();
             if (slot)
             {
+                if (slot->sandboxed)
+                    slotObj->setProperty("sandboxed", true);
+                
                 if (slot->instance)
                 {
                     slot->instance->getStateInformation(slot->state);
@@ -125,6 +190,16 @@ private:
             sendsArray.add(juce::var(sObj));
         }
         obj->setProperty("sends", sendsArray);
+        
+        if (track.freeze.frozen)
+        {
+            juce::DynamicObject* freezeObj = new juce::DynamicObject();
+            freezeObj->setProperty("file", track.freeze.file.getFullPathName());
+            freezeObj->setProperty("lengthBeats", track.freeze.lengthBeats);
+            freezeObj->setProperty("signature", track.freeze.signature);
+            freezeObj->setProperty("pluginStateHash", track.freeze.pluginStateHash);
+            obj->setProperty("freeze", juce::var(freezeObj));
+        }
 
         return juce::var(obj);
     }
@@ -138,10 +213,13 @@ private:
             
         track.name = v["name"].toString();
         track.type = (TrackType)(int)v["type"];
-        track.volume = (float)v["volume"];
-        track.pan = (float)v["pan"];
-        track.mute = (bool)v["mute"];
-        track.solo = (bool)v["solo"];
+        track.mixer->volume = (float)v["volume"];
+        track.mixer->pan = (float)v["pan"];
+        track.mixer->mute = (bool)v["mute"];
+        track.mixer->solo = (bool)v["solo"];
+        track.mixer->soloSafe = (bool)v.getProperty("soloSafe", false);
+        track.inputChannel = juce::jmax(0, (int)v.getProperty("inputChannel", 0));
+        track.numInputChannels = juce::jlimit(1, 2, (int)v.getProperty("numInputChannels", 2));
         
         auto sendsArray = v["sends"].getArray();
         if (sendsArray)
@@ -167,12 +245,32 @@ private:
             }
         }
         
+        if (auto* lanesArray = v["takeLanes"].getArray())
+        {
+            for (auto& l : *lanesArray)
+            {
+                std::vector<Clip> lane;
+                if (auto* laneClips = l.getArray())
+                {
+                    for (auto& c : *laneClips)
+                    {
+                        Clip clip;
+                        varToClip(c, clip);
+                        lane.push_back(clip);
+                    }
+                }
+                track.takeLanes.push_back(lane);
+            }
+            track.activeTakeLane = juce::jlimit(-1, (int)track.takeLanes.size() - 1, (int)v.getProperty("activeTakeLane", -1));
+        }
+        
         // Instrument
         juce::String instId = v["instrumentId"].toString();
         if (instId.isNotEmpty())
         {
             track.instrumentPlugin = std::make_shared<PluginSlot>();
             track.instrumentPlugin->identifier = instId;
+            track.instrumentPlugin->sandboxed = v.getProperty("instrumentSandboxed", false);
             
             juce::String stateStr = v["instrumentState"].toString();
             if (stateStr.isNotEmpty())
@@ -192,6 +290,7 @@ private:
                 if (i.isObject())
                 {
                     slot->identifier = i["id"].toString();
+                    slot->sandboxed = i.getProperty("sandboxed", false);
                     juce::String stateStr = i["state"].toString();
                     if (stateStr.isNotEmpty())
                     {
@@ -227,6 +326,17 @@ private:
                 track.automationCurves.push_back(curve);
             }
         }
+        
+        // The engine checks the bounce against the loaded track and unfreezes it if stale
+        auto freezeVar = v["freeze"];
+        if (freezeVar.isObject())
+        {
+            track.freeze.frozen = true;
+            track.freeze.file = juce::File(freezeVar["file"].toString());
+            track.freeze.lengthBeats = (double)freezeVar["lengthBeats"];
+            track.freeze.signature = freezeVar["signature"].toString();
+            track.freeze.pluginStateHash = freezeVar["pluginStateHash"].toString();
+        }
     }
     
     static juce::var clipToVar(const Clip& clip)
@@ -272,6 +382,8 @@ private:
         else
         {
             obj->setProperty("audioPath", clip.audioFile.getFullPathName());
+            if (clip.sourceOffset > 0.0)
+                obj->setProperty("sourceOffset", clip.sourceOffset);
         }
         
         return juce::var(obj);
@@ -305,6 +417,7 @@ private:
         else
         {
             clip.audioFile = juce::File(v["audioPath"].toString());
+            clip.sourceOffset = v.getProperty("sourceOffset", 0.0);
         }
     }
     
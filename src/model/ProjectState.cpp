@@ -10,6 +10,7 @@ std::shared_ptr<Track> ProjectState::addTrack(TrackType type, const juce::String
     track->type = type;
     track->name = name;
     tracks.push_back(track);
+    markDirty();
     return track;
 }
 
@@ -18,6 +19,7 @@ void ProjectState::removeTrack(int index)
     if (index >= 0 && index < tracks.size())
     {
         tracks.erase(tracks.begin() + index);
+        markDirty();
     }
 }
 
@@ -26,6 +28,7 @@ void ProjectState::addClip(int trackIndex, const Clip& clip)
     if (auto* track = getTrack(trackIndex))
     {
         track->clips.push_back(clip);
+        markDirty();
     }
 }
 
@@ -37,3 +40,37 @@ void ProjectState::addClip(int trackIndex, double startBeat, double lengthBeats)
     clip.trackIndex = trackIndex;
     addClip(trackIndex, clip);
 }
+
+TempoMap ProjectState::createTempoMap() const
+{
+    std::vector<TempoChange> tempos { { 0.0, tempo, tempoRamp } };
+    for (const auto& change : tempoChanges)
+        if (change.beat > 0.0)
+            tempos.push_back(change);
+    
+    std::vector<MeterChange> meters { { 0.0, timeSignatureNumerator, timeSignatureDenominator } };
+    for (const auto& change : meterChanges)
+        if (change.beat > 0.0)
+            meters.push_back(change);
+    
+    return TempoMap(std::move(tempos), std::move(meters));
+}
+
+double ProjectState::trimClipStart(Clip& clip, double newStartBeat, const TempoMap& tempoMap)
+{
+    constexpr double minimumLengthBeats = 0.25;
+    if (clip.isMidi) return clip.startBeat;
+    
+    const double endBeat = clip.getEndBeat();
+    const double startSeconds = tempoMap.beatToSeconds(clip.startBeat);
+    const double fileStartBeat = tempoMap.secondsToBeat(startSeconds - clip.sourceOffset);
+    
+    newStartBeat = juce::jmax(0.0, fileStartBeat, juce::jmin(newStartBeat, endBeat - minimumLengthBeats));
+    if (newStartBeat >= endBeat) return clip.startBeat; // Already shorter than the minimum
+    
+    // Audio plays at a fixed rate: the file position moves by the time between the two starts
+    clip.sourceOffset = juce::jmax(0.0, clip.sourceOffset + tempoMap.beatToSeconds(newStartBeat) - startSeconds);
+    clip.startBeat = newStartBeat;
+    clip.lengthBeats = endBeat - newStartBeat;
+    return newStartBeat;
+}
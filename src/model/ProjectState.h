@@ -1,6 +1,8 @@
 #pragma once
 #include <juce_core/juce_core.h>
+#include <atomic>
 #include "MusicData.h"
+#include "TempoMap.h"
 
 class ProjectState
 {
@@ -9,16 +11,24 @@ public:
     ~ProjectState() = default;
 
     // Transport
+    // Tempo and time signature at beat 0; the change lists hold what follows
     double tempo = 120.0;
+    bool tempoRamp = false; // Glides from 'tempo' to the first tempo change
     int timeSignatureNumerator = 4;
     int timeSignatureDenominator = 4;
+    std::vector<TempoChange> tempoChanges;
+    std::vector<MeterChange> meterChanges;
     
-    double playheadBeat = 0.0;
-    bool isPlaying = false;
+    // Written by the audio thread while playing, so these two are atomic
+    std::atomic<double> playheadBeat { 0.0 };
+    std::atomic<bool> isPlaying { false };
     bool isLooping = false;
     double loopStart = 0.0;
     double loopEnd = 4.0;
     bool metronomeEnabled = false;
+    float metronomeLevel = 0.8f;
+    int metronomeOutputChannel = 0; // First of the device output pair the clicks go to (never bounced)
+    int countInBars = 0;            // Clicks before recording from a stopped transport
 
     // Data
     std::vector<std::shared_ptr<Track>> tracks;
@@ -33,10 +43,26 @@ public:
     void removeTrack(int index);
     void addClip(int trackIndex, const Clip& clip);
     void addClip(int trackIndex, double startBeat, double lengthBeats);
+    TempoMap createTempoMap() const;
+    
+    // Moves an audio clip's start to newStartBeat (clamped), keeping its end where it is and
+    // its audio where it was on the timeline: sourceOffset follows. Earlier than the clip's
+    // start extends it back into the file, e.g. into the pre-roll a take was recorded with,
+    // but never before the file's start. Returns the start the clip got.
+    static double trimClipStart(Clip& clip, double newStartBeat, const TempoMap& tempoMap);
     
     // Helpers
     Track* getTrack(int index) {
         if (index >= 0 && index < tracks.size()) return tracks[index].get();
         return nullptr;
     }
+    
+    // Change Tracking
+    // Call after editing tracks, clips, automation or transport settings.
+    // The audio engine republishes its render snapshot when the revision moves.
+    void markDirty() { ++revision; }
+    juce::uint32 getRevision() const { return revision.load(); }
+
+private:
+    std::atomic<juce::uint32> revision { 1 };
 };
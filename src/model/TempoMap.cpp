@@ -0,0 +1,231 @@
+#include "TempoMap.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Below this a ramp is treated as a constant tempo (the closed form divides by the slope)
+static constexpr double minimumSlope = 1.0e-9;
+
+TempoMap::TempoMap() : TempoMap({ TempoChange() }, { MeterChange() })
+{
+}
+
+TempoMap::TempoMap(std::vector<TempoChange> tempoChanges, std::vector<MeterChange> meterChanges)
+{
+    // Tempo changes: sorted, the last one wins at any beat, one at beat 0
+    std::stable_sort(tempoChanges.begin(), tempoChanges.end(),
+                     [](const TempoChange& a, const TempoChange& b) { return a.beat < b.beat; });
+
+    for (auto change : tempoChanges)
+    {
+        change.beat = std::max(0.0, change.beat);
+        change.bpm = juce::jlimit(1.0, 999.0, change.bpm);
+
+        if (!tempos.empty() && tempos.back().beat == change.beat)
+            tempos.back() = change;
+        else
+            tempos.push_back(change);
+    }
+
+    if (tempos.empty())
+        tempos.push_back(TempoChange());
+    else if (tempos.front().beat > 0.0)
+        tempos.insert(tempos.begin(), { 0.0, tempos.front().bpm, false });
+
+    segments.reserve(tempos.size());
+    for (size_t i = 0; i < tempos.size(); ++i)
+    {
+        Segment segment;
+        segment.beat = tempos[i].beat;
+        segment.bpm = tempos[i].bpm;
+
+        if (i > 0)
+            segment.seconds = secondsAt(segments.back(), segment.beat);
+
+        if (tempos[i].ramp && i + 1 < tempos.size())
+            segment.slope = (tempos[i + 1].bpm - tempos[i].bpm) / (tempos[i + 1].beat - tempos[i].beat);
+
+        segments.push_back(segment);
+    }
+
+    // Meters, likewise
+    std::stable_sort(meterChanges.begin(), meterChanges.end(),
+                     [](const MeterChange& a, const MeterChange& b) { return a.beat < b.beat; });
+
+    for (const auto& change : meterChanges)
+    {
+        Meter meter;
+        meter.beat = std::max(0.0, change.beat);
+        meter.numerator = juce::jlimit(1, 64, change.numerator);
+        meter.denominator = juce::jlimit(1, 64, change.denominator);
+
+        if (!meters.empty() && meters.back().beat == meter.beat)
+            meters.back() = meter;
+        else
+            meters.push_back(meter);
+    }
+
+    if (meters.empty())
+        meters.push_back(Meter());
+    else if (meters.front().beat > 0.0)
+        meters.insert(meters.begin(), { 0.0, meters.front().numerator, meters.front().denominator, 0 });
+
+    for (size_t i = 1; i < meters.size(); ++i)
+    {
+        const auto& previous = meters[i - 1];
+        const double bars = (meters[i].beat - previous.beat) / previous.getBeatsPerBar();
+        meters[i].bar = previous.bar + (int)std::ceil(bars - 1.0e-9);
+    }
+}
+
+//==============================================================================
+double TempoMap::secondsAt(const Segment& segment, double beat)
+{
+    const double beats = beat - segment.beat;
+
+    // Before the first segment the tempo is constant
+    if (beats < 0.0 || std::abs(segment.slope) < minimumSlope)
+        return segment.seconds + 60.0 * beats / segment.bpm;
+
+    return segment.seconds + 60.0 / segment.slope * std::log((segment.bpm + segment.slope * beats) / segment.bpm);
+}
+
+double TempoMap::beatAt(const Segment& segment, double seconds)
+{
+    const double elapsed = seconds - segment.seconds;
+
+    if (elapsed < 0.0 || std::abs(segment.slope) < minimumSlope)
+        return segment.beat + elapsed * segment.bpm / 60.0;
+
+    return segment.beat + segment.bpm * (std::exp(segment.slope * elapsed / 60.0) - 1.0) / segment.slope;
+}
+
+bool TempoMap::containsBeat(size_t index, double beat) const
+{
+    return index < segments.size()
+        && (index == 0 || segments[index].beat <= beat)
+        && (index + 1 == segments.size() || beat < segments[index + 1].beat);
+}
+
+bool TempoMap::containsSeconds(size_t index, double seconds) const
+{
+    return index < segments.size()
+        && (index == 0 || segments[index].seconds <= seconds)
+        && (index + 1 == segments.size() || seconds < segments[index + 1].seconds);
+}
+
+size_t TempoMap::findSegmentForBeat(double beat) const
+{
+    auto next = std::upper_bound(segments.begin() + 1, segments.end(), beat,
+                                 [](double b, const Segment& segment) { return b < segment.beat; });
+    return (size_t)(next - segments.begin()) - 1;
+}
+
+size_t TempoMap::findSegmentForSeconds(double seconds) const
+{
+    auto next = std::upper_bound(segments.begin() + 1, segments.end(), seconds,
+                                 [](double s, const Segment& segment) { return s < segment.seconds; });
+    return (size_t)(next - segments.begin()) - 1;
+}
+
+double TempoMap::beatToSeconds(double beat) const
+{
+    return secondsAt(segments[findSegmentForBeat(beat)], beat);
+}
+
+double TempoMap::secondsToBeat(double seconds) const
+{
+    return beatAt(segments[findSegmentForSeconds(seconds)], seconds);
+}
+
+double TempoMap::getTempoAt(double beat) const
+{
+    const auto& segment = segments[findSegmentForBeat(beat)];
+    return segment.bpm + segment.slope * std::max(0.0, beat - segment.beat);
+}
+
+//==============================================================================
+const TempoMap::Meter& TempoMap::getMeterAt(double beat) const
+{
+    auto next = std::upper_bound(meters.begin() + 1, meters.end(), beat,
+                                 [](double b, const Meter& meter) { return b < meter.beat; });
+    return *(next - 1);
+}
+
+double TempoMap::getNextMeterChange(double beat) const
+{
+    auto next = std::upper_bound(meters.begin(), meters.end(), beat,
+                                 [](double b, const Meter& meter) { return b < meter.beat; });
+    return next != meters.end() ? next->beat : std::numeric_limits<double>::infinity();
+}
+
+double TempoMap::beatToBar(double beat) const
+{
+    const auto& meter = getMeterAt(beat);
+    return meter.bar + (beat - meter.beat) / meter.getBeatsPerBar();
+}
+
+void TempoMap::writeTo(juce::OutputStream& out) const
+{
+    out.writeInt((int)segments.size());
+    for (const auto& segment : segments)
+    {
+        out.writeDouble(segment.beat);
+        out.writeDouble(segment.bpm);
+        out.writeDouble(segment.slope);
+    }
+}
+
+//==============================================================================
+TempoMap::Cursor::Cursor(const TempoMap& m, double rate) : map(m), sampleRate(rate)
+{
+}
+
+void TempoMap::Cursor::seekBeat(double beat)
+{
+    if (map.containsBeat(segment, beat)) return;
+
+    if (map.containsBeat(segment + 1, beat))
+        ++segment;
+    else
+        segment = map.findSegmentForBeat(beat);
+}
+
+void TempoMap::Cursor::seekSeconds(double seconds)
+{
+    if (map.containsSeconds(segment, seconds)) return;
+
+    if (map.containsSeconds(segment + 1, seconds))
+        ++segment;
+    else
+        segment = map.findSegmentForSeconds(seconds);
+}
+
+double TempoMap::Cursor::beatToSample(double beat)
+{
+    seekBeat(beat);
+    return secondsAt(map.segments[segment], beat) * sampleRate;
+}
+
+double TempoMap::Cursor::sampleToBeat(double sample)
+{
+    const double seconds = sample / sampleRate;
+    seekSeconds(seconds);
+    return beatAt(map.segments[segment], seconds);
+}
+
+double TempoMap::Cursor::getSamplesPerBeatAt(double beat)
+{
+    seekBeat(beat);
+    const auto& current = map.segments[segment];
+    return 60.0 * sampleRate / (current.bpm + current.slope * std::max(0.0, beat - current.beat));
+}
+
+int TempoMap::Cursor::getSamplesToNextChange(double sample, int maxSamples)
+{
+    seekSeconds(sample / sampleRate);
+    if (segment + 1 == map.segments.size()) return maxSamples;
+
+    const double samplesToChange = std::ceil(map.segments[segment + 1].seconds * sampleRate - sample);
+    return (int)juce::jlimit(1.0, (double)std::max(1, maxSamples), samplesToChange);
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <vector>
+
+//==============================================================================
+struct TempoChange
+{
+    double beat = 0.0;
+    double bpm = 120.0;
+    bool ramp = false; // Glides to the next change (linearly per beat) instead of jumping there
+};
+
+struct MeterChange
+{
+    double beat = 0.0; // Meant to be on a bar line of the meter before it; if not, a new bar starts anyway
+    int numerator = 4;
+    int denominator = 4;
+};
+
+//==============================================================================
+// Tempo and meter over the timeline (beats are quarter notes).
+//
+// The tempo changes are compiled into a table of segments, each with a constant tempo
+// or a linear ramp, and the time at which it starts. A conversion between beats and
+// time is a binary search for the segment plus a closed form within it. Before beat 0
+// the first tempo holds.
+//
+// Immutable once built, so any number of threads may read it.
+class TempoMap
+{
+public:
+    struct Meter
+    {
+        double beat = 0.0;
+        int numerator = 4;
+        int denominator = 4;
+        int bar = 0; // Number of the bar that starts here, counted from 0
+
+        double getBeatsPerBar() const { return numerator * 4.0 / denominator; }
+    };
+
+    // 120 BPM, 4/4
+    TempoMap();
+
+    // Changes may come in any order. If none is at beat 0, the first one also holds before it.
+    TempoMap(std::vector<TempoChange> tempoChanges, std::vector<MeterChange> meterChanges);
+
+    double beatToSeconds(double beat) const;
+    double secondsToBeat(double seconds) const;
+    double getTempoAt(double beat) const;
+
+    const Meter& getMeterAt(double beat) const;
+    double getNextMeterChange(double beat) const; // Infinity if there is none
+    double beatToBar(double beat) const;          // Fractional, counted from 0
+
+    // Sorted, the first at beat 0
+    const std::vector<TempoChange>& getTempoChanges() const { return tempos; }
+    const std::vector<Meter>& getMeters() const { return meters; }
+
+    // Writes everything that affects timing, for signatures of rendered material
+    void writeTo(juce::OutputStream& out) const;
+
+    //==============================================================================
+    // Sample based conversions for one thread, e.g. an audio block at a time.
+    // Remembers the segment of the last lookup, so lookups that move forward steadily
+    // cost O(1); anything else falls back to binary search.
+    class Cursor
+    {
+    public:
+        Cursor(const TempoMap& map, double sampleRate);
+
+        double beatToSample(double beat);
+        double sampleToBeat(double sample);
+        double getSamplesPerBeatAt(double beat);
+
+        // Samples from 'sample' up to the next tempo jump or end of a ramp, within [1, maxSamples].
+        // Blocks split there can use a single samplesPerBeat.
+        int getSamplesToNextChange(double sample, int maxSamples);
+
+    private:
+        void seekBeat(double beat);
+        void seekSeconds(double seconds);
+
+        const TempoMap& map;
+        const double sampleRate;
+        size_t segment = 0;
+    };
+
+private:
+    struct Segment
+    {
+        double beat = 0.0;
+        double seconds = 0.0;
+        double bpm = 120.0;
+        double slope = 0.0; // BPM per beat, 0 for a constant tempo
+    };
+
+    static double secondsAt(const Segment& segment, double beat);
+    static double beatAt(const Segment& segment, double seconds);
+    bool containsBeat(size_t index, double beat) const;
+    bool containsSeconds(size_t index, double seconds) const;
+    size_t findSegmentForBeat(double beat) const;
+    size_t findSegmentForSeconds(double seconds) const;
+
+    std::vector<TempoChange> tempos;
+    std::vector<Meter> meters;
+    std::vector<Segment> segments; // One per tempo change
+};
@@ -0,0 +1,80 @@
+// Plugin delay compensation as RenderSnapshot::createFrom works it out: per-input and
+// main output delays, and delay lines with room for them.
+#include "../engine/RenderSnapshot.h"
+#include "TestProjects.h"
+
+using namespace TestProjects;
+
+class DelayCompensationTests : public juce::UnitTest
+{
+public:
+    DelayCompensationTests() : juce::UnitTest("Delay compensation", "AiceCube") {}
+
+    void runTest() override
+    {
+        beginTest("Bus inputs and main output feeds line up with the slowest path");
+        {
+            ProjectState state;
+            auto bus = state.addTrack(TrackType::Bus, "Bus");
+            auto slow = state.addTrack(TrackType::Audio, "Slow");
+            auto fast = state.addTrack(TrackType::Audio, "Fast");
+            addInsert(*bus, 50);
+            addInsert(*slow, 64);
+            addInsert(*slow, 36);
+            addSend(*slow, *bus);
+            addSend(*fast, *bus);
+
+            auto snapshot = RenderSnapshot::createFrom(state, nullptr, 512);
+            const auto& tracks = snapshot->tracks;
+            expectEquals(tracks[1].latencySamples, 100);
+            expectEquals(tracks[0].latencySamples, 50);
+
+            expectEquals((int)tracks[0].inputDelays.size(), 2);
+            expectEquals(tracks[0].inputDelays[0], 0);   // Slow
+            expectEquals(tracks[0].inputDelays[1], 100); // Fast
+
+            // The bus output is ready after 150 samples, the others are delayed to match
+            expectEquals(snapshot->outputLatencySamples, 150);
+            expectEquals(tracks[0].outputDelay, 0);
+            expectEquals(tracks[1].outputDelay, 50);
+            expectEquals(tracks[2].outputDelay, 150);
+
+            // ... and their delay lines have room for it
+            expect(tracks[2].renderState->outputDelay.fits(2, 150, 512));
+            expect(tracks[0].renderState->inputDelays[1].fits(2, 100, 512));
+        }
+
+        beginTest("Bypassed plugins add no latency");
+        {
+            ProjectState state;
+            auto track = state.addTrack(TrackType::Audio, "Audio");
+            state.addTrack(TrackType::Audio, "Other");
+            addInsert(*track, 64);
+            track->insertPlugins[0]->bypassed = true;
+
+            auto snapshot = RenderSnapshot::createFrom(state, nullptr, 512);
+            expectEquals(snapshot->outputLatencySamples, 0);
+            expectEquals(snapshot->tracks[1].outputDelay, 0);
+        }
+
+        beginTest("With a master track the master's inputs are aligned instead");
+        {
+            ProjectState state;
+            auto master = state.addTrack(TrackType::Master, "Master");
+            auto slow = state.addTrack(TrackType::Audio, "Slow");
+            state.addTrack(TrackType::Audio, "Fast");
+            addInsert(*slow, 128);
+            addInsert(*master, 32);
+
+            auto snapshot = RenderSnapshot::createFrom(state, nullptr, 512);
+            const auto& tracks = snapshot->tracks;
+            expectEquals(tracks[0].inputDelays[0], 0);
+            expectEquals(tracks[0].inputDelays[1], 128);
+            expectEquals(tracks[1].outputDelay, 0);
+            expectEquals(tracks[2].outputDelay, 0);
+            expectEquals(snapshot->outputLatencySamples, 160);
+        }
+    }
+};
+
+static DelayCompensationTests delayCompensationTests;
@@ -0,0 +1,242 @@
+// Disk streaming: a ClipStream serviced by hand (preroll at the cue, the ring taking over
+// where it ends, underruns after an unexpected jump), and the DiskStreamer opening files
+// on its I/O threads.
+#include "../engine/DiskStreamer.h"
+#include <cmath>
+
+namespace
+{
+    // Left: a ramp that wraps every 10000 samples, right: the same, inverted
+    float rampAt(juce::int64 position, int channel)
+    {
+        const auto value = (float)(position % 10000) / 10000.0f;
+        return channel == 0 ? value : -value;
+    }
+
+    // Generates the ramp instead of reading a file, so a stream can be driven without I/O
+    class RampReader : public juce::AudioFormatReader
+    {
+    public:
+        RampReader() : juce::AudioFormatReader(nullptr, "Ramp")
+        {
+            sampleRate = 44100.0;
+            numChannels = 2;
+            lengthInSamples = 1 << 20;
+            bitsPerSample = 32;
+            usesFloatingPointData = true;
+        }
+
+        bool readSamples(int* const* destChannels, int numDestChannels, int startOffsetInDestBuffer,
+                         juce::int64 startSampleInFile, int numSamples) override
+        {
+            clearSamplesBeyondAvailableLength(destChannels, numDestChannels, startOffsetInDestBuffer,
+                                              startSampleInFile, numSamples, lengthInSamples);
+
+            for (int ch = 0; ch < numDestChannels; ++ch)
+                if (destChannels[ch] != nullptr)
+                    for (int i = 0; i < numSamples; ++i)
+                        reinterpret_cast<float*>(destChannels[ch])[startOffsetInDestBuffer + i] = rampAt(startSampleInFile + i, ch);
+
+            return true;
+        }
+    };
+
+    bool writeRampFile(const juce::File& file, int numSamples)
+    {
+        juce::AudioBuffer<float> buffer(2, numSamples);
+        for (int ch = 0; ch < 2; ++ch)
+            for (int i = 0; i < numSamples; ++i)
+                buffer.setSample(ch, i, rampAt(i, ch));
+
+        std::unique_ptr<juce::FileOutputStream> stream(file.createOutputStream());
+        if (stream == nullptr)
+            return false;
+
+        juce::WavAudioFormat wav;
+        std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(stream.get(), 44100.0, 2, 32, {}, 0));
+        if (writer == nullptr)
+            return false;
+
+        stream.release(); // Writer owns it now
+        return writer->writeFromAudioSampleBuffer(buffer, 0, numSamples);
+    }
+
+    // Whether 'buffer' holds the ramp from 'position' on, in both channels
+    bool holdsRamp(const juce::AudioBuffer<float>& buffer, juce::int64 position)
+    {
+        for (int ch = 0; ch < 2; ++ch)
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+                if (std::abs(buffer.getSample(ch, i) - rampAt(position + i, ch)) > 1.0e-6f)
+                    return false;
+
+        return true;
+    }
+
+    bool isSilent(const juce::AudioBuffer<float>& buffer)
+    {
+        return buffer.getMagnitude(0, buffer.getNumSamples()) == 0.0f;
+    }
+
+    template <typename Condition>
+    bool waitUntil(Condition condition)
+    {
+        const auto deadline = juce::Time::getMillisecondCounter() + 10000;
+
+        while (!condition())
+        {
+            if (juce::Time::getMillisecondCounter() > deadline)
+                return false;
+
+            juce::Thread::sleep(1);
+        }
+
+        return true;
+    }
+}
+
+//==============================================================================
+class ClipStreamTests : public juce::UnitTest
+{
+public:
+    ClipStreamTests() : juce::UnitTest("ClipStream", "AiceCube") {}
+
+    void runTest() override
+    {
+        std::atomic<int> underruns { 0 };
+        ClipStream stream([] { return std::unique_ptr<juce::AudioFormatReader>(new RampReader()); }, underruns);
+        juce::AudioBuffer<float> block(2, 512);
+
+        auto serviceAll = [&stream] { while (stream.service()) {} };
+
+        beginTest("Nothing plays before the file is open");
+        {
+            expect(!stream.isReady());
+            expect(!stream.read(block, 512, 0));
+            expect(isSilent(block));
+            expectEquals(stream.getNumUnderruns(), 0);
+
+            expect(stream.service());
+            expect(stream.isReady());
+        }
+
+        beginTest("A jump to the cue plays from the preroll right away");
+        {
+            stream.setCue(50000);
+            serviceAll();
+
+            expect(stream.read(block, 512, 50000));
+            expect(holdsRamp(block, 50000));
+        }
+
+        beginTest("The ring takes over where the preroll ends");
+        {
+            // The read above sent the ring to the end of the preroll
+            serviceAll();
+
+            const juce::int64 prerollEnd = 50000 + ClipStream::prerollSize;
+            expect(stream.read(block, 512, prerollEnd - 256));
+            expect(holdsRamp(block, prerollEnd - 256));
+
+            expect(stream.read(block, 512, prerollEnd + 256));
+            expect(holdsRamp(block, prerollEnd + 256));
+
+            // A sample off (beat to sample rounding) carries on where the last block ended
+            expect(stream.read(block, 512, prerollEnd + 769));
+            expect(holdsRamp(block, prerollEnd + 768));
+            expectEquals(stream.getNumUnderruns(), 0);
+        }
+
+        beginTest("Anywhere else underruns until the ring catches up");
+        {
+            expect(!stream.read(block, 512, 300000));
+            expect(isSilent(block));
+            expectEquals(stream.getNumUnderruns(), 1);
+            expectEquals(underruns.load(), 1);
+
+            // The playhead moved on meanwhile, the ring follows it there
+            serviceAll();
+            expect(stream.read(block, 512, 300512));
+            expect(holdsRamp(block, 300512));
+            expectEquals(stream.getNumUnderruns(), 1);
+        }
+
+        beginTest("A file that can't be opened never gets ready");
+        {
+            ClipStream missing([] { return std::unique_ptr<juce::AudioFormatReader>(); }, underruns);
+            missing.service();
+            expect(!missing.isReady());
+            expect(!missing.read(block, 512, 0));
+            expect(!missing.service());
+        }
+    }
+};
+
+static ClipStreamTests clipStreamTests;
+
+//==============================================================================
+class DiskStreamerTests : public juce::UnitTest
+{
+public:
+    DiskStreamerTests() : juce::UnitTest("DiskStreamer", "AiceCube") {}
+
+    void runTest() override
+    {
+        const auto directory = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                                   .getChildFile("AiceCubeDiskStreamerTests-" + juce::String::toHexString(juce::Random::getSystemRandom().nextInt()));
+        const auto audioFile = directory.getChildFile("ramp.wav");
+        directory.createDirectory();
+        expect(writeRampFile(audioFile, 88200));
+
+        juce::AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+        juce::AudioBuffer<float> block(2, 512);
+
+        beginTest("One stream per clip and rate, opened on an I/O thread");
+        {
+            DiskStreamer streamer(formatManager, 1);
+            auto stream = streamer.getStream("clip", audioFile, 44100.0, ResamplingQuality::Realtime);
+            expect(stream != nullptr);
+            if (stream == nullptr) return;
+
+            expect(streamer.getStream("clip", audioFile, 44100.0, ResamplingQuality::Realtime) == stream);
+            expect(streamer.getStream("clip", audioFile, 48000.0, ResamplingQuality::Realtime) != stream);
+
+            expect(waitUntil([&stream] { return stream->isReady(); }));
+
+            // Short enough for the RAM cache
+            expect(stream->read(block, 512, 1000));
+            expect(holdsRamp(block, 1000));
+            expectEquals((int)streamer.getFileCache().getStatistics().misses, 1);
+        }
+
+        beginTest("Offline reads wait for the disk instead of underrunning");
+        {
+            DiskStreamer streamer(formatManager, 1);
+            streamer.getFileCache().setMaxUncompressedSeconds(0.0); // Memory-mapped, through the ring
+
+            auto stream = streamer.getStream("clip", audioFile, 44100.0, ResamplingQuality::Realtime);
+            expect(stream != nullptr);
+            if (stream == nullptr) return;
+
+            stream->setBlocking(true);
+            expect(stream->read(block, 512, 0));
+            expect(holdsRamp(block, 0));
+            expect(stream->read(block, 512, 512));
+            expect(holdsRamp(block, 512));
+            expectEquals(streamer.getNumUnderruns(), 0);
+        }
+
+        beginTest("Files that can't be read give no stream");
+        {
+            DiskStreamer streamer(formatManager, 1);
+            const auto missingFile = directory.getChildFile("missing.wav");
+
+            expect(waitUntil([&] { return streamer.getStream("missing", missingFile, 44100.0, ResamplingQuality::Realtime) == nullptr; }));
+            streamer.removeUnusedStreams();
+        }
+
+        directory.deleteRecursively();
+    }
+};
+
+static DiskStreamerTests diskStreamerTests;
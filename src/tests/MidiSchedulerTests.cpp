@@ -0,0 +1,144 @@
+// MIDI scheduling: clips flattened into one sorted schedule, sample accurate playback
+// by the cursor, note-offs for held notes on seeks and stops, and held notes surviving
+// a render state that is rebuilt while they sound.
+#include "../engine/RenderSnapshot.h"
+#include "TestProjects.h"
+
+using namespace TestProjects;
+
+namespace
+{
+    constexpr double samplesPerBeat = 100.0;
+    constexpr int samplesPerBlock = 100; // One beat
+
+    void addEvent(Clip& clip, const juce::MidiMessage& message, double beat)
+    {
+        clip.midiSequence.addEvent(message, beat);
+    }
+
+    Clip createClip(double startBeat, double lengthBeats)
+    {
+        Clip clip;
+        clip.startBeat = startBeat;
+        clip.lengthBeats = lengthBeats;
+        return clip;
+    }
+
+    // "on 60@0,off 60@50": note, and sample position in the block
+    juce::String describe(const juce::MidiBuffer& buffer)
+    {
+        juce::StringArray events;
+        for (const auto metadata : buffer)
+        {
+            const auto message = metadata.getMessage();
+            const juce::String type = message.isNoteOn() ? "on " : message.isNoteOff() ? "off " : "other ";
+            events.add(type + juce::String(message.getNoteNumber()) + "@" + juce::String(metadata.samplePosition));
+        }
+
+        return events.joinIntoString(",");
+    }
+
+    // Plays the beat from 'startBeat' on, returns what it sent
+    juce::String playBeat(MidiScheduleCursor& cursor, const std::vector<ScheduledMidiEvent>& events, double startBeat)
+    {
+        juce::MidiBuffer trackMidi, outgoingMidi;
+        cursor.render(events, 1, startBeat, startBeat + 1.0, samplesPerBeat, samplesPerBlock, trackMidi, outgoingMidi);
+        return describe(trackMidi);
+    }
+
+    juce::String stop(MidiScheduleCursor& cursor, bool expectReleased, juce::UnitTest& test)
+    {
+        juce::MidiBuffer trackMidi, outgoingMidi;
+        test.expectEquals(cursor.stop(trackMidi, outgoingMidi), expectReleased);
+        return describe(trackMidi);
+    }
+}
+
+//==============================================================================
+class MidiSchedulerTests : public juce::UnitTest
+{
+public:
+    MidiSchedulerTests() : juce::UnitTest("MidiScheduler", "AiceCube") {}
+
+    void runTest() override
+    {
+        // 60 from beat 0 to 1, 62 from 3.5 until the clip ends at 4, and again from 4 to 5
+        std::vector<Clip> clips { createClip(0.0, 4.0), createClip(4.0, 4.0) };
+        addEvent(clips[0], juce::MidiMessage::noteOn(1, 60, (juce::uint8)100), 0.0);
+        addEvent(clips[0], juce::MidiMessage::noteOff(1, 60), 1.0);
+        addEvent(clips[0], juce::MidiMessage::noteOn(1, 62, (juce::uint8)100), 3.5);
+        addEvent(clips[0], juce::MidiMessage::noteOn(1, 64, (juce::uint8)100), 5.0); // Past the clip end
+        addEvent(clips[1], juce::MidiMessage::noteOn(1, 62, (juce::uint8)100), 0.0);
+        addEvent(clips[1], juce::MidiMessage::noteOff(1, 62), 1.0);
+
+        const auto events = buildMidiSchedule(clips);
+
+        beginTest("Clips are flattened in beat order, note-offs first");
+        {
+            expectEquals((int)events.size(), 6);
+            expectEquals(events[3].beat, 4.0);
+            expect(events[3].message.isNoteOff() && events[3].message.getNoteNumber() == 62);
+            expectEquals(events[4].beat, 4.0);
+            expect(events[4].message.isNoteOn() && events[4].message.getNoteNumber() == 62);
+        }
+
+        beginTest("Events land on their sample, once");
+        {
+            MidiScheduleCursor cursor;
+            expectEquals(playBeat(cursor, events, 0.0), juce::String("on 60@0"));
+            expectEquals(playBeat(cursor, events, 1.0), juce::String("off 60@0"));
+            expectEquals(playBeat(cursor, events, 2.0), juce::String());
+            expectEquals(playBeat(cursor, events, 3.0), juce::String("on 62@50"));
+            expectEquals(playBeat(cursor, events, 4.0), juce::String("off 62@0,on 62@0"));
+            expectEquals(playBeat(cursor, events, 5.0), juce::String("off 62@0"));
+            expectEquals(stop(cursor, false, *this), juce::String());
+        }
+
+        beginTest("Seeks and stops release what is held");
+        {
+            MidiScheduleCursor cursor;
+            expectEquals(playBeat(cursor, events, 3.0), juce::String("on 62@50"));
+            expectEquals(playBeat(cursor, events, 0.0), juce::String("off 62@0,on 60@0"));
+            expectEquals(stop(cursor, true, *this), juce::String("off 60@0"));
+            expectEquals(stop(cursor, false, *this), juce::String());
+        }
+
+        beginTest("A rebuilt render state takes over the held notes");
+        {
+            ProjectState state;
+            auto synth = state.addTrack(TrackType::Midi, "Synth");
+            synth->clips.push_back(createClip(0.0, 4.0));
+            addEvent(synth->clips[0], juce::MidiMessage::noteOn(1, 60, (juce::uint8)100), 0.0);
+
+            auto first = RenderSnapshot::createFrom(state, nullptr, 512);
+            auto firstState = first->tracks[0].renderState;
+            firstState->takeOverPlayback();
+            expectEquals(playBeat(firstState->midiCursor, first->tracks[0].midiEvents, 0.0), juce::String("on 60@0"));
+
+            // A slower track next to it: the synth's output is delayed, its state no longer fits
+            auto slow = state.addTrack(TrackType::Audio, "Slow");
+            addInsert(*slow, 64);
+            auto second = RenderSnapshot::createFrom(state, first.get(), 512);
+            auto secondState = second->tracks[0].renderState;
+            expect(secondState != firstState);
+            expect(secondState->replaced == firstState);
+
+            // Replaced again before it got to play: the next one looks past it
+            slow->insertPlugins[0]->instance->setLatencySamples(4096);
+            state.markDirty();
+            auto third = RenderSnapshot::createFrom(state, second.get(), 512);
+            auto thirdState = third->tracks[0].renderState;
+            expect(thirdState != secondState);
+
+            thirdState->takeOverPlayback();
+            expectEquals(stop(thirdState->midiCursor, true, *this), juce::String("off 60@0"));
+
+            // Once it has played, the next snapshot lets go of what it replaced
+            auto fourth = RenderSnapshot::createFrom(state, third.get(), 512);
+            expect(fourth->tracks[0].renderState == thirdState);
+            expect(thirdState->replaced == nullptr);
+        }
+    }
+};
+
+static MidiSchedulerTests midiSchedulerTests;
@@ -0,0 +1,187 @@
+// PeakCache: peaks of a known file at fine and coarse zoom (i.e. from different levels of
+// the pyramid), the partial peaks at the end, and peaks loaded back from the cache directory.
+#include "../engine/PeakCache.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+    constexpr int fileLength = 300000;
+    constexpr int loudSamples = 150000; // Then quieter
+    constexpr int spikeSample = 200000;
+
+    // +-0.5 up to loudSamples, +-0.25 after that, and one sample at 0.9
+    bool writeTestFile(const juce::File& file)
+    {
+        juce::AudioBuffer<float> buffer(1, fileLength);
+        for (int i = 0; i < fileLength; ++i)
+            buffer.setSample(0, i, (i % 2 == 0 ? 1.0f : -1.0f) * (i < loudSamples ? 0.5f : 0.25f));
+        buffer.setSample(0, spikeSample, 0.9f);
+
+        std::unique_ptr<juce::FileOutputStream> stream(file.createOutputStream());
+        if (stream == nullptr)
+            return false;
+
+        juce::WavAudioFormat wav;
+        std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(stream.get(), 44100.0, 1, 32, {}, 0));
+        if (writer == nullptr)
+            return false;
+
+        stream.release(); // Writer owns it now
+        return writer->writeFromAudioSampleBuffer(buffer, 0, fileLength);
+    }
+
+    bool waitUntilComplete(PeakCache& cache, const juce::File& file)
+    {
+        const auto deadline = juce::Time::getMillisecondCounter() + 10000;
+        PeakCache::Info info;
+
+        while (juce::Time::getMillisecondCounter() < deadline)
+        {
+            if (cache.getInfo(file, info) && info.complete)
+                return true;
+
+            juce::Thread::sleep(5);
+        }
+
+        return false;
+    }
+}
+
+class PeakCacheTests : public juce::UnitTest
+{
+public:
+    PeakCacheTests() : juce::UnitTest("PeakCache", "AiceCube") {}
+
+    void runTest() override
+    {
+        constexpr float tolerance = 1.0e-3f; // Peaks are stored in 16 bits
+
+        const auto directory = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                                   .getChildFile("AiceCubePeakCacheTests-" + juce::String::toHexString(juce::Random::getSystemRandom().nextInt()));
+        const auto audioFile = directory.getChildFile("test.wav");
+        const auto cacheDirectory = directory.getChildFile("Peaks");
+        directory.createDirectory();
+
+        juce::AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+
+        beginTest("Analysis");
+        expect(writeTestFile(audioFile));
+
+        {
+            PeakCache cache(formatManager);
+            cache.setCacheDirectory(cacheDirectory);
+
+            PeakCache::Info info;
+            cache.getInfo(audioFile, info); // Queues it
+            expect(waitUntilComplete(cache, audioFile));
+            expect(cache.getInfo(audioFile, info));
+            expectEquals(info.numChannels, 1);
+            expectEquals((int)info.lengthInSamples, fileLength);
+            expectEquals(info.sampleRate, 44100.0);
+
+            beginTest("Finest level");
+            {
+                PeakCache::Peak peaks[2];
+                expect(cache.getPeaks(audioFile, 0, 0.0, PeakCache::baseSamplesPerPeak, peaks, 2));
+                expectWithinAbsoluteError(peaks[0].min, -0.5f, tolerance);
+                expectWithinAbsoluteError(peaks[0].max, 0.5f, tolerance);
+                expectWithinAbsoluteError(peaks[0].rms, 0.5f, tolerance);
+
+                // The pixel with the spike, and the one after it
+                const int spikePixel = spikeSample / PeakCache::baseSamplesPerPeak;
+                expect(cache.getPeaks(audioFile, 0, spikePixel * (double)PeakCache::baseSamplesPerPeak,
+                                      PeakCache::baseSamplesPerPeak, peaks, 2));
+                expectWithinAbsoluteError(peaks[0].max, 0.9f, tolerance);
+                expectWithinAbsoluteError(peaks[1].max, 0.25f, tolerance);
+                expectWithinAbsoluteError(peaks[1].rms, 0.25f, tolerance);
+            }
+
+            beginTest("Coarse levels");
+            {
+                // 65536 samples per pixel: one peak of the fifth level per pixel
+                PeakCache::Peak peaks[6];
+                expect(cache.getPeaks(audioFile, 0, 0.0, 65536.0, peaks, 6));
+                expectWithinAbsoluteError(peaks[0].max, 0.5f, tolerance);
+                expectWithinAbsoluteError(peaks[0].rms, 0.5f, tolerance);
+
+                // Loud and quiet
+                expectWithinAbsoluteError(peaks[2].min, -0.5f, tolerance);
+                expectWithinAbsoluteError(peaks[2].max, 0.5f, tolerance);
+                expect(peaks[2].rms > 0.25f + tolerance && peaks[2].rms < 0.5f - tolerance);
+
+                expectWithinAbsoluteError(peaks[3].max, 0.9f, tolerance);
+
+                // The partial peak at the end, and silence past it
+                expectWithinAbsoluteError(peaks[4].max, 0.25f, tolerance);
+                expectWithinAbsoluteError(peaks[4].min, -0.25f, tolerance);
+                expectEquals(peaks[5].max, 0.0f);
+                expectEquals(peaks[5].min, 0.0f);
+
+                // The whole file in one pixel, from the coarsest level
+                expect(cache.getPeaks(audioFile, 0, 0.0, 1.0e6, peaks, 1));
+                expectWithinAbsoluteError(peaks[0].min, -0.5f, tolerance);
+                expectWithinAbsoluteError(peaks[0].max, 0.9f, tolerance);
+            }
+
+            beginTest("Levels agree");
+            {
+                // Every zoom in between sees the same extremes over the same samples
+                for (double samplesPerPixel = 256.0; samplesPerPixel <= 262144.0; samplesPerPixel *= 2.0)
+                {
+                    const int numPixels = (int)std::ceil(fileLength / samplesPerPixel);
+                    std::vector<PeakCache::Peak> peaks((size_t)numPixels);
+                    expect(cache.getPeaks(audioFile, 0, 0.0, samplesPerPixel, peaks.data(), numPixels));
+
+                    float min = 1.0f, max = -1.0f;
+                    for (const auto& peak : peaks)
+                    {
+                        min = std::min(min, peak.min);
+                        max = std::max(max, peak.max);
+                    }
+
+                    expectWithinAbsoluteError(min, -0.5f, tolerance, "at " + juce::String(samplesPerPixel) + " samples per pixel");
+                    expectWithinAbsoluteError(max, 0.9f, tolerance, "at " + juce::String(samplesPerPixel) + " samples per pixel");
+                }
+            }
+
+            beginTest("Channels that don't exist are silent");
+            {
+                PeakCache::Peak peak { 1.0f, 1.0f, 1.0f };
+                expect(cache.getPeaks(audioFile, 1, 0.0, 256.0, &peak, 1));
+                expectEquals(peak.max, 0.0f);
+            }
+        }
+
+        beginTest("Peaks are loaded from the cache directory");
+        {
+            expect(cacheDirectory.getNumberOfChildFiles(juce::File::findFiles) > 0);
+
+            PeakCache cache(formatManager);
+            cache.setCacheDirectory(cacheDirectory);
+
+            PeakCache::Info info;
+            cache.getInfo(audioFile, info);
+            expect(waitUntilComplete(cache, audioFile));
+
+            PeakCache::Peak peak;
+            expect(cache.getPeaks(audioFile, 0, 0.0, 1.0e6, &peak, 1));
+            expectWithinAbsoluteError(peak.max, 0.9f, tolerance);
+        }
+
+        beginTest("Missing files");
+        {
+            PeakCache cache(formatManager);
+            PeakCache::Info info;
+            PeakCache::Peak peak;
+            expect(!cache.getInfo(directory.getChildFile("missing.wav"), info));
+            expect(!cache.getPeaks(directory.getChildFile("missing.wav"), 0, 0.0, 256.0, &peak, 1));
+        }
+
+        directory.deleteRecursively();
+    }
+};
+
+static PeakCacheTests peakCacheTests;
@@ -0,0 +1,205 @@
+// PluginLoader: instances come back on the message thread with their state restored and
+// prepared, failures come back as errors, nothing comes back once the loader is gone,
+// and released instances are dropped only once nobody else holds them.
+#include "../engine/PluginLoader.h"
+#include "TestProjects.h"
+
+using namespace TestProjects;
+
+namespace
+{
+    // Remembers the calls the loader makes, in order
+    class RecordingPlugin : public LatencyPlugin
+    {
+    public:
+        RecordingPlugin() : LatencyPlugin(0) {}
+
+        void prepareToPlay(double sampleRate, int blockSize) override
+        {
+            expectMessageThread();
+            calls.add("prepare " + juce::String(sampleRate) + " " + juce::String(blockSize));
+        }
+
+        void setStateInformation(const void* data, int size) override
+        {
+            expectMessageThread();
+            calls.add("state " + juce::String::fromUTF8(static_cast<const char*>(data), size));
+        }
+
+        void expectMessageThread()
+        {
+            if (!juce::MessageManager::existsAndIsCurrentThread())
+                calls.add("off the message thread");
+        }
+
+        juce::StringArray calls;
+    };
+
+    // Creates RecordingPlugins for descriptions of the "Test" format
+    class TestFormat : public juce::AudioPluginFormat
+    {
+    public:
+        juce::String getName() const override { return "Test"; }
+        void findAllTypesForFile(juce::OwnedArray<juce::PluginDescription>&, const juce::String&) override {}
+        bool fileMightContainThisPluginType(const juce::String&) override { return false; }
+        juce::String getNameOfPluginFromIdentifier(const juce::String& identifier) override { return identifier; }
+        bool pluginNeedsRescanning(const juce::PluginDescription&) override { return false; }
+        bool doesPluginStillExist(const juce::PluginDescription&) override { return true; }
+        bool canScanForPlugins() const override { return false; }
+        bool isTrivialToScan() const override { return true; }
+        juce::StringArray searchPathsForPlugins(const juce::FileSearchPath&, bool, bool) override { return {}; }
+        juce::FileSearchPath getDefaultLocationsToSearch() override { return {}; }
+
+    private:
+        void createPluginInstance(const juce::PluginDescription& description, double, int,
+                                  PluginCreationCallback callback) override
+        {
+            if (description.name == "Broken")
+                callback(nullptr, "Broken on purpose");
+            else
+                callback(std::make_unique<RecordingPlugin>(), {});
+        }
+
+        bool requiresUnblockedMessageThreadDuringCreation(const juce::PluginDescription&) const override { return false; }
+    };
+
+    juce::PluginDescription describe(const juce::String& name, const juce::String& formatName = "Test")
+    {
+        juce::PluginDescription description;
+        description.name = name;
+        description.pluginFormatName = formatName;
+        description.fileOrIdentifier = name;
+        return description;
+    }
+
+    // Runs the message loop until 'condition' holds, or for 'timeoutMs' at most
+    template <typename Condition>
+    bool dispatchUntil(Condition condition, int timeoutMs = 5000)
+    {
+        const auto deadline = juce::Time::getMillisecondCounter() + (juce::uint32)timeoutMs;
+
+        while (!condition())
+        {
+            if (juce::Time::getMillisecondCounter() > deadline)
+                return false;
+
+            juce::MessageManager::getInstance()->runDispatchLoopUntil(5);
+        }
+
+        return true;
+    }
+
+    struct Result
+    {
+        bool called = false;
+        bool onMessageThread = false;
+        std::shared_ptr<juce::AudioPluginInstance> instance;
+        juce::String error;
+    };
+
+    PluginLoader::Callback storeIn(Result& result)
+    {
+        return [&result](std::shared_ptr<juce::AudioPluginInstance> instance, const juce::String& error) {
+            result.called = true;
+            result.onMessageThread = juce::MessageManager::existsAndIsCurrentThread();
+            result.instance = std::move(instance);
+            result.error = error;
+        };
+    }
+}
+
+//==============================================================================
+class PluginLoaderTests : public juce::UnitTest
+{
+public:
+    PluginLoaderTests() : juce::UnitTest("PluginLoader", "AiceCube") {}
+
+    void runTest() override
+    {
+        juce::AudioPluginFormatManager formatManager;
+        formatManager.addFormat(new TestFormat());
+
+        juce::MemoryBlock state;
+        state.append("preset", 6);
+
+        beginTest("Instances come back with their state, then prepared");
+        {
+            PluginLoader loader(formatManager);
+            Result result;
+            loader.load(describe("Synth"), 48000.0, 256, state, storeIn(result));
+
+            // Never from within load() itself
+            expect(!result.called);
+            expectEquals(loader.getNumPendingLoads(), 1);
+
+            expect(dispatchUntil([&result] { return result.called; }));
+            expect(result.onMessageThread);
+            expect(result.error.isEmpty());
+            expectEquals(loader.getNumPendingLoads(), 0);
+
+            auto* plugin = dynamic_cast<RecordingPlugin*>(result.instance.get());
+            expect(plugin != nullptr);
+            if (plugin != nullptr)
+                expectEquals(plugin->calls.joinIntoString(","), juce::String("state preset,prepare 48000 256"));
+        }
+
+        beginTest("Empty state is left alone");
+        {
+            PluginLoader loader(formatManager);
+            Result result;
+            loader.load(describe("Synth"), 44100.0, 512, {}, storeIn(result));
+
+            expect(dispatchUntil([&result] { return result.called; }));
+            if (auto* plugin = dynamic_cast<RecordingPlugin*>(result.instance.get()))
+                expectEquals(plugin->calls.joinIntoString(","), juce::String("prepare 44100 512"));
+            else
+                expect(false, "No instance");
+        }
+
+        beginTest("Failures come back as errors");
+        {
+            PluginLoader loader(formatManager);
+            Result broken, unknown;
+            loader.load(describe("Broken"), 48000.0, 256, state, storeIn(broken));
+            loader.load(describe("Elsewhere", "Nonexistent"), 48000.0, 256, state, storeIn(unknown));
+
+            expect(dispatchUntil([&] { return broken.called && unknown.called; }));
+            expect(broken.instance == nullptr && unknown.instance == nullptr);
+            expectEquals(broken.error, juce::String("Broken on purpose"));
+            expect(unknown.error.isNotEmpty());
+            expect(unknown.onMessageThread);
+            expectEquals(loader.getNumPendingLoads(), 0);
+        }
+
+        beginTest("Nothing comes back once the loader is gone");
+        {
+            auto loader = std::make_unique<PluginLoader>(formatManager);
+            Result result;
+            loader->load(describe("Synth"), 48000.0, 256, state, storeIn(result));
+            loader.reset();
+
+            expect(!dispatchUntil([&result] { return result.called; }, 200));
+        }
+
+        beginTest("Released instances go once nobody else holds them");
+        {
+            PluginLoader loader(formatManager);
+            Result result;
+            loader.load(describe("Synth"), 48000.0, 256, {}, storeIn(result));
+            expect(dispatchUntil([&result] { return result.called; }));
+
+            // A render snapshot still playing it
+            auto snapshotReference = result.instance;
+            std::weak_ptr<juce::AudioPluginInstance> watch = result.instance;
+            loader.release(std::move(result.instance));
+
+            dispatchUntil([] { return false; }, 100);
+            expect(!watch.expired());
+
+            snapshotReference.reset();
+            expect(dispatchUntil([&watch] { return watch.expired(); }));
+        }
+    }
+};
+
+static PluginLoaderTests pluginLoaderTests;
@@ -0,0 +1,96 @@
+// PluginSandbox: hosts are started from this executable (see TestMain.cpp), report
+// plugins they can't load back to the engine, and keep serving after a failed load.
+// Crash recovery needs a plugin that crashes on demand, so it isn't covered here.
+#include "../engine/PluginSandbox.h"
+
+namespace
+{
+    juce::PluginDescription describeMissingPlugin(const juce::String& name)
+    {
+        juce::PluginDescription description;
+        description.name = name;
+        description.pluginFormatName = "VST3";
+        description.fileOrIdentifier = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                                           .getChildFile("AiceCubeNoSuchPlugin").getChildFile(name + ".vst3").getFullPathName();
+        return description;
+    }
+
+    template <typename Condition>
+    bool dispatchUntil(Condition condition, int timeoutMs = 10000)
+    {
+        const auto deadline = juce::Time::getMillisecondCounter() + (juce::uint32)timeoutMs;
+
+        while (!condition())
+        {
+            if (juce::Time::getMillisecondCounter() > deadline)
+                return false;
+
+            juce::MessageManager::getInstance()->runDispatchLoopUntil(5);
+        }
+
+        return true;
+    }
+
+    struct Result
+    {
+        bool called = false;
+        std::shared_ptr<juce::AudioPluginInstance> instance;
+        juce::String error;
+    };
+
+    PluginLoader::Callback storeIn(Result& result)
+    {
+        return [&result](std::shared_ptr<juce::AudioPluginInstance> instance, const juce::String& error) {
+            result.called = true;
+            result.instance = std::move(instance);
+            result.error = error;
+        };
+    }
+}
+
+//==============================================================================
+class PluginSandboxTests : public juce::UnitTest
+{
+public:
+    PluginSandboxTests() : juce::UnitTest("PluginSandbox", "AiceCube") {}
+
+    void runTest() override
+    {
+        PluginSandbox sandbox;
+        juce::StringArray problems;
+        sandbox.onProblem = [&problems](const juce::String& message) { problems.add(message); };
+
+        beginTest("Plugins a host can't load come back as errors");
+        {
+            Result result;
+            sandbox.load(describeMissingPlugin("Missing"), 48000.0, 256, {}, storeIn(result));
+
+            // Answered by the host process, never from within load() itself
+            expect(!result.called);
+            expect(dispatchUntil([&result] { return result.called; }), "No answer from the host");
+            expect(result.instance == nullptr);
+            expect(result.error.isNotEmpty());
+        }
+
+        beginTest("The host keeps serving after a failed load");
+        {
+            Result first, second;
+            sandbox.load(describeMissingPlugin("First"), 48000.0, 256, {}, storeIn(first));
+            sandbox.load(describeMissingPlugin("Second"), 48000.0, 256, {}, storeIn(second));
+
+            expect(dispatchUntil([&] { return first.called && second.called; }), "No answer from the host");
+            expect(first.instance == nullptr && second.instance == nullptr);
+            expect(first.error.isNotEmpty() && second.error.isNotEmpty());
+        }
+
+        beginTest("Failed loads are neither problems nor round trips");
+        {
+            // Long enough for the health check to have seen a crashed host
+            dispatchUntil([] { return false; }, 300);
+            expectEquals(problems.joinIntoString("\n"), juce::String());
+            expectEquals((int)sandbox.getStatistics().numBlocks, 0);
+        }
+    }
+};
+
+static PluginSandboxTests pluginSandboxTests;
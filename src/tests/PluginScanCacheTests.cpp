@@ -0,0 +1,153 @@
+// PluginScanCache: which plugin files count as unchanged (size and time, else contents),
+// bundles, forgetting removed files, and the index file.
+#include "../engine/PluginScanCache.h"
+
+namespace
+{
+    void setTime(const juce::File& file, juce::int64 milliseconds)
+    {
+        file.setLastModificationTime(juce::Time(milliseconds));
+    }
+}
+
+class PluginScanCacheTests : public juce::UnitTest
+{
+public:
+    PluginScanCacheTests() : juce::UnitTest("PluginScanCache", "AiceCube") {}
+
+    void runTest() override
+    {
+        const auto directory = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                                   .getChildFile("AiceCubePluginScanCacheTests-" + juce::String::toHexString(juce::Random::getSystemRandom().nextInt()));
+        const auto indexFile = directory.getChildFile("ScanCache.xml");
+        const auto plugin = directory.getChildFile("Plugin.so");
+        const auto path = plugin.getFullPathName();
+        directory.createDirectory();
+
+        const juce::int64 time = juce::Time(2024, 0, 1, 12, 0).toMilliseconds();
+        plugin.replaceWithText("plugin binary");
+        setTime(plugin, time);
+
+        beginTest("Probed files are unchanged until they change");
+        {
+            PluginScanCache cache(indexFile);
+            expect(!cache.isUnchanged(path, 1, false));
+
+            cache.setProbed(path, 1, false);
+            expect(cache.isUnchanged(path, 1, false));
+
+            // What the probe found is part of it
+            expect(!cache.isUnchanged(path, 2, false));
+            expect(!cache.isUnchanged(path, 1, true));
+
+            plugin.replaceWithText("plugin binary, rebuilt");
+            setTime(plugin, time + 60000);
+            expect(!cache.isUnchanged(path, 1, false));
+        }
+
+        beginTest("Same contents under a new time are unchanged");
+        {
+            PluginScanCache cache(indexFile);
+            plugin.replaceWithText("plugin binary");
+            setTime(plugin, time);
+            cache.setProbed(path, 1, false);
+
+            setTime(plugin, time + 120000); // Copied or touched
+            expect(cache.isUnchanged(path, 1, false));
+
+            // The new time is remembered
+            PluginScanCache::Entry entry;
+            expect(cache.getEntry(path, entry));
+            expectEquals(entry.modified, time + 120000);
+
+            // Same size under a new time, different contents
+            plugin.replaceWithText("plugin binarY");
+            setTime(plugin, time + 180000);
+            expect(!cache.isUnchanged(path, 1, false));
+        }
+
+        beginTest("Adopted entries have no contents to fall back on");
+        {
+            PluginScanCache cache(indexFile);
+            plugin.replaceWithText("plugin binary");
+            setTime(plugin, time);
+            cache.adopt(path, 1);
+            expect(cache.isUnchanged(path, 1, false));
+
+            setTime(plugin, time + 60000);
+            expect(!cache.isUnchanged(path, 1, false));
+        }
+
+        beginTest("Bundles: everything but the resources");
+        {
+            const auto bundle = directory.getChildFile("Plugin.vst3");
+            const auto binary = bundle.getChildFile("Contents/x86_64-linux/Plugin.so");
+            const auto resource = bundle.getChildFile("Contents/Resources/moduleinfo.json");
+            binary.create();
+            binary.replaceWithText("bundle binary");
+            resource.create();
+            resource.replaceWithText("{}");
+
+            PluginScanCache cache(indexFile);
+            cache.setProbed(bundle.getFullPathName(), 2, false);
+
+            resource.replaceWithText("{ \"changed\": true }");
+            setTime(resource, time + 60000);
+            expect(cache.isUnchanged(bundle.getFullPathName(), 2, false));
+
+            binary.replaceWithText("bundle binary, rebuilt");
+            expect(!cache.isUnchanged(bundle.getFullPathName(), 2, false));
+        }
+
+        beginTest("Removed files are forgotten");
+        {
+            const auto other = directory.getChildFile("Other.so");
+            other.replaceWithText("other binary");
+
+            PluginScanCache cache(indexFile);
+            cache.setProbed(path, 1, false);
+            cache.setProbed(other.getFullPathName(), 0, true);
+
+            const auto removed = cache.removeMissing(juce::StringArray(path));
+            expectEquals(removed.size(), 1);
+            expectEquals(removed[0], other.getFullPathName());
+
+            PluginScanCache::Entry entry;
+            expect(cache.getEntry(path, entry));
+            expect(!cache.getEntry(other.getFullPathName(), entry));
+        }
+
+        beginTest("The index survives a restart");
+        {
+            plugin.replaceWithText("plugin binary");
+            setTime(plugin, time);
+            indexFile.deleteFile();
+
+            {
+                PluginScanCache cache(indexFile);
+                cache.setProbed(path, 3, false);
+                cache.save();
+            }
+
+            expect(indexFile.existsAsFile());
+
+            PluginScanCache cache(indexFile);
+            PluginScanCache::Entry entry;
+            expect(cache.getEntry(path, entry));
+            expectEquals(entry.numTypes, 3);
+            expectEquals(entry.modified, time);
+            expectEquals(entry.size, plugin.getSize());
+            expect(!entry.failed);
+            expect(entry.hash.isNotEmpty());
+            expect(cache.isUnchanged(path, 3, false));
+
+            // Touched while the engine was down
+            setTime(plugin, time + 60000);
+            expect(cache.isUnchanged(path, 3, false));
+        }
+
+        directory.deleteRecursively();
+    }
+};
+
+static PluginScanCacheTests pluginScanCacheTests;
@@ -0,0 +1,190 @@
+// Recording with pre-roll: takes that start before the record point (MultiTrackRecorder),
+// and clips trimmed back into that audio (ProjectState::trimClipStart).
+#include "../engine/MultiTrackRecorder.h"
+#include "../model/ProjectState.h"
+
+namespace
+{
+    constexpr double sampleRate = 8000.0;
+    constexpr int blockSize = 800;
+
+    // What the device delivers at input position 'position'
+    float inputAt(juce::int64 position)
+    {
+        return (float)(position % 1000) / 1000.0f;
+    }
+
+    // Plays 'numBlocks' blocks of device input into the recorder, from 'position' on. The
+    // recorder counts a callback's input once the next one starts, so an empty one follows.
+    juce::int64 feed(MultiTrackRecorder& recorder, juce::int64 position, int numBlocks)
+    {
+        juce::AudioBuffer<float> input(1, blockSize);
+
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            for (int i = 0; i < blockSize; ++i)
+                input.setSample(0, i, inputAt(position + i));
+
+            recorder.process(input, 0, blockSize);
+            position += blockSize;
+        }
+
+        recorder.process(input, 0, 0);
+        return position;
+    }
+
+    std::unique_ptr<juce::AudioFormatReader> openTake(const juce::File& file)
+    {
+        juce::WavAudioFormat wav;
+        return std::unique_ptr<juce::AudioFormatReader>(wav.createReaderFor(file.createInputStream().release(), true));
+    }
+}
+
+//==============================================================================
+class RecorderPreRollTests : public juce::UnitTest
+{
+public:
+    RecorderPreRollTests() : juce::UnitTest("Recorder pre-roll", "AiceCube") {}
+
+    void runTest() override
+    {
+        const auto directory = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                                   .getChildFile("AiceCubeRecordingTests-" + juce::String::toHexString(juce::Random::getSystemRandom().nextInt()));
+        directory.createDirectory();
+
+        beginTest("Pre-roll is on by default");
+        {
+            MultiTrackRecorder recorder;
+            expectEquals(recorder.getPreRollSeconds(), 30.0);
+        }
+
+        beginTest("Takes start up to the pre-roll before the record point");
+        {
+            MultiTrackRecorder recorder;
+            recorder.prepare(sampleRate);
+            recorder.setPreRollSeconds(0.5);
+            recorder.setCapturedInputs(juce::BigInteger(1));
+
+            // Two seconds of armed input go by, then recording asks for more than is kept
+            const auto position = feed(recorder, 0, 20);
+            juce::String error;
+            const auto file = directory.getChildFile("PreRoll.wav");
+            expect(recorder.start({ { file, 0, 1 } }, 32, (juce::int64)sampleRate, false, error), error);
+
+            feed(recorder, position, 10);
+            const auto takes = recorder.stop();
+            expectEquals((int)takes.size(), 1);
+            if (takes.size() != 1) return;
+
+            const auto& take = takes[0];
+            expectEquals(take.startOffset, (juce::int64)-4000);
+            expectEquals(take.numSamples, (juce::int64)12000);
+
+            auto reader = openTake(take.file);
+            expect(reader != nullptr);
+            if (reader == nullptr) return;
+
+            // The file starts 4000 samples before the record point (16000)
+            expectEquals((juce::int64)reader->lengthInSamples, take.numSamples);
+            juce::AudioBuffer<float> audio(1, (int)reader->lengthInSamples);
+            reader->read(&audio, 0, audio.getNumSamples(), 0, true, false);
+
+            for (int i : { 0, 123, 3999, 4000, 4321, 11999 })
+                expectWithinAbsoluteError(audio.getSample(0, i), inputAt(12000 + i), 1.0e-6f,
+                                          "at sample " + juce::String(i));
+
+            expectEquals(recorder.getStatistics().droppedSamples, (juce::int64)0);
+        }
+
+        beginTest("Without pre-roll, takes start at the record point");
+        {
+            MultiTrackRecorder recorder;
+            recorder.prepare(sampleRate);
+            recorder.setPreRollSeconds(0.0);
+            recorder.setCapturedInputs(juce::BigInteger(1));
+
+            const auto position = feed(recorder, 0, 5);
+            juce::String error;
+            const auto file = directory.getChildFile("NoPreRoll.wav");
+            expect(recorder.start({ { file, 0, 1 } }, 32, (juce::int64)sampleRate, false, error), error);
+
+            feed(recorder, position, 5);
+            const auto takes = recorder.stop();
+            expectEquals((int)takes.size(), 1);
+            if (takes.size() != 1) return;
+
+            expectEquals(takes[0].startOffset, (juce::int64)0);
+            expectEquals(takes[0].numSamples, (juce::int64)4000);
+        }
+
+        directory.deleteRecursively();
+    }
+};
+
+static RecorderPreRollTests recorderPreRollTests;
+
+//==============================================================================
+class TrimClipStartTests : public juce::UnitTest
+{
+public:
+    TrimClipStartTests() : juce::UnitTest("Trim clip start", "AiceCube") {}
+
+    void runTest() override
+    {
+        constexpr double tolerance = 1.0e-9;
+
+        // 120 BPM: half a second per beat. The take was recorded at beat 8 with 3 s of pre-roll.
+        const TempoMap tempoMap;
+        Clip take;
+        take.isMidi = false;
+        take.startBeat = 8.0;
+        take.lengthBeats = 4.0;
+        take.sourceOffset = 3.0;
+
+        beginTest("Trimming back uncovers the pre-roll");
+        {
+            expectWithinAbsoluteError(ProjectState::trimClipStart(take, 6.0, tempoMap), 6.0, tolerance);
+            expectWithinAbsoluteError(take.sourceOffset, 2.0, tolerance);
+            expectWithinAbsoluteError(take.getEndBeat(), 12.0, tolerance);
+        }
+
+        beginTest("Never before the file starts");
+        {
+            expectWithinAbsoluteError(ProjectState::trimClipStart(take, 0.0, tempoMap), 2.0, tolerance);
+            expectWithinAbsoluteError(take.sourceOffset, 0.0, tolerance);
+            expectWithinAbsoluteError(take.lengthBeats, 10.0, tolerance);
+        }
+
+        beginTest("Trimming forward keeps the end and a minimum length");
+        {
+            expectWithinAbsoluteError(ProjectState::trimClipStart(take, 20.0, tempoMap), 11.75, tolerance);
+            expectWithinAbsoluteError(take.lengthBeats, 0.25, tolerance);
+            expectWithinAbsoluteError(take.sourceOffset, 4.875, tolerance);
+        }
+
+        beginTest("Audio keeps its place across tempo changes");
+        {
+            // 120 BPM up to beat 4, then 60: beat 8 is at 6 s, beat 10 at 8 s
+            const TempoMap slower({ { 0.0, 120.0, false }, { 4.0, 60.0, false } }, {});
+            Clip clip;
+            clip.isMidi = false;
+            clip.startBeat = 8.0;
+            clip.lengthBeats = 4.0;
+
+            expectWithinAbsoluteError(ProjectState::trimClipStart(clip, 6.0, slower), 8.0, tolerance);
+            expectWithinAbsoluteError(ProjectState::trimClipStart(clip, 10.0, slower), 10.0, tolerance);
+            expectWithinAbsoluteError(clip.sourceOffset, 2.0, tolerance);
+            expectWithinAbsoluteError(clip.lengthBeats, 2.0, tolerance);
+        }
+
+        beginTest("MIDI clips are left alone");
+        {
+            Clip clip;
+            clip.startBeat = 8.0;
+            expectWithinAbsoluteError(ProjectState::trimClipStart(clip, 6.0, tempoMap), 8.0, tolerance);
+            expectWithinAbsoluteError(clip.lengthBeats, 4.0, tolerance);
+        }
+    }
+};
+
+static TrimClipStartTests trimClipStartTests;
@@ -0,0 +1,112 @@
+// RoutingGraph: render order, master and output feeds, rejected feedback loops and the
+// routing key.
+#include "../engine/RoutingGraph.h"
+#include "TestProjects.h"
+#include <algorithm>
+
+using namespace TestProjects;
+
+namespace
+{
+    int positionInOrder(const RoutingGraph& graph, int index)
+    {
+        return (int)(std::find(graph.order.begin(), graph.order.end(), index) - graph.order.begin());
+    }
+}
+
+//==============================================================================
+class RoutingGraphTests : public juce::UnitTest
+{
+public:
+    RoutingGraphTests() : juce::UnitTest("RoutingGraph", "AiceCube") {}
+
+    void runTest() override
+    {
+        beginTest("Sources render before the buses and the master they feed");
+        {
+            ProjectState state;
+            auto master = state.addTrack(TrackType::Master, "Master");
+            auto bus = state.addTrack(TrackType::Bus, "Reverb");
+            auto drums = state.addTrack(TrackType::Audio, "Drums");
+            auto bass = state.addTrack(TrackType::Audio, "Bass");
+            addSend(*drums, *bus);
+            addSend(*bass, *bus);
+
+            auto graph = RoutingGraph::compile(state);
+            expectEquals((int)graph->order.size(), 4);
+            expectEquals(graph->masterIndex, 0);
+            expectEquals(graph->numRejectedSends, 0);
+            expect(positionInOrder(*graph, 2) < positionInOrder(*graph, 1));
+            expect(positionInOrder(*graph, 3) < positionInOrder(*graph, 1));
+            expectEquals(graph->order.back(), 0);
+
+            expectEquals((int)graph->nodes[1].inputs.size(), 2);
+            expectEquals(graph->nodes[1].inputs[0].sourceIndex, 2);
+            expectEquals(graph->nodes[1].inputs[0].sendIndex, 0);
+            expectEquals((int)graph->nodes[0].inputs.size(), 3);
+            expectEquals(graph->nodes[0].inputs[0].sendIndex, -1);
+
+            // With a master track only the master reaches the output
+            expect(graph->nodes[0].feedsMainOutput);
+            expect(!graph->nodes[1].feedsMainOutput && !graph->nodes[2].feedsMainOutput);
+        }
+
+        beginTest("Without a master track every track feeds the output");
+        {
+            ProjectState state;
+            auto bus = state.addTrack(TrackType::Bus, "Bus");
+            auto track = state.addTrack(TrackType::Audio, "Audio");
+            addSend(*track, *bus);
+
+            auto graph = RoutingGraph::compile(state);
+            expectEquals(graph->masterIndex, -1);
+            expect(graph->nodes[0].feedsMainOutput && graph->nodes[1].feedsMainOutput);
+            expectEquals(graph->order[0], 1);
+        }
+
+        beginTest("Feedback loops are rejected");
+        {
+            ProjectState state;
+            auto master = state.addTrack(TrackType::Master, "Master");
+            auto a = state.addTrack(TrackType::Bus, "A");
+            auto b = state.addTrack(TrackType::Bus, "B");
+            auto audio = state.addTrack(TrackType::Audio, "Audio");
+            addSend(*a, *b);
+
+            expect(RoutingGraph::wouldCreateCycle(state, b->id, a->id));
+            expect(RoutingGraph::wouldCreateCycle(state, a->id, a->id));
+            expect(!RoutingGraph::wouldCreateCycle(state, audio->id, a->id));
+
+            // Only buses take sends, and the master sends nowhere
+            expect(RoutingGraph::wouldCreateCycle(state, a->id, audio->id));
+            expect(RoutingGraph::wouldCreateCycle(state, a->id, master->id));
+            expect(RoutingGraph::wouldCreateCycle(state, master->id, b->id));
+
+            // A project that has one anyway still compiles, first send wins
+            addSend(*b, *a);
+            auto graph = RoutingGraph::compile(state);
+            expectEquals(graph->numRejectedSends, 1);
+            expectEquals((int)graph->order.size(), 4);
+            expect(positionInOrder(*graph, 1) < positionInOrder(*graph, 2));
+        }
+
+        beginTest("Routing key follows sends, not mixer settings");
+        {
+            ProjectState state;
+            auto bus = state.addTrack(TrackType::Bus, "Bus");
+            auto track = state.addTrack(TrackType::Audio, "Audio");
+            const auto before = RoutingGraph::createRoutingKey(state);
+
+            track->mixer->volume = 0.5f;
+            expectEquals(RoutingGraph::createRoutingKey(state), before);
+
+            addSend(*track, *bus);
+            expectNotEquals(RoutingGraph::createRoutingKey(state), before);
+
+            track->sends[0].active = false;
+            expectNotEquals(RoutingGraph::createRoutingKey(state), before);
+        }
+    }
+};
+
+static RoutingGraphTests routingGraphTests;
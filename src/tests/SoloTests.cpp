@@ -0,0 +1,67 @@
+// Solo in place as RenderSnapshot::createFrom resolves it: what a solo keeps along the
+// routing, solo safe tracks and several solos at once.
+#include "../engine/RenderSnapshot.h"
+#include "TestProjects.h"
+
+using namespace TestProjects;
+
+class SoloTests : public juce::UnitTest
+{
+public:
+    SoloTests() : juce::UnitTest("Solo", "AiceCube") {}
+
+    void runTest() override
+    {
+        // Master <- everything; Drums bus <- Kick, Snare; Reverb bus <- Snare, Vocals
+        ProjectState state;
+        auto master = state.addTrack(TrackType::Master, "Master");
+        auto drums = state.addTrack(TrackType::Bus, "Drums");
+        auto reverb = state.addTrack(TrackType::Bus, "Reverb");
+        auto kick = state.addTrack(TrackType::Audio, "Kick");
+        auto snare = state.addTrack(TrackType::Audio, "Snare");
+        auto vocals = state.addTrack(TrackType::Audio, "Vocals");
+        addSend(*kick, *drums);
+        addSend(*snare, *drums);
+        addSend(*snare, *reverb);
+        addSend(*vocals, *reverb);
+
+        auto silenced = [&state]
+        {
+            auto snapshot = RenderSnapshot::createFrom(state, nullptr, 512);
+            juce::StringArray names;
+            for (size_t i = 0; i < snapshot->tracks.size(); ++i)
+                if (snapshot->tracks[i].soloSilenced)
+                    names.add(state.tracks[i]->name);
+            return names.joinIntoString(",");
+        };
+
+        beginTest("Nothing soloed, nothing silenced");
+        expectEquals(silenced(), juce::String());
+
+        beginTest("A soloed track keeps the buses it feeds and the master");
+        snare->mixer->solo = true;
+        expectEquals(silenced(), juce::String("Kick,Vocals"));
+
+        beginTest("A soloed bus keeps its sources");
+        snare->mixer->solo = false;
+        drums->mixer->solo = true;
+        expectEquals(silenced(), juce::String("Reverb,Vocals"));
+
+        beginTest("Solo safe tracks stay audible");
+        reverb->mixer->soloSafe = true;
+        expectEquals(silenced(), juce::String("Vocals"));
+
+        beginTest("Several solos add up");
+        vocals->mixer->solo = true;
+        expectEquals(silenced(), juce::String());
+
+        beginTest("Soloing the master keeps everything");
+        drums->mixer->solo = false;
+        vocals->mixer->solo = false;
+        reverb->mixer->soloSafe = false;
+        master->mixer->solo = true;
+        expectEquals(silenced(), juce::String());
+    }
+};
+
+static SoloTests soloTests;
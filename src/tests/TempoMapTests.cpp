@@ -0,0 +1,109 @@
+// TempoMap: beat/time conversions across tempo jumps and ramps, meters and bars,
+// and the sample based Cursor.
+#include "../model/TempoMap.h"
+#include <cmath>
+
+class TempoMapTests : public juce::UnitTest
+{
+public:
+    TempoMapTests() : juce::UnitTest("TempoMap", "AiceCube") {}
+
+    void runTest() override
+    {
+        constexpr double tolerance = 1.0e-9;
+
+        beginTest("Default map is 120 BPM in 4/4");
+        {
+            TempoMap map;
+            expectWithinAbsoluteError(map.beatToSeconds(4.0), 2.0, tolerance);
+            expectWithinAbsoluteError(map.secondsToBeat(3.0), 6.0, tolerance);
+            expectWithinAbsoluteError(map.getTempoAt(100.0), 120.0, tolerance);
+            expectEquals(map.getMeterAt(0.0).numerator, 4);
+            expectWithinAbsoluteError(map.beatToBar(6.0), 1.5, tolerance);
+        }
+
+        beginTest("Tempo jump");
+        {
+            TempoMap map({ { 0.0, 120.0, false }, { 8.0, 60.0, false } }, {});
+            expectWithinAbsoluteError(map.beatToSeconds(8.0), 4.0, tolerance);
+            expectWithinAbsoluteError(map.beatToSeconds(12.0), 8.0, tolerance);
+            expectWithinAbsoluteError(map.secondsToBeat(6.0), 10.0, tolerance);
+            expectWithinAbsoluteError(map.getTempoAt(7.9), 120.0, tolerance);
+            expectWithinAbsoluteError(map.getTempoAt(8.0), 60.0, tolerance);
+        }
+
+        beginTest("Changes in any order, none at beat 0");
+        {
+            TempoMap map({ { 8.0, 60.0, false }, { 4.0, 90.0, false } }, {});
+            expectEquals((int)map.getTempoChanges().size(), 3);
+            expectWithinAbsoluteError(map.getTempoAt(0.0), 90.0, tolerance);
+            expectWithinAbsoluteError(map.beatToSeconds(8.0), 8.0 * 60.0 / 90.0, tolerance);
+        }
+
+        beginTest("Before beat 0 the first tempo holds");
+        {
+            TempoMap map({ { 0.0, 60.0, false }, { 4.0, 120.0, false } }, {});
+            expectWithinAbsoluteError(map.beatToSeconds(-2.0), -2.0, tolerance);
+            expectWithinAbsoluteError(map.secondsToBeat(-3.0), -3.0, tolerance);
+        }
+
+        beginTest("Linear ramp");
+        {
+            // 60 to 120 BPM over 4 beats: 15 BPM per beat, so beat b is at 4 ln(1 + b / 4) seconds
+            TempoMap map({ { 0.0, 60.0, true }, { 4.0, 120.0, false } }, {});
+            expectWithinAbsoluteError(map.getTempoAt(2.0), 90.0, tolerance);
+            expectWithinAbsoluteError(map.beatToSeconds(2.0), 4.0 * std::log(1.5), tolerance);
+            expectWithinAbsoluteError(map.beatToSeconds(4.0), 4.0 * std::log(2.0), tolerance);
+            expectWithinAbsoluteError(map.beatToSeconds(6.0), 4.0 * std::log(2.0) + 1.0, tolerance);
+
+            for (double beat = 0.0; beat < 8.0; beat += 0.37)
+                expectWithinAbsoluteError(map.secondsToBeat(map.beatToSeconds(beat)), beat, 1.0e-7);
+        }
+
+        beginTest("Meters and bars");
+        {
+            TempoMap map({}, { { 0.0, 4, 4 }, { 8.0, 3, 4 }, { 14.0, 7, 8 } });
+            expectEquals(map.getMeterAt(7.9).numerator, 4);
+            expectEquals(map.getMeterAt(9.0).numerator, 3);
+            expectEquals(map.getMeterAt(9.0).bar, 2);
+            expectEquals(map.getMeterAt(14.0).bar, 4);
+            expectWithinAbsoluteError(map.beatToBar(11.0), 3.0, tolerance);
+            expectWithinAbsoluteError(map.beatToBar(17.5), 5.0, tolerance);
+            expectWithinAbsoluteError(map.getNextMeterChange(9.0), 14.0, tolerance);
+            expect(std::isinf(map.getNextMeterChange(14.0)));
+        }
+
+        beginTest("A meter change off the bar line starts a new bar");
+        {
+            TempoMap map({}, { { 0.0, 4, 4 }, { 6.0, 3, 4 } });
+            expectEquals(map.getMeterAt(6.0).bar, 2);
+            expectWithinAbsoluteError(map.beatToBar(5.0), 1.25, tolerance);
+        }
+
+        beginTest("Cursor");
+        {
+            TempoMap map({ { 0.0, 120.0, false }, { 8.0, 60.0, true }, { 12.0, 120.0, false } }, {});
+            TempoMap::Cursor cursor(map, 48000.0);
+
+            expectWithinAbsoluteError(cursor.beatToSample(1.0), 24000.0, 1.0e-6);
+            expectWithinAbsoluteError(cursor.beatToSample(8.0), 192000.0, 1.0e-6);
+            expectWithinAbsoluteError(cursor.sampleToBeat(96000.0), 4.0, tolerance);
+            expectWithinAbsoluteError(cursor.getSamplesPerBeatAt(2.0), 24000.0, 1.0e-6);
+
+            // Backwards and forwards again, across the segments
+            expectWithinAbsoluteError(cursor.sampleToBeat(cursor.beatToSample(13.0)), 13.0, 1.0e-7);
+            expectWithinAbsoluteError(cursor.sampleToBeat(cursor.beatToSample(0.5)), 0.5, 1.0e-7);
+            expectWithinAbsoluteError(cursor.beatToSample(10.0), map.beatToSeconds(10.0) * 48000.0, 1.0e-6);
+
+            // Blocks split at the jump to the ramp and at the end of the ramp
+            expectEquals(cursor.getSamplesToNextChange(0.0, 512), 512);
+            expectEquals(cursor.getSamplesToNextChange(191900.0, 512), 100);
+            const double rampEnd = map.beatToSeconds(12.0) * 48000.0;
+            const int toRampEnd = cursor.getSamplesToNextChange(rampEnd - 10.0, 512);
+            expect(toRampEnd == 10 || toRampEnd == 11, "Ramp ends " + juce::String(toRampEnd) + " samples on");
+            expectEquals(cursor.getSamplesToNextChange(rampEnd + 1.0, 512), 512);
+        }
+    }
+};
+
+static TempoMapTests tempoMapTests;
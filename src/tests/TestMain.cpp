@@ -0,0 +1,51 @@
+// Runs the unit tests (every juce::UnitTest in the "AiceCube" category) and exits with 1
+// if any of them failed, so ctest can run it.
+//
+//   AiceCube_Tests [test name]
+//
+// It also serves as the plugin host of the sandbox under test, like the app and engine do.
+#include <juce_events/juce_events.h>
+#include "../engine/PluginSandbox.h"
+
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser; // Some classes under test broadcast change messages
+
+    juce::StringArray arguments;
+    for (int i = 1; i < argc; ++i)
+        arguments.add(argv[i]);
+
+    const auto commandLine = arguments.joinIntoString(" ");
+    if (PluginSandbox::isHostCommandLine(commandLine))
+    {
+        auto host = PluginSandbox::createHost(commandLine, [] { juce::MessageManager::getInstance()->stopDispatchLoop(); });
+        if (host == nullptr)
+            return 1;
+
+        juce::MessageManager::getInstance()->runDispatchLoop();
+        return 0;
+    }
+
+    juce::UnitTestRunner runner;
+    runner.setAssertOnFailure(false);
+
+    if (argc > 1)
+    {
+        juce::Array<juce::UnitTest*> tests;
+        for (auto* test : juce::UnitTest::getTestsInCategory("AiceCube"))
+            if (test->getName() == juce::String(argv[1]))
+                tests.add(test);
+
+        runner.runTests(tests);
+    }
+    else
+    {
+        runner.runTestsInCategory("AiceCube");
+    }
+
+    int failures = 0;
+    for (int i = 0; i < runner.getNumResults(); ++i)
+        failures += runner.getResult(i)->failures;
+
+    return failures > 0 || runner.getNumResults() == 0 ? 1 : 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+// Building blocks for the projects the tests render or compile
+#include "../model/ProjectState.h"
+
+namespace TestProjects
+{
+    // A pass-through insert that reports a fixed latency
+    class LatencyPlugin : public juce::AudioPluginInstance
+    {
+    public:
+        explicit LatencyPlugin(int latency)
+            : juce::AudioPluginInstance(BusesProperties().withInput("Input", juce::AudioChannelSet::stereo())
+                                                         .withOutput("Output", juce::AudioChannelSet::stereo()))
+        {
+            setLatencySamples(latency);
+        }
+
+        void fillInPluginDescription(juce::PluginDescription& description) const override { description.name = getName(); }
+        const juce::String getName() const override { return "Latency"; }
+        void prepareToPlay(double, int) override {}
+        void releaseResources() override {}
+        void processBlock(juce::AudioBuffer<float>&, juce::MidiBuffer&) override {}
+        double getTailLengthSeconds() const override { return 0.0; }
+        bool acceptsMidi() const override { return false; }
+        bool producesMidi() const override { return false; }
+        juce::AudioProcessorEditor* createEditor() override { return nullptr; }
+        bool hasEditor() const override { return false; }
+        int getNumPrograms() override { return 1; }
+        int getCurrentProgram() override { return 0; }
+        void setCurrentProgram(int) override {}
+        const juce::String getProgramName(int) override { return {}; }
+        void changeProgramName(int, const juce::String&) override {}
+        void getStateInformation(juce::MemoryBlock&) override {}
+        void setStateInformation(const void*, int) override {}
+    };
+
+    inline void addInsert(Track& track, int latency)
+    {
+        auto slot = std::make_shared<PluginSlot>();
+        slot->instance = std::make_shared<LatencyPlugin>(latency);
+        track.insertPlugins.push_back(slot);
+    }
+
+    inline void addSend(Track& source, const Track& target)
+    {
+        source.sends.push_back({ target.id, 1.0f, true });
+    }
+}
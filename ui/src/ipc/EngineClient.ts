@@ -29,6 +29,20 @@ export interface TransportState {
   timeSignatureDenominator: number;
 }
 
+export interface PeakChannel {
+  min: number[];
+  max: number[];
+  rms: number[];
+}
+
+export interface ClipPeaks {
+  ready: boolean;           // false while the file is queued for analysis (a peaksUpdated event follows)
+  complete?: boolean;       // false while analysing or recording
+  sampleRate?: number;
+  lengthSeconds?: number;
+  channels?: PeakChannel[]; // One min/max/rms entry per pixel
+}
+
 export interface EngineResponse {
   type: 'response';
   id: string;
@@ -186,6 +200,13 @@ class EngineClient {
     await this.sendCommand('transport.toggleMetronome');
   }
   
+  // Waveform peaks of an audio file for numPixels pixels from 'start' (times in seconds of the file).
+  // Request only the visible part of a clip: the engine's cost is per pixel, not per sample.
+  async getPeaks(path: string, start: number, secondsPerPixel: number, numPixels: number): Promise<ClipPeaks> {
+    const response = await this.sendCommand('clip.getPeaks', { path, start, secondsPerPixel, numPixels });
+    return (response.data as unknown as ClipPeaks | undefined) ?? { ready: false };
+  }
+  
   get isConnected(): boolean {
     return this.ws?.readyState === WebSocket.OPEN;
   }